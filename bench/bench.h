@@ -0,0 +1,61 @@
+// bench/bench.h
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <string>
+
+// Timing loop handed to every benchmark:
+//
+//     while (state.keepRunning()) { ...measured work... }
+//
+// The loop runs until the minimum time has passed, and work between
+// pauseTiming() and resumeTiming() is left out of the measurement.
+class BenchState {
+  public:
+    explicit BenchState(double min_seconds);
+
+    bool keepRunning();
+    void pauseTiming();
+    void resumeTiming();
+
+    // Work done by one iteration, used to report throughput
+    void setBytesProcessed(size_t bytes) { bytes_per_iteration = bytes; }
+    void setItemsProcessed(size_t items) { items_per_iteration = items; }
+
+    size_t iterations() const { return iteration_count; }
+    double seconds() const;
+    size_t bytesProcessed() const { return bytes_per_iteration; }
+    size_t itemsProcessed() const { return items_per_iteration; }
+
+  private:
+    using Clock = std::chrono::steady_clock;
+
+    double min_seconds;
+    bool started;
+    bool paused;
+    size_t iteration_count;
+    size_t bytes_per_iteration;
+    size_t items_per_iteration;
+    Clock::time_point start_time;
+    Clock::time_point pause_time;
+    Clock::duration paused_total;
+    Clock::duration elapsed;
+};
+
+using BenchFunction = std::function<void(BenchState&)>;
+
+// Adds a benchmark to the global registry; returns true so it can be used
+// to initialize a static
+bool registerBenchmark(const std::string& name, BenchFunction fn);
+
+// Text of doc/<name> repeated until it is `bytes` long, cut at a line break
+std::string scaledCorpus(const std::string& name, size_t bytes);
+// The same text written to a temporary file, made once per size and
+// removed when the program exits; returns its path
+std::string scaledCorpusFile(const std::string& name, size_t bytes);
+
+#endif // BENCH_H
@@ -0,0 +1,261 @@
+// bench/bench_buffer.cpp
+//
+// Buffer operations on HarryPotter-1.txt scaled to 1 MB, 100 MB and 1 GB:
+// loading and saving, single edits at the head, middle and tail of the
+// text, :s, chains of undo and redo, and finding the top line of a screen.
+// The seed has CRLF line endings, so every size is read whole and
+// converted on load, as the editor does with such files. One size can be
+// picked with a filter, such as `vixx_bench buffer/1MB/`.
+
+#include "backend/buffer.h"
+#include "bench.h"
+#include "common/thread_pool.h"
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+struct Scale {
+    const char* label;
+    size_t bytes;
+};
+
+const Scale kScales[] = {
+    {"1MB", size_t(1) << 20},
+    {"100MB", size_t(100) << 20},
+    {"1GB", size_t(1) << 30},
+};
+
+enum class Place { HEAD, MIDDLE, TAIL };
+
+struct PlaceCase {
+    const char* label;
+    Place place;
+};
+
+const PlaceCase kPlaces[] = {
+    {"head", Place::HEAD},
+    {"middle", Place::MIDDLE},
+    {"tail", Place::TAIL},
+};
+
+// Undo steps in one chain
+const int kChainLength = 1000;
+// Bottom lines looked up per iteration of the top-line benchmark
+const int kTopLineQueries = 1000;
+const int kScreenWidth = 80;
+const int kScreenLines = 50;
+
+std::string corpusPath(const Scale& scale) {
+    return scaledCorpusFile("HarryPotter-1.txt", scale.bytes);
+}
+
+// The corpus loaded and indexed, built once per size. Benchmarks that edit
+// it put the text back before they return.
+Buffer& corpusBuffer(const Scale& scale) {
+    static std::map<size_t, std::unique_ptr<Buffer>> buffers;
+    std::unique_ptr<Buffer>& buffer = buffers[scale.bytes];
+    if (!buffer) {
+        buffer.reset(new Buffer());
+        if (!buffer->loadFromFile(corpusPath(scale))) {
+            throw std::runtime_error("cannot load the corpus");
+        }
+        buffer->indexThrough(INT_MAX);
+    }
+    return *buffer;
+}
+
+// A line at `place`, and the middle of it
+int placeLine(const Buffer& buffer, Place place) {
+    switch (place) {
+    case Place::HEAD:
+        return 0;
+    case Place::MIDDLE:
+        return buffer.getLineCount() / 2;
+    case Place::TAIL:
+        break;
+    }
+    return buffer.getLineCount() - 1;
+}
+
+int placeColumn(const Buffer& buffer, int line) {
+    return buffer.getLineLength(line) / 2;
+}
+
+// ===--- Files ---===
+
+void benchLoad(BenchState& state, const Scale& scale, bool index) {
+    std::string path = corpusPath(scale);
+    while (state.keepRunning()) {
+        Buffer buffer;
+        buffer.loadFromFile(path);
+        if (index) {
+            buffer.indexThrough(INT_MAX);
+        }
+    }
+    state.setBytesProcessed(scale.bytes);
+}
+
+void benchSave(BenchState& state, const Scale& scale) {
+    std::string target = corpusPath(scale) + ".saved";
+    Buffer buffer;
+    buffer.loadFromFile(corpusPath(scale));
+    while (state.keepRunning()) {
+        buffer.saveToFile(target);
+    }
+    state.setBytesProcessed(scale.bytes);
+
+    // The file and the undofile written next to it
+    size_t slash = target.rfind('/') + 1;
+    std::string undofile =
+        target.substr(0, slash) + "." + target.substr(slash) + ".un~";
+    std::remove(target.c_str());
+    std::remove(undofile.c_str());
+}
+
+// ===--- Edits ---===
+
+// Each iteration makes an edit and then its inverse, so both are timed and
+// the text is the same after every iteration
+
+void benchChar(BenchState& state, const Scale& scale, Place place) {
+    Buffer& buffer = corpusBuffer(scale);
+    int line = placeLine(buffer, place);
+    int column = placeColumn(buffer, line);
+    while (state.keepRunning()) {
+        buffer.insertChar(line, column, 'x');
+        buffer.deleteChar(line, column);
+    }
+    state.setItemsProcessed(2);
+}
+
+void benchSplitMerge(BenchState& state, const Scale& scale, Place place) {
+    Buffer& buffer = corpusBuffer(scale);
+    int line = placeLine(buffer, place);
+    int column = placeColumn(buffer, line);
+    while (state.keepRunning()) {
+        buffer.splitLine(line, column);
+        buffer.mergeLines(line, column);
+    }
+    state.setItemsProcessed(2);
+}
+
+void benchDeleteLine(BenchState& state, const Scale& scale, Place place) {
+    Buffer& buffer = corpusBuffer(scale);
+    int line = placeLine(buffer, place);
+    std::string content = buffer.getLine(line);
+    while (state.keepRunning()) {
+        buffer.deleteLine(line);
+        buffer.insertLine(line, content);
+    }
+    state.setItemsProcessed(2);
+}
+
+void benchReplaceAll(BenchState& state, const Scale& scale) {
+    Buffer& buffer = corpusBuffer(scale);
+    while (state.keepRunning()) {
+        buffer.replaceAll("the", "THE");
+        state.pauseTiming();
+        buffer.closeUndoGroup();
+        buffer.undo();
+        state.resumeTiming();
+    }
+    state.setBytesProcessed(scale.bytes);
+    state.setItemsProcessed(static_cast<size_t>(buffer.getLineCount()));
+}
+
+// Types a character kChainLength times at `place`, each its own undo step,
+// then undoes and redoes all of them each iteration
+void benchUndoChain(BenchState& state, const Scale& scale, Place place) {
+    Buffer& buffer = corpusBuffer(scale);
+    int line = placeLine(buffer, place);
+    buffer.setCursorY(line);
+    buffer.setCursorX(placeColumn(buffer, line));
+    for (int i = 0; i < kChainLength; ++i) {
+        buffer.insertCharacter("x");
+        buffer.closeUndoGroup();
+    }
+    while (state.keepRunning()) {
+        for (int i = 0; i < kChainLength; ++i) {
+            buffer.undo();
+        }
+        for (int i = 0; i < kChainLength; ++i) {
+            buffer.redo();
+        }
+    }
+    for (int i = 0; i < kChainLength; ++i) {
+        buffer.undo();
+    }
+    state.setItemsProcessed(2 * kChainLength);
+}
+
+// ===--- Scrolling ---===
+
+// The top line for bottom lines spread over the whole text, once the row
+// index has been built
+void benchTopLine(BenchState& state, const Scale& scale) {
+    Buffer& buffer = corpusBuffer(scale);
+    uint32_t lines = static_cast<uint32_t>(buffer.getLineCount());
+    buffer.calculateTopLine(lines - 1, kScreenWidth, kScreenLines);
+    uint32_t seed = 2463534242u;
+    while (state.keepRunning()) {
+        for (int i = 0; i < kTopLineQueries; ++i) {
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+            buffer.calculateTopLine(static_cast<int>(seed % lines),
+                                    kScreenWidth, kScreenLines);
+        }
+    }
+    state.setItemsProcessed(kTopLineQueries);
+}
+
+bool registerBufferBenchmarks() {
+    for (const Scale& scale : kScales) {
+        std::string prefix = std::string("buffer/") + scale.label + "/";
+        registerBenchmark(prefix + "load", [&scale](BenchState& state) {
+            benchLoad(state, scale, false);
+        });
+        registerBenchmark(prefix + "load_indexed", [&scale](BenchState& state) {
+            benchLoad(state, scale, true);
+        });
+        registerBenchmark(prefix + "save", [&scale](BenchState& state) {
+            benchSave(state, scale);
+        });
+        for (const PlaceCase& at : kPlaces) {
+            std::string suffix = std::string("/") + at.label;
+            registerBenchmark(prefix + "insert_delete_char" + suffix,
+                              [&scale, &at](BenchState& state) {
+                                  benchChar(state, scale, at.place);
+                              });
+            registerBenchmark(prefix + "split_merge_lines" + suffix,
+                              [&scale, &at](BenchState& state) {
+                                  benchSplitMerge(state, scale, at.place);
+                              });
+            registerBenchmark(prefix + "delete_insert_line" + suffix,
+                              [&scale, &at](BenchState& state) {
+                                  benchDeleteLine(state, scale, at.place);
+                              });
+            registerBenchmark(prefix + "undo_redo_chain" + suffix,
+                              [&scale, &at](BenchState& state) {
+                                  benchUndoChain(state, scale, at.place);
+                              });
+        }
+        registerBenchmark(prefix + "replace_all", [&scale](BenchState& state) {
+            benchReplaceAll(state, scale);
+        });
+        registerBenchmark(prefix + "top_line", [&scale](BenchState& state) {
+            benchTopLine(state, scale);
+        });
+    }
+    return true;
+}
+
+const bool registered = registerBufferBenchmarks();
+
+} // namespace
@@ -0,0 +1,92 @@
+// bench/bench_line_layout.cpp
+//
+// Laying out lines for display: the paragraphs of HarryPotter-1.txt, which
+// are printable ASCII and take the vector fast path, the same text with a
+// tab in front of every line, and a line of CJK with an ASCII word every
+// few characters, which needs a piece per character.
+
+#include "backend/line_layout.h"
+#include "bench.h"
+#include <string>
+#include <vector>
+
+namespace {
+
+const size_t kCorpusBytes = 4 << 20;
+const size_t kWidth = 74; // An 80-column terminal less the line numbers
+
+std::vector<std::string> corpusLines(bool indent) {
+    std::string text = scaledCorpus("HarryPotter-1.txt", kCorpusBytes);
+    std::vector<std::string> lines;
+    size_t begin = 0;
+    while (begin < text.size()) {
+        size_t end = text.find('\n', begin);
+        if (end == std::string::npos) {
+            end = text.size();
+        }
+        // The file is CRLF, which loading takes off
+        size_t stop = end > begin && text[end - 1] == '\r' ? end - 1 : end;
+        lines.push_back((indent ? "\t" : "") + text.substr(begin, stop - begin));
+        begin = end + 1;
+    }
+    return lines;
+}
+
+void benchLayout(BenchState& state, const std::vector<std::string>& lines) {
+    size_t bytes = 0;
+    size_t rows = 0;
+    for (const std::string& line : lines) {
+        bytes += line.size();
+    }
+    while (state.keepRunning()) {
+        rows = 0;
+        for (const std::string& line : lines) {
+            rows += LineLayout(line.data(), line.size()).rowCount(kWidth);
+        }
+    }
+    state.setBytesProcessed(bytes);
+    state.setItemsProcessed(rows);
+}
+
+void benchCountRows(BenchState& state, const std::vector<std::string>& lines) {
+    size_t bytes = 0;
+    size_t rows = 0;
+    for (const std::string& line : lines) {
+        bytes += line.size();
+    }
+    while (state.keepRunning()) {
+        rows = 0;
+        for (const std::string& line : lines) {
+            rows += LineLayout::countRows(line.data(), line.size(), kWidth);
+        }
+    }
+    state.setBytesProcessed(bytes);
+    state.setItemsProcessed(rows);
+}
+
+bool registerLineLayoutBenchmarks() {
+    static const std::vector<std::string> ascii = corpusLines(false);
+    static const std::vector<std::string> indented = corpusLines(true);
+    static const std::vector<std::string> cjk = [] {
+        std::string line;
+        while (line.size() < (64 << 10)) {
+            line += "\xe4\xb8\xad\xe6\x96\x87\xe5\xad\x97 text ";
+        }
+        return std::vector<std::string>(64, line);
+    }();
+    registerBenchmark("line_layout/build/ascii",
+                      [](BenchState& state) { benchLayout(state, ascii); });
+    registerBenchmark("line_layout/build/tab",
+                      [](BenchState& state) { benchLayout(state, indented); });
+    registerBenchmark("line_layout/build/cjk",
+                      [](BenchState& state) { benchLayout(state, cjk); });
+    registerBenchmark("line_layout/count_rows/ascii",
+                      [](BenchState& state) { benchCountRows(state, ascii); });
+    registerBenchmark("line_layout/count_rows/cjk",
+                      [](BenchState& state) { benchCountRows(state, cjk); });
+    return true;
+}
+
+const bool registered = registerLineLayoutBenchmarks();
+
+} // namespace
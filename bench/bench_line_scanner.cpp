@@ -0,0 +1,89 @@
+// bench/bench_line_scanner.cpp
+//
+// Newline indexing over the doc/ corpora scaled to 64 MB: every scanner
+// kernel, plus memchr and the std::getline loop the loader used to run.
+
+#include "backend/line_scanner.h"
+#include "bench.h"
+#include <cstring>
+#include <sstream>
+#include <vector>
+
+namespace {
+
+const size_t kCorpusBytes = 64 << 20;
+
+const char* const kCorpora[] = {"HarryPotter-1.txt", "A-paradoxical-ode.txt"};
+
+void benchKernel(BenchState& state, const std::string& corpus,
+                 ScanKernel kernel) {
+    const std::string text = scaledCorpus(corpus, kCorpusBytes);
+    std::vector<size_t> breaks;
+    while (state.keepRunning()) {
+        breaks.clear();
+        LineScanStats stats;
+        scanLines(kernel, text.data(), text.size(), 0, '\0', breaks, stats);
+    }
+    state.setBytesProcessed(text.size());
+    state.setItemsProcessed(breaks.size());
+}
+
+void benchMemchr(BenchState& state, const std::string& corpus) {
+    const std::string text = scaledCorpus(corpus, kCorpusBytes);
+    std::vector<size_t> breaks;
+    while (state.keepRunning()) {
+        breaks.clear();
+        const char* p = text.data();
+        const char* end = p + text.size();
+        while (const char* nl = static_cast<const char*>(
+                   std::memchr(p, '\n', static_cast<size_t>(end - p)))) {
+            breaks.push_back(static_cast<size_t>(nl - text.data()));
+            p = nl + 1;
+        }
+    }
+    state.setBytesProcessed(text.size());
+    state.setItemsProcessed(breaks.size());
+}
+
+void benchGetline(BenchState& state, const std::string& corpus) {
+    const std::string text = scaledCorpus(corpus, kCorpusBytes);
+    size_t count = 0;
+    while (state.keepRunning()) {
+        std::istringstream in(text);
+        std::string line;
+        count = 0;
+        while (std::getline(in, line)) {
+            ++count;
+        }
+    }
+    state.setBytesProcessed(text.size());
+    state.setItemsProcessed(count);
+}
+
+bool registerLineScannerBenchmarks() {
+    for (const char* corpus : kCorpora) {
+        std::string suffix = std::string("/") + corpus + "/64MB";
+        for (ScanKernel kernel :
+             {ScanKernel::SCALAR, ScanKernel::SSE2, ScanKernel::AVX2}) {
+            if (!scanKernelSupported(kernel)) {
+                continue;
+            }
+            registerBenchmark(
+                std::string("scan/") + scanKernelName(kernel) + suffix,
+                [corpus, kernel](BenchState& state) {
+                    benchKernel(state, corpus, kernel);
+                });
+        }
+        registerBenchmark("scan/memchr" + suffix, [corpus](BenchState& state) {
+            benchMemchr(state, corpus);
+        });
+        registerBenchmark("scan/getline" + suffix, [corpus](BenchState& state) {
+            benchGetline(state, corpus);
+        });
+    }
+    return true;
+}
+
+const bool registered = registerLineScannerBenchmarks();
+
+} // namespace
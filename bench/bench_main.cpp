@@ -0,0 +1,261 @@
+// bench/bench_main.cpp
+
+#include "bench.h"
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#ifndef VIXX_DOC_DIR
+#define VIXX_DOC_DIR "doc"
+#endif
+
+namespace {
+
+struct Registration {
+    std::string name;
+    BenchFunction fn;
+};
+
+std::vector<Registration>& registry() {
+    static std::vector<Registration> benchmarks;
+    return benchmarks;
+}
+
+} // namespace
+
+// ===--- BenchState ---===
+
+BenchState::BenchState(double min_seconds)
+    : min_seconds(min_seconds), started(false), paused(false),
+      iteration_count(0), bytes_per_iteration(0), items_per_iteration(0),
+      paused_total(0), elapsed(0) {}
+
+bool BenchState::keepRunning() {
+    Clock::time_point now = Clock::now();
+    if (!started) {
+        started = true;
+        start_time = now;
+        return true;
+    }
+    ++iteration_count;
+    elapsed = now - start_time - paused_total;
+    return std::chrono::duration<double>(elapsed).count() < min_seconds;
+}
+
+void BenchState::pauseTiming() {
+    if (!paused) {
+        paused = true;
+        pause_time = Clock::now();
+    }
+}
+
+void BenchState::resumeTiming() {
+    if (paused) {
+        paused = false;
+        paused_total += Clock::now() - pause_time;
+    }
+}
+
+double BenchState::seconds() const {
+    return std::chrono::duration<double>(elapsed).count();
+}
+
+// ===--- Registry and corpora ---===
+
+bool registerBenchmark(const std::string& name, BenchFunction fn) {
+    registry().push_back(Registration{name, std::move(fn)});
+    return true;
+}
+
+namespace {
+
+const std::string& corpusSeed(const std::string& name) {
+    static std::map<std::string, std::string> seeds;
+    auto it = seeds.find(name);
+    if (it == seeds.end()) {
+        std::ifstream file(std::string(VIXX_DOC_DIR) + "/" + name,
+                           std::ios::binary);
+        if (!file.is_open()) {
+            throw std::runtime_error("Cannot open corpus " + name);
+        }
+        std::stringstream ss;
+        ss << file.rdbuf();
+        it = seeds.emplace(name, ss.str()).first;
+    }
+    return it->second;
+}
+
+std::vector<std::string>& corpusFiles() {
+    static std::vector<std::string> paths;
+    return paths;
+}
+
+void removeCorpusFiles() {
+    for (const std::string& path : corpusFiles()) {
+        std::remove(path.c_str());
+    }
+}
+
+} // namespace
+
+std::string scaledCorpus(const std::string& name, size_t bytes) {
+    const std::string& seed = corpusSeed(name);
+    std::string out;
+    out.reserve(bytes + seed.size());
+    while (out.size() < bytes) {
+        out += seed;
+    }
+    size_t cut = out.rfind('\n', bytes);
+    out.resize(cut == std::string::npos ? bytes : cut + 1);
+    return out;
+}
+
+// Written a copy of the seed at a time, so a corpus larger than memory
+// never has to be held whole
+std::string scaledCorpusFile(const std::string& name, size_t bytes) {
+    static std::map<std::pair<std::string, size_t>, std::string> made;
+    auto it = made.find({name, bytes});
+    if (it != made.end()) {
+        return it->second;
+    }
+
+    const std::string& seed = corpusSeed(name);
+    char path[] = "/tmp/vixx_bench_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot create a temporary file");
+    }
+    if (corpusFiles().empty()) {
+        std::atexit(removeCorpusFiles);
+    }
+    corpusFiles().push_back(path);
+
+    // Whole copies, then the start of one more up to its last line break
+    // at or before `bytes`, as scaledCorpus() cuts it
+    size_t copies = bytes / seed.size();
+    size_t rest = seed.rfind('\n', bytes % seed.size());
+    rest = rest == std::string::npos ? 0 : rest + 1;
+    bool written = true;
+    for (size_t i = 0; i <= copies && written; ++i) {
+        size_t n = i < copies ? seed.size() : rest;
+        written = write(fd, seed.data(), n) == static_cast<ssize_t>(n);
+    }
+    close(fd);
+    if (!written) {
+        throw std::runtime_error("Cannot write corpus " + name);
+    }
+    made.emplace(std::make_pair(name, bytes), path);
+    return path;
+}
+
+// ===--- Driver ---===
+
+namespace {
+
+struct Result {
+    std::string name;
+    size_t iterations;
+    double ns_per_iter;
+    double bytes_per_second;
+    double items_per_second;
+};
+
+std::string jsonString(const std::string& s) {
+    std::string out = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+        }
+        out += c;
+    }
+    return out + "\"";
+}
+
+// Same field names as Google Benchmark's JSON, so the usual tools for
+// comparing two runs read it
+bool writeJson(const std::string& path, const std::vector<Result>& results,
+               double min_seconds) {
+    std::FILE* out = std::fopen(path.c_str(), "w");
+    if (!out) {
+        return false;
+    }
+    char date[32];
+    std::time_t now = std::time(nullptr);
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S",
+                  std::localtime(&now));
+    std::fprintf(out,
+                 "{\n  \"context\": {\n    \"date\": \"%s\",\n"
+                 "    \"num_cpus\": %u,\n    \"min_time\": %g\n  },\n"
+                 "  \"benchmarks\": [",
+                 date, std::thread::hardware_concurrency(), min_seconds);
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& r = results[i];
+        std::fprintf(out,
+                     "%s\n    {\n      \"name\": %s,\n"
+                     "      \"iterations\": %zu,\n"
+                     "      \"real_time\": %.1f,\n"
+                     "      \"time_unit\": \"ns\",\n"
+                     "      \"bytes_per_second\": %.1f,\n"
+                     "      \"items_per_second\": %.1f\n    }",
+                     i > 0 ? "," : "", jsonString(r.name).c_str(),
+                     r.iterations, r.ns_per_iter, r.bytes_per_second,
+                     r.items_per_second);
+    }
+    std::fprintf(out, "\n  ]\n}\n");
+    return std::fclose(out) == 0;
+}
+
+} // namespace
+
+// vixx_bench [--min-time=<seconds>] [--json=<file>] [filter]
+int main(int argc, char* argv[]) {
+    std::string filter;
+    std::string json_path;
+    double min_seconds = 0.5;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("--min-time=", 0) == 0) {
+            min_seconds = std::atof(arg.c_str() + 11);
+        } else if (arg.rfind("--json=", 0) == 0) {
+            json_path = arg.substr(7);
+        } else {
+            filter = arg;
+        }
+    }
+
+    std::vector<Result> results;
+    std::printf("%-48s %10s %14s %12s %14s\n", "benchmark", "iters",
+                "ns/iter", "MB/s", "items/s");
+    for (const Registration& bench : registry()) {
+        if (!filter.empty() && bench.name.find(filter) == std::string::npos) {
+            continue;
+        }
+        BenchState state(min_seconds);
+        bench.fn(state);
+
+        double per_iter = state.iterations() > 0
+                              ? state.seconds() / state.iterations()
+                              : 0.0;
+        double bytes = per_iter > 0 ? state.bytesProcessed() / per_iter : 0.0;
+        double items = per_iter > 0 ? state.itemsProcessed() / per_iter : 0.0;
+        std::printf("%-48s %10zu %14.0f %12.1f %14.0f\n", bench.name.c_str(),
+                    state.iterations(), per_iter * 1e9, bytes / 1e6, items);
+        std::fflush(stdout);
+        results.push_back(Result{bench.name, state.iterations(),
+                                 per_iter * 1e9, bytes, items});
+    }
+
+    if (!json_path.empty() && !writeJson(json_path, results, min_seconds)) {
+        std::fprintf(stderr, "Cannot write %s\n", json_path.c_str());
+        return 1;
+    }
+    return 0;
+}
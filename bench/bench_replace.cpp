@@ -0,0 +1,101 @@
+// bench/bench_replace.cpp
+//
+// :s/the/THE/g over HarryPotter-1.txt scaled to 64 MB (about 1.5M lines),
+// with the pool at every power-of-two thread count up to the machine's;
+// then regex patterns of growing cost, and one that never matches, on one
+// thread.
+
+#include "backend/buffer.h"
+#include "bench.h"
+#include "common/thread_pool.h"
+#include <memory>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+
+const size_t kCorpusBytes = 64 << 20;
+
+// The corpus as a loaded buffer, built once. Each iteration undoes its
+// change, untimed, so the next one starts from the same text.
+Buffer& corpusBuffer() {
+    static std::unique_ptr<Buffer> buffer;
+    if (!buffer) {
+        buffer.reset(new Buffer());
+        if (!buffer->loadFromFile(
+                scaledCorpusFile("HarryPotter-1.txt", kCorpusBytes),
+                LoadMode::EAGER)) {
+            throw std::runtime_error("cannot load the corpus");
+        }
+    }
+    return *buffer;
+}
+
+void benchReplace(BenchState& state, size_t threads) {
+    Buffer& work = corpusBuffer();
+    ThreadPool pool(threads - 1);
+    while (state.keepRunning()) {
+        work.replaceAll("the", "THE", pool);
+        state.pauseTiming();
+        work.closeUndoGroup();
+        work.undo();
+        state.resumeTiming();
+    }
+    state.setBytesProcessed(kCorpusBytes);
+    state.setItemsProcessed(static_cast<size_t>(work.getLineCount()));
+}
+
+struct RegexCase {
+    const char* label;
+    const char* pattern;
+    const char* replacement;
+};
+
+const RegexCase kRegexCases[] = {
+    {"literal", "the", "THE"},
+    {"word", "\\<the\\>", "THE"},
+    {"class", "[Dd]urs\\l\\+ey", "&"},
+    {"groups", "\\(Mr\\|Mrs\\)\\. \\(\\u\\l\\+\\)", "\\2, \\1."},
+    {"backref", "\\(\\<\\w\\+\\) \\1\\>", "\\1"},
+    {"absent", "qu\\+x\\d", "-"},
+};
+
+void benchRegex(BenchState& state, const RegexCase& regex_case) {
+    Buffer& work = corpusBuffer();
+    ThreadPool pool(0);
+    Regex pattern(regex_case.pattern);
+    ReplaceTemplate replacement(regex_case.replacement);
+    while (state.keepRunning()) {
+        SubstituteResult result =
+            work.substitute(pattern, replacement, true, pool);
+        state.pauseTiming();
+        work.closeUndoGroup();
+        if (result.substitutions > 0) {
+            work.undo();
+        }
+        state.resumeTiming();
+    }
+    state.setBytesProcessed(kCorpusBytes);
+    state.setItemsProcessed(static_cast<size_t>(work.getLineCount()));
+}
+
+bool registerReplaceBenchmarks() {
+    size_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+    for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+        registerBenchmark("replace/threads:" + std::to_string(threads),
+                          [threads](BenchState& state) {
+                              benchReplace(state, threads);
+                          });
+    }
+    for (const RegexCase& regex_case : kRegexCases) {
+        registerBenchmark(std::string("replace/regex/") + regex_case.label,
+                          [&regex_case](BenchState& state) {
+                              benchRegex(state, regex_case);
+                          });
+    }
+    return true;
+}
+
+const bool registered = registerReplaceBenchmarks();
+
+} // namespace
@@ -0,0 +1,76 @@
+// bench/bench_row_index.cpp
+//
+// Wrapped rows on HarryPotter-1.txt scaled to 64 MB, whose paragraphs are
+// long lines: reading every line after a resize, finding the top line for a
+// cursor on the last line as G does, and keeping the index current through
+// a one-line edit.
+
+#include "backend/piece_table.h"
+#include "backend/row_index.h"
+#include "bench.h"
+
+namespace {
+
+const size_t kCorpusBytes = 64 << 20;
+const size_t kWidth = 74; // An 80-column terminal less the line numbers
+
+const PieceTable& corpusTable() {
+    static PieceTable* table = nullptr;
+    if (!table) {
+        table = new PieceTable();
+        table->load(scaledCorpus("HarryPotter-1.txt", kCorpusBytes));
+    }
+    return *table;
+}
+
+void benchBuild(BenchState& state) {
+    const PieceTable& text = corpusTable();
+    RowIndex index;
+    size_t rows = 0;
+    while (state.keepRunning()) {
+        index.invalidate();
+        rows = index.rowsBetween(text, kWidth, 0, text.lineCount());
+    }
+    state.setBytesProcessed(kCorpusBytes);
+    state.setItemsProcessed(rows);
+}
+
+void benchTopLine(BenchState& state) {
+    const PieceTable& text = corpusTable();
+    RowIndex index;
+    size_t last = text.lineCount() - 1;
+    index.rowsBetween(text, kWidth, 0, last + 1);
+    while (state.keepRunning()) {
+        for (size_t rows = 1; rows <= 64; ++rows) {
+            index.firstLineFitting(text, kWidth, last, rows);
+        }
+    }
+    state.setItemsProcessed(64);
+}
+
+// Typing one character in a line near the middle: the edit and the index
+// update that follows it
+void benchEdit(BenchState& state) {
+    PieceTable text = corpusTable();
+    RowIndex index;
+    index.rowsBetween(text, kWidth, 0, text.lineCount());
+    size_t line = text.lineCount() / 2;
+    while (state.keepRunning()) {
+        text.insert(text.lineStart(line), "D", 1);
+        index.linesChanged(text, line, 1, 1);
+        text.erase(text.lineStart(line), 1);
+        index.linesChanged(text, line, 1, 1);
+    }
+    state.setItemsProcessed(2);
+}
+
+bool registerRowIndexBenchmarks() {
+    registerBenchmark("row_index/build", benchBuild);
+    registerBenchmark("row_index/top_line", benchTopLine);
+    registerBenchmark("row_index/edit", benchEdit);
+    return true;
+}
+
+const bool registered = registerRowIndexBenchmarks();
+
+} // namespace
@@ -0,0 +1,112 @@
+// bench/bench_search.cpp
+//
+// Counting every occurrence of a needle in HarryPotter-1.txt scaled to
+// 64 MB: each search kernel against std::string::find and memmem, for
+// needles from one byte up to a 50-byte phrase, plus one that never occurs.
+
+#include "backend/string_search.h"
+#include "bench.h"
+#include <cstring>
+
+namespace {
+
+const size_t kCorpusBytes = 64 << 20;
+
+const char* const kNeedles[] = {
+    "e",
+    "the",
+    "Dursley",
+    "good-for-nothing",
+    "Mr. and Mrs. Dursley, of number four, Privet Drive",
+    "Mr. and Mrs. Dursley, of number four, Privet Drive, were proud to say "
+    "that they were perfectly normal, thank you very mu",
+    "zqxjvk",
+};
+
+std::string needleLabel(const std::string& needle) {
+    return std::to_string(needle.size()) + "B" +
+           (needle == "zqxjvk" ? "-absent" : "");
+}
+
+const std::string& corpus() {
+    static const std::string text =
+        scaledCorpus("HarryPotter-1.txt", kCorpusBytes);
+    return text;
+}
+
+void benchKernel(BenchState& state, const std::string& needle,
+                 SearchKernel kernel) {
+    const std::string& text = corpus();
+    SubstringSearcher searcher(needle, kernel);
+    size_t count = 0;
+    while (state.keepRunning()) {
+        count = 0;
+        for (size_t pos = searcher.find(text); pos != SubstringSearcher::npos;
+             pos = searcher.find(text, pos + 1)) {
+            ++count;
+        }
+    }
+    state.setBytesProcessed(text.size());
+    state.setItemsProcessed(count);
+}
+
+void benchStdFind(BenchState& state, const std::string& needle) {
+    const std::string& text = corpus();
+    size_t count = 0;
+    while (state.keepRunning()) {
+        count = 0;
+        for (size_t pos = text.find(needle); pos != std::string::npos;
+             pos = text.find(needle, pos + 1)) {
+            ++count;
+        }
+    }
+    state.setBytesProcessed(text.size());
+    state.setItemsProcessed(count);
+}
+
+void benchMemmem(BenchState& state, const std::string& needle) {
+    const std::string& text = corpus();
+    size_t count = 0;
+    while (state.keepRunning()) {
+        count = 0;
+        const char* p = text.data();
+        const char* end = p + text.size();
+        while (const void* hit = memmem(p, static_cast<size_t>(end - p),
+                                        needle.data(), needle.size())) {
+            ++count;
+            p = static_cast<const char*>(hit) + 1;
+        }
+    }
+    state.setBytesProcessed(text.size());
+    state.setItemsProcessed(count);
+}
+
+bool registerSearchBenchmarks() {
+    for (const char* needle : kNeedles) {
+        std::string suffix = "/" + needleLabel(needle);
+        for (SearchKernel kernel : {SearchKernel::SCALAR, SearchKernel::SSE2,
+                                    SearchKernel::AVX2, SearchKernel::HORSPOOL}) {
+            if (!searchKernelSupported(kernel)) {
+                continue;
+            }
+            registerBenchmark(
+                std::string("search/") + searchKernelName(kernel) + suffix,
+                [needle, kernel](BenchState& state) {
+                    benchKernel(state, needle, kernel);
+                });
+        }
+        registerBenchmark("search/std::find" + suffix,
+                          [needle](BenchState& state) {
+                              benchStdFind(state, needle);
+                          });
+        registerBenchmark("search/memmem" + suffix,
+                          [needle](BenchState& state) {
+                              benchMemmem(state, needle);
+                          });
+    }
+    return true;
+}
+
+const bool registered = registerSearchBenchmarks();
+
+} // namespace
@@ -0,0 +1,100 @@
+// bench/bench_search_index.cpp
+//
+// The / and n machinery on HarryPotter-1.txt scaled to 64 MB: building the
+// match index on one thread and on the shared pool, stepping through every
+// match with n, keeping the index current through a one-line edit, and the
+// index-free search the preview does while a pattern is typed, for a
+// pattern that never matches and so reads the whole text.
+
+#include "backend/piece_table.h"
+#include "backend/search_index.h"
+#include "bench.h"
+#include "common/thread_pool.h"
+
+namespace {
+
+const size_t kCorpusBytes = 64 << 20;
+
+const PieceTable& corpusTable() {
+    static PieceTable* table = nullptr;
+    if (!table) {
+        table = new PieceTable();
+        table->load(scaledCorpus("HarryPotter-1.txt", kCorpusBytes));
+    }
+    return *table;
+}
+
+void benchBuild(BenchState& state, const char* pattern, ThreadPool& pool) {
+    const PieceTable& text = corpusTable();
+    Regex regex(pattern);
+    SearchIndex index;
+    while (state.keepRunning()) {
+        index.build(regex, text, pool);
+    }
+    state.setBytesProcessed(kCorpusBytes);
+    state.setItemsProcessed(index.matchCount());
+}
+
+void benchNext(BenchState& state) {
+    const PieceTable& text = corpusTable();
+    ThreadPool pool(0);
+    SearchIndex index;
+    index.build(Regex("Dursley"), text, pool);
+    while (state.keepRunning()) {
+        SearchHit hit;
+        for (size_t k = 0; k < index.matchCount(); ++k) {
+            index.next(hit.line, hit.column, true, hit);
+        }
+    }
+    state.setItemsProcessed(index.matchCount());
+}
+
+// Typing one character in a line near the middle: the edit and the index
+// update that follows it
+void benchEdit(BenchState& state) {
+    PieceTable text = corpusTable();
+    ThreadPool pool(0);
+    SearchIndex index;
+    index.build(Regex("Dursley"), text, pool);
+    size_t line = text.lineCount() / 2;
+    while (state.keepRunning()) {
+        text.insert(text.lineStart(line), "D", 1);
+        index.linesChanged(text, line, 1, 1);
+        text.erase(text.lineStart(line), 1);
+        index.linesChanged(text, line, 1, 1);
+    }
+    state.setItemsProcessed(2);
+}
+
+void benchFindAbsent(BenchState& state) {
+    const PieceTable& text = corpusTable();
+    Regex regex("qu\\+x\\d");
+    SearchHit hit;
+    while (state.keepRunning()) {
+        SearchIndex::find(regex, text, 0, 0, true, hit);
+    }
+    state.setBytesProcessed(kCorpusBytes);
+}
+
+bool registerSearchIndexBenchmarks() {
+    static ThreadPool serial(0);
+    for (const char* pattern : {"Dursley", "\\<the\\>"}) {
+        std::string label = pattern[0] == 'D' ? "literal" : "word";
+        registerBenchmark("search_index/build/" + label + "/threads:1",
+                          [pattern](BenchState& state) {
+                              benchBuild(state, pattern, serial);
+                          });
+        registerBenchmark("search_index/build/" + label + "/shared",
+                          [pattern](BenchState& state) {
+                              benchBuild(state, pattern, ThreadPool::shared());
+                          });
+    }
+    registerBenchmark("search_index/next", benchNext);
+    registerBenchmark("search_index/edit", benchEdit);
+    registerBenchmark("search_index/find/absent", benchFindAbsent);
+    return true;
+}
+
+const bool registered = registerSearchIndexBenchmarks();
+
+} // namespace
@@ -0,0 +1,111 @@
+// bench/bench_syntax.cpp
+//
+// Syntax highlighting on a 500k-line C++ file made by repeating a block of
+// typical code: lexing every line, as idle time does after a load, and the
+// work one keystroke near the middle costs when the viewport is redrawn.
+// Opening a block comment recolors everything after it, which is still
+// only lexed as far as the screen until idle time gets to the rest.
+
+#include "backend/piece_table.h"
+#include "backend/syntax.h"
+#include "bench.h"
+#include <cstdint>
+#include <string>
+
+namespace {
+
+const size_t kLines = 500000;
+const size_t kViewport = 50;
+
+const char kBlock[] =
+    "#include <vector>\n"
+    "\n"
+    "// Sums the values that pass a filter\n"
+    "template <typename T>\n"
+    "static size_t sumIf(const std::vector<T>& values, bool (*keep)(T)) {\n"
+    "    size_t total = 0;\n"
+    "    for (size_t i = 0; i < values.size(); ++i) {\n"
+    "        if (keep(values[i])) {\n"
+    "            total += static_cast<size_t>(values[i]) * 0x10 + 1.5e3;\n"
+    "        }\n"
+    "    }\n"
+    "    /* An empty list sums to zero,\n"
+    "       which is what total starts at */\n"
+    "    const char* name = \"sum \\\"if\\\"\";\n"
+    "    auto raw = R\"(not a \"string\" end)\";\n"
+    "    return total;\n"
+    "}\n";
+
+const PieceTable& corpusTable() {
+    static PieceTable* table = nullptr;
+    if (!table) {
+        size_t block_lines = 0;
+        for (const char* p = kBlock; *p; ++p) {
+            block_lines += *p == '\n';
+        }
+        std::string text;
+        for (size_t lines = 0; lines < kLines; lines += block_lines) {
+            text += kBlock;
+        }
+        table = new PieceTable();
+        table->load(std::move(text));
+    }
+    return *table;
+}
+
+void benchLex(BenchState& state) {
+    const PieceTable& text = corpusTable();
+    SyntaxHighlighter syntax;
+    syntax.setLanguage(SyntaxLanguage::CPP);
+    size_t first = SIZE_MAX;
+    size_t last = 0;
+    while (state.keepRunning()) {
+        syntax.clear();
+        syntax.idle(text, std::chrono::steady_clock::time_point::max(), first,
+                    last);
+    }
+    state.setBytesProcessed(text.size());
+    state.setItemsProcessed(text.lineCount());
+}
+
+// Types `keys` at the start of a line in the middle and draws the screen
+// around it after each key, then deletes them again the same way
+void benchKeystrokes(BenchState& state, const std::string& keys) {
+    PieceTable text = corpusTable();
+    SyntaxHighlighter syntax;
+    syntax.setLanguage(SyntaxLanguage::CPP);
+    size_t first = SIZE_MAX;
+    size_t last = 0;
+    syntax.idle(text, std::chrono::steady_clock::time_point::max(), first,
+                last);
+    size_t line = text.lineCount() / 2;
+    size_t top = line - kViewport / 2;
+    while (state.keepRunning()) {
+        for (size_t i = 0; i < keys.size(); ++i) {
+            text.insert(text.lineStart(line) + i, keys.data() + i, 1);
+            syntax.linesChanged(line, 1, 1);
+            syntax.prepare(text, top, top + kViewport, first, last);
+        }
+        for (size_t i = keys.size(); i > 0; --i) {
+            text.erase(text.lineStart(line) + i - 1, 1);
+            syntax.linesChanged(line, 1, 1);
+            syntax.prepare(text, top, top + kViewport, first, last);
+        }
+    }
+    state.setItemsProcessed(2 * keys.size());
+}
+
+bool registerSyntaxBenchmarks() {
+    registerBenchmark("syntax/lex", benchLex);
+    registerBenchmark("syntax/keystroke/word", [](BenchState& state) {
+        benchKeystrokes(state, "value ");
+    });
+    registerBenchmark("syntax/keystroke/open_comment", [](BenchState& state) {
+        benchKeystrokes(state, "/*");
+    });
+    return true;
+}
+
+const bool registered = registerSyntaxBenchmarks();
+
+} // namespace
@@ -0,0 +1,55 @@
+// bench/bench_thread_pool.cpp
+//
+// Overhead of the shared pool: background tasks that do nothing, submitted
+// from outside and waited for, and a parallel loop over small bodies.
+
+#include "bench.h"
+#include "common/thread_pool.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+namespace {
+
+const size_t kTasks = 10000;
+
+void benchSubmit(BenchState& state) {
+    ThreadPool& pool = ThreadPool::shared();
+    std::mutex mutex;
+    std::condition_variable all_done;
+    while (state.keepRunning()) {
+        std::atomic<size_t> left(kTasks);
+        for (size_t i = 0; i < kTasks; ++i) {
+            pool.submit([&] {
+                if (--left == 0) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    all_done.notify_one();
+                }
+            });
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        all_done.wait(lock, [&] { return left == 0; });
+    }
+    state.setItemsProcessed(kTasks);
+}
+
+void benchParallelFor(BenchState& state) {
+    ThreadPool& pool = ThreadPool::shared();
+    std::atomic<size_t> sum(0);
+    while (state.keepRunning()) {
+        pool.parallelFor(kTasks, [&](size_t i) {
+            sum.fetch_add(i, std::memory_order_relaxed);
+        });
+    }
+    state.setItemsProcessed(kTasks);
+}
+
+bool registerThreadPoolBenchmarks() {
+    registerBenchmark("thread_pool/submit", benchSubmit);
+    registerBenchmark("thread_pool/parallel_for", benchParallelFor);
+    return true;
+}
+
+const bool registered = registerThreadPoolBenchmarks();
+
+} // namespace
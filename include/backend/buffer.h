@@ -1,32 +1,106 @@
 #ifndef BUFFER_H
 #define BUFFER_H
 
+#include "backend/line_layout.h"
+#include "backend/piece_table.h"
+#include "backend/regex.h"
+#include "backend/row_index.h"
+#include "backend/search_index.h"
+#include "backend/syntax.h"
+#include "backend/undo_file.h"
+#include "backend/undo_tree.h"
+#include "common/thread_pool.h"
 #include "common/types.h"
+#include <chrono>
+#include <climits>
+#include <functional>
+#include <map>
+#include <memory>
 #include <string>
 #include <vector>
-#include <stack>
 
+// Lines changed since the buffer was last drawn, in current line numbers
+struct Damage {
+    int first_line = INT_MAX;
+    int last_line = -1;
+    bool shifted = false; // Lines were added or removed after first_line
+
+    bool empty() const { return first_line == INT_MAX; }
+    bool touches(int line) const {
+        return line >= first_line && (shifted || line <= last_line);
+    }
+};
+
+// What a :s changed
+struct SubstituteResult {
+    size_t substitutions = 0;
+    size_t lines = 0;
+};
+
+// A view of a file: a cursor and scroll position over a document that other
+// views of the same file may share.
 class Buffer {
 
   private:
-    std::vector<std::string> lines;
+    // The text and everything kept about it. Views opened on the same file
+    // share one, so an edit made in one shows in all of them and undoes
+    // from any.
+    struct Document {
+        PieceTable text;
+        UndoTree history;
+        UndoFile undo_file;
+        SearchIndex search;
+        // Built by the first scroll or frame that needs it
+        mutable RowIndex rows;
+        mutable LayoutCache layouts;
+        SyntaxHighlighter syntax;
+
+        std::string filename;
+        LineEnding line_ending = LineEnding::LF;
+        // Whether the file ended with a line terminator
+        bool final_newline = true;
+
+        // Lines marked with m, by name; they move with the lines around
+        // them, and go away with their line
+        std::map<char, int> marks;
+
+        Damage damage;
+    };
+
+    std::shared_ptr<Document> doc;
     // Put these new members inside the Buffer:
     int cursor_x;
     int cursor_y;
     int top_line;
-
-    std::stack<Action> undo_stack;
-    std::stack<Action> redo_stack;
-
-    std::string filename;
+    // A read-only view gets a copy of the document once edited through
+    bool read_only;
 
   public:
     // Constructor
     Buffer();
+    // The editor holds each view in a std::unique_ptr; a second view of a
+    // file comes from newView(), never from copying
+    Buffer(const Buffer&) = delete;
+    Buffer& operator=(const Buffer&) = delete;
+    Buffer(Buffer&&) = default;
+    Buffer& operator=(Buffer&&) = default;
+
+    // Another view of this document, with a cursor of its own. A read-only
+    // one keeps sharing until an edit is made through it, which copies the
+    // document first.
+    std::unique_ptr<Buffer> newView(bool read_only_view) const;
+    bool isReadOnly() const { return read_only; }
+    void setReadOnly(bool value) { read_only = value; }
+    bool sharesDocumentWith(const Buffer& other) const {
+        return doc == other.doc;
+    }
 
     // File operations
-    bool loadFromFile(const std::string& filename);
+    bool loadFromFile(const std::string& filename,
+                      LoadMode load_mode = LoadMode::AUTO);
     bool saveToFile(const std::string& fname);
+    // Lines [first, last] to another file, leaving the buffer's name alone
+    bool writeLines(int first, int last, const std::string& fname) const;
 
     // Basic line/char manipulation
     void addLine(const std::string& line);
@@ -38,12 +112,72 @@ class Buffer {
     void mergeLines(int line, int pos);
     void replaceOneLine(int line, const std::string& old_str, const std::string& new_str);
     void replaceAll(const std::string& old_str, const std::string& new_str);
+    void replaceAll(const std::string& old_str, const std::string& new_str,
+                    ThreadPool& pool);
+    // :s over lines [first, last], every line by default: matches of
+    // `pattern`, only the first on each line unless `global`, become
+    // `replacement`, as one undo step
+    SubstituteResult substitute(const Regex& pattern,
+                                const ReplaceTemplate& replacement, bool global,
+                                int first = 0, int last = INT_MAX);
+    SubstituteResult substitute(const Regex& pattern,
+                                const ReplaceTemplate& replacement, bool global,
+                                ThreadPool& pool, int first = 0,
+                                int last = INT_MAX);
+    // :g/.../s: the same on `lines` alone, ascending
+    SubstituteResult substituteLines(const Regex& pattern,
+                                     const ReplaceTemplate& replacement,
+                                     bool global,
+                                     const std::vector<int>& lines);
+
+    // Search. The buffer keeps an index of the matches of one pattern up
+    // to date as the text changes; n and N read it.
+    void setSearchPattern(const Regex& pattern);
+    const std::string& getSearchPattern() const { return doc->search.source(); }
+    size_t getMatchCount() const { return doc->search.matchCount(); }
+    // The indexed match after (line, column), or before it if not `forward`
+    bool nextMatch(int line, int column, bool forward, SearchHit& hit) const;
+    // The same for any pattern, reading the text until a match turns up
+    bool findMatch(const Regex& pattern, int line, int column, bool forward,
+                   SearchHit& hit) const;
+    // :g and :v: the lines in [first, last] with a match, or without one if
+    // `invert`, ascending. Large ranges are searched on the shared pool.
+    std::vector<int> matchingLines(const Regex& pattern, int first, int last,
+                                   bool invert);
 
     // Accessors
-    const std::string& getLine(int index) const;
-    std::string& getLine(int index);
+    std::string getLine(int index) const;
+    int getLineLength(int index) const;
+    // Where the characters of a line are on screen; good until the next
+    // call
+    const LineLayout& getLayout(int index) const;
     int getLineCount() const;
-    const std::vector<std::string>& getLines() const;
+    LineView getLines() const;
+
+    // Syntax highlighting, for the languages detectSyntaxLanguage() knows.
+    // Gets lines [first, last) ready to draw, damaging the ones whose
+    // colors changed since they were drawn.
+    void prepareHighlight(int first, int last);
+    // Whether lexing is left to do, and a slice of it until `deadline`;
+    // returns whether lines [first, last) were damaged
+    bool hasHighlightWork() const { return doc->syntax.pending(doc->text); }
+    bool highlightIdle(std::chrono::steady_clock::time_point deadline,
+                       int first, int last);
+    // The colored stretches of a line whose text is `content`
+    void highlightLine(int index, const std::string& content,
+                       std::vector<SyntaxToken>& tokens) const;
+
+    // Lazily loaded files: make lines up to `line` available, and tell
+    // whether getLineCount() is final yet
+    void indexThrough(int line);
+    bool isFullyIndexed() const;
+    // Indexes the rest of the file on the shared pool and calls `done`
+    // from there when it is finished
+    void indexInBackground(std::function<void()> done) const;
+
+    // Damage tracking for incremental rendering
+    const Damage& getDamage() const { return doc->damage; }
+    void clearDamage() { doc->damage = Damage(); }
 
     // New getters/setters
     int getCursorX() const { return cursor_x; }
@@ -63,29 +197,98 @@ class Buffer {
     void goToFirstLine();
     void goToLastLine();
     void jumpToLine(int target_line);
-    void deleteCurrentLine();
-    // void copyCurrentLine();
-    void pasteContent(std::string& copied_line, int t);
+    // The line `count` paragraphs from `line`: past any empty lines, then
+    // to the next empty one, or the first or last line if none is left
+    int paragraphBoundary(int line, int count, bool forward) const;
+
+    // Operators. The text of lines [first, last], each with its '\n', or
+    // of bytes [from, to) of a line, shared with the document rather than
+    // copied; and the same ranges deleted as one edit and one undo step.
+    SharedText copyLines(int first, int last) const;
+    SharedText copyText(int line, int from, int to) const;
+    void deleteLines(int first, int last);
+    void deleteText(int line, int from, int to);
+    // :g/.../d: `lines`, ascending, deleted as one undo step
+    void deleteLineSet(const std::vector<int>& lines);
+    // Puts text in `t` times over, as one edit and one undo step: lines
+    // below the cursor line, or above it if `before`, and characters after
+    // the cursor, or before it. The pieces are the text's own, or one copy
+    // for a large count. Returns false, changing nothing, if the result
+    // would be over 256 MiB.
+    bool put(const SharedText& text, bool linewise, int t, bool before);
+    // :m and :t: lines [first, last] moved or copied to below line `dest`
+    // (-1 for above the first), as one edit and one undo step, leaving the
+    // cursor on the last of them. Moving them into themselves does nothing.
+    void moveLines(int first, int last, int dest);
+    void duplicateLines(int first, int last, int dest);
+
+    // Marks a-z: the line set, or -1
+    void setMark(char name, int line) { doc->marks[name] = line; }
+    int getMark(char name) const;
 
     // Insert Mode Operations
-    void insertCharacter(char c);
+    // Inserts one character, given as its UTF-8 bytes
+    void insertCharacter(const std::string& c);
     void handleBackspace();
     void handleEnter();
+    // Inserts text of any length at the cursor as one edit and one undo
+    // step, leaving the cursor after it
+    void insertText(const std::string& text);
 
     // Replace Mode Operations
 
     // Undo/Redo Operations
     void undo();
     void redo();
+    // :earlier/:later: move `count` changes, or `count` seconds, back
+    // (negative) or forward through the undo tree
+    void timeTravel(long count, bool seconds);
+    // Ends the current undo step; the next edit starts a new one
+    void closeUndoGroup() { doc->history.closeGroup(); }
+    void setUndoLimit(size_t bytes) { doc->history.setLimit(bytes); }
+    size_t getUndoMemory() const { return doc->history.memoryUsage(); }
+    size_t getUndoSteps() const { return doc->history.undoSteps(); }
+    // Sequence number of the current state in the undo tree, 0 for none
+    size_t getChangeNumber() const { return doc->history.currentSeq(); }
 
-    void setFilename(const std::string& fname) { filename = fname; }
-    const std::string& getFilename() const { return filename; }
+    void setFilename(const std::string& fname);
+    const std::string& getFilename() const { return doc->filename; }
+    LineEnding getLineEnding() const { return doc->line_ending; }
 
-    // Scrolling logic can also be put here if you wish:
-    int calculateTopLine(int bottomLine, int COLS, int screen_lines);
+    // Screen rows lines [first, last) take when wrapped at `width` columns
+    int getRowsBetween(int first, int last, int width) const;
+    // The top line that shows as many lines as fit in `screen_lines` rows
+    // down to bottomLine, and bottomLine itself if it is taller than that
+    int calculateTopLine(int bottomLine, int width, int screen_lines) const;
 
     // Additional convenience
     void ensureCursorWithinBounds();
+
+  private:
+    // Gives a read-only view a document of its own before it is edited
+    void detach();
+    bool loadMapped(const std::string& fname);
+    bool loadEager(const std::string& fname);
+    size_t offsetOf(int line, int pos) const;
+    void edit(size_t offset, size_t length, const char* s, size_t n);
+    void editPieces(size_t offset, size_t length, const PieceList& pieces);
+    void splice(size_t offset, size_t length, const PieceList& pieces);
+    void moveCursorToOffset(size_t offset);
+    // Without closing the undo group, unlike deleteLines and put
+    void eraseLines(int first, int last);
+    void insertLines(int line, SharedText text);
+    bool writeText(const std::string& path, size_t from, size_t to,
+                   bool final_newline, ContentHash& hash) const;
+    void applyUndoGroup(const UndoGroup& group, bool forward);
+    SubstituteResult substituteRange(const Regex& pattern,
+                                     const ReplaceTemplate& replacement,
+                                     bool global, ThreadPool& pool,
+                                     int first_line, int last_line,
+                                     const std::vector<int>* only);
+    void markLinesChanged(int line, int removed, int inserted);
+    void markAllChanged();
+    bool damageLines(size_t first, size_t last, int visible_first,
+                     int visible_last);
 };
 
 #endif // BUFFER_H
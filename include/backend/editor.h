@@ -4,7 +4,14 @@
 #define EDITOR_H
 
 #include "backend/buffer.h"
+#include "backend/ex_range.h"
+#include "backend/registers.h"
+#include "common/completion_queue.h"
+#include "common/idle_scheduler.h"
 #include "common/types.h"
+#include <chrono>
+#include <functional>
+#include <memory>
 #include <ncurses.h>
 #include <string>
 #include <vector>
@@ -14,14 +21,30 @@ class InputHandler; // Forward declaration
 
 class Editor {
   public:
-    Editor();
+    // Draws with `renderer`, or on the terminal if it is null
+    explicit Editor(std::unique_ptr<Renderer> renderer = nullptr);
     ~Editor();
 
     void initialize();
     void shutdown();
     void adjustScrolling();
 
+    // Marks the screen as out of date; the event loop draws it once per
+    // batch of input through flushRender()
     void refresh_render();
+    void flushRender();
+
+    // Work off the input path. runInBackground() runs `work` on the shared
+    // thread pool and then `done` on the UI thread, when the event loop
+    // calls drainCompletions() between keys. Idle tasks, such as lexing
+    // the lines not on screen, run a slice at a time while no key is
+    // waiting.
+    void runInBackground(std::function<void()> work, std::function<void()> done);
+    void drainCompletions();
+    bool hasBackgroundWork() const { return background_jobs > 0; }
+    void postIdleTask(IdleScheduler::Task task);
+    bool hasIdleWork() const;
+    void runIdleWork(IdleScheduler::Clock::time_point deadline);
     void clear_message();
 
     // Mode Management
@@ -29,7 +52,9 @@ class Editor {
     void switchMode(Mode new_mode);
 
     // Multi-file management
-    void openFile(const std::string &fname);   // :e <fname>
+    // :e <fname>, and :view <fname> read-only. A file already open gets
+    // a new view sharing its text and undo history.
+    void openFile(const std::string &fname, bool read_only = false);
     void switchBuffer(int index);              // :buffer <n>
     void closeBuffer(int index);               // :wq
     void listBuffers();                        // :ls
@@ -52,18 +77,44 @@ class Editor {
     void goToFirstLine();
     void goToLastLine();
     void jumpToLine(int target_line);
-    void deleteCurrentLine();
-    void copyCurrentLine();
-    void pasteContent(int t);
+    void moveParagraph(int count, bool forward); // } and {
+    void setMark(char name);                     // m, on the cursor line
+
+    // Operators: `op` ('d' or 'y') over the text from the cursor to where
+    // `motion` goes `count` times, as one edit and one undo step, stored in
+    // register `reg_name` (0 for none). Only FIRST_LINE and LAST_LINE tell
+    // a count of 1 from none.
+    void applyOperator(char reg_name, char op, Motion motion, int count,
+                       bool has_count);
+    // p and P: a register put after or `before` the cursor `t` times
+    void pasteContent(char reg_name, int t, bool before);
 
     // Insert Mode Operations
-    void insertCharacter(char c);
+    // One character, as its UTF-8 bytes
+    void insertCharacter(const std::string& c);
     void handleBackspace();
     void handleEnter();
+    // A bracketed paste, inserted at the cursor in one piece
+    void pasteText(const std::string& text);
 
     // Command Execution
+    void setCommandLine(const std::string& command);
     void executeCommand(const std::string& command);
     void executeOpenFileCommand(const std::string& fname);
+    // :s/pat/rep/ over `range`, or every line if it has no addresses, or
+    // over `lines` alone if given
+    void executeSubstituteCommand(const std::string& command,
+                                  const LineRange& range = LineRange(),
+                                  const std::vector<int>* lines = nullptr);
+
+    // Search. The match is previewed and highlighted as the pattern is
+    // typed, once per batch of input.
+    void beginSearch(bool forward);                 // / and ?
+    void updateSearch(const std::string& pattern);  // Typed so far
+    void executeSearch(const std::string& pattern); // <Enter>
+    void cancelSearch();                            // <Esc>
+    void searchNext(int count, bool reverse);       // n and N
+    void clearHighlight();                          // :noh
 
     // Undo/Redo Operations
     void undo();
@@ -75,8 +126,15 @@ class Editor {
     // Renderer Access
     Renderer& getRenderer();
 
+    // Called after shutdown() when the last buffer is closed, before the
+    // process exits
+    void setQuitHandler(std::function<void()> handler);
+
   private:
-    std::vector<Buffer> buffers;
+    // Each buffer stays where it was allocated, so opening or closing one
+    // does not move the others. tab_names[i] is buffers[i]'s file name.
+    std::vector<std::unique_ptr<Buffer>> buffers;
+    std::vector<std::string> tab_names;
     int current_buffer_index;
     
     Mode mode;
@@ -85,13 +143,50 @@ class Editor {
     int window_height;         // Current window height
 
     std::string number_buffer; // To record digitally-guided commands
-    std::string copied_line;
+    Registers registers;
     std::string message;
-
-    Renderer* renderer; // Pointer to Renderer instance
-    // InputHandler can be managed separately
-
-    
+    std::string command_line;  // What is typed after ':' in command mode
+    size_t undo_limit;         // Undo history cap per buffer, in bytes
+    bool render_pending;
+
+    // The last pattern searched for and its direction; what is highlighted,
+    // which while typing is the pattern so far
+    std::shared_ptr<const Regex> search_regex;
+    bool search_forward;
+    std::shared_ptr<const Regex> highlight;
+    // The search being typed, and where the cursor was when it began
+    std::string search_typed;
+    bool search_typed_forward;
+    bool search_preview_pending;
+    int search_origin_x;
+    int search_origin_y;
+    int search_origin_top;
+
+    IdleScheduler idle_tasks;
+    CompletionQueue completions;
+    size_t background_jobs;   // Started and not yet drained
+    bool highlight_scheduled; // An idle task is lexing the current buffer
+
+    // Counts a job as started; the function returned is called, on any
+    // thread, when it finishes and queues `done` for the UI thread
+    std::function<void()> startBackgroundJob(std::function<void()> done);
+    void scheduleHighlight();
+
+    void applyCharOperator(char reg_name, char op, Motion motion, int count);
+    void operateOnLines(char reg_name, char op, int first, int last);
+    // :d, :y, :m, :t and :w with a range; false for any other command
+    bool executeRangeCommand(const LineRange& range, const std::string& command);
+    // :g/pattern/command, or :v if `invert`, with `command` after the name
+    void executeGlobalCommand(const LineRange& range,
+                              const std::string& command, bool invert);
+
+    void previewSearch();
+    void restoreSearchOrigin();
+    void jumpToMatch(bool forward, int count);
+
+    std::unique_ptr<Renderer> renderer;
+    std::function<void()> quit_handler;
+    void quit();
 };
 
 #endif // EDITOR_H
@@ -0,0 +1,33 @@
+// include/backend/ex_range.h
+
+#ifndef EX_RANGE_H
+#define EX_RANGE_H
+
+#include <cstddef>
+#include <string>
+
+class Buffer; // Forward declaration
+
+// The lines an ex command works on, 0-based and inclusive. `count` is how
+// many addresses were typed; with none the command picks its own lines.
+struct LineRange {
+    int first = 0;
+    int last = 0;
+    int count = 0;
+};
+
+// Parses the range at `pos` in `command` and leaves `pos` after it. An
+// address is ., $, a line number or 'x for mark x, followed by any number
+// of +N and -N (N is 1 if left out); offsets alone count from the cursor
+// line. Two addresses are separated by , or by ;, after which the second
+// counts from the first. % is 1,$. A backwards range is turned around.
+// Returns false with `error` set for a line past the end or a mark not set.
+bool parseRange(const std::string& command, size_t& pos, Buffer& buffer,
+                LineRange& range, std::string& error);
+
+// One address, as where :m and :t put their lines: they go below `line`,
+// which is -1 for line 0, above the first
+bool parseAddress(const std::string& command, size_t& pos, Buffer& buffer,
+                  int& line, std::string& error);
+
+#endif // EX_RANGE_H
@@ -0,0 +1,103 @@
+// include/backend/line_layout.h
+
+#ifndef LINE_LAYOUT_H
+#define LINE_LAYOUT_H
+
+#include "backend/piece_table.h"
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+// Bytes in the UTF-8 sequence a lead byte starts, 0 for a byte that cannot
+// start one
+size_t utf8SequenceLength(unsigned char lead);
+
+// How a line looks on screen. The cursor and the text stay in byte offsets;
+// this maps them to display columns, one character at a time, where a
+// character is a code point with the combining marks that follow it.
+//
+//   - Printable ASCII takes one column a byte.
+//   - East Asian wide characters and emoji take two.
+//   - A tab runs to the next multiple of kTabStop.
+//   - Control characters are shown as ^X, C1 controls and bytes that are
+//     not UTF-8 as <xx>.
+//
+// A line of printable ASCII, found by a vector scan, keeps nothing but its
+// length. Other lines keep a sorted list of pieces, each one character or
+// a run of printable ASCII, with the byte and column it starts at, so
+// lookups are binary searches. Wrapped rows break between characters, and
+// a character that does not fit at the end of a row starts the next one.
+class LineLayout {
+  public:
+    static const size_t kTabStop = 8;
+
+    LineLayout();
+    LineLayout(const char* line, size_t length);
+
+    size_t length() const { return bytes; }
+    size_t columns() const { return total_columns; }
+    // Printable ASCII only, every byte one column
+    bool simple() const { return pieces.empty(); }
+
+    // Offsets of characters, clamped to [0, length]
+    size_t charStart(size_t offset) const;
+    size_t nextChar(size_t offset) const;
+    size_t prevChar(size_t offset) const;
+
+    // Column the character at `offset` starts at, columns() at the end
+    size_t columnOf(size_t offset) const;
+    // The character covering `column`, length() past the end
+    size_t offsetAtColumn(size_t column) const;
+
+    // Rows the line takes wrapped at `width` columns, at least one
+    size_t rowCount(size_t width) const;
+    // First byte of a row, length() past the last one
+    size_t rowStart(size_t row, size_t width) const;
+    // Row and column on screen of the character at `offset`. The end of a
+    // line whose last row is full is at the start of the row after it.
+    void position(size_t offset, size_t width, size_t& row,
+                  size_t& column) const;
+
+    // Appends the characters in [begin, end) of `line` as they are shown
+    void display(const char* line, size_t begin, size_t end,
+                 std::string& out) const;
+
+    // rowCount() without keeping a layout
+    static size_t countRows(const char* line, size_t length, size_t width);
+
+  private:
+    struct Piece {
+        size_t byte;
+        size_t column;
+        bool ascii; // A run of printable ASCII rather than one character
+    };
+
+    size_t bytes;
+    size_t total_columns;
+    // Empty for printable ASCII; otherwise ends with a piece at length()
+    std::vector<Piece> pieces;
+    // Row starts for the last width asked for
+    mutable size_t wrap_width;
+    mutable std::vector<size_t> row_starts;
+
+    size_t pieceAt(size_t offset) const;
+    void wrap(size_t width) const;
+};
+
+// Layouts of the lines last looked at, by line number. An edit drops the
+// layouts of the lines it touched and renumbers the ones after them, so
+// the rest stay cached.
+class LayoutCache {
+  public:
+    // The reference is good until the next call
+    const LineLayout& get(const PieceTable& text, size_t line);
+    // Lines [line, line + removed) were replaced by `inserted` lines
+    void linesChanged(size_t line, size_t removed, size_t inserted);
+    void clear() { layouts.clear(); }
+
+  private:
+    std::map<size_t, LineLayout> layouts;
+};
+
+#endif // LINE_LAYOUT_H
@@ -0,0 +1,35 @@
+// include/backend/line_scanner.h
+
+#ifndef LINE_SCANNER_H
+#define LINE_SCANNER_H
+
+#include "common/types.h"
+#include <cstddef>
+#include <vector>
+
+// Newline statistics gathered while scanning
+struct LineScanStats {
+    size_t newlines = 0; // Every '\n'
+    size_t crlf = 0;     // '\n' preceded by '\r'
+};
+
+// Implementations of the scanner. bestScanKernel() picks the widest one the
+// CPU supports at runtime.
+enum class ScanKernel { SCALAR, SSE2, AVX2 };
+
+ScanKernel bestScanKernel();
+bool scanKernelSupported(ScanKernel kernel);
+const char* scanKernelName(ScanKernel kernel);
+
+// Appends base + offset of every '\n' in [data, data + n) to breaks, in one
+// pass. prev is the byte just before data ('\0' at the start of a file), so
+// a CRLF split across two calls is still counted.
+void scanLines(const char* data, size_t n, size_t base, char prev,
+               std::vector<size_t>& breaks, LineScanStats& stats);
+void scanLines(ScanKernel kernel, const char* data, size_t n, size_t base,
+               char prev, std::vector<size_t>& breaks, LineScanStats& stats);
+
+// LF if no newline has a '\r', CRLF if all of them do, MIXED otherwise
+LineEnding detectLineEnding(const LineScanStats& stats);
+
+#endif // LINE_SCANNER_H
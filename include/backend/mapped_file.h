@@ -0,0 +1,32 @@
+// include/backend/mapped_file.h
+
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+// Read-only memory mapping of a whole file. The mapping stays valid after
+// the file is replaced on disk (saves go through a rename), so pieces can
+// keep pointing into it.
+class MappedFile {
+  public:
+    // Returns nullptr if the file cannot be opened or mapped
+    static std::shared_ptr<MappedFile> open(const std::string& path);
+
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const { return addr; }
+    size_t size() const { return length; }
+
+  private:
+    MappedFile(const char* addr, size_t length);
+
+    const char* addr;
+    size_t length;
+};
+
+#endif // MAPPED_FILE_H
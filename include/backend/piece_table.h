@@ -0,0 +1,317 @@
+// include/backend/piece_table.h
+
+#ifndef PIECE_TABLE_H
+#define PIECE_TABLE_H
+
+#include "backend/mapped_file.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class ThreadPool; // Forward declaration
+
+// A block of text referenced by pieces. The original file is one source and
+// typed text goes to append-only chunks. Bytes are never modified once
+// written, and a chunk never reallocates, so a piece stays valid for as long
+// as its source is alive.
+//
+// A memory-mapped source starts without a newline index. Lines are indexed
+// on demand by the UI thread and in full by tasks on a thread pool; until
+// the index is complete every index access takes index_mutex.
+class TextSource : public std::enable_shared_from_this<TextSource> {
+  public:
+    // Read-only, fully populated, with the offsets of its newlines
+    TextSource(std::string text, std::vector<size_t> breaks);
+    explicit TextSource(size_t capacity);  // Empty append-only chunk
+    explicit TextSource(std::shared_ptr<MappedFile> file); // Lazily indexed
+
+    const char* data() const { return base; }
+    size_t size() const { return length; }
+    size_t capacity() const { return cap; }
+
+    // Appends text if it fits, returns the offset it was written at
+    size_t append(const char* text, size_t n);
+
+    // Number of '\n' in [start, end) indexed so far
+    size_t countBreaks(size_t start, size_t end) const;
+    // Offset of the k-th (0-based) '\n' at or after start
+    size_t nthBreak(size_t start, size_t k) const;
+
+    // Lazy indexing
+    bool indexed() const { return index_complete.load(std::memory_order_acquire); }
+    // Scans until at least `count` newlines are known or the end is reached
+    void indexBreaks(size_t count);
+    // Scans until every newline before `offset` is known
+    void indexTo(size_t offset);
+    void indexAll();
+    // Indexes the rest on `pool`, a chunk per task so other tasks get a
+    // turn, then calls `done` there. Stops early, still calling `done`, if
+    // the source goes away.
+    void indexInBackground(ThreadPool& pool, std::function<void()> done);
+
+  private:
+    std::string owned;
+    std::unique_ptr<char[]> storage;
+    std::shared_ptr<MappedFile> mapping;
+    const char* base;
+    size_t length;
+    size_t cap;
+    std::vector<size_t> breaks; // Sorted offsets of every '\n'
+
+    mutable std::mutex index_mutex;
+    std::atomic<bool> index_complete;
+    size_t scanned; // Bytes indexed so far
+
+    void scanChunk(size_t bytes); // Requires index_mutex
+    static void indexStep(std::weak_ptr<TextSource> source, ThreadPool& pool,
+                          std::function<void()> done);
+};
+
+// A contiguous run of one source
+struct Piece {
+    uint32_t source;
+    size_t start;
+    size_t length;
+    size_t newlines;
+};
+
+// Ordered list of pieces. One piece is stored inline, so the common case of
+// a single run (one typed character, one deleted line) does not allocate.
+class PieceList {
+  public:
+    PieceList() : single{0, 0, 0, 0}, count(0) {}
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    const Piece& operator[](size_t i) const {
+        return count == 1 ? single : many[i];
+    }
+    Piece& operator[](size_t i) { return count == 1 ? single : many[i]; }
+    const Piece* data() const { return count == 1 ? &single : many.data(); }
+    Piece& front() { return count == 1 ? single : many.front(); }
+    Piece& back() { return count == 1 ? single : many.back(); }
+
+    void push_back(const Piece& piece);
+    void push_front(const Piece& piece);
+    void pop_back();
+
+    size_t length() const;   // Total bytes
+    size_t newlines() const; // Total '\n'
+    size_t heapBytes() const { return many.capacity() * sizeof(Piece); }
+
+  private:
+    Piece single;
+    size_t count;
+    std::vector<Piece> many; // Used once there is more than one piece
+};
+
+// Text that belongs to no table: runs of sources, which it keeps alive.
+// A table shares part of its document this way and adopt() turns it back
+// into pieces of any table, so yanked text moves between buffers, and into
+// the undo history, by reference rather than by copy.
+class SharedText {
+  public:
+    struct Run {
+        std::shared_ptr<TextSource> source;
+        size_t start;
+        size_t length;
+        size_t newlines;
+    };
+
+    // A single '\n', from a source of its own
+    static const SharedText& newline();
+
+    bool empty() const { return runs.empty(); }
+    size_t length() const;   // Total bytes
+    size_t newlines() const; // Total '\n'
+    const std::vector<Run>& getRuns() const { return runs; }
+
+    void append(const SharedText& other);
+    // The text `t` times over. Runs are shared while there are few of them;
+    // past that the text is copied once, by doubling, into a source of its
+    // own, so the result costs its bytes rather than a run per copy.
+    SharedText repeat(size_t t) const;
+    // Drops a final '\n', if there is one
+    void chopNewline();
+    std::string str() const;
+
+  private:
+    friend class PieceTable;
+    std::vector<Run> runs;
+};
+
+// Piece table over an original text plus an append-only add buffer. Pieces
+// live in a treap keyed implicitly by document offset and augmented with
+// subtree byte and newline counts, so offset/line lookups and edits are all
+// O(log n) in the number of pieces.
+//
+// The document is the text with lines separated by '\n'; a document with
+// no newline has exactly one line.
+class PieceTable {
+  public:
+    PieceTable();
+
+    // Replaces the whole content, the text becomes the original source
+    void load(std::string text);
+    // Same, with the newline offsets of text already known
+    void load(std::string text, std::vector<size_t> breaks);
+    // Uses the first `length` bytes of a mapped file as the original source.
+    // Lines are indexed as they are asked for, and by indexInBackground().
+    void loadMapped(std::shared_ptr<MappedFile> file, size_t length);
+
+    // True once every line of the original is indexed
+    bool indexed() const;
+    // Makes sure at least `count` lines are indexed (or the whole text)
+    void indexLines(size_t count) const;
+    // Indexes every line on `pool`, then calls `done` on the pool's thread;
+    // calls it right away if there is nothing to index
+    void indexInBackground(ThreadPool& pool, std::function<void()> done) const;
+
+    size_t size() const;
+    size_t lineCount() const;
+    // Offset of the first byte of a line
+    size_t lineStart(size_t line) const;
+    // Offset of the '\n' terminating a line, or size() for the last line
+    size_t lineEnd(size_t line) const;
+    size_t lineLength(size_t line) const;
+
+    // Reads a line without its terminator, reusing out's storage
+    void readLine(size_t line, std::string& out) const;
+    std::string getLine(size_t line) const;
+    char at(size_t offset) const;
+    std::string read(size_t offset, size_t n) const;
+
+    // Calls f for each contiguous span of [offset, offset + n) in order
+    void forEachSpan(size_t offset, size_t n,
+                     const std::function<void(const char*, size_t)>& f) const;
+
+    // Line containing a byte offset
+    size_t lineAt(size_t offset) const;
+
+    // Pieces covering [offset, offset + n), sharing the table's sources. The
+    // sources are append-only, so the list stays valid after later edits.
+    PieceList collect(size_t offset, size_t n) const;
+    // [offset, offset + n) as text that outlives the table
+    SharedText share(size_t offset, size_t n) const;
+    // Pieces of this table for shared text, adding the sources it lacks
+    PieceList adopt(const SharedText& text);
+    // The part of a piece starting `from` bytes in, `length` bytes long
+    Piece slice(const Piece& piece, size_t from, size_t length) const;
+    // The bytes a piece refers to
+    const char* pieceData(const Piece& piece) const {
+        return sources[piece.source]->data() + piece.start;
+    }
+    // Copies text into the add buffer without putting it in the document,
+    // for pieces that are inserted later (such as a restored undo history)
+    Piece store(const char* text, size_t n) { return appendText(text, n); }
+
+    // Editing. insert() returns the piece that now holds the text.
+    Piece insert(size_t offset, const char* text, size_t n);
+    Piece insert(size_t offset, const std::string& text) {
+        return insert(offset, text.data(), text.size());
+    }
+    void insertPieces(size_t offset, const PieceList& pieces);
+    void erase(size_t offset, size_t n);
+
+    // Adds a finished source, such as text built off the UI thread, and
+    // returns the index pieces refer to it by
+    uint32_t addSource(std::shared_ptr<TextSource> source);
+
+    // Replaces [offset, offset + length) with `pieces`
+    struct Splice {
+        size_t offset;
+        size_t length;
+        PieceList pieces;
+    };
+    // Applies many splices in one pass over the pieces, rebuilding the tree
+    // in O(pieces + splices) rather than splitting it once per splice.
+    // Offsets are in current coordinates, sorted, and must not overlap.
+    void replaceRanges(const std::vector<Splice>& splices);
+    // Indexes a lazily loaded original and moves all of it into the tree,
+    // for a bulk edit over the whole text. Other edits only take the part
+    // of the original up to where they end.
+    void materialize();
+
+  private:
+    struct Node {
+        Piece piece;
+        uint32_t left;
+        uint32_t right;
+        uint32_t priority;
+        size_t sub_length;
+        size_t sub_newlines;
+    };
+
+    std::vector<std::shared_ptr<TextSource>> sources;
+    uint32_t add_source; // Chunk currently receiving typed text
+
+    std::vector<Node> nodes; // nodes[0] is the nil sentinel
+    std::vector<uint32_t> free_nodes;
+    uint32_t root;
+    uint32_t rng_state;
+    // The document is the tree followed by [tail_start, tail_end) of the
+    // original, which is still being indexed and has no newline count in
+    // the tree; line queries past the tree go straight to the source's
+    // index. An edit moves the tail up to its end into the tree.
+    bool lazy;
+    size_t tail_start;
+    size_t tail_end;
+
+    uint32_t nextPriority();
+    uint32_t newNode(const Piece& piece);
+    void freeTree(uint32_t t);
+    void pull(uint32_t t);
+    uint32_t merge(uint32_t a, uint32_t b);
+    void split(uint32_t t, size_t offset, uint32_t& l, uint32_t& r);
+    bool extendLast(uint32_t t, const Piece& piece);
+    uint32_t buildTree(const Piece* pieces, size_t n);
+    void flatten(uint32_t t, std::vector<Piece>& out) const;
+    Piece appendText(const char* text, size_t n);
+    size_t newlineOffset(size_t k) const;
+    void detachTail(size_t end);
+    void visit(uint32_t t, size_t base, size_t from, size_t to,
+               const std::function<void(const char*, size_t)>& f) const;
+    void collectPieces(uint32_t t, size_t base, size_t from, size_t to,
+                       PieceList& out) const;
+};
+
+// Read-only view over the lines of a piece table. Lines are materialized on
+// access, so callers that used to hold a std::vector<std::string> can keep
+// indexing and iterating without the storage being a vector.
+class LineView {
+  public:
+    class iterator {
+      public:
+        iterator(const PieceTable* table, size_t line)
+            : table(table), line(line) {}
+        std::string operator*() const { return table->getLine(line); }
+        iterator& operator++() {
+            ++line;
+            return *this;
+        }
+        bool operator!=(const iterator& other) const {
+            return line != other.line;
+        }
+
+      private:
+        const PieceTable* table;
+        size_t line;
+    };
+
+    explicit LineView(const PieceTable& table) : table(&table) {}
+
+    size_t size() const { return table->lineCount(); }
+    std::string operator[](size_t line) const { return table->getLine(line); }
+    iterator begin() const { return iterator(table, 0); }
+    iterator end() const { return iterator(table, size()); }
+
+  private:
+    const PieceTable* table;
+};
+
+#endif // PIECE_TABLE_H
@@ -0,0 +1,138 @@
+// include/backend/regex.h
+
+#ifndef REGEX_H
+#define REGEX_H
+
+#include "backend/string_search.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Vim regular expressions in the default 'magic' syntax, matched against
+// one line at a time:
+//
+//   x  .  [abc]  [^a-z]  [[:alpha:]]     characters
+//   *  \+  \=  \?  \{n,m}  \{-n,m}       repeats; \{-...} is lazy
+//   \(...\)  \%(...\)  \|  \1..\9        groups, alternation, backrefs
+//   ^  $  \<  \>                         line and word anchors
+//   \s \d \w \a \l \u \x \o \h           classes; uppercase negates
+//   \t \e \r  \c \C                      escapes; \c ignores case
+//
+// Patterns are compiled to an NFA, which a RegexMatcher turns into a DFA
+// lazily, one state at a time as the text reaches it. The backtracker only
+// runs to fill in \(...\) groups that a replacement asks for, and for
+// patterns with backreferences, on lines the DFA has not ruled out.
+struct RegexProgram;
+class RegexDFA;
+
+// Offsets of a match and its groups in the line; group 0 is the whole
+// match, and groups that took no part are npos
+struct RegexMatch {
+    static constexpr size_t kGroups = 10;
+    static constexpr size_t npos = SIZE_MAX;
+
+    size_t begin[kGroups];
+    size_t end[kGroups];
+};
+
+class Regex {
+  public:
+    // Compiles `pattern`; on a syntax error ok() is false and error() says
+    // what is wrong
+    explicit Regex(const std::string& pattern);
+    // Matches `text` as it is, with no special characters
+    static Regex literal(const std::string& text);
+
+    bool ok() const { return error_message.empty(); }
+    const std::string& error() const { return error_message; }
+    const std::string& pattern() const { return source; }
+    size_t groupCount() const;
+    bool hasBackrefs() const;
+
+  private:
+    std::string source;
+    std::string error_message;
+    std::shared_ptr<const RegexProgram> program;
+
+    Regex() = default;
+    friend class RegexMatcher;
+};
+
+// Matches one Regex. The DFA states it builds are kept for the next call,
+// so use one matcher for a whole search; it is not thread-safe, so give
+// each thread its own.
+class RegexMatcher {
+  public:
+    explicit RegexMatcher(const Regex& regex);
+    ~RegexMatcher();
+    RegexMatcher(const RegexMatcher&) = delete;
+    RegexMatcher& operator=(const RegexMatcher&) = delete;
+
+    // Finds the first match in the line [data, data + n) that starts at or
+    // after `from`: leftmost, and among matches starting there the one a
+    // backtracking matcher would pick. Groups 1-9 are only filled in if
+    // `captures` is set. Allocates nothing when the line has no match.
+    bool find(const char* data, size_t n, size_t from, RegexMatch& match,
+              bool captures = false);
+
+    // For text of whole lines separated by '\n': the offset of the first
+    // line at or after `from`, itself a line start, that may have a match,
+    // or npos. One pass over the bytes; find() has the final say for
+    // patterns with backreferences.
+    size_t findLine(const char* data, size_t n, size_t from);
+
+  private:
+    std::shared_ptr<const RegexProgram> program;
+    std::unique_ptr<SubstringSearcher> searcher; // Bytes every match has
+    std::unique_ptr<RegexDFA> forward;           // Unanchored, leftmost-first
+    std::unique_ptr<RegexDFA> reverse;           // Anchored, longest
+
+    // Backtracker state, kept to reuse the allocations
+    struct Job {
+        uint32_t pc;
+        uint32_t slot; // Restores slots[slot] = pos if not kNoSlot
+        size_t pos;
+    };
+    std::vector<Job> jobs;
+    std::vector<uint64_t> visited; // (pc, pos) pairs already tried
+    size_t slots[2 * RegexMatch::kGroups];
+
+    size_t matchEnd(const char* data, size_t n, size_t from);
+    size_t matchStart(const char* data, size_t n, size_t from, size_t end);
+    bool backtrack(const char* data, size_t n, size_t start, size_t limit,
+                   bool memoize);
+};
+
+// Replacement text of :s, in which & and \0 stand for the whole match,
+// \1..\9 for a group, \r for a line break, \n for a NUL byte, \t for a tab,
+// and a backslash before anything else for that character
+class ReplaceTemplate {
+  public:
+    explicit ReplaceTemplate(const std::string& replacement);
+    // Inserts `text` as it is
+    static ReplaceTemplate literal(const std::string& text);
+
+    // Whether it refers to \1..\9, which needs RegexMatcher::find to
+    // capture groups
+    bool usesGroups() const { return groups; }
+    // Appends the replacement for `match` in `line` to `out`
+    void expand(const char* line, const RegexMatch& match,
+                std::string& out) const;
+
+  private:
+    struct Part {
+        int group; // -1 for text[begin, begin + length)
+        size_t begin;
+        size_t length;
+    };
+    std::string text;
+    std::vector<Part> parts;
+    bool groups;
+
+    ReplaceTemplate() : groups(false) {}
+    void addText(const char* s, size_t n);
+};
+
+#endif // REGEX_H
@@ -0,0 +1,36 @@
+// include/backend/registers.h
+
+#ifndef REGISTERS_H
+#define REGISTERS_H
+
+#include "backend/piece_table.h"
+
+// Text yanked or deleted. Whole lines end in '\n' each; anything else is
+// characters, put back inside a line.
+struct Register {
+    SharedText text;
+    bool linewise = false;
+};
+
+// The unnamed register ("), the yank register (0) and the named ones
+// (a-z). A yank or delete goes to the named register if one is given and
+// otherwise to the unnamed one and, for a yank, to 0; an uppercase name
+// appends to the register. The unnamed register always ends up with what
+// was stored last. Registers hold text by reference (see SharedText), so
+// yanking a large range costs a few runs rather than a copy.
+class Registers {
+  public:
+    // '"', '0', a-z and A-Z
+    static bool isValid(char name);
+
+    void store(char name, const Register& reg, bool yank);
+    // The register called `name` (0 for the unnamed), or null if empty
+    const Register* get(char name) const;
+
+  private:
+    Register unnamed;
+    Register yanked;
+    Register named[26];
+};
+
+#endif // REGISTERS_H
@@ -0,0 +1,81 @@
+// include/backend/row_index.h
+
+#ifndef ROW_INDEX_H
+#define ROW_INDEX_H
+
+#include "backend/line_layout.h"
+#include "backend/piece_table.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// How many screen rows the lines of a buffer take when long lines wrap at a
+// given width, as LineLayout wraps them, so that scrolling and placing the
+// cursor are O(log n) sums rather than walks over the lines in between.
+//
+// Most lines fit in one row, so only the lines that wrap are kept: a treap
+// in line order whose nodes hold the rows a line takes past its first and,
+// as in SearchIndex, how many lines the node is past the node before it. An
+// edit that adds or removes lines moves every later line by changing one
+// node. Lines are read the first time a query reaches them and read again
+// after the width changes, so a resize costs nothing until the next frame
+// and a lazily loaded file is only read as far as it is shown.
+class RowIndex {
+  public:
+    RowIndex();
+
+    // Forgets every line; they are read again when next asked for
+    void invalidate();
+    // Lines [line, line + removed) were replaced by `inserted` lines, which
+    // are now in `text`
+    void linesChanged(const PieceTable& text, size_t line, size_t removed,
+                      size_t inserted);
+
+    // Rows lines [first, last) take at `width` columns
+    size_t rowsBetween(const PieceTable& text, size_t width, size_t first,
+                       size_t last);
+    // The first of the most lines ending with `last` that fit in `rows`
+    // rows; `last` itself if it does not fit on its own
+    size_t firstLineFitting(const PieceTable& text, size_t width, size_t last,
+                            size_t rows);
+
+  private:
+    struct Node {
+        uint32_t left;
+        uint32_t right;
+        uint32_t priority;
+        size_t gap; // Lines past the node before it; line + 1 for the first
+        size_t sub_gap;
+        size_t extra; // Rows past the first
+        size_t sub_extra;
+    };
+
+    // A wrapped line, before it goes into the tree
+    struct Entry {
+        size_t gap;
+        size_t extra;
+    };
+
+    size_t width;   // Width the tree is for, 0 before it is first used
+    size_t covered; // Lines [0, covered) have been read
+    std::vector<Node> nodes; // nodes[0] is the nil sentinel
+    std::vector<uint32_t> free_nodes;
+    uint32_t root;
+    uint32_t rng_state;
+
+    void sync(const PieceTable& text, size_t width, size_t lines);
+    void scan(const PieceTable& text, size_t first, size_t last,
+              size_t& before, std::vector<Entry>& entries) const;
+    size_t extraBefore(size_t line) const;
+
+    uint32_t nextPriority();
+    uint32_t newNode(size_t gap, size_t extra);
+    void freeTree(uint32_t t);
+    void pull(uint32_t t);
+    uint32_t merge(uint32_t a, uint32_t b);
+    void split(uint32_t t, size_t lines, uint32_t& l, uint32_t& r);
+    void shiftFirst(uint32_t t, size_t diff);
+    uint32_t buildTree(const Entry* entries, size_t n);
+};
+
+#endif // ROW_INDEX_H
@@ -0,0 +1,98 @@
+// include/backend/search_index.h
+
+#ifndef SEARCH_INDEX_H
+#define SEARCH_INDEX_H
+
+#include "backend/piece_table.h"
+#include "backend/regex.h"
+#include "common/thread_pool.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Where a search lands
+struct SearchHit {
+    size_t line = 0;
+    size_t column = 0;
+    size_t ordinal = 0;   // 1-based number of the match, 0 if not known
+    bool wrapped = false; // Went past the end (or start) of the buffer
+};
+
+// Every match of the last search pattern in a buffer, so that n and N find
+// the next one in O(log m), for m lines with matches, without reading the
+// text again.
+//
+// Lines with matches live in a treap in line order. A node stores how many
+// lines it is past the node before it rather than its line number, so an
+// edit that adds or removes lines moves every later match by changing one
+// node. The buffer reports each edit, and only the lines it touched are
+// searched again.
+class SearchIndex {
+  public:
+    SearchIndex();
+
+    // Searches all of `text` for `pattern`, in parallel on `pool`
+    void build(const Regex& pattern, const PieceTable& text, ThreadPool& pool);
+    // Searches the whole text again for the same pattern
+    void rebuild(const PieceTable& text, ThreadPool& pool);
+    void clear();
+    bool active() const { return pattern != nullptr; }
+    // The pattern the index was built for, empty if none
+    const std::string& source() const;
+
+    // Lines [line, line + removed) were replaced by `inserted` lines, which
+    // are now in `text`
+    void linesChanged(const PieceTable& text, size_t line, size_t removed,
+                      size_t inserted);
+
+    size_t matchCount() const { return nodes[root].sub_matches; }
+    // The first match after (line, column), or the last one before it if
+    // not `forward`, going round the ends of the buffer
+    bool next(size_t line, size_t column, bool forward, SearchHit& hit) const;
+
+    // The same without an index, reading the text from (line, column) on
+    // until a match turns up; hit.ordinal is left 0
+    static bool find(const Regex& pattern, const PieceTable& text, size_t line,
+                     size_t column, bool forward, SearchHit& hit);
+
+  private:
+    struct Node {
+        uint32_t left;
+        uint32_t right;
+        uint32_t priority;
+        size_t gap; // Lines past the node before it; line + 1 for the first
+        size_t sub_gap;
+        size_t sub_nodes;
+        size_t sub_matches;
+        std::vector<size_t> starts; // Columns where the matches begin
+    };
+
+    // A line with matches, before it goes into the tree
+    struct Entry {
+        size_t line;
+        size_t gap;
+        std::vector<size_t> starts;
+    };
+
+    std::shared_ptr<const Regex> pattern;
+    std::vector<Node> nodes; // nodes[0] is the nil sentinel
+    std::vector<uint32_t> free_nodes;
+    uint32_t root;
+    uint32_t rng_state;
+
+    uint32_t nextPriority();
+    uint32_t newNode(size_t gap, std::vector<size_t> starts);
+    void freeTree(uint32_t t);
+    void pull(uint32_t t);
+    uint32_t merge(uint32_t a, uint32_t b);
+    void split(uint32_t t, size_t lines, uint32_t& l, uint32_t& r);
+    void shiftFirst(uint32_t t, size_t diff);
+    uint32_t buildTree(Entry* entries, size_t n);
+    void countBefore(size_t line, size_t& nodes_before,
+                     size_t& matches_before) const;
+    uint32_t nodeAt(size_t k, size_t& line) const;
+};
+
+#endif // SEARCH_INDEX_H
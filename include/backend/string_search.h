@@ -0,0 +1,49 @@
+// include/backend/string_search.h
+
+#ifndef STRING_SEARCH_H
+#define STRING_SEARCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Implementations of substring search. The vector kernels compare the
+// needle's first and last bytes against a whole block of positions at once
+// and only check candidates that match both. Horspool, which skips ahead by
+// up to the needle's length, is kept for comparison.
+enum class SearchKernel { SCALAR, SSE2, AVX2, HORSPOOL };
+
+// Fastest kernel this CPU supports
+SearchKernel bestSearchKernel();
+bool searchKernelSupported(SearchKernel kernel);
+const char* searchKernelName(SearchKernel kernel);
+
+// Finds occurrences of one needle. Build it once per search and reuse it for
+// every line or chunk searched.
+class SubstringSearcher {
+  public:
+    static const size_t npos = SIZE_MAX;
+
+    explicit SubstringSearcher(const std::string& needle);
+    SubstringSearcher(const std::string& needle, SearchKernel kernel);
+
+    // Offset of the first match in [data, data + n) starting at or after
+    // `from`, or npos. An empty needle matches at `from`.
+    size_t find(const char* data, size_t n, size_t from = 0) const;
+    size_t find(const std::string& haystack, size_t from = 0) const {
+        return find(haystack.data(), haystack.size(), from);
+    }
+
+    const std::string& pattern() const { return needle; }
+    SearchKernel kernel() const { return method; }
+
+  private:
+    std::string needle;
+    SearchKernel method;
+    size_t skip[256]; // Horspool shift per byte value
+
+    size_t findScalar(const char* data, size_t n) const;
+    size_t findHorspool(const char* data, size_t n) const;
+};
+
+#endif // STRING_SEARCH_H
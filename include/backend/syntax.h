@@ -0,0 +1,105 @@
+// include/backend/syntax.h
+
+#ifndef SYNTAX_H
+#define SYNTAX_H
+
+#include "backend/piece_table.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// What a stretch of text is, for coloring
+enum class SyntaxKind : uint8_t {
+    NORMAL,
+    KEYWORD,
+    TYPE,
+    STRING,
+    NUMBER,
+    COMMENT,
+    PREPROC
+};
+
+// Bytes [begin, end) of a line are of one kind
+struct SyntaxToken {
+    size_t begin;
+    size_t end;
+    SyntaxKind kind;
+};
+
+// Languages the highlighter knows
+enum class SyntaxLanguage { NONE, CPP };
+
+// The language a file name suggests, by its extension
+SyntaxLanguage detectSyntaxLanguage(const std::string& filename);
+
+// Lexes one line of C or C++ that starts in `state`, appending the tokens
+// that are not NORMAL to `tokens` if it is not null, and returns the state
+// at its end: inside a block comment, a raw string, or a string or comment
+// that a backslash carries on to the next line.
+uint32_t lexCppLine(const char* line, size_t length, uint32_t state,
+                    std::vector<SyntaxToken>* tokens);
+
+// Lexer states at the end of each line, so a line can be lexed on its own.
+//
+// Lines [0, valid) have their states right. Past that, a stored state was
+// right before some edit or is a guess. Each stored state after a known one
+// was lexed from it, and kUnknown marks where that does not hold: edited
+// lines, and the lines around a guess or where lexing last stopped. So when
+// lexing on from `valid` gives a line the state it already has, every line
+// up to the next kUnknown is right too and is skipped. An edit only costs
+// the lines until the states agree again.
+//
+// The lines on screen are made ready as they are drawn. When they are far
+// past `valid` they are lexed from kSyncLines before them, guessing that
+// nothing is open there, and the rest is done a slice at a time while the
+// editor is idle.
+class SyntaxHighlighter {
+  public:
+    static constexpr uint32_t kUnknown = UINT32_MAX;
+    // Lines lexed before a window that is guessed
+    static constexpr size_t kSyncLines = 200;
+
+    SyntaxHighlighter();
+
+    void setLanguage(SyntaxLanguage language);
+    bool enabled() const { return language != SyntaxLanguage::NONE; }
+    // Forgets every state, for a text that was replaced
+    void clear();
+    // Lines [line, line + removed) were replaced by `inserted` lines
+    void linesChanged(size_t line, size_t removed, size_t inserted);
+
+    // Gets the states lines [first, last) start in ready to draw them.
+    // Lines whose start state changed widen [changed_first, changed_last].
+    void prepare(const PieceTable& text, size_t first, size_t last,
+                 size_t& changed_first, size_t& changed_last);
+    // Whether some line is not known to be right
+    bool pending(const PieceTable& text) const;
+    // Lexes on from `valid` until the deadline, reporting changes as
+    // prepare() does
+    void idle(const PieceTable& text,
+              std::chrono::steady_clock::time_point deadline,
+              size_t& changed_first, size_t& changed_last);
+
+    // The tokens of a line, whose text is `content`
+    void tokens(size_t line, const std::string& content,
+                std::vector<SyntaxToken>& out) const;
+
+  private:
+    SyntaxLanguage language;
+    std::vector<uint32_t> states; // End state of each line lexed so far
+    size_t valid;
+    std::string scratch;
+
+    static size_t available(const PieceTable& text);
+    uint32_t startState(size_t line) const;
+    uint32_t lexLine(const char* line, size_t length, uint32_t state,
+                     std::vector<SyntaxToken>* tokens) const;
+    bool store(const PieceTable& text, size_t line, size_t& changed_first,
+               size_t& changed_last);
+    void advance(const PieceTable& text, size_t limit, size_t& changed_first,
+                 size_t& changed_last);
+};
+
+#endif // SYNTAX_H
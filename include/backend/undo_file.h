@@ -0,0 +1,69 @@
+// include/backend/undo_file.h
+
+#ifndef UNDO_FILE_H
+#define UNDO_FILE_H
+
+#include "backend/piece_table.h"
+#include "backend/undo_tree.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Streaming 64-bit hash of the text, used to check that an undofile still
+// belongs to the file next to it
+class ContentHash {
+  public:
+    ContentHash();
+    void update(const char* data, size_t n);
+    uint64_t digest() const;
+
+  private:
+    uint64_t state;
+    uint64_t tail;     // Bytes not yet making up a whole word
+    size_t tail_bytes;
+    size_t total;
+
+    void mix(uint64_t word);
+};
+
+uint64_t hashText(const PieceTable& text);
+
+// The undo tree of a file, kept next to it as ".<name>.un~".
+//
+// The file is a header followed by records. Node records hold a node's
+// place in the tree and the bytes of its changes; a checkpoint record holds
+// the current node and the hash of the text at a save. Each save appends
+// the nodes created since the last one and a checkpoint, so it costs the
+// size of the new history rather than of all of it. The file is rewritten
+// in full only when it cannot be appended to: it belongs to another file
+// name, was changed behind our back, or the tree dropped its old root.
+//
+// On load the last checkpoint has to match the text, otherwise the file is
+// ignored and replaced at the next save.
+class UndoFile {
+  public:
+    UndoFile();
+
+    static std::string pathFor(const std::string& filename);
+
+    // Restores `tree` from the undofile of `filename`. Returns false, and
+    // leaves the tree empty, if there is none or it does not match `text`.
+    bool load(const std::string& filename, PieceTable& text, UndoTree& tree);
+    // Records the tree after `filename` was saved with text hashing to `hash`
+    bool save(const std::string& filename, uint64_t hash,
+              const PieceTable& text, const UndoTree& tree);
+
+    // Forgets what is on disk, so the next save rewrites the file
+    void reset();
+
+  private:
+    std::string path;     // Undofile the fields below describe
+    size_t written_seq;   // Newest node on disk
+    size_t written_bytes; // Size of the file as we left it
+    size_t rebases;       // UndoTree::rebaseCount() when it was written
+
+    bool rewrite(const std::string& filename, uint64_t hash,
+                 const PieceTable& text, const UndoTree& tree);
+};
+
+#endif // UNDO_FILE_H
@@ -0,0 +1,133 @@
+// include/backend/undo_tree.h
+
+#ifndef UNDO_TREE_H
+#define UNDO_TREE_H
+
+#include "backend/piece_table.h"
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// One change to the text: at `offset`, `removed` was replaced by `inserted`.
+// Both sides are pieces of the buffer's append-only sources, so recording a
+// change copies no text, and a run of one piece stays inline.
+struct Action {
+    size_t offset;
+    PieceList removed;
+    PieceList inserted;
+};
+
+// Changes undone and redone together, with the cursor from before the first
+struct UndoGroup {
+    std::vector<Action> actions;
+    int cursor_y;
+    int cursor_x;
+    size_t cost; // Bytes this group holds on to
+};
+
+// A state of the text. Node `seq` is reached from its parent by applying
+// its group; seq 0 is the root, the text before the oldest change kept.
+// Sequence numbers grow with every new change, so a parent always has a
+// smaller one than its children.
+struct UndoNode {
+    size_t seq;
+    size_t parent;
+    size_t redo_child; // Where redo goes: the child visited last, 0 for none
+    std::vector<size_t> children;
+    int64_t time;      // When the node was last changed, in seconds
+    bool alive;
+    UndoGroup group;
+};
+
+// One group to apply when moving between states
+struct UndoStep {
+    const UndoGroup* group;
+    bool forward; // Redo the group if true, undo it otherwise
+};
+
+// Undo tree of a buffer.
+//
+// Edits recorded while a group is open join it, and an edit that continues
+// the previous one (typing on after it, backspacing into it, deleting
+// forward from its end) is merged into the same Action. The caller closes
+// the group at the end of a command or an insert-mode session. An edit made
+// after an undo starts a new branch; the old one is kept and can be reached
+// with travelTo().
+//
+// The tree keeps at most `limit` bytes of its own nodes and piece lists;
+// once over, the oldest nodes are dropped. The node being recorded is never
+// dropped. Text removed by an edit is not counted: the pieces refer to it in
+// the table's append-only sources, which dropping a node does not free.
+class UndoTree {
+  public:
+    static const size_t kDefaultLimit = 32 << 20;
+
+    UndoTree();
+
+    // Records a change made with the cursor at (cursor_y, cursor_x)
+    void record(size_t offset, const PieceList& removed,
+                const PieceList& inserted, int cursor_y, int cursor_x,
+                const PieceTable& table);
+    void closeGroup() { group_open = false; }
+
+    // Step to the parent or to the redo child and return the group to undo
+    // or redo, or nullptr if there is none. Pointers into the tree are valid
+    // until it is next changed.
+    const UndoGroup* undo();
+    const UndoGroup* redo();
+    // Moves to state `seq` and returns the groups to apply, in order
+    std::vector<UndoStep> travelTo(size_t seq);
+
+    // States for :earlier/:later: `count` changes away, or the newest state
+    // not later than `seconds` away from the current one
+    size_t seqByCount(long count) const;
+    size_t seqByTime(int64_t seconds) const;
+
+    void clear();
+    void setLimit(size_t bytes);
+    size_t getLimit() const { return limit; }
+    size_t memoryUsage() const { return total_bytes; }
+    // Number of undo() calls that would succeed
+    size_t undoSteps() const;
+
+    // ===--- Persistence ---===
+    size_t currentSeq() const { return current; }
+    size_t lastSeq() const { return next_seq - 1; }
+    int64_t rootTime() const { return root.time; }
+    // The node with this sequence number, or nullptr if it was dropped
+    const UndoNode* node(size_t seq) const;
+    // Bumped whenever dropping old nodes changes the root state, which
+    // invalidates anything saved relative to the old root
+    size_t rebaseCount() const { return rebases; }
+
+    // Rebuilding a saved tree: nodes are added in sequence order, children
+    // after their parent
+    void restoreRoot(int64_t time);
+    bool restoreNode(size_t seq, size_t parent, int64_t time,
+                     UndoGroup group);
+    bool restoreCurrent(size_t seq);
+
+  private:
+    UndoNode root;
+    std::deque<UndoNode> nodes; // nodes[i] has sequence number first_seq + i
+    size_t first_seq;
+    size_t next_seq;
+    size_t current;
+    bool group_open;
+    size_t total_bytes;
+    size_t limit;
+    size_t rebases;
+
+    UndoNode* find(size_t seq);
+    UndoNode& newChild(int cursor_y, int cursor_x);
+    void dropNewest();
+    void dropSubtree(size_t seq);
+    bool onCurrentPath(size_t seq) const;
+    bool coalesce(Action& last, size_t offset, const PieceList& removed,
+                  const PieceList& inserted, const PieceTable& table);
+    void enforceLimit();
+    static size_t costOf(const Action& action);
+};
+
+#endif // UNDO_TREE_H
@@ -0,0 +1,26 @@
+#ifndef __COMMON_COMPLETION_QUEUE_H__
+#define __COMMON_COMPLETION_QUEUE_H__
+
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+// Work handed back to the UI thread. A background task posts what is to be
+// done with its result, from any thread, and the event loop drains the
+// queue between keys, so the editor's state is only touched by one thread.
+class CompletionQueue {
+  public:
+    void post(std::function<void()> completion);
+    // Runs everything posted so far, oldest first, on the calling thread.
+    // Completions posted meanwhile wait for the next call. Returns how many
+    // ran.
+    size_t drain();
+
+  private:
+    std::mutex mutex;
+    std::vector<std::function<void()>> posted; // Guarded by mutex
+    std::vector<std::function<void()>> running;
+};
+
+#endif // __COMMON_COMPLETION_QUEUE_H__
@@ -0,0 +1,27 @@
+#ifndef __COMMON_IDLE_SCHEDULER_H__
+#define __COMMON_IDLE_SCHEDULER_H__
+
+#include <chrono>
+#include <deque>
+#include <functional>
+
+// Low-priority work run on the UI thread while no key is waiting. A task
+// does a slice of its work, stopping by the deadline it is given, and
+// returns whether it has more; it is called again until it has none. Tasks
+// take turns, a slice each, and a key that arrives waits for one slice at
+// most.
+class IdleScheduler {
+  public:
+    using Clock = std::chrono::steady_clock;
+    using Task = std::function<bool(Clock::time_point deadline)>;
+
+    void post(Task task);
+    bool empty() const { return tasks.empty(); }
+    // Runs slices until the deadline passes or no task is left
+    void run(Clock::time_point deadline);
+
+  private:
+    std::deque<Task> tasks;
+};
+
+#endif // __COMMON_IDLE_SCHEDULER_H__
@@ -0,0 +1,150 @@
+#ifndef __COMMON_PROFILER_H__
+#define __COMMON_PROFILER_H__
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Counts of recorded values in log-linear buckets, laid out as in
+// HdrHistogram: values below 64 each have their own bucket, and every
+// power of two above that is split into 32, so a bucket is within about
+// 3% of any value in it. Recording is an increment, with no allocation.
+class Histogram {
+  public:
+    Histogram();
+
+    void record(uint64_t value);
+    void reset();
+
+    uint64_t count() const { return total_count; }
+    uint64_t sum() const { return total_sum; }
+    uint64_t min() const { return total_count > 0 ? min_value : 0; }
+    uint64_t max() const { return max_value; }
+    double mean() const;
+    // The highest value of the bucket holding the `p`th percentile
+    uint64_t percentile(double p) const;
+
+    // Non-empty buckets, lowest first
+    struct Bucket {
+        uint64_t low;
+        uint64_t high;
+        uint64_t count;
+    };
+    std::vector<Bucket> buckets() const;
+
+  private:
+    static const int kSubBucketBits = 6;
+    static const size_t kBucketCount = 1920; // Up to 2^64 - 1
+
+    std::vector<uint64_t> counts;
+    uint64_t total_count;
+    uint64_t total_sum;
+    uint64_t min_value;
+    uint64_t max_value;
+
+    static size_t indexOf(uint64_t value);
+    static Bucket bucketAt(size_t index);
+};
+
+// Where the time of a key goes. Phases nest: a key includes the edits it
+// makes, and the frame drawn after it includes indexing, highlighting and
+// rendering.
+enum class ProfilePhase {
+    KEY,         // InputHandler::handleInput
+    EDIT,        // One change to a buffer's text
+    SUBSTITUTE,  // :s over a buffer
+    UNDO,        // Applying an undo or redo step
+    SEARCH,      // Building the match index, or finding one match
+    SCROLL,      // Editor::adjustScrolling
+    FRAME,       // Editor::flushRender
+    INDEX,       // Indexing the lines of a frame
+    HIGHLIGHT,   // Lexing the lines of a frame
+    RENDER,      // Renderer::render
+    IDLE,        // A slice of idle work
+    COMPLETIONS, // Draining background completions
+    COUNT
+};
+
+// Per-frame values, recorded once for each frame drawn
+enum class ProfileCounter {
+    ROWS_PAINTED,
+    BYTES_WRITTEN,
+    COUNT
+};
+
+// Collects phase timings and frame counters, in nanoseconds and units,
+// between start() and stop(). It is only used from the UI thread.
+//
+// The PROFILE_SCOPE and PROFILE_COUNT macros record into it, and are only
+// compiled in when the build defines VIXX_PROFILE (cmake -DVIXX_PROFILE=ON);
+// otherwise they are empty and profiling costs nothing.
+class Profiler {
+  public:
+    static Profiler& instance();
+
+    // Starting discards what was collected before
+    void start();
+    void stop();
+    bool running() const { return is_running; }
+
+    void record(ProfilePhase phase, uint64_t nanoseconds);
+    void count(ProfileCounter counter, uint64_t value);
+
+    // The `top` phases taking the most time, for the status bar
+    std::string summary(size_t top) const;
+    // Every phase and counter with its percentiles and buckets
+    bool dump(const std::string& path) const;
+
+  private:
+    Profiler();
+
+    bool is_running;
+    std::chrono::steady_clock::time_point started;
+    std::chrono::steady_clock::time_point stopped;
+    Histogram phases[static_cast<size_t>(ProfilePhase::COUNT)];
+    Histogram counters[static_cast<size_t>(ProfileCounter::COUNT)];
+};
+
+// Records the time from its construction to the end of its scope in
+// `phase`, if the profiler was running when it began
+class ScopedTimer {
+  public:
+    explicit ScopedTimer(ProfilePhase phase)
+        : phase(phase), active(Profiler::instance().running()) {
+        if (active) {
+            start = std::chrono::steady_clock::now();
+        }
+    }
+    ~ScopedTimer() {
+        if (active) {
+            std::chrono::nanoseconds elapsed =
+                std::chrono::steady_clock::now() - start;
+            Profiler::instance().record(phase,
+                                        static_cast<uint64_t>(elapsed.count()));
+        }
+    }
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+  private:
+    ProfilePhase phase;
+    bool active;
+    std::chrono::steady_clock::time_point start;
+};
+
+#ifdef VIXX_PROFILE
+#define PROFILE_SCOPE(phase) ScopedTimer profile_scope_timer(ProfilePhase::phase)
+#define PROFILE_COUNT(counter, value)                                         \
+    do {                                                                       \
+        if (Profiler::instance().running()) {                                  \
+            Profiler::instance().count(ProfileCounter::counter, (value));      \
+        }                                                                      \
+    } while (0)
+#else
+#define PROFILE_SCOPE(phase) ((void)0)
+#define PROFILE_COUNT(counter, value) ((void)0)
+#endif
+
+#endif // __COMMON_PROFILER_H__
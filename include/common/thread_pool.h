@@ -0,0 +1,85 @@
+#ifndef __COMMON_THREAD_POOL_H__
+#define __COMMON_THREAD_POOL_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads, for data-parallel loops and for background
+// tasks that run off the input path.
+//
+// Each worker has a queue of its own. submit() from a worker adds to that
+// worker's queue, from any other thread to the queues in turn. A worker
+// runs its own queue oldest first and, when it is empty, steals the newest
+// task of another, so one long task does not hold up the ones queued
+// behind it.
+//
+// In parallelFor() the calling thread takes part in the work, so a pool of
+// n threads runs n + 1 loop bodies at once and a pool of 0 threads runs
+// everything inline.
+class ThreadPool {
+  public:
+    using Task = std::function<void()>;
+
+    explicit ThreadPool(size_t threads);
+    // Waits for the tasks that are running; the ones still queued are
+    // dropped, as are tasks submitted from then on
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Runs a task on a worker, or right away in a pool of 0 threads
+    void submit(Task task);
+
+    // Calls body(i) for every i in [0, count), spread over the workers, and
+    // returns once all calls have finished. The caller claims indices too,
+    // so a loop always finishes even when every worker is busy, and loops
+    // may be run from several threads, workers included, at once.
+    void parallelFor(size_t count, const std::function<void(size_t)>& body);
+
+    // Threads that can run a task at once, the caller included
+    size_t concurrency() const { return workers.size() + 1; }
+
+    // One worker per hardware thread besides the caller's, and at least one
+    // so that background tasks never run on the UI thread
+    static ThreadPool& shared();
+
+  private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        std::thread thread;
+    };
+
+    // A parallelFor() in progress, shared with the tasks that help with it
+    struct Loop {
+        const std::function<void(size_t)>* body;
+        size_t count;
+        std::atomic<size_t> next{0};     // First index not yet claimed
+        std::atomic<size_t> finished{0}; // Indices whose call returned
+        std::mutex mutex;
+        std::condition_variable done;
+
+        // Claims and runs indices until none are left
+        void run();
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<size_t> queued;    // Tasks in all the queues
+    std::atomic<size_t> next_queue; // Where the next outside task goes
+    std::mutex sleep_mutex;
+    std::condition_variable wake;
+    bool stopping; // Guarded by sleep_mutex
+
+    void workerLoop(size_t self);
+    void push(size_t queue, Task task);
+    bool take(size_t self, Task& task);
+};
+
+#endif // __COMMON_THREAD_POOL_H__
@@ -3,34 +3,38 @@
 #ifndef TYPES_H
 #define TYPES_H
 
-#include <string>
-#include <vector>
-
-// Enumeration for editor modes
-enum class Mode { NORMAL, INSERT, COMMAND };
-
-struct ReplaceLine {
-    int lineNumber;          // which line was changed
-    std::string oldLine;     // old content of that line
-    std::string newLine;     // new content after replacement
+// Enumeration for editor modes. SEARCH is the prompt of / and ?.
+enum class Mode { NORMAL, INSERT, COMMAND, SEARCH };
+
+// How Buffer::loadFromFile reads a file: AUTO maps large files and reads
+// small ones into memory
+enum class LoadMode { AUTO, EAGER, MAPPED };
+
+// Line terminator detected when loading a file, kept for saving it back.
+// MIXED files keep their '\r' bytes in the text and are saved with LF.
+enum class LineEnding { LF, CRLF, MIXED };
+
+// Motions an operator (d, y) takes. LINES is the operator typed twice, as
+// in dd: the cursor line and count - 1 more. The ones up to
+// PARAGRAPH_BACKWARD work on whole lines, the rest on characters of the
+// cursor line.
+enum class Motion {
+    LINES,
+    DOWN,
+    UP,
+    FIRST_LINE,
+    LAST_LINE,
+    PARAGRAPH_FORWARD,
+    PARAGRAPH_BACKWARD,
+    LEFT,
+    RIGHT,
+    LINE_START,
+    LINE_END
 };
 
-// Structure to represent an action for undo/redo
-struct Action {
-    enum Type {
-        INSERT_CHAR, // single-character (includes '\n' for line-split)
-        DELETE_CHAR, // single-character (includes '\n' for line-merge)
-        INSERT_LINE, // entire line inserted
-        DELETE_LINE, // entire line deleted
-
-        REPLACE
-    };
-    Type type;
-    int line;
-    int pos;
-    std::string text;
-
-    std::vector<ReplaceLine> replaceLines;
-};
+// Keys past ncurses' own (KEY_MAX is 0777) for the sequences a terminal in
+// bracketed paste mode puts around a paste, ESC [200~ and ESC [201~
+const int KEY_PASTE_BEGIN = 01000;
+const int KEY_PASTE_END = 01001;
 
 #endif // TYPES_H
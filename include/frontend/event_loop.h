@@ -0,0 +1,46 @@
+// include/frontend/event_loop.h
+
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <deque>
+#include <string>
+
+class Editor;       // Forward declaration
+class InputHandler; // Forward declaration
+
+// Main loop of the editor. It waits for the first key, then drains every
+// key already waiting with non-blocking reads and dispatches each through
+// InputHandler::handleInput. The screen is drawn once per batch, or once
+// per frame budget while a long batch (a paste) is still being applied.
+//
+// The wait is a getch() with a timeout(): zero while the editor has idle
+// tasks, which run a short slice at a time between reads; a short one while
+// background work is running, so its completions are drained soon after
+// they are posted; and otherwise none at all, blocking until a key comes.
+//
+// A bracketed paste is not read key by key: after its begin marker the
+// loop reads the terminal in large blocks up to the end marker and hands
+// the whole text to InputHandler::handlePaste. Keys read past its end
+// marker are kept and given out before the loop reads the terminal again.
+class EventLoop {
+  public:
+    EventLoop(Editor& editor, InputHandler& input_handler);
+
+    void run();
+
+  private:
+    Editor& editor_ref;
+    InputHandler& input_ref;
+
+    // Bytes that came after the end of a paste
+    std::deque<char> pending;
+
+    // Applies every key that is already waiting
+    void drainInput();
+    void dispatch(int ch);
+    int nextKey();
+    std::string readPaste();
+};
+
+#endif // EVENT_LOOP_H
@@ -0,0 +1,91 @@
+// include/frontend/frame_renderer.h
+
+#ifndef FRAME_RENDERER_H
+#define FRAME_RENDERER_H
+
+#include "backend/buffer.h"
+#include "common/types.h"
+#include "frontend/renderer.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+// Lays out a frame and keeps the model of the last one, for any screen. A
+// subclass only says where the cells go: TerminalRenderer to ncurses,
+// HeadlessRenderer to rows of text in memory. Both then repaint the same
+// rows of a frame and do the same work apart from the output.
+//
+// Color pairs are numbered as TerminalRenderer sets them up: 1 status bar,
+// 2 line number, 3 command, 4 message, 5 file information, 6 active tab,
+// 7 search match and 8 on syntax kinds, 0 for none.
+class FrameRenderer : public Renderer {
+  public:
+    FrameRenderer();
+
+    void render(const Buffer& buffer, const std::vector<std::string>& tab_names,
+                int current_tab, int cursor_x, int cursor_y, int top_line,
+                Mode mode, const std::string& message,
+                const std::string& number_buffer,
+                const std::string& command_line,
+                const Regex* highlight) override;
+
+    int getTextWidth() const override;
+
+    const FrameStats& getLastFrameStats() const override {
+        return last_frame_stats;
+    }
+    void invalidate() override { frame_valid = false; }
+
+  protected:
+    // ===--- Cell sink ---===
+    virtual int getScreenColumns() const = 0;
+    // Blanks the screen for a frame the model knows nothing of. `resized`
+    // if something was shown before at another size or for another buffer.
+    virtual void clearScreen(bool resized) = 0;
+    virtual void clearRow(int y) = 0;
+    // Writes n bytes of text from column x of row y in color `pair`
+    virtual void putText(int y, int x, const char* text, size_t n,
+                         int pair) = 0;
+    // Colors n columns from column x of row y with `pair`
+    virtual void colorCells(int y, int x, int n, int pair) = 0;
+    virtual void placeCursor(int y, int x) = 0;
+    // Shows the frame, adding what that sent to stats.bytes_written
+    virtual void flush(FrameStats& stats) = 0;
+
+  private:
+    // Off-screen model of the last frame. A text row is identified by the
+    // logical line and the byte offset of the segment it shows; it is
+    // repainted only when that changes or the line is damaged.
+    struct RowOrigin {
+        int line;
+        int start;
+        bool operator!=(const RowOrigin& other) const {
+            return line != other.line || start != other.start;
+        }
+    };
+    std::vector<RowOrigin> row_origins;
+    std::vector<std::string> last_tab_names;
+    int last_tab;
+    std::string last_status;
+    const Buffer* last_buffer;
+    int last_lines;
+    int last_cols;
+    bool frame_valid;
+    FrameStats last_frame_stats;
+
+    // Matcher for the highlighted pattern, rebuilt when it changes
+    std::unique_ptr<RegexMatcher> highlight_matcher;
+    std::string highlight_source;
+
+    void setHighlight(const Regex* highlight);
+    std::string shown; // A row as displayed, when that is not its bytes
+    std::vector<SyntaxToken> tokens; // Of the line being painted
+    void putString(int y, int x, const std::string& text, int pair) {
+        putText(y, x, text.data(), text.size(), pair);
+    }
+    void paintTextRow(int screen_y, const std::string& line,
+                      const LineLayout& layout, int line_number, size_t start,
+                      size_t end);
+};
+
+#endif // FRAME_RENDERER_H
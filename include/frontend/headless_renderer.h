@@ -0,0 +1,51 @@
+// include/frontend/headless_renderer.h
+
+#ifndef HEADLESS_RENDERER_H
+#define HEADLESS_RENDERER_H
+
+#include "frontend/frame_renderer.h"
+#include <string>
+#include <vector>
+
+// Draws into memory instead of a terminal, for running the editor without
+// one: replaying keys to measure latency, or checking what a frame shows.
+//
+// The screen has a fixed size. Frames are laid out and repainted by
+// FrameRenderer as on a terminal; each row is kept as the text it shows,
+// and beside it the color pair of each column, 0 for none. The bytes a
+// frame writes are the bytes of text put in rows.
+class HeadlessRenderer : public FrameRenderer {
+  public:
+    HeadlessRenderer(int lines = 24, int cols = 80);
+
+    void initialize() override;
+    void shutdown() override {}
+
+    int getScreenHeight() const override { return lines; }
+
+    // The last frame
+    const std::vector<std::string>& getRows() const { return rows; }
+    const std::vector<std::string>& getColors() const { return colors; }
+    int getCursorRow() const { return cursor_row; }
+    int getCursorColumn() const { return cursor_column; }
+
+  protected:
+    int getScreenColumns() const override { return cols; }
+    void clearScreen(bool resized) override;
+    void clearRow(int y) override;
+    void putText(int y, int x, const char* text, size_t n, int pair) override;
+    void colorCells(int y, int x, int n, int pair) override;
+    void placeCursor(int y, int x) override;
+    void flush(FrameStats& stats) override;
+
+  private:
+    int lines;
+    int cols;
+    std::vector<std::string> rows;
+    std::vector<std::string> colors;
+    int cursor_row;
+    int cursor_column;
+    size_t bytes_written; // Since the last flush
+};
+
+#endif // HEADLESS_RENDERER_H
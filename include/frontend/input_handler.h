@@ -13,14 +13,32 @@ class InputHandler {
     ~InputHandler();
 
     void handleInput(int ch);
+    // What came between KEY_PASTE_BEGIN and KEY_PASTE_END
+    void handlePaste(const std::string& text);
 
   private:
     Editor& editor_ref;
     std::string command_buffer;
+    std::string pending_char; // Bytes so far of a UTF-8 character
+
+    // Operator-pending state: d or y waiting for its motion, with the count
+    // typed before it, and a g waiting for the second g of gg
+    char pending_operator;
+    int operator_count;
+    bool operator_has_count;
+    bool pending_g;
+
+    // A register named with ", for the next operator or put. 0 is none.
+    bool pending_register;
+    char register_name;
+    // An m waiting for the name of the mark
+    bool pending_mark;
 
     void handleNormalMode(int ch);
+    void handleOperatorPending(int ch);
     void handleInsertMode(int ch);
     void handleCommandMode(int ch);
+    void handleSearchMode(int ch);
     int getNumberBufferOrDefaultOne();
 };
 
@@ -6,36 +6,44 @@
 #include "backend/buffer.h"
 #include "common/types.h"
 #include <string>
+#include <vector>
 
+// What the last call to render() did
+struct FrameStats {
+    int rows_painted = 0;
+    size_t bytes_written = 0; // Bytes sent to the terminal
+};
+
+// Where the editor draws. TerminalRenderer draws with ncurses;
+// HeadlessRenderer keeps the screen in memory, so the whole path from a key
+// to a frame runs without a terminal.
 class Renderer {
   public:
-    Renderer();
-    ~Renderer();
-
-    void initialize();
-    void shutdown();
-
-
-    void render(const std::vector<Buffer>& buffers, int current_buffer_index,
-                     int cursor_x, int cursor_y, int top_line, Mode mode,
-                     const std::string& message, const std::string& number_buffer);
-                     
-    void renderTabBar(const std::vector<Buffer>& buffers, int current_buffer_index);
-
-    void displayStatusBar(const std::string& mode, const std::string& filename,
-                          const std::string& message,
-                          const std::string& cmd_buf, const std::string& coor);
-    void displayCommandLine(const std::string& command);
-    void clearCommandLine();
-    int getScreenHeight() const;
-
-    void color_on(int order);
-    void color_off(int order);
-
-    int getCOLS();
-
-  private:
-    bool colors_initialized;
+    virtual ~Renderer() {}
+
+    virtual void initialize() = 0;
+    virtual void shutdown() = 0;
+
+    // Draws `buffer`, with a tab for each name in `tab_names` ("" for a
+    // buffer without a file) of which `current_tab` is the one shown.
+    // Matches of `highlight`, if not null, are shown in the text. In
+    // SEARCH mode command_line starts with its '/' or '?'.
+    virtual void render(const Buffer& buffer,
+                        const std::vector<std::string>& tab_names,
+                        int current_tab, int cursor_x, int cursor_y,
+                        int top_line, Mode mode, const std::string& message,
+                        const std::string& number_buffer,
+                        const std::string& command_line,
+                        const Regex* highlight) = 0;
+
+    // Rows on screen, tab bar and status bar included
+    virtual int getScreenHeight() const = 0;
+    // Columns of text in a row, after the line numbers
+    virtual int getTextWidth() const = 0;
+
+    virtual const FrameStats& getLastFrameStats() const = 0;
+    // Forces the next render to repaint every row
+    virtual void invalidate() = 0;
 };
 
 #endif // RENDERER_H
@@ -0,0 +1,45 @@
+// include/frontend/replay_driver.h
+
+#ifndef REPLAY_DRIVER_H
+#define REPLAY_DRIVER_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+class Editor;       // Forward declaration
+class InputHandler; // Forward declaration
+
+// Feeds a recorded key log to the editor as fast as it is applied, timing
+// each key from InputHandler::handleInput through the frame it leads to.
+// Used with a HeadlessRenderer, it measures the whole path from a key to
+// a frame with nothing but the editor in it.
+//
+// The log is the bytes a terminal sends, one key per byte, so `printf` or
+// a `script` recording makes one. A carriage return is read as a newline,
+// as ncurses reads it, but escape sequences are not decoded into function
+// keys; each of their bytes is a key. A bracketed paste (ESC [200~ ...
+// ESC [201~) is applied whole, as the event loop does, and timed as one
+// key. Between keys the driver does what the
+// event loop would while waiting for the next one: it drains completions
+// and runs a slice of idle work. That time is not counted.
+class ReplayDriver {
+  public:
+    ReplayDriver(Editor& editor, InputHandler& input_handler);
+
+    bool load(const std::string& path);
+
+    // Replays every key, unless one of them quits the editor
+    void run();
+
+    // Keys, p50/p99/max latency and throughput so far
+    void printReport(std::FILE* out) const;
+
+  private:
+    Editor& editor_ref;
+    InputHandler& input_ref;
+    std::string keys;
+    std::vector<double> latencies; // Seconds, one per key replayed
+};
+
+#endif // REPLAY_DRIVER_H
@@ -0,0 +1,43 @@
+// include/frontend/terminal_renderer.h
+
+#ifndef TERMINAL_RENDERER_H
+#define TERMINAL_RENDERER_H
+
+#include "frontend/frame_renderer.h"
+#include <ncurses.h>
+#include <string>
+
+// Draws the editor on the terminal with ncurses
+class TerminalRenderer : public FrameRenderer {
+  public:
+    TerminalRenderer();
+    ~TerminalRenderer() override;
+
+    void initialize() override;
+    void shutdown() override;
+
+    int getScreenHeight() const override;
+
+    void color_on(int order);
+    void color_off(int order);
+
+  protected:
+    int getScreenColumns() const override;
+    void clearScreen(bool resized) override;
+    void clearRow(int y) override;
+    void putText(int y, int x, const char* text, size_t n, int pair) override;
+    void colorCells(int y, int x, int n, int pair) override;
+    void placeCursor(int y, int x) override;
+    void flush(FrameStats& stats) override;
+
+  private:
+    bool colors_initialized;
+
+    // The UI thread's I/O counters (/proc/thread-self/io). ncurses writes
+    // straight to the terminal's file descriptor, so the bytes a frame sends
+    // are measured as the thread's write count across refresh().
+    int io_stats_fd;
+    size_t bytesWrittenByThread() const;
+};
+
+#endif // TERMINAL_RENDERER_H
@@ -1,259 +1,986 @@
 // src/backend/buffer.cpp
 
 #include "backend/buffer.h"
+#include "backend/line_scanner.h"
+#include "backend/mapped_file.h"
+#include "backend/string_search.h"
+#include "common/profiler.h"
 #include "common/types.h"
+#include <algorithm>
 #include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <sys/stat.h>
+
+// Files at least this large are memory-mapped in LoadMode::AUTO
+static const size_t kMapThreshold = 8 << 20;
+
+// Bytes of a mapped file looked at to decide its line ending
+static const size_t kEndingSample = 64 << 10;
+
+// Fewest lines :s hands to one worker
+static const size_t kReplaceChunkLines = 16 << 10;
+
+// Fewest lines :g hands to one worker while marking
+static const size_t kGlobalChunkLines = 64 << 10;
+
+// Most bytes one put adds; a count that would go past it is refused
+static const size_t kMaxPutBytes = 256 << 20;
 
 // Constructor: Initializes the buffer with a single empty line
-Buffer::Buffer() : cursor_x(0), cursor_y(0), top_line(0), filename("") {
-    lines.emplace_back(""); // at least one line
+Buffer::Buffer()
+    : doc(std::make_shared<Document>()), cursor_x(0), cursor_y(0),
+      top_line(0), read_only(false) {}
+
+std::unique_ptr<Buffer> Buffer::newView(bool read_only_view) const {
+    std::unique_ptr<Buffer> view = std::make_unique<Buffer>();
+    view->doc = doc;
+    view->setReadOnly(read_only_view);
+    return view;
+}
+
+// The copy shares every byte of text with the original through the piece
+// table's sources, which are append-only; only the piece tree, the undo
+// tree and the indexes over them are duplicated
+void Buffer::detach() {
+    if (read_only && doc.use_count() > 1) {
+        doc = std::make_shared<Document>(*doc);
+    }
 }
 
 // Loads the buffer content from a file
-bool Buffer::loadFromFile(const std::string& filename) {
-    std::ifstream file(filename);
-    if (!file.is_open()) {
+bool Buffer::loadFromFile(const std::string& filename, LoadMode load_mode) {
+    struct stat st;
+    if (stat(filename.c_str(), &st) != 0) {
         // If the file cannot be opened, return false
         return false;
     }
+    bool large = static_cast<size_t>(st.st_size) >= kMapThreshold;
+    bool mapped = (load_mode == LoadMode::MAPPED ||
+                   (load_mode == LoadMode::AUTO && large)) &&
+                  loadMapped(filename);
+    if (!mapped && !loadEager(filename)) {
+        return false;
+    }
+    // Picks up the history saved with the file, if it still matches
+    doc->undo_file.load(filename, doc->text, doc->history);
+    return true;
+}
+
+// Maps an LF file and leaves its lines to be indexed lazily. Returns false
+// for files whose first block has CRLF endings: stripping the '\r's needs a
+// private copy, which is what loadEager makes.
+bool Buffer::loadMapped(const std::string& fname) {
+    std::shared_ptr<MappedFile> mapped = MappedFile::open(fname);
+    if (!mapped) {
+        return false;
+    }
 
-    lines.clear(); // Clear existing content
-    std::string line;
-    while (std::getline(file, line)) {
-        line.pop_back();
-        lines.emplace_back(line);
+    std::vector<size_t> sample_breaks;
+    LineScanStats sample;
+    scanLines(mapped->data(), std::min(mapped->size(), kEndingSample), 0,
+              '\0', sample_breaks, sample);
+    if (sample.crlf > 0) {
+        return false;
     }
 
-    // Ensure there is at least one line
-    if (lines.empty()) {
-        lines.emplace_back("");
+    // The final newline terminates the last line rather than starting a new
+    // one. Any CRLF further into the file stays in the text byte for byte.
+    size_t length = mapped->size();
+    doc->line_ending = LineEnding::LF;
+    doc->final_newline = length > 0 && mapped->data()[length - 1] == '\n';
+    if (doc->final_newline) {
+        --length;
     }
+    doc->text.loadMapped(std::move(mapped), length);
+    markAllChanged();
+    return true;
+}
 
+// Reads the whole file and indexes it in a single scan
+bool Buffer::loadEager(const std::string& fname) {
+    std::ifstream file(fname, std::ios::binary);
+    if (!file.is_open()) {
+        // If the file cannot be opened, return false
+        return false;
+    }
+    file.seekg(0, std::ios::end);
+    std::string content(static_cast<size_t>(file.tellg()), '\0');
+    file.seekg(0);
+    file.read(&content[0], static_cast<std::streamsize>(content.size()));
     file.close();
+
+    std::vector<size_t> breaks;
+    LineScanStats stats;
+    scanLines(content.data(), content.size(), 0, '\0', breaks, stats);
+    doc->line_ending = detectLineEnding(stats);
+
+    if (doc->line_ending == LineEnding::CRLF) {
+        // Drop the '\r' in front of every '\n'; each break moves left by the
+        // number of '\r's removed before it
+        std::string normalized;
+        normalized.reserve(content.size() - breaks.size());
+        size_t from = 0;
+        for (size_t k = 0; k < breaks.size(); ++k) {
+            normalized.append(content, from, breaks[k] - 1 - from);
+            normalized += '\n';
+            from = breaks[k] + 1;
+            breaks[k] -= k + 1;
+        }
+        normalized.append(content, from, std::string::npos);
+        content.swap(normalized);
+    }
+
+    doc->final_newline = !content.empty() && content.back() == '\n';
+    if (doc->final_newline) {
+        content.pop_back();
+        breaks.pop_back();
+    }
+    doc->text.load(std::move(content), std::move(breaks));
+    markAllChanged();
     return true;
 }
 
+// Also picks the highlighting for the file's language
+void Buffer::setFilename(const std::string& fname) {
+    doc->filename = fname;
+    doc->syntax.setLanguage(detectSyntaxLanguage(fname));
+}
+
 // Saves the buffer content to a file
 bool Buffer::saveToFile(const std::string& fname) {
-    if (filename.empty() && fname.empty()) {
+    if (doc->filename.empty() && fname.empty()) {
         // If no filename is specified, return false
         throw std::runtime_error("No filename specified");
     } else if (!fname.empty()) {
         // If a filename is provided, update the buffer's filename
-        filename = fname;
+        setFilename(fname);
+    }
+
+    // The undofile is keyed to a hash of the text, taken as it is written
+    ContentHash hash;
+    if (!writeText(doc->filename, 0, doc->text.size(), doc->final_newline,
+                   hash)) {
+        return false;
     }
 
-    std::ofstream file(filename);
+    // Nodes on disk must not change, so a save ends the current undo step
+    doc->history.closeGroup();
+    doc->undo_file.save(doc->filename, hash.digest(), doc->text, doc->history);
+    return true;
+}
+
+bool Buffer::writeLines(int first, int last, const std::string& fname) const {
+    first = std::max(first, 0);
+    last = std::min(last, getLineCount() - 1);
+    if (first > last) {
+        return false;
+    }
+    // Every line but the file's last ends in a '\n'
+    bool final_newline = last < getLineCount() - 1 || doc->final_newline;
+    ContentHash hash;
+    return writeText(fname, doc->text.lineStart(first), doc->text.lineEnd(last),
+                     final_newline, hash);
+}
+
+// Bytes [from, to) of the text to `path`, in the file's line ending
+bool Buffer::writeText(const std::string& path, size_t from, size_t to,
+                       bool final_newline, ContentHash& hash) const {
+    // Write next to the target and rename over it: the original may be
+    // memory-mapped, and truncating it in place would pull the text out from
+    // under the pieces that still point into it
+    std::string tmp_name = path + ".vixx-tmp";
+    std::ofstream file(tmp_name, std::ios::binary);
     if (!file.is_open()) {
         // If the file cannot be opened for writing, return false
         return false;
     }
 
-    for (const auto& line : lines) {
-        file << line << "\n";
+    // Lines are stored with '\n' only; CRLF files get their '\r' back here
+    bool crlf = doc->line_ending == LineEnding::CRLF;
+    const PieceTable& text = doc->text;
+    text.forEachSpan(from, to - from, [&file, &hash, crlf](const char* p,
+                                                           size_t n) {
+        hash.update(p, n);
+        const char* end = p + n;
+        while (crlf && p < end) {
+            const char* nl = static_cast<const char*>(
+                std::memchr(p, '\n', static_cast<size_t>(end - p)));
+            if (!nl)
+                break;
+            file.write(p, nl - p);
+            file.write("\r\n", 2);
+            p = nl + 1;
+        }
+        file.write(p, end - p);
+    });
+    if (final_newline) {
+        file << (crlf ? "\r\n" : "\n");
     }
 
     file.close();
+    if (!file) {
+        std::remove(tmp_name.c_str());
+        return false;
+    }
+
+    struct stat st;
+    if (stat(path.c_str(), &st) == 0) {
+        chmod(tmp_name.c_str(), st.st_mode & 07777);
+    }
+    if (std::rename(tmp_name.c_str(), path.c_str()) != 0) {
+        std::remove(tmp_name.c_str());
+        return false;
+    }
     return true;
 }
 
 // Adds a new line at the end of the buffer
 void Buffer::addLine(const std::string& line) {
-    lines.emplace_back(line);
+    detach();
+    doc->text.insert(doc->text.size(), "\n" + line);
+    markLinesChanged(getLineCount() - 1, 0, 1);
 }
 
 // Inserts a new line at a specified index
 void Buffer::insertLine(int index, const std::string& line) {
-    if (index >= 0 && index <= static_cast<int>(lines.size())) {
-        lines.insert(lines.begin() + index, line);
+    detach();
+    int count = getLineCount();
+    if (index >= 0 && index < count) {
+        doc->text.insert(doc->text.lineStart(index), line + "\n");
+        markLinesChanged(index, 0, 1);
+    } else if (index == count) {
+        doc->text.insert(doc->text.size(), "\n" + line);
+        markLinesChanged(index, 0, 1);
     }
 }
 
 // Deletes a line at a specified index
 void Buffer::deleteLine(int index) {
-    if (index >= 0 && index < static_cast<int>(lines.size())) {
-        lines.erase(lines.begin() + index);
-        if (lines.empty()) {
-            // Ensure there is at least one line
-            lines.emplace_back("");
-        }
+    detach();
+    int count = getLineCount();
+    if (index < 0 || index >= count) {
+        return;
+    }
+    if (count == 1) {
+        // Ensure there is at least one line
+        doc->text.erase(0, doc->text.size());
+        markLinesChanged(0, 1, 1);
+    } else if (index < count - 1) {
+        size_t start = doc->text.lineStart(index);
+        doc->text.erase(start, doc->text.lineStart(index + 1) - start);
+        markLinesChanged(index, 1, 0);
+    } else {
+        // The last line takes the newline before it
+        size_t start = doc->text.lineStart(index) - 1;
+        doc->text.erase(start, doc->text.size() - start);
+        markLinesChanged(index, 1, 0);
     }
 }
 
 // Inserts a character into a specific line at a given position
 void Buffer::insertChar(int line, int pos, char c) {
-    if (line < 0 || line >= static_cast<int>(lines.size())) {
+    if (line < 0 || line >= getLineCount()) {
         return; // Invalid line number
     }
-    if (pos < 0 || pos > static_cast<int>(lines[line].size())) {
+    if (pos < 0 || pos > getLineLength(line)) {
         return; // Invalid position
     }
-    lines[line].insert(lines[line].begin() + pos, c);
+    detach();
+    doc->text.insert(offsetOf(line, pos), &c, 1);
+    markLinesChanged(line, 1, 1);
 }
 
 // Deletes a character from a specific line at a given position
 void Buffer::deleteChar(int line, int pos) {
-    if (line < 0 || line >= static_cast<int>(lines.size())) {
+    if (line < 0 || line >= getLineCount()) {
         return; // Invalid line number
     }
-    if (pos < 0 || pos >= static_cast<int>(lines[line].size())) {
+    if (pos < 0 || pos >= getLineLength(line)) {
         return; // Invalid position
     }
-    lines[line].erase(lines[line].begin() + pos);
+    detach();
+    doc->text.erase(offsetOf(line, pos), 1);
+    markLinesChanged(line, 1, 1);
 }
 
 // Splits a line into two at a specified position
 void Buffer::splitLine(int line, int pos) {
-    if (line < 0 || line >= static_cast<int>(lines.size())) {
+    if (line < 0 || line >= getLineCount()) {
         return; // Invalid line number
     }
-    if (pos < 0 || pos > static_cast<int>(lines[line].size())) {
+    if (pos < 0 || pos > getLineLength(line)) {
         return; // Invalid position
     }
 
-    std::string new_line = lines[line].substr(pos); // Text after the split
-    lines[line] = lines[line].substr(0, pos);       // Text before the split
-    lines.insert(lines.begin() + line + 1,
-                 new_line); // Insert the new line below
+    detach();
+    doc->text.insert(offsetOf(line, pos), "\n", 1);
+    markLinesChanged(line, 1, 2);
 }
 
 // Merges the current line with the line below at the specified position
 void Buffer::mergeLines(int line, int pos) {
-    if (line < 0 || line >= static_cast<int>(lines.size()) - 1) {
+    if (line < 0 || line >= getLineCount() - 1) {
         return; // Invalid line number or no line below to merge with
     }
-    if (pos < 0 || pos > static_cast<int>(lines[line].size())) {
+    if (pos < 0 || pos > getLineLength(line)) {
         return; // Invalid position
     }
 
-    std::string next_line = lines[line + 1];
-    lines[line] += next_line; // Append the next line to the current line
-    lines.erase(lines.begin() + line + 1); // Remove the next line
+    detach();
+    // Remove the newline between them
+    doc->text.erase(doc->text.lineEnd(line), 1);
+    markLinesChanged(line, 2, 1);
 }
 
 void Buffer::replaceOneLine(int line, const std::string& old_str, const std::string& new_str) {
-    if (line < 0 || line >= static_cast<int>(lines.size())) {
+    if (line < 0 || line >= getLineCount()) {
         return; // Invalid line number
     }
 
-    size_t pos = lines[line].find(old_str);
-    if (pos != std::string::npos) {
-        lines[line].replace(pos, old_str.length(), new_str);
+    std::string content = getLine(line);
+    size_t pos = SubstringSearcher(old_str).find(content);
+    if (pos != SubstringSearcher::npos) {
+        detach();
+        size_t offset = offsetOf(line, static_cast<int>(pos));
+        doc->text.erase(offset, old_str.length());
+        doc->text.insert(offset, new_str);
+        markLinesChanged(line, 1, 1);
     }
 }
 
 void Buffer::replaceAll(const std::string& old_str, const std::string& new_str) {
-    Action action;
-    action.type = Action::REPLACE;
+    replaceAll(old_str, new_str, ThreadPool::shared());
+}
+
+void Buffer::replaceAll(const std::string& old_str, const std::string& new_str,
+                        ThreadPool& pool) {
+    if (!old_str.empty()) {
+        substitute(Regex::literal(old_str), ReplaceTemplate::literal(new_str),
+                   true, pool);
+    }
+}
+
+SubstituteResult Buffer::substitute(const Regex& pattern,
+                                    const ReplaceTemplate& replacement,
+                                    bool global, int first, int last) {
+    return substitute(pattern, replacement, global, ThreadPool::shared(),
+                      first, last);
+}
+
+SubstituteResult Buffer::substitute(const Regex& pattern,
+                                    const ReplaceTemplate& replacement,
+                                    bool global, ThreadPool& pool, int first,
+                                    int last) {
+    return substituteRange(pattern, replacement, global, pool, first, last,
+                           nullptr);
+}
+
+SubstituteResult Buffer::substituteLines(const Regex& pattern,
+                                         const ReplaceTemplate& replacement,
+                                         bool global,
+                                         const std::vector<int>& lines) {
+    if (lines.empty()) {
+        return SubstituteResult();
+    }
+    return substituteRange(pattern, replacement, global, ThreadPool::shared(),
+                           lines.front(), lines.back(), &lines);
+}
 
-    // 1) For each line, store the old version before we do the replace
-    for (size_t i = 0; i < lines.size(); ++i) {
-        std::string& originalLine = lines[i];
+// The lines are split into chunks that the pool searches and rewrites in
+// parallel. Each worker also captures its chunk's part of the undo record:
+// the pieces it replaces, and the pieces replacing them, with the rewritten
+// lines in a source of its own. The chunks are then applied in line order
+// in one pass over the piece table, and undo as one step.
+SubstituteResult Buffer::substituteRange(const Regex& pattern,
+                                         const ReplaceTemplate& replacement,
+                                         bool global, ThreadPool& pool,
+                                         int first_line, int last_line,
+                                         const std::vector<int>* only) {
+    PROFILE_SCOPE(SUBSTITUTE);
+    SubstituteResult result;
+    if (!pattern.ok()) {
+        return result;
+    }
+    detach();
+    PieceTable& text = doc->text;
+    // Workers only read the table, so it must not be indexed, or have the
+    // original moved into the tree, under them
+    text.materialize();
+    bool captures = replacement.usesGroups();
 
-        if (originalLine.find(old_str) != std::string::npos) {
-            ReplaceLine rl;
-            rl.lineNumber = i;
-            rl.oldLine = originalLine;
-            // We'll fill rc.newLine after the replacement.
+    struct ChunkEdit {
+        std::shared_ptr<TextSource> source; // Null if nothing matched
+        PieceTable::Splice splice;          // Pieces from kPendingSource
+        PieceList removed;                  // refer to `source`
+        SubstituteResult result;
+    };
+    const uint32_t kPendingSource = UINT32_MAX;
 
-            action.replaceLines.push_back(rl);
+    size_t range_begin = static_cast<size_t>(std::max(first_line, 0));
+    size_t range_end = std::min(static_cast<size_t>(last_line) + 1,
+                                text.lineCount());
+    if (last_line < 0 || range_begin >= range_end) {
+        return result;
+    }
+    size_t line_count = range_end - range_begin;
+    size_t chunk_count = std::max<size_t>(
+        1, std::min(pool.concurrency() * 4,
+                    line_count / kReplaceChunkLines));
+    std::vector<ChunkEdit> chunks(chunk_count);
+
+    // Where the lines of `only` start; the rest are not looked at
+    std::vector<size_t> only_starts;
+    if (only) {
+        only_starts.reserve(only->size());
+        for (int line : *only) {
+            only_starts.push_back(text.lineStart(static_cast<size_t>(line)));
         }
     }
 
-    // 2) Perform the actual replacement
-    for (auto& line : lines) {
-        size_t pos = 0;
-        while ((pos = line.find(old_str, pos)) != std::string::npos) {
-            line.replace(pos, old_str.length(), new_str);
-            pos += new_str.length(); // Move past the new substring
+    pool.parallelFor(chunk_count, [&](size_t c) {
+        size_t first = range_begin + line_count * c / chunk_count;
+        size_t last = range_begin + line_count * (c + 1) / chunk_count;
+        // Without the last line's terminator, which would read as one more
+        // empty line
+        size_t begin = text.lineStart(first);
+        std::string chunk = text.read(begin, text.lineEnd(last - 1) - begin);
+        RegexMatcher matcher(pattern);
+        RegexMatch match;
+        ChunkEdit& edit = chunks[c];
+        // The next line at or after `from` that may have a match
+        auto nextLine = [&](size_t from) {
+            if (!only) {
+                return matcher.findLine(chunk.data(), chunk.size(), from);
+            }
+            std::vector<size_t>::const_iterator it = std::lower_bound(
+                only_starts.begin(), only_starts.end(), begin + from);
+            return it != only_starts.end() && *it <= begin + chunk.size()
+                       ? *it - begin
+                       : RegexMatch::npos;
+        };
+
+        // Changed lines: where they are in the chunk, and where their new
+        // text is in `rewritten`
+        struct LineEdit {
+            size_t begin, length, new_begin, new_length;
+        };
+        std::vector<LineEdit> lines;
+        std::string rewritten;
+        for (size_t line_begin = nextLine(0); line_begin != RegexMatch::npos;) {
+            const char* line = chunk.data() + line_begin;
+            const void* newline =
+                std::memchr(line, '\n', chunk.size() - line_begin);
+            size_t length = newline ? static_cast<const char*>(newline) - line
+                                    : chunk.size() - line_begin;
+
+            size_t new_begin = rewritten.size();
+            size_t copied = 0;
+            size_t last_end = RegexMatch::npos;
+            for (size_t from = 0;
+                 from <= length &&
+                 matcher.find(line, length, from, match, captures);) {
+                size_t match_begin = match.begin[0], match_end = match.end[0];
+                if (match_begin == match_end && match_begin == last_end) {
+                    // No empty match right where the last one ended
+                    from = match_begin + 1;
+                    continue;
+                }
+                rewritten.append(line + copied, match_begin - copied);
+                replacement.expand(line, match, rewritten);
+                copied = match_end;
+                last_end = match_end;
+                ++edit.result.substitutions;
+                if (!global) {
+                    break;
+                }
+                from = match_end > match_begin ? match_end : match_end + 1;
+            }
+            if (last_end != RegexMatch::npos) {
+                rewritten.append(line + copied, length - copied);
+                lines.push_back(LineEdit{line_begin, length, new_begin,
+                                         rewritten.size() - new_begin});
+            }
+
+            size_t next = line_begin + length + 1;
+            line_begin =
+                next <= chunk.size() ? nextLine(next) : RegexMatch::npos;
+        }
+        if (lines.empty()) {
+            return;
+        }
+        edit.result.lines = lines.size();
+
+        std::vector<size_t> breaks;
+        LineScanStats stats;
+        scanLines(rewritten.data(), rewritten.size(), 0, '\0', breaks, stats);
+        edit.source =
+            std::make_shared<TextSource>(std::move(rewritten), std::move(breaks));
+        // One splice from the first changed line to the end of the last;
+        // the unchanged lines between them keep their pieces
+        size_t span_begin = begin + lines.front().begin;
+        size_t span_end = begin + lines.back().begin + lines.back().length;
+        edit.splice.offset = span_begin;
+        edit.splice.length = span_end - span_begin;
+        edit.removed = text.collect(span_begin, span_end - span_begin);
+
+        size_t kept = span_begin;
+        for (const LineEdit& line : lines) {
+            PieceList gap = text.collect(kept, begin + line.begin - kept);
+            for (size_t k = 0; k < gap.size(); ++k) {
+                edit.splice.pieces.push_back(gap[k]);
+            }
+            if (line.new_length > 0) {
+                edit.splice.pieces.push_back(Piece{
+                    kPendingSource, line.new_begin, line.new_length,
+                    edit.source->countBreaks(line.new_begin,
+                                             line.new_begin + line.new_length)});
+            }
+            kept = begin + line.begin + line.length;
+        }
+    });
+
+    // Merge in line order. Each chunk becomes one Action, its offset moved
+    // by what the chunks before it added or removed.
+    std::vector<PieceTable::Splice> splices;
+    std::vector<Action> actions;
+    size_t shift_up = 0, shift_down = 0;
+    for (ChunkEdit& edit : chunks) {
+        if (!edit.source) {
+            continue;
+        }
+        result.substitutions += edit.result.substitutions;
+        result.lines += edit.result.lines;
+        uint32_t id = text.addSource(std::move(edit.source));
+        PieceList& pieces = edit.splice.pieces;
+        for (size_t k = 0; k < pieces.size(); ++k) {
+            if (pieces[k].source == kPendingSource) {
+                pieces[k].source = id;
+            }
         }
+        actions.push_back(Action{edit.splice.offset + shift_up - shift_down,
+                                 std::move(edit.removed), pieces});
+        shift_up += pieces.length();
+        shift_down += edit.splice.length;
+        splices.push_back(std::move(edit.splice));
+    }
+    if (splices.empty()) {
+        return result;
     }
 
-    // 3) Now we populate `newLine` in each ReplaceChange from the buffer after
-    //    the replacement
-    for (auto& rl : action.replaceLines) {
-        rl.newLine = lines[rl.lineNumber];
+    text.replaceRanges(splices);
+    doc->history.closeGroup();
+    for (const Action& action : actions) {
+        doc->history.record(action.offset, action.removed, action.inserted,
+                            cursor_y, cursor_x, text);
     }
+    doc->history.closeGroup();
+    markAllChanged();
+    ensureCursorWithinBounds();
+    return result;
+}
 
-    // 4) If something actually changed, we push it to the undo stack
-    //    If no line was changed, action.replaceChanges would be empty
-    if (!action.replaceLines.empty()) {
-        undo_stack.push(action);
+// ===--- Search ---===
+void Buffer::setSearchPattern(const Regex& pattern) {
+    PROFILE_SCOPE(SEARCH);
+    doc->search.build(pattern, doc->text, ThreadPool::shared());
+}
+
+// Chunks of the range are searched in parallel, each worker jumping from
+// one line that may match to the next and walking the lines in between
+// only for :v, which wants them
+std::vector<int> Buffer::matchingLines(const Regex& pattern, int first,
+                                       int last, bool invert) {
+    PROFILE_SCOPE(SEARCH);
+    std::vector<int> lines;
+    if (!pattern.ok()) {
+        return lines;
     }
+    const PieceTable& text = doc->text;
+    // Workers only read the table, so it must not be indexed under them
+    doc->text.indexLines(SIZE_MAX);
+    size_t range_begin = static_cast<size_t>(std::max(first, 0));
+    size_t range_end =
+        std::min(static_cast<size_t>(last) + 1, text.lineCount());
+    if (last < 0 || range_begin >= range_end) {
+        return lines;
+    }
+
+    ThreadPool& pool = ThreadPool::shared();
+    size_t line_count = range_end - range_begin;
+    size_t chunk_count = std::max<size_t>(
+        1, std::min(pool.concurrency() * 4, line_count / kGlobalChunkLines));
+    std::vector<std::vector<int>> marked(chunk_count);
+    pool.parallelFor(chunk_count, [&](size_t c) {
+        size_t line = range_begin + line_count * c / chunk_count;
+        size_t end_line = range_begin + line_count * (c + 1) / chunk_count;
+        size_t begin = text.lineStart(line);
+        std::string chunk =
+            text.read(begin, text.lineEnd(end_line - 1) - begin);
+        auto lineLength = [&chunk](size_t from) {
+            const void* newline =
+                std::memchr(chunk.data() + from, '\n', chunk.size() - from);
+            return newline ? static_cast<size_t>(
+                                 static_cast<const char*>(newline) -
+                                 (chunk.data() + from))
+                           : chunk.size() - from;
+        };
+        RegexMatcher matcher(pattern);
+        RegexMatch match;
+        std::vector<int>& found = marked[c];
+
+        size_t pos = 0; // Where `line` starts in the chunk
+        while (line < end_line) {
+            size_t candidate =
+                matcher.findLine(chunk.data(), chunk.size(), pos);
+            if (candidate == RegexMatch::npos) {
+                candidate = chunk.size() + 1;
+            }
+            for (; pos < candidate && line < end_line; ++line) {
+                if (invert) {
+                    found.push_back(static_cast<int>(line));
+                }
+                pos += lineLength(pos) + 1;
+            }
+            if (line == end_line) {
+                break;
+            }
+            size_t length = lineLength(pos);
+            if (matcher.find(chunk.data() + pos, length, 0, match) != invert) {
+                found.push_back(static_cast<int>(line));
+            }
+            pos += length + 1;
+            ++line;
+        }
+    });
+
+    size_t total = 0;
+    for (const std::vector<int>& found : marked) {
+        total += found.size();
+    }
+    lines.reserve(total);
+    for (const std::vector<int>& found : marked) {
+        lines.insert(lines.end(), found.begin(), found.end());
+    }
+    return lines;
+}
+
+bool Buffer::nextMatch(int line, int column, bool forward,
+                       SearchHit& hit) const {
+    return doc->search.next(static_cast<size_t>(line),
+                            static_cast<size_t>(column), forward, hit);
+}
+
+bool Buffer::findMatch(const Regex& pattern, int line, int column, bool forward,
+                       SearchHit& hit) const {
+    PROFILE_SCOPE(SEARCH);
+    doc->text.indexLines(SIZE_MAX);
+    return SearchIndex::find(pattern, doc->text, static_cast<size_t>(line),
+                             static_cast<size_t>(column), forward, hit);
 }
 
 // Retrieves the content of a specific line
-const std::string& Buffer::getLine(int index) const {
-    static const std::string empty_line = "";
-    if (index >= 0 && index < static_cast<int>(lines.size())) {
-        return lines[index];
+std::string Buffer::getLine(int index) const {
+    if (index >= 0 && index < getLineCount()) {
+        return doc->text.getLine(index);
     }
-    return empty_line;
+    return "";
 }
 
-std::string& Buffer::getLine(int index) {
-    static std::string empty_line = "";
-    if (index >= 0 && index < static_cast<int>(lines.size())) {
-        return lines[index];
+// Returns the length of a specific line without copying it
+int Buffer::getLineLength(int index) const {
+    if (index >= 0 && index < getLineCount()) {
+        return static_cast<int>(doc->text.lineLength(index));
     }
-    return empty_line;
+    return 0;
+}
+
+const LineLayout& Buffer::getLayout(int index) const {
+    return doc->layouts.get(doc->text, static_cast<size_t>(index));
 }
 
 // Returns the total number of lines in the buffer
 int Buffer::getLineCount() const {
-    return static_cast<int>(lines.size());
+    return static_cast<int>(doc->text.lineCount());
 }
 
 // Retrieves all lines in the buffer
-const std::vector<std::string>& Buffer::getLines() const {
-    return lines;
+LineView Buffer::getLines() const {
+    return LineView(doc->text);
+}
+
+// ===--- Syntax Highlighting ---===
+
+void Buffer::prepareHighlight(int first, int last) {
+    if (!doc->syntax.enabled() || first >= last) {
+        return;
+    }
+    size_t changed_first = SIZE_MAX;
+    size_t changed_last = 0;
+    doc->syntax.prepare(doc->text, static_cast<size_t>(std::max(first, 0)),
+                        static_cast<size_t>(last), changed_first,
+                        changed_last);
+    damageLines(changed_first, changed_last, first, last);
+}
+
+bool Buffer::highlightIdle(std::chrono::steady_clock::time_point deadline,
+                           int first, int last) {
+    size_t changed_first = SIZE_MAX;
+    size_t changed_last = 0;
+    doc->syntax.idle(doc->text, deadline, changed_first, changed_last);
+    return damageLines(changed_first, changed_last, first, last);
+}
+
+void Buffer::highlightLine(int index, const std::string& content,
+                           std::vector<SyntaxToken>& tokens) const {
+    doc->syntax.tokens(static_cast<size_t>(index), content, tokens);
+}
+
+// Damages the lines in [first, last] that are also in [visible_first,
+// visible_last); the others are drawn afresh when scrolled to. Returns
+// whether there were any.
+bool Buffer::damageLines(size_t first, size_t last, int visible_first,
+                         int visible_last) {
+    if (first > last || visible_first < 0 || visible_first >= visible_last) {
+        return false;
+    }
+    size_t from = std::max(first, static_cast<size_t>(visible_first));
+    size_t to = std::min(last, static_cast<size_t>(visible_last) - 1);
+    if (from > to) {
+        return false;
+    }
+    Damage& damage = doc->damage;
+    damage.first_line = std::min(damage.first_line, static_cast<int>(from));
+    damage.last_line = std::max(damage.last_line, static_cast<int>(to));
+    return true;
+}
+
+void Buffer::indexThrough(int line) {
+    if (line >= 0) {
+        doc->text.indexLines(static_cast<size_t>(line) + 1);
+    }
+}
+
+bool Buffer::isFullyIndexed() const {
+    return doc->text.indexed();
+}
+
+void Buffer::indexInBackground(std::function<void()> done) const {
+    doc->text.indexInBackground(ThreadPool::shared(), std::move(done));
+}
+
+// Byte offset of (line, pos) in the piece table
+size_t Buffer::offsetOf(int line, int pos) const {
+    return doc->text.lineStart(line) + pos;
+}
+
+// Replaces `length` bytes at `offset` with [s, s + n) and records the change
+// for undo. Edits made in one undo step coalesce in the history.
+void Buffer::edit(size_t offset, size_t length, const char* s, size_t n) {
+    PROFILE_SCOPE(EDIT);
+    detach();
+    int line = static_cast<int>(doc->text.lineAt(offset));
+    int removed_lines =
+        length > 0 ? static_cast<int>(doc->text.lineAt(offset + length)) - line
+                   : 0;
+
+    PieceList removed = doc->text.collect(offset, length);
+    doc->text.erase(offset, length);
+    PieceList inserted;
+    if (n > 0) {
+        inserted.push_back(doc->text.insert(offset, s, n));
+    }
+    doc->history.record(offset, removed, inserted, cursor_y, cursor_x,
+                        doc->text);
+    markLinesChanged(line, removed_lines + 1,
+                     static_cast<int>(inserted.newlines()) + 1);
+}
+
+// Replaces `length` bytes at `offset` with existing pieces and records the
+// change for undo, as edit() does with new text
+void Buffer::editPieces(size_t offset, size_t length,
+                        const PieceList& pieces) {
+    PROFILE_SCOPE(EDIT);
+    detach();
+    int line = static_cast<int>(doc->text.lineAt(offset));
+    int removed_lines =
+        length > 0 ? static_cast<int>(doc->text.lineAt(offset + length)) - line
+                   : 0;
+
+    PieceList removed = doc->text.collect(offset, length);
+    doc->text.erase(offset, length);
+    doc->text.insertPieces(offset, pieces);
+    doc->history.record(offset, removed, pieces, cursor_y, cursor_x,
+                        doc->text);
+    markLinesChanged(line, removed_lines + 1,
+                     static_cast<int>(pieces.newlines()) + 1);
+}
+
+// Replaces `length` bytes at `offset` with existing pieces, for undo/redo
+void Buffer::splice(size_t offset, size_t length, const PieceList& pieces) {
+    PROFILE_SCOPE(EDIT);
+    int line = static_cast<int>(doc->text.lineAt(offset));
+    int removed_lines =
+        length > 0 ? static_cast<int>(doc->text.lineAt(offset + length)) - line
+                   : 0;
+
+    doc->text.erase(offset, length);
+    doc->text.insertPieces(offset, pieces);
+    markLinesChanged(line, removed_lines + 1,
+                     static_cast<int>(pieces.newlines()) + 1);
+}
+
+void Buffer::moveCursorToOffset(size_t offset) {
+    offset = std::min(offset, doc->text.size());
+    size_t line = doc->text.lineAt(offset);
+    cursor_y = static_cast<int>(line);
+    cursor_x = static_cast<int>(offset - doc->text.lineStart(line));
+}
+
+// Lines [first, last] with their '\n', or with the one before them if they
+// end the text, as one edit
+void Buffer::eraseLines(int first, int last) {
+    int count = getLineCount();
+    size_t start = doc->text.lineStart(first);
+    size_t end = last + 1 < count ? doc->text.lineStart(last + 1)
+                                  : doc->text.size();
+    if (last == count - 1 && first > 0) {
+        // The last lines take the newline before them
+        --start;
+    }
+    edit(start, end - start, nullptr, 0);
+}
+
+// Lines, each ending in '\n', put in so the first of them is `line`. They
+// go in at the start of a line with their '\n' after them, except below the
+// last line, which has none: there the '\n' comes first.
+void Buffer::insertLines(int line, SharedText text) {
+    size_t offset;
+    if (line < getLineCount()) {
+        offset = doc->text.lineStart(line);
+    } else {
+        offset = doc->text.size();
+        text.chopNewline();
+        SharedText lines = SharedText::newline();
+        lines.append(text);
+        text = lines;
+    }
+    editPieces(offset, 0, doc->text.adopt(text));
+}
+
+// Records that `removed` lines starting at `line` were replaced by
+// `inserted` lines. A change in line count moves every line after it.
+// The search index looks at those lines again.
+void Buffer::markLinesChanged(int line, int removed, int inserted) {
+    Damage& damage = doc->damage;
+    damage.first_line = std::min(damage.first_line, line);
+    if (removed != inserted) {
+        damage.shifted = true;
+    } else {
+        damage.last_line = std::max(damage.last_line, line + inserted - 1);
+    }
+    if (doc->search.active()) {
+        doc->search.linesChanged(doc->text, static_cast<size_t>(line),
+                                 static_cast<size_t>(removed),
+                                 static_cast<size_t>(inserted));
+    }
+    doc->rows.linesChanged(doc->text, static_cast<size_t>(line),
+                           static_cast<size_t>(removed),
+                           static_cast<size_t>(inserted));
+    doc->layouts.linesChanged(static_cast<size_t>(line),
+                              static_cast<size_t>(removed),
+                              static_cast<size_t>(inserted));
+    doc->syntax.linesChanged(static_cast<size_t>(line),
+                             static_cast<size_t>(removed),
+                             static_cast<size_t>(inserted));
+
+    // Marks below the change move with it. Where it leaves fewer lines
+    // than it spanned, the last one's end is kept as the last line now
+    // there, and marks on the lines in between go.
+    for (std::map<char, int>::iterator it = doc->marks.begin();
+         it != doc->marks.end();) {
+        int offset = it->second - line;
+        if (offset >= removed) {
+            it->second += inserted - removed;
+        } else if (offset >= inserted) {
+            if (offset != removed - 1 || inserted == 0) {
+                it = doc->marks.erase(it);
+                continue;
+            }
+            it->second = line + inserted - 1;
+        }
+        ++it;
+    }
+}
+
+void Buffer::markAllChanged() {
+    doc->damage.first_line = 0;
+    doc->damage.shifted = true;
+    if (doc->search.active()) {
+        doc->search.rebuild(doc->text, ThreadPool::shared());
+    }
+    doc->rows.invalidate();
+    doc->layouts.clear();
+    doc->syntax.clear();
 }
 
 // ===--- Cursor Movement ---===
+// Left and right step whole characters. Up and down keep the display
+// column, landing on the character that covers it.
 void Buffer::moveCursorLeft(int t) {
-    cursor_x -= t;
-    int min = 0;
-    if (cursor_x < min)
-        cursor_x = min;
+    const LineLayout& layout = getLayout(cursor_y);
+    size_t x = static_cast<size_t>(cursor_x);
+    for (int i = 0; i < t && x > 0; ++i) {
+        x = layout.prevChar(x);
+    }
+    cursor_x = static_cast<int>(x);
 }
 void Buffer::moveCursorRight(int t) {
-    cursor_x += t;
-    int max = static_cast<int>(getLine(cursor_y).size());
-    if (cursor_x > max)
-        cursor_x = max;
+    const LineLayout& layout = getLayout(cursor_y);
+    size_t x = static_cast<size_t>(cursor_x);
+    for (int i = 0; i < t && x < layout.length(); ++i) {
+        x = layout.nextChar(x);
+    }
+    cursor_x = static_cast<int>(x);
 }
 void Buffer::moveCursorUp(int t) {
+    size_t column = getLayout(cursor_y).columnOf(cursor_x);
     cursor_y -= t;
     int min = 0;
     if (cursor_y < min)
         cursor_y = min;
-    if (cursor_x > static_cast<int>(getLine(cursor_y).size()))
-        cursor_x = getLine(cursor_y).size();
+    cursor_x = static_cast<int>(getLayout(cursor_y).offsetAtColumn(column));
 }
 void Buffer::moveCursorDown(int t) {
+    size_t column = getLayout(cursor_y).columnOf(cursor_x);
+    indexThrough(cursor_y + t);
     cursor_y += t;
     int max = getLineCount() - 1;
     if (cursor_y > max)
         cursor_y = max;
-    if (cursor_x > static_cast<int>(getLine(cursor_y).size()))
-        cursor_x = getLine(cursor_y).size();
+    cursor_x = static_cast<int>(getLayout(cursor_y).offsetAtColumn(column));
 }
 void Buffer::jumpToLineStart() {
     cursor_x = 0;
 }
 void Buffer::jumpToLineEnd() {
-    cursor_x = getLine(cursor_y).size();
+    cursor_x = getLineLength(cursor_y);
 }
 void Buffer::goToFirstLine() {
     cursor_y = 0;
     cursor_x = 0;
 }
 void Buffer::goToLastLine() {
+    doc->text.indexLines(SIZE_MAX);
     cursor_y = getLineCount() - 1;
     cursor_x = 0;
 }
 void Buffer::jumpToLine(int target_line) {
+    indexThrough(target_line);
     if (target_line < 0)
         target_line = 0;
     else if (target_line >= getLineCount())
@@ -261,90 +988,224 @@ void Buffer::jumpToLine(int target_line) {
     cursor_y = target_line;
     cursor_x = 0;
 }
-void Buffer::deleteCurrentLine() {
-    // Create an Action for undo
-    std::string removed_line = getLine(cursor_y);
-    Action action;
-    action.type = Action::DELETE_LINE;
-    action.line = cursor_y;
-    action.pos = 0;             // for a full line delete, pos = 0
-    action.text = removed_line; // store the entire line
-    undo_stack.push(action);
+int Buffer::paragraphBoundary(int line, int count, bool forward) const {
+    int step = forward ? 1 : -1;
+    int end = forward ? getLineCount() - 1 : 0;
+    for (int i = 0; i < count && line != end; ++i) {
+        line += step;
+        while (line != end && getLineLength(line) == 0) {
+            line += step;
+        }
+        while (line != end && getLineLength(line) != 0) {
+            line += step;
+        }
+    }
+    return line;
+}
 
-    deleteLine(cursor_y);
+SharedText Buffer::copyLines(int first, int last) const {
+    size_t start = doc->text.lineStart(first);
+    if (last + 1 < getLineCount()) {
+        return doc->text.share(start, doc->text.lineStart(last + 1) - start);
+    }
+    // The last line has no '\n' of its own in the document
+    SharedText text = doc->text.share(start, doc->text.size() - start);
+    text.append(SharedText::newline());
+    return text;
+}
 
-    // If we end up past the last line, adjust cursor
-    if (cursor_y >= getLineCount()) {
-        cursor_y = getLineCount() - 1;
+SharedText Buffer::copyText(int line, int from, int to) const {
+    return doc->text.share(offsetOf(line, from), to - from);
+}
+
+void Buffer::deleteLines(int first, int last) {
+    first = std::max(first, 0);
+    last = std::min(last, getLineCount() - 1);
+    if (first > last) {
+        return;
+    }
+    doc->history.closeGroup();
+    eraseLines(first, last);
+    doc->history.closeGroup();
+
+    // The line after the deleted ones, or the last line if there is none
+    cursor_y = std::min(first, getLineCount() - 1);
+    cursor_x = 0;
+}
+
+// Each run of adjacent lines is one splice, and the splices are applied in
+// one pass over the piece table: the cost follows the size of the text, not
+// the number of lines times it as deleting them one by one would
+void Buffer::deleteLineSet(const std::vector<int>& lines) {
+    if (lines.empty()) {
+        return;
+    }
+    PROFILE_SCOPE(EDIT);
+    detach();
+    PieceTable& text = doc->text;
+    int count = getLineCount();
+
+    std::vector<PieceTable::Splice> splices;
+    std::vector<Action> actions;
+    size_t removed = 0;
+    for (size_t i = 0; i < lines.size();) {
+        size_t j = i + 1;
+        while (j < lines.size() && lines[j] == lines[j - 1] + 1) {
+            ++j;
+        }
+        int first = lines[i];
+        int last = lines[j - 1];
+        size_t start = text.lineStart(first);
+        size_t end = last + 1 < count ? text.lineStart(last + 1) : text.size();
+        if (last == count - 1 && first > 0) {
+            // The last lines take the newline before them
+            --start;
+        }
+        splices.push_back(PieceTable::Splice{start, end - start, PieceList()});
+        // Undo offsets are after the runs before this one are gone
+        actions.push_back(Action{
+            start - removed, text.collect(start, end - start), PieceList()});
+        removed += end - start;
+        i = j;
     }
 
-    cursor_x = 0; // Move cursor to the beginning of the line
+    text.replaceRanges(splices);
+    doc->history.closeGroup();
+    for (const Action& action : actions) {
+        doc->history.record(action.offset, action.removed, action.inserted,
+                            cursor_y, cursor_x, text);
+    }
+    doc->history.closeGroup();
+
+    // Marks on deleted lines go; the rest move up past those above them
+    for (std::map<char, int>::iterator it = doc->marks.begin();
+         it != doc->marks.end();) {
+        std::vector<int>::const_iterator above =
+            std::lower_bound(lines.begin(), lines.end(), it->second);
+        if (above != lines.end() && *above == it->second) {
+            it = doc->marks.erase(it);
+            continue;
+        }
+        it->second -= static_cast<int>(above - lines.begin());
+        ++it;
+    }
+    markAllChanged();
+
+    // Where the last of them was
+    cursor_y = std::min(lines.back() - static_cast<int>(lines.size()) + 1,
+                        getLineCount() - 1);
+    cursor_x = 0;
 }
-// void Buffer::copyCurrentLine();
 
-void Buffer::pasteContent(std::string& copied_line, int t) {
-    if (copied_line.empty())
+void Buffer::deleteText(int line, int from, int to) {
+    if (from >= to) {
         return;
+    }
+    doc->history.closeGroup();
+    edit(offsetOf(line, from), to - from, nullptr, 0);
+    doc->history.closeGroup();
+    cursor_y = line;
+    cursor_x = from;
+    ensureCursorWithinBounds();
+}
 
-    for (int i = 0; i < t; i++) {
-        // Insert new line after the current line
-        int insert_index = cursor_y + 1;
-        insertLine(insert_index, copied_line);
-
-        // Record action
-        Action action;
-        action.type = Action::INSERT_LINE;
-        action.line = insert_index;
-        action.pos = 0;
-        action.text = copied_line;
-        undo_stack.push(action);
-
-        // Move the cursor downward to the newly inserted line
-        cursor_y = insert_index;
+bool Buffer::put(const SharedText& text, bool linewise, int t, bool before) {
+    if (text.empty() || t <= 0) {
+        return true;
+    }
+    if (text.length() > kMaxPutBytes / static_cast<size_t>(t)) {
+        return false;
+    }
+    detach();
+    SharedText all = text.repeat(static_cast<size_t>(t));
+
+    if (linewise) {
+        int line = before ? cursor_y : cursor_y + 1;
+        doc->history.closeGroup();
+        insertLines(line, all);
+        doc->history.closeGroup();
+        // On the first line put in
+        cursor_y = line;
         cursor_x = 0;
+    } else {
+        int column = cursor_x;
+        if (!before && cursor_x < getLineLength(cursor_y)) {
+            column = static_cast<int>(getLayout(cursor_y).nextChar(cursor_x));
+        }
+        size_t offset = offsetOf(cursor_y, column);
+        doc->history.closeGroup();
+        editPieces(offset, 0, doc->text.adopt(all));
+        doc->history.closeGroup();
+        // On the last character put in
+        moveCursorToOffset(offset + all.length());
+        if (cursor_x > 0) {
+            cursor_x = static_cast<int>(getLayout(cursor_y).prevChar(cursor_x));
+        }
+    }
+    return true;
+}
+
+// Taking the lines out first when they go above themselves, and last when
+// they go below, leaves `dest` where it was for the insert
+void Buffer::moveLines(int first, int last, int dest) {
+    first = std::max(first, 0);
+    last = std::min(last, getLineCount() - 1);
+    if (first > last || (dest >= first - 1 && dest <= last)) {
+        return;
     }
+    detach();
+    SharedText lines = copyLines(first, last);
+    doc->history.closeGroup();
+    if (dest > last) {
+        insertLines(dest + 1, lines);
+        eraseLines(first, last);
+        cursor_y = dest;
+    } else {
+        eraseLines(first, last);
+        insertLines(dest + 1, lines);
+        cursor_y = dest + last - first + 1;
+    }
+    doc->history.closeGroup();
+    cursor_x = 0;
 }
 
-// ===--- Insert Mode Operations ---===
-void Buffer::insertCharacter(char c) {
-    insertChar(cursor_y, cursor_x, c);
-    // Record action for undo
-    Action action;
-    action.type = Action::INSERT_CHAR;
-    action.line = cursor_y;
-    action.pos = cursor_x;
-    action.text = std::string(1, c);
-    undo_stack.push(action);
+void Buffer::duplicateLines(int first, int last, int dest) {
+    first = std::max(first, 0);
+    last = std::min(last, getLineCount() - 1);
+    if (first > last) {
+        return;
+    }
+    detach();
+    doc->history.closeGroup();
+    insertLines(dest + 1, copyLines(first, last));
+    doc->history.closeGroup();
+    cursor_y = dest + last - first + 1;
+    cursor_x = 0;
+}
 
+int Buffer::getMark(char name) const {
+    std::map<char, int>::const_iterator it = doc->marks.find(name);
+    return it != doc->marks.end() ? it->second : -1;
+}
+
+// ===--- Insert Mode Operations ---===
+void Buffer::insertCharacter(const std::string& c) {
+    edit(offsetOf(cursor_y, cursor_x), 0, c.data(), c.size());
     // Update cursor position
-    cursor_x++;
+    cursor_x += static_cast<int>(c.size());
 }
 
 void Buffer::handleBackspace() {
     if (cursor_x > 0) {
-        char deleted_char = getLine(cursor_y)[cursor_x - 1];
-        deleteChar(cursor_y, cursor_x - 1);
-        // Record action for undo
-        Action action;
-        action.type = Action::DELETE_CHAR;
-        action.line = cursor_y;
-        action.pos = cursor_x - 1;
-        action.text = std::string(1, deleted_char);
-        undo_stack.push(action);
+        // The whole character before the cursor, marks and all
+        int prev = static_cast<int>(getLayout(cursor_y).prevChar(cursor_x));
+        edit(offsetOf(cursor_y, prev), cursor_x - prev, nullptr, 0);
         // Update cursor position
-        cursor_x--;
+        cursor_x = prev;
     } else if (cursor_y > 0) {
-        // Merge with previous line
-        int prev_line_length = getLine(cursor_y - 1).size();
-        std::string current_line = getLine(cursor_y);
-        mergeLines(cursor_y - 1, prev_line_length);
-        // Record action for undo (line merge)
-        Action action;
-        action.type = Action::DELETE_CHAR;
-        action.line = cursor_y - 1;
-        action.pos = prev_line_length;
-        action.text = "\n"; // Representing line merge
-        undo_stack.push(action);
+        // Merge with previous line by removing the newline between them
+        int prev_line_length = getLineLength(cursor_y - 1);
+        edit(doc->text.lineEnd(cursor_y - 1), 1, nullptr, 0);
         // Update cursor position
         cursor_y--;
         cursor_x = prev_line_length;
@@ -352,175 +1213,107 @@ void Buffer::handleBackspace() {
 }
 
 void Buffer::handleEnter() {
-    splitLine(cursor_y, cursor_x);
-    // Record action for undo (line split)
-    Action action;
-    action.type = Action::INSERT_CHAR;
-    action.line = cursor_y;
-    action.pos = cursor_x;
-    action.text = "\n"; // Representing line split
-    undo_stack.push(action);
+    edit(offsetOf(cursor_y, cursor_x), 0, "\n", 1);
     // Move to the new line
     cursor_y++;
     cursor_x = 0;
 }
 
-// ===--- Undo/Redo Operations ---===
-void Buffer::undo() {
-    if (undo_stack.empty())
+void Buffer::insertText(const std::string& text) {
+    if (text.empty()) {
         return;
-    Action action = undo_stack.top();
-    undo_stack.pop();
-
-    switch (action.type) {
-    case Action::INSERT_CHAR:
-        if (action.text == "\n") {
-            // We inserted a newline => we splitted a line.
-            // Undo means we do the opposite: merge lines.
-            mergeLines(action.line, action.pos);
-
-            // Position the cursor so it makes sense after the merge.
-            cursor_y = action.line;
-            cursor_x = action.pos;
-        } else {
-            // We inserted a character => undo means we delete it.
-            deleteChar(action.line, action.pos);
-
-            // Position the cursor so it makes sense after the deletion.
-            cursor_y = action.line;
-            cursor_x = action.pos;
-        }
-        break;
-
-    case Action::DELETE_CHAR:
-        if (action.text == "\n") {
-            // We removed a newline => line merge
-            // The opposite is to split them again
-            splitLine(action.line, action.pos);
-            // Usually go to the new line
-            cursor_y = action.line + 1;
-            cursor_x = 0;
-        } else {
-            // We removed 1 normal char
-            insertChar(action.line, action.pos, action.text[0]);
-            cursor_y = action.line;
-            cursor_x = action.pos + 1;
-        }
-        break;
-
-    case Action::INSERT_LINE:
-        // The opposite is to remove that line
-        deleteLine(action.line);
-        // Cursor might go to that line if it still exists
-        if (action.line >= getLineCount()) {
-            cursor_y = getLineCount() - 1;
-        } else {
-            cursor_y = action.line;
-        }
-        cursor_x = 0;
-        break;
-
-    case Action::DELETE_LINE:
-        // The opposite is to re-insert that line
-        insertLine(action.line, action.text);
-        cursor_y = action.line;
-        cursor_x = 0;
-        break;
-
-    case Action::REPLACE:
-        for (auto& rl : action.replaceLines) {
-            lines[rl.lineNumber] = rl.oldLine;
-        }
-        break;
     }
+    size_t offset = offsetOf(cursor_y, cursor_x);
+    doc->history.closeGroup();
+    edit(offset, 0, text.data(), text.size());
+    doc->history.closeGroup();
+    moveCursorToOffset(offset + text.size());
+}
 
-    // Push the inverse action to redo stack
-    redo_stack.push(action);
+// ===--- Undo/Redo Operations ---===
+void Buffer::undo() {
+    detach();
+    const UndoGroup* group = doc->history.undo();
+    if (group)
+        applyUndoGroup(*group, false);
 }
 
 void Buffer::redo() {
-    if (redo_stack.empty())
-        return;
-    Action action = redo_stack.top();
-    redo_stack.pop();
-
-    switch (action.type) {
-    case Action::INSERT_CHAR:
-        if (action.text == "\n") {
-            // Re-split lines
-            splitLine(action.line, action.pos);
-            cursor_y = action.line + 1;
-            cursor_x = 0;
-        } else {
-            insertChar(action.line, action.pos, action.text[0]);
-            cursor_y = action.line;
-            cursor_x = action.pos + 1;
-        }
-        break;
-
-    case Action::DELETE_CHAR:
-        if (action.text == "\n") {
-            // Re-merge lines
-            mergeLines(action.line, action.pos);
-            cursor_y = action.line;
-            cursor_x = action.pos;
-        } else {
-            deleteChar(action.line, action.pos);
-            cursor_y = action.line;
-            cursor_x = action.pos;
-        }
-        break;
-
-    case Action::INSERT_LINE:
-        // Re-insert line
-        insertLine(action.line, action.text);
-        cursor_y = action.line;
-        cursor_x = 0;
-        break;
+    detach();
+    const UndoGroup* group = doc->history.redo();
+    if (group)
+        applyUndoGroup(*group, true);
+}
 
-    case Action::DELETE_LINE:
-        // Re-delete line
-        deleteLine(action.line);
-        if (cursor_y >= getLineCount()) {
-            cursor_y = getLineCount() - 1;
-        }
-        cursor_x = 0;
-        break;
+void Buffer::timeTravel(long count, bool seconds) {
+    detach();
+    size_t target = seconds ? doc->history.seqByTime(count)
+                            : doc->history.seqByCount(count);
+    for (const UndoStep& step : doc->history.travelTo(target)) {
+        applyUndoGroup(*step.group, step.forward);
+    }
+}
 
-    case Action::REPLACE:
-        for (auto& rl : action.replaceLines) {
-            lines[rl.lineNumber] = rl.newLine;
+// Undo reverts a group newest change first and puts the cursor back where
+// it was before the group began. Redo reapplies it oldest change first and
+// leaves the cursor at the start of the first change.
+void Buffer::applyUndoGroup(const UndoGroup& group, bool forward) {
+    PROFILE_SCOPE(UNDO);
+    if (!forward) {
+        for (auto it = group.actions.rbegin(); it != group.actions.rend();
+             ++it) {
+            splice(it->offset, it->inserted.length(), it->removed);
         }
-        break;
+        cursor_y = group.cursor_y;
+        cursor_x = group.cursor_x;
+        ensureCursorWithinBounds();
+        return;
     }
 
-    // Move action to undo stack
-    undo_stack.push(action);
+    for (const Action& action : group.actions) {
+        splice(action.offset, action.removed.length(), action.inserted);
+    }
+    const Action& first = group.actions.front();
+    moveCursorToOffset(first.offset);
+    if (first.removed.empty() && !first.inserted.empty() &&
+        doc->text.at(first.offset) == '\n') {
+        // A pasted line starts with its newline; land on the line itself
+        moveCursorToOffset(first.offset + 1);
+    }
 }
 
-int Buffer::calculateTopLine(int bottomLine, int COLS, int screen_lines) {
-    int topLine = bottomLine;
-    int occupy = (lines[topLine].size() / COLS) + 1;
-    while (occupy <= screen_lines) {
-        occupy += (lines[--topLine].size() / COLS) + 1;
+int Buffer::getRowsBetween(int first, int last, int width) const {
+    first = std::max(first, 0);
+    if (last <= first) {
+        return 0;
     }
-    return ++topLine;
+    return static_cast<int>(doc->rows.rowsBetween(
+        doc->text, static_cast<size_t>(std::max(width, 1)),
+        static_cast<size_t>(first), static_cast<size_t>(last)));
+}
+
+int Buffer::calculateTopLine(int bottomLine, int width, int screen_lines) const {
+    bottomLine = std::max(0, std::min(bottomLine, getLineCount() - 1));
+    return static_cast<int>(doc->rows.firstLineFitting(
+        doc->text, static_cast<size_t>(std::max(width, 1)),
+        static_cast<size_t>(bottomLine),
+        static_cast<size_t>(std::max(screen_lines, 1))));
 }
 
 void Buffer::ensureCursorWithinBounds() {
     // Ensure cursor_y is within [0, lines.size() - 1]
     if (cursor_y < 0)
         cursor_y = 0;
-    if (cursor_y >= static_cast<int>(lines.size())) {
-        cursor_y = static_cast<int>(lines.size()) - 1;
+    if (cursor_y >= getLineCount()) {
+        cursor_y = getLineCount() - 1;
     }
 
     // Ensure cursor_x is within [0, line_length]
-    int line_len = (cursor_y >= 0 && cursor_y < (int)lines.size())
-                       ? lines[cursor_y].size()
-                       : 0;
+    int line_len = getLineLength(cursor_y);
     if (cursor_x < 0)
         cursor_x = 0;
     if (cursor_x > line_len)
         cursor_x = line_len;
+    // ...and on the first byte of a character
+    cursor_x = static_cast<int>(getLayout(cursor_y).charStart(cursor_x));
 }
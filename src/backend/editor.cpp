@@ -1,16 +1,25 @@
 // src/backend/editor.cpp
 
 #include "backend/editor.h"
+#include "common/profiler.h"
 #include "common/utils.h"
 #include "frontend/input_handler.h"
-#include "frontend/renderer.h"
+#include "frontend/terminal_renderer.h"
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cstring>
 #include <stdexcept>
 #include <string>
 
 // Constructor
-Editor::Editor()
+Editor::Editor(std::unique_ptr<Renderer> renderer)
     : mode(Mode::NORMAL), message(""), number_buffer(""),
-      current_buffer_index(0), renderer(nullptr) {
+      current_buffer_index(0), undo_limit(UndoTree::kDefaultLimit),
+      render_pending(false), search_forward(true), search_typed_forward(true),
+      search_preview_pending(false), search_origin_x(0), search_origin_y(0),
+      search_origin_top(0), background_jobs(0), highlight_scheduled(false),
+      renderer(std::move(renderer)) {
     initialize();
 }
 
@@ -21,7 +30,9 @@ Editor::~Editor() {
 
 // Initialize the editor (including the renderer)
 void Editor::initialize() {
-    renderer = new Renderer();
+    if (!renderer) {
+        renderer.reset(new TerminalRenderer());
+    }
     renderer->initialize();
     // Initialize buffer with at least one empty line
     // buffer.addLine("");
@@ -31,13 +42,25 @@ void Editor::initialize() {
 void Editor::shutdown() {
     if (renderer) {
         renderer->shutdown();
-        delete renderer;
-        renderer = nullptr;
+        renderer.reset();
+    }
+}
+
+void Editor::setQuitHandler(std::function<void()> handler) {
+    quit_handler = std::move(handler);
+}
+
+void Editor::quit() {
+    shutdown();
+    if (quit_handler) {
+        quit_handler();
     }
+    exit(0);
 }
 
 // Adjust top_line for scrolling
 void Editor::adjustScrolling() {
+    PROFILE_SCOPE(SCROLL);
     int screen_lines = renderer->getScreenHeight() - 2; // Adjust for tab bar
 
     if (currentBuffer().getCursorY() < currentBuffer().getTopLine()) {
@@ -46,7 +69,7 @@ void Editor::adjustScrolling() {
     } else {
         // Scroll down
         int new_top = currentBuffer().calculateTopLine(
-            currentBuffer().getCursorY(), renderer->getCOLS(), screen_lines);
+            currentBuffer().getCursorY(), renderer->getTextWidth(), screen_lines);
         if (new_top > currentBuffer().getTopLine()) {
             currentBuffer().setTopLine(new_top);
         }
@@ -54,11 +77,109 @@ void Editor::adjustScrolling() {
 }
 
 void Editor::refresh_render() {
+    render_pending = true;
+}
+
+void Editor::flushRender() {
+    if (!render_pending) {
+        return;
+    }
+    render_pending = false;
+    PROFILE_SCOPE(FRAME);
+    if (search_preview_pending) {
+        previewSearch();
+    }
+
+    // Lazily loaded files only need the visible window indexed
+    int top = currentBuffer().getTopLine();
+    int bottom = top + renderer->getScreenHeight();
+    {
+        PROFILE_SCOPE(INDEX);
+        currentBuffer().indexThrough(bottom);
+    }
+    // Only the lines on screen are lexed now; the rest waits for idle time
+    {
+        PROFILE_SCOPE(HIGHLIGHT);
+        currentBuffer().prepareHighlight(top, bottom);
+    }
     // Render all buffers to include tab bar
-    renderer->render(buffers, current_buffer_index,
-                    currentBuffer().getCursorX(), currentBuffer().getCursorY(),
-                    currentBuffer().getTopLine(),
-                    mode, message, number_buffer);
+    {
+        PROFILE_SCOPE(RENDER);
+        renderer->render(currentBuffer(), tab_names, current_buffer_index,
+                         currentBuffer().getCursorX(),
+                         currentBuffer().getCursorY(),
+                         currentBuffer().getTopLine(), mode, message,
+                         number_buffer, command_line, highlight.get());
+    }
+    PROFILE_COUNT(ROWS_PAINTED, renderer->getLastFrameStats().rows_painted);
+    PROFILE_COUNT(BYTES_WRITTEN, renderer->getLastFrameStats().bytes_written);
+    currentBuffer().clearDamage();
+    // Edits and scrolling leave lines to lex
+    scheduleHighlight();
+}
+
+// ===--- Background and Idle Work ---===
+
+std::function<void()> Editor::startBackgroundJob(std::function<void()> done) {
+    ++background_jobs;
+    return [this, done] {
+        completions.post([this, done] {
+            --background_jobs;
+            if (done) {
+                done();
+            }
+        });
+    };
+}
+
+void Editor::runInBackground(std::function<void()> work,
+                             std::function<void()> done) {
+    std::function<void()> finish = startBackgroundJob(std::move(done));
+    ThreadPool::shared().submit([work, finish] {
+        work();
+        finish();
+    });
+}
+
+void Editor::drainCompletions() {
+    PROFILE_SCOPE(COMPLETIONS);
+    completions.drain();
+}
+
+void Editor::postIdleTask(IdleScheduler::Task task) {
+    idle_tasks.post(std::move(task));
+}
+
+bool Editor::hasIdleWork() const {
+    return !idle_tasks.empty();
+}
+
+void Editor::runIdleWork(IdleScheduler::Clock::time_point deadline) {
+    PROFILE_SCOPE(IDLE);
+    idle_tasks.run(deadline);
+}
+
+// Lexes the current buffer past the screen while idle, drawing again when
+// that recolors what is shown. One task at a time; it goes on for as long
+// as there is lexing to do, for whichever buffer is current.
+void Editor::scheduleHighlight() {
+    if (highlight_scheduled || buffers.empty() ||
+        !currentBuffer().hasHighlightWork()) {
+        return;
+    }
+    highlight_scheduled = true;
+    postIdleTask([this](IdleScheduler::Clock::time_point deadline) {
+        if (!buffers.empty()) {
+            Buffer& buf = currentBuffer();
+            int top = buf.getTopLine();
+            int bottom = top + renderer->getScreenHeight();
+            if (buf.highlightIdle(deadline, top, bottom)) {
+                refresh_render();
+            }
+        }
+        highlight_scheduled = !buffers.empty() && currentBuffer().hasHighlightWork();
+        return highlight_scheduled;
+    });
 }
 
 void Editor::clear_message() {
@@ -71,21 +192,40 @@ Mode Editor::getMode() const {
 }
 
 void Editor::switchMode(Mode new_mode) {
+    // An insert-mode session is undone as one step
+    currentBuffer().closeUndoGroup();
     mode = new_mode;
-    if (mode != Mode::COMMAND) {
-        renderer->clearCommandLine();
-    }
+    command_line.clear();
     refresh_render();
 }
 
 // Create a new buffer, or load existing file
-void Editor::openFile(const std::string& fname) {
-    Buffer buf;
+void Editor::openFile(const std::string& fname, bool read_only) {
+    // A file that is already open gets another view of the same document
+    for (const std::unique_ptr<Buffer>& open : buffers) {
+        if (open->getFilename() == fname && !fname.empty()) {
+            buffers.push_back(open->newView(read_only));
+            tab_names.push_back(fname);
+            current_buffer_index = (int)buffers.size() - 1;
+            refresh_render();
+            return;
+        }
+    }
+
+    std::unique_ptr<Buffer> buf = std::make_unique<Buffer>();
+    buf->setReadOnly(read_only);
+    buf->setUndoLimit(undo_limit);
     if (!fname.empty()) {
-        buf.setFilename(fname);
-        buf.loadFromFile(fname);
+        buf->setFilename(fname);
+        buf->loadFromFile(fname);
     }
-    buffers.push_back(buf);
+    // A mapped file is indexed off the input path; the line count in the
+    // status bar is final once it is done
+    if (!buf->isFullyIndexed()) {
+        buf->indexInBackground(startBackgroundJob([this] { refresh_render(); }));
+    }
+    buffers.push_back(std::move(buf));
+    tab_names.push_back(fname);
     current_buffer_index = (int)buffers.size() - 1;
     refresh_render();
 }
@@ -94,6 +234,8 @@ void Editor::openFile(const std::string& fname) {
 void Editor::switchBuffer(int index) {
     if (index >= 0 && index < (int)buffers.size()) {
         current_buffer_index = index;
+        // Another view of the document may have shortened it meanwhile
+        currentBuffer().ensureCursorWithinBounds();
         refresh_render();
     } else {
         message = "Invalid buffer number";
@@ -115,6 +257,7 @@ void Editor::closeBuffer(int index) {
     // For simplicity, we'll assume buffers are saved or handle it elsewhere
 
     buffers.erase(buffers.begin() + index);
+    tab_names.erase(tab_names.begin() + index);
     message = "Buffer " + std::to_string(index + 1) + " closed";
 
     if (current_buffer_index >= static_cast<int>(buffers.size())) {
@@ -123,8 +266,7 @@ void Editor::closeBuffer(int index) {
 
     if (buffers.empty()) {
         // No buffers left, shutdown editor
-        shutdown();
-        exit(0);
+        quit();
     }
 
     refresh_render();
@@ -136,7 +278,7 @@ void Editor::listBuffers() {
     message = "Buffers: ";
     for (int i = 0; i < (int)buffers.size(); ++i) {
         message +=
-            std::to_string(i + 1) + ": " + buffers[i].getFilename() + " | ";
+            std::to_string(i + 1) + ": " + tab_names[i] + " | ";
     }
     // Potentially use your renderer to display or just store in 'message'
     // We'll store in 'message' for simplicity:
@@ -145,10 +287,10 @@ void Editor::listBuffers() {
 
 Buffer& Editor::currentBuffer() {
     // Always assume currentBufferIndex >= 0
-    return buffers[current_buffer_index];
+    return *buffers[current_buffer_index];
 }
 const Buffer& Editor::currentBuffer() const {
-    return buffers[current_buffer_index];
+    return *buffers[current_buffer_index];
 }
 
 std::string& Editor::getNumberBuffer() {
@@ -161,21 +303,26 @@ void Editor::clearNumberBuffer() {
     number_buffer.clear();
 }
 
-// Cursor Movement
+// Cursor Movement. Moving the cursor in insert mode starts a new undo step,
+// as in vim.
 void Editor::moveCursorLeft(int t) {
+    currentBuffer().closeUndoGroup();
     currentBuffer().moveCursorLeft(t);
     refresh_render();
 }
 void Editor::moveCursorRight(int t) {
+    currentBuffer().closeUndoGroup();
     currentBuffer().moveCursorRight(t);
     refresh_render();
 }
 void Editor::moveCursorUp(int t) {
+    currentBuffer().closeUndoGroup();
     currentBuffer().moveCursorUp(t);
     adjustScrolling();
     refresh_render();
 }
 void Editor::moveCursorDown(int t) {
+    currentBuffer().closeUndoGroup();
     currentBuffer().moveCursorDown(t);
     adjustScrolling();
     refresh_render();
@@ -213,29 +360,177 @@ void Editor::jumpToLine(int target_line) {
     refresh_render();
 }
 
-// Delete the current line
-void Editor::deleteCurrentLine() {
-    currentBuffer().deleteCurrentLine();
+void Editor::moveParagraph(int count, bool forward) {
+    Buffer& buf = currentBuffer();
+    buf.closeUndoGroup();
+    buf.setCursorY(buf.paragraphBoundary(buf.getCursorY(), count, forward));
+    buf.setCursorX(0);
+    adjustScrolling();
+    refresh_render();
+}
+
+void Editor::setMark(char name) {
+    currentBuffer().setMark(name, currentBuffer().getCursorY());
+}
+
+// The range is worked out from the motion, then copied and, for d, cut
+// out with one edit, however many lines it spans
+void Editor::applyOperator(char reg_name, char op, Motion motion, int count,
+                           bool has_count) {
+    if (motion >= Motion::LEFT) {
+        applyCharOperator(reg_name, op, motion, count);
+        return;
+    }
+    Buffer& buf = currentBuffer();
+    int cursor = buf.getCursorY();
+    int last_line = buf.getLineCount() - 1;
+    // A count past the end goes as far as the end, and keeps cursor + count
+    // from overflowing
+    count = std::min(count, last_line + 1);
+    int first = cursor;
+    int last = cursor;
+    bool moved = true; // Whether the motion could go anywhere
+    switch (motion) {
+    case Motion::LINES:
+        last = cursor + count - 1;
+        break;
+    case Motion::DOWN:
+        last = cursor + count;
+        moved = cursor < last_line;
+        break;
+    case Motion::UP:
+        first = cursor - count;
+        moved = cursor > 0;
+        break;
+    case Motion::FIRST_LINE:
+    case Motion::LAST_LINE: {
+        int target = has_count ? count - 1
+                     : motion == Motion::FIRST_LINE ? 0
+                                                    : last_line;
+        target = std::max(0, std::min(target, last_line));
+        first = std::min(cursor, target);
+        last = std::max(cursor, target);
+        break;
+    }
+    case Motion::PARAGRAPH_FORWARD:
+        // Up to the empty line that ends the paragraph, not including it
+        last = buf.paragraphBoundary(cursor, count, true);
+        moved = last > cursor;
+        if (moved && buf.getLineLength(last) == 0) {
+            --last;
+        }
+        break;
+    case Motion::PARAGRAPH_BACKWARD:
+        // From the empty line before the paragraph to the line above
+        first = buf.paragraphBoundary(cursor, count, false);
+        moved = first < cursor;
+        last = cursor - 1;
+        break;
+    default:
+        return;
+    }
+    // A motion that cannot move, such as j on the last line, does nothing
+    if (!moved) {
+        return;
+    }
+    first = std::max(first, 0);
+    last = std::min(last, last_line);
+
+    operateOnLines(reg_name, op, first, last);
+    if (op == 'y') {
+        buf.setCursorY(first);
+        buf.ensureCursorWithinBounds();
+    }
     adjustScrolling();
     refresh_render();
 }
 
-// Copy the current line
-void Editor::copyCurrentLine() {
-    // Save the current line to the clipboard
-    copied_line = currentBuffer().getLine(
-        currentBuffer().getCursorY()); 
+// Lines [first, last] into a register, and out of the buffer for d
+void Editor::operateOnLines(char reg_name, char op, int first, int last) {
+    Buffer& buf = currentBuffer();
+    first = std::max(first, 0);
+    last = std::min(last, buf.getLineCount() - 1);
+    if (first > last) {
+        return;
+    }
+    registers.store(reg_name, Register{buf.copyLines(first, last), true},
+                    op == 'y');
+    int lines = last - first + 1;
+    if (op == 'd') {
+        buf.deleteLines(first, last);
+        if (lines > 2) {
+            message = std::to_string(lines) + " fewer lines";
+        }
+    } else {
+        buf.closeUndoGroup();
+        if (lines > 2) {
+            message = std::to_string(lines) + " lines yanked";
+        }
+    }
+}
+
+// Within the cursor line, from the cursor to where the motion goes
+void Editor::applyCharOperator(char reg_name, char op, Motion motion,
+                               int count) {
+    Buffer& buf = currentBuffer();
+    int line = buf.getCursorY();
+    int length = buf.getLineLength(line);
+    const LineLayout& layout = buf.getLayout(line);
+    int from = std::min(buf.getCursorX(), length);
+    int to = from;
+    switch (motion) {
+    case Motion::RIGHT:
+        for (int i = 0; i < count && to < length; ++i) {
+            to = static_cast<int>(layout.nextChar(to));
+        }
+        break;
+    case Motion::LEFT:
+        for (int i = 0; i < count && from > 0; ++i) {
+            from = static_cast<int>(layout.prevChar(from));
+        }
+        break;
+    case Motion::LINE_START:
+        from = 0;
+        break;
+    case Motion::LINE_END:
+        to = length;
+        break;
+    default:
+        return;
+    }
+    if (from == to) {
+        return;
+    }
+
+    registers.store(reg_name, Register{buf.copyText(line, from, to), false},
+                    op == 'y');
+    if (op == 'd') {
+        buf.deleteText(line, from, to);
+    } else {
+        buf.closeUndoGroup();
+        buf.setCursorX(from);
+    }
+    refresh_render();
 }
 
 // Paste the copied content
-void Editor::pasteContent(int t) {
-    currentBuffer().pasteContent(copied_line, t);
+void Editor::pasteContent(char reg_name, int t, bool before) {
+    const Register* reg = registers.get(reg_name);
+    if (!reg) {
+        message = std::string("Nothing in register ") +
+                  (reg_name ? reg_name : '"');
+        refresh_render();
+        return;
+    }
+    if (!currentBuffer().put(reg->text, reg->linewise, t, before)) {
+        message = "Resulting text too long";
+    }
     adjustScrolling();
     refresh_render();
 }
 
 // Insert Mode Operations
-void Editor::insertCharacter(char c) {
+void Editor::insertCharacter(const std::string& c) {
     currentBuffer().insertCharacter(c);
     refresh_render();
 }
@@ -252,10 +547,55 @@ void Editor::handleEnter() {
     refresh_render();
 }
 
+// Terminals send the line breaks of a paste as CR or CRLF
+void Editor::pasteText(const std::string& text) {
+    std::string normalized;
+    normalized.reserve(text.size());
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (text[i] != '\r') {
+            normalized += text[i];
+        } else if (i + 1 >= text.size() || text[i + 1] != '\n') {
+            normalized += '\n';
+        }
+    }
+    currentBuffer().insertText(normalized);
+    adjustScrolling();
+    refresh_render();
+}
+
 // ===--- Command Execution ---===
+void Editor::setCommandLine(const std::string& command) {
+    command_line = command;
+    refresh_render();
+}
+
 void Editor::executeCommand(const std::string& command) {
+    // The lines a command works on come before it, as in :1,10d
+    LineRange range;
+    size_t pos = 0;
+    std::string error;
+    if (!parseRange(command, pos, currentBuffer(), range, error)) {
+        message = error;
+        return;
+    }
+    std::string rest = command.substr(pos);
+    if (rest.empty()) {
+        // A range alone goes to its last line
+        if (range.count > 0) {
+            jumpToLine(range.last);
+        }
+        return;
+    }
+    if (executeRangeCommand(range, rest)) {
+        return;
+    }
+    if (range.count > 0) {
+        message = "No range allowed";
+        return;
+    }
+
     // split the command into parts
-    std::vector<std::string> parts = split(command, 2);
+    std::vector<std::string> parts = split(rest, 2);
 
     // process the write command with optional filename
     if (parts[0] == "e") {
@@ -265,6 +605,14 @@ void Editor::executeCommand(const std::string& command) {
             message = "No file specified";
         }
     }
+    // "view <fname>" opens a file read-only
+    else if (parts[0] == "view") {
+        if (parts.size() > 1) {
+            openFile(parts[1], true);
+        } else {
+            message = "No file specified";
+        }
+    }
     // "ls" to list buffers
     else if (parts[0] == "ls") {
         listBuffers();
@@ -286,13 +634,11 @@ void Editor::executeCommand(const std::string& command) {
 
     } else if (parts[0] == "q") {
         if (buffers.empty()) {
-            shutdown();
-            exit(0);
+            quit();
         } else {
             closeBuffer(current_buffer_index);
             if (buffers.empty()) {
-                shutdown();
-                exit(0);
+                quit();
             }
         }
     }
@@ -304,33 +650,505 @@ void Editor::executeCommand(const std::string& command) {
                 closeBuffer(current_buffer_index);
             }
             if (buffers.empty()) {
-                shutdown();
-                exit(0);
+                quit();
             }
         } catch (const std::runtime_error& e) {
             message = e.what();
         }
 
-    } else if (command.rfind("s/", 0) == 0) { // s/old/new/g
-        size_t pref = 1;
-        size_t first = command.find('/', pref + 1);
-        size_t second = command.find('/', first + 1);
-        if (first != std::string::npos && second != std::string::npos) {
-            std::string old_str = command.substr(pref + 1, first - pref - 1);
-            std::string new_str = command.substr(first + 1, second - first - 1);
-            currentBuffer().replaceAll(old_str, new_str);
-            
-            refresh_render();
+    } else if (parts[0] == "stats") {
+        // Cost of the last frame drawn before this command
+        const FrameStats& stats = renderer->getLastFrameStats();
+        message = "Last frame: " + std::to_string(stats.rows_painted) +
+                  " rows, " + std::to_string(stats.bytes_written) + " bytes";
+    } else if (parts[0] == "profile") {
+        // profile start|stop|dump <file>
+        std::string action = parts.size() > 1 ? parts[1] : "";
+#ifdef VIXX_PROFILE
+        Profiler& profiler = Profiler::instance();
+        if (action == "start") {
+            profiler.start();
+            message = "Profiling";
+        } else if (action == "stop") {
+            profiler.stop();
+            message = profiler.summary(3);
+        } else if (action == "dump" && parts.size() > 2) {
+            message = profiler.dump(parts[2]) ? profiler.summary(3)
+                                              : "Cannot write " + parts[2];
         } else {
-            message = "Insufficient parameter";
+            message = "Usage: profile start|stop|dump <file>";
         }
-
+#else
+        message = "Profiling is not built in; configure with -DVIXX_PROFILE=ON";
+#endif
+    } else if (parts[0] == "earlier" || parts[0] == "later") {
+        // earlier/later [N | Ns | Nm | Nh | Nd]: N changes or a span of time
+        std::string arg = parts.size() > 1 ? parts[1] : "1";
+        size_t digits = 0;
+        while (digits < arg.size() && isdigit(arg[digits])) {
+            ++digits;
+        }
+        std::string unit = arg.substr(digits);
+        long scale = unit.empty()  ? 1
+                     : unit == "s" ? 1
+                     : unit == "m" ? 60
+                     : unit == "h" ? 3600
+                     : unit == "d" ? 86400
+                                   : 0;
+        if (digits == 0 || scale == 0) {
+            message = "Invalid argument: " + arg;
+        } else {
+            // Saturates rather than overflows; that far back is the start
+            long count = 0;
+            for (size_t i = 0; i < digits; ++i) {
+                count = std::min(count * 10 + (arg[i] - '0'), 1L * INT_MAX);
+            }
+            count *= scale;
+            currentBuffer().timeTravel(parts[0] == "earlier" ? -count : count,
+                                       !unit.empty());
+            adjustScrolling();
+        }
+    } else if (parts[0] == "set") {
+        // set undobytes=<n> caps each buffer's undo history
+        std::string option = parts.size() > 1 ? parts[1] : "";
+        if (option == "undobytes" || option == "undobytes?") {
+            message = "undobytes=" + std::to_string(undo_limit) + " (" +
+                      std::to_string(currentBuffer().getUndoMemory()) +
+                      " in use, " +
+                      std::to_string(currentBuffer().getUndoSteps()) +
+                      " steps)";
+        } else if (option.rfind("undobytes=", 0) == 0) {
+            try {
+                undo_limit = std::stoull(option.substr(10));
+                for (const std::unique_ptr<Buffer>& buffer : buffers) {
+                    buffer->setUndoLimit(undo_limit);
+                }
+            } catch (const std::exception&) {
+                message = "Invalid argument: " + option;
+            }
+        } else {
+            message = "Unknown option: " + option;
+        }
+    } else if (parts[0] == "noh" || parts[0] == "nohlsearch") {
+        clearHighlight();
     } else {
         message = "Not an editor command: " + command;
     }
     
 }
 
+// Without a range these work on the cursor line, except :s and :w, which
+// work on every line. Each is one edit and one undo step however many
+// lines it spans.
+bool Editor::executeRangeCommand(const LineRange& range,
+                                 const std::string& command) {
+    if (command.size() > 1 && command[0] == 's' &&
+        std::ispunct(static_cast<unsigned char>(command[1]))) {
+        executeSubstituteCommand(command, range); // s/pattern/replacement/flags
+        return true;
+    }
+    size_t name_end = 0;
+    while (name_end < command.size() &&
+           std::isalpha(static_cast<unsigned char>(command[name_end]))) {
+        ++name_end;
+    }
+    std::string name = command.substr(0, name_end);
+    size_t arg_begin = command.find_first_not_of(' ', name_end);
+    std::string arg =
+        arg_begin != std::string::npos ? command.substr(arg_begin) : "";
+
+    if (name == "g" || name == "global" || name == "v" || name == "vglobal") {
+        executeGlobalCommand(range, command.substr(name_end), name[0] == 'v');
+        return true;
+    }
+
+    Buffer& buf = currentBuffer();
+    int first = range.count > 0 ? range.first : buf.getCursorY();
+    int last = range.count > 0 ? range.last : first;
+    if (name == "d" || name == "delete" || name == "y" || name == "yank") {
+        // d [x] and y [x]: into register x
+        char reg_name = arg.empty() ? 0 : arg[0];
+        if (arg.size() > 1 ||
+            (reg_name != 0 && !Registers::isValid(reg_name))) {
+            message = "Trailing characters: " + arg;
+            return true;
+        }
+        operateOnLines(reg_name, name[0], first, last);
+    } else if (name == "m" || name == "move" || name == "t" || name == "co" ||
+               name == "copy") {
+        // m {address} and t {address}: below the line at the address
+        int dest;
+        size_t pos = 0;
+        std::string error;
+        if (!parseAddress(arg, pos, buf, dest, error)) {
+            message = error;
+            return true;
+        }
+        if (pos < arg.size()) {
+            message = "Trailing characters: " + arg.substr(pos);
+            return true;
+        }
+        if (name[0] != 'm') {
+            buf.duplicateLines(first, last, dest);
+        } else if (dest >= first && dest < last) {
+            message = "Cannot move a range of lines into itself";
+            return true;
+        } else {
+            buf.moveLines(first, last, dest);
+            if (last - first + 1 > 2) {
+                message = std::to_string(last - first + 1) + " lines moved";
+            }
+        }
+    } else if (name == "w" && range.count > 0) {
+        // Every line is a plain :w; fewer go to a file of their own
+        if (first == 0 && last == buf.getLineCount() - 1 &&
+            buf.isFullyIndexed()) {
+            try {
+                saveFile(arg);
+            } catch (const std::runtime_error& e) {
+                message = e.what();
+            }
+        } else if (arg.empty() || arg == buf.getFilename()) {
+            message = "Cannot write part of the buffer over its own file";
+        } else if (!buf.writeLines(first, last, arg)) {
+            message = "Cannot write " + arg;
+        } else {
+            message = "\"" + arg + "\" " + std::to_string(last - first + 1) +
+                      " lines written";
+        }
+    } else {
+        return false;
+    }
+    adjustScrolling();
+    refresh_render();
+    return true;
+}
+
+// In two passes: the lines are marked first, on the shared pool for a large
+// buffer, and the command then runs over all of them at once, so :g/x/d
+// costs one pass over the text rather than one per line deleted. Only d, y
+// and s follow; with no command, the cursor goes to the last line marked.
+void Editor::executeGlobalCommand(const LineRange& range,
+                                  const std::string& command, bool invert) {
+    size_t pos = 0;
+    if (pos < command.size() && command[pos] == '!') { // :g! is :v
+        invert = !invert;
+        ++pos;
+    }
+    if (pos >= command.size() ||
+        !std::ispunct(static_cast<unsigned char>(command[pos]))) {
+        message = "Regular expression missing from :g";
+        return;
+    }
+    char delimiter = command[pos++];
+    std::string pattern;
+    for (; pos < command.size() && command[pos] != delimiter; ++pos) {
+        if (command[pos] == '\\' && pos + 1 < command.size()) {
+            if (command[pos + 1] != delimiter) {
+                pattern += command[pos];
+            }
+            ++pos;
+        }
+        pattern += command[pos];
+    }
+    size_t command_begin = command.find_first_not_of(' ', pos + 1);
+    std::string sub_command =
+        pos < command.size() && command_begin != std::string::npos
+            ? command.substr(command_begin)
+            : "";
+    if (pattern.empty()) {
+        // An empty pattern is the last one searched for
+        if (!search_regex) {
+            message = "No previous regular expression";
+            return;
+        }
+        pattern = search_regex->pattern();
+    }
+    std::shared_ptr<const Regex> regex = std::make_shared<const Regex>(pattern);
+    if (!regex->ok()) {
+        message = "Invalid pattern: " + regex->error();
+        return;
+    }
+    // Becomes the last pattern, as the one an s after it leaves out
+    search_regex = regex;
+
+    Buffer& buf = currentBuffer();
+    std::vector<int> lines =
+        buf.matchingLines(*regex, range.count > 0 ? range.first : 0,
+                          range.count > 0 ? range.last : INT_MAX, invert);
+    if (lines.empty()) {
+        message = (invert ? "Pattern found in every line: "
+                          : "Pattern not found: ") +
+                  pattern;
+        return;
+    }
+
+    size_t name_end = 0;
+    while (name_end < sub_command.size() &&
+           std::isalpha(static_cast<unsigned char>(sub_command[name_end]))) {
+        ++name_end;
+    }
+    std::string name = sub_command.substr(0, name_end);
+    size_t arg_begin = sub_command.find_first_not_of(' ', name_end);
+    std::string arg =
+        arg_begin != std::string::npos ? sub_command.substr(arg_begin) : "";
+    int count = static_cast<int>(lines.size());
+
+    if (sub_command.empty()) {
+        buf.setCursorY(lines.back());
+        buf.setCursorX(0);
+        message = std::to_string(count) + (count == 1 ? " line" : " lines");
+    } else if (sub_command.size() > 1 && sub_command[0] == 's' &&
+               std::ispunct(static_cast<unsigned char>(sub_command[1]))) {
+        executeSubstituteCommand(sub_command, LineRange(), &lines);
+        return;
+    } else if (name == "d" || name == "delete" || name == "y" ||
+               name == "yank") {
+        char reg_name = arg.empty() ? 0 : arg[0];
+        if (arg.size() > 1 ||
+            (reg_name != 0 && !Registers::isValid(reg_name))) {
+            message = "Trailing characters: " + arg;
+            return;
+        }
+        // As if run on each line in turn: an uppercase register gets every
+        // line added to it, any other ends up with the last
+        SharedText text;
+        if (std::isupper(static_cast<unsigned char>(reg_name))) {
+            for (int line : lines) {
+                text.append(buf.copyLines(line, line));
+            }
+        } else {
+            text = buf.copyLines(lines.back(), lines.back());
+        }
+        registers.store(reg_name, Register{text, true}, name[0] == 'y');
+        if (name[0] == 'd') {
+            buf.deleteLineSet(lines);
+            if (count > 2) {
+                message = std::to_string(count) + " fewer lines";
+            }
+        } else {
+            buf.closeUndoGroup();
+            if (count > 2) {
+                message = std::to_string(count) + " lines yanked";
+            }
+        }
+    } else {
+        message = "Not supported after :g: " + sub_command;
+        return;
+    }
+    adjustScrolling();
+    refresh_render();
+}
+
+// :s/pattern/replacement/flags over the lines of `range`, or of `lines`
+// for :g, or the whole buffer. Any punctuation can stand in for '/', and a
+// backslash keeps it from ending a field. Flags: g replaces every match on a
+// line rather than the first, i and I ignore and match case, and e keeps
+// quiet when nothing matches.
+void Editor::executeSubstituteCommand(const std::string& command,
+                                      const LineRange& range,
+                                      const std::vector<int>* lines) {
+    char delimiter = command[1];
+    std::string fields[3];
+    int field = 0;
+    for (size_t i = 2; i < command.size(); ++i) {
+        char c = command[i];
+        if (c == delimiter && field < 2) {
+            ++field;
+            continue;
+        }
+        if (c == '\\' && i + 1 < command.size() && command[i + 1] == delimiter) {
+            c = command[++i];
+            if (field == 0 && std::strchr("^$.*[~", c)) {
+                fields[0] += '\\'; // The delimiter stands for itself
+            }
+        } else if (c == '\\' && i + 1 < command.size()) {
+            fields[field] += c;
+            c = command[++i];
+        }
+        fields[field] += c;
+    }
+    if (field == 0) {
+        message = "Insufficient parameter";
+        return;
+    }
+    if (fields[0].empty()) {
+        // An empty pattern is the last one searched for
+        if (!search_regex) {
+            message = "No previous regular expression";
+            return;
+        }
+        fields[0] = search_regex->pattern();
+    }
+
+    bool global = false, quiet = false;
+    std::string pattern = fields[0];
+    for (char flag : fields[2]) {
+        if (flag == 'g') {
+            global = true;
+        } else if (flag == 'i' || flag == 'I') {
+            pattern += flag == 'i' ? "\\c" : "\\C";
+        } else if (flag == 'e') {
+            quiet = true;
+        } else {
+            message = std::string("Invalid flag: ") + flag;
+            return;
+        }
+    }
+
+    Regex regex(pattern);
+    if (!regex.ok()) {
+        message = "Invalid pattern: " + regex.error();
+        return;
+    }
+    SubstituteResult result =
+        lines ? currentBuffer().substituteLines(
+                    regex, ReplaceTemplate(fields[1]), global, *lines)
+              : currentBuffer().substitute(
+                    regex, ReplaceTemplate(fields[1]), global,
+                    range.count > 0 ? range.first : 0,
+                    range.count > 0 ? range.last : INT_MAX);
+    if (result.substitutions == 0) {
+        if (!quiet) {
+            message = "Pattern not found: " + fields[0];
+        }
+        return;
+    }
+    if (result.lines > 2) {
+        message = std::to_string(result.substitutions) + " substitutions on " +
+                  std::to_string(result.lines) + " lines";
+    }
+    adjustScrolling();
+    refresh_render();
+}
+
+// ===--- Search ---===
+void Editor::beginSearch(bool forward) {
+    switchMode(Mode::SEARCH);
+    search_typed.clear();
+    search_typed_forward = forward;
+    search_origin_x = currentBuffer().getCursorX();
+    search_origin_y = currentBuffer().getCursorY();
+    search_origin_top = currentBuffer().getTopLine();
+    command_line = forward ? "/" : "?";
+}
+
+void Editor::updateSearch(const std::string& pattern) {
+    search_typed = pattern;
+    command_line = (search_typed_forward ? "/" : "?") + pattern;
+    search_preview_pending = true;
+    refresh_render();
+}
+
+// Shows where the pattern typed so far would land, without an index: the
+// text is read from the cursor until the first match
+void Editor::previewSearch() {
+    search_preview_pending = false;
+    restoreSearchOrigin();
+    highlight.reset();
+    if (search_typed.empty()) {
+        return;
+    }
+    auto regex = std::make_shared<const Regex>(search_typed);
+    SearchHit hit;
+    if (!regex->ok() ||
+        !currentBuffer().findMatch(*regex, search_origin_y, search_origin_x,
+                                   search_typed_forward, hit)) {
+        return;
+    }
+    highlight = regex;
+    currentBuffer().setCursorY(static_cast<int>(hit.line));
+    currentBuffer().setCursorX(static_cast<int>(hit.column));
+    adjustScrolling();
+}
+
+void Editor::restoreSearchOrigin() {
+    currentBuffer().setCursorX(search_origin_x);
+    currentBuffer().setCursorY(search_origin_y);
+    currentBuffer().setTopLine(search_origin_top);
+}
+
+// An empty pattern searches for the last one again, in the new direction
+void Editor::executeSearch(const std::string& pattern) {
+    search_preview_pending = false;
+    restoreSearchOrigin();
+    highlight = search_regex;
+    if (pattern.empty() && !search_regex) {
+        message = "No previous regular expression";
+        return;
+    }
+    if (!pattern.empty()) {
+        auto regex = std::make_shared<const Regex>(pattern);
+        if (!regex->ok()) {
+            message = "Invalid pattern: " + regex->error();
+            return;
+        }
+        search_regex = regex;
+        highlight = regex;
+    }
+    search_forward = search_typed_forward;
+    jumpToMatch(search_forward, 1);
+}
+
+void Editor::cancelSearch() {
+    search_preview_pending = false;
+    restoreSearchOrigin();
+    highlight = search_regex;
+    refresh_render();
+}
+
+void Editor::searchNext(int count, bool reverse) {
+    if (!search_regex) {
+        message = "No previous regular expression";
+        return;
+    }
+    highlight = search_regex;
+    jumpToMatch(reverse ? !search_forward : search_forward, count);
+}
+
+void Editor::clearHighlight() {
+    highlight.reset();
+    refresh_render();
+}
+
+// Moves to the count-th match from the cursor through the buffer's index,
+// which is built the first time a buffer is searched for a pattern
+void Editor::jumpToMatch(bool forward, int count) {
+    Buffer& buffer = currentBuffer();
+    if (buffer.getSearchPattern() != search_regex->pattern()) {
+        buffer.setSearchPattern(*search_regex);
+    }
+    SearchHit hit;
+    int line = buffer.getCursorY(), column = buffer.getCursorX();
+    bool wrapped = false;
+    // Going round the buffer comes back to the same match after all of them
+    size_t matches = buffer.getMatchCount();
+    if (matches > 0 && static_cast<size_t>(count) > matches) {
+        count = static_cast<int>((count - 1) % matches + 1);
+        wrapped = true;
+    }
+    for (int i = 0; i < count; ++i) {
+        if (!buffer.nextMatch(line, column, forward, hit)) {
+            message = "Pattern not found: " + search_regex->pattern();
+            refresh_render();
+            return;
+        }
+        line = static_cast<int>(hit.line);
+        column = static_cast<int>(hit.column);
+        wrapped = wrapped || hit.wrapped;
+    }
+    buffer.setCursorY(line);
+    buffer.setCursorX(column);
+    if (wrapped) {
+        message = forward ? "search hit BOTTOM, continuing at TOP "
+                          : "search hit TOP, continuing at BOTTOM ";
+    }
+    message += "[" + std::to_string(hit.ordinal) + "/" +
+               std::to_string(buffer.getMatchCount()) + "]";
+    adjustScrolling();
+    refresh_render();
+}
+
 // ===--- Undo/Redo Operations ---===
 void Editor::undo() {
     currentBuffer().undo();
@@ -345,7 +1163,16 @@ void Editor::redo() {
 }
 
 void Editor::saveFile(const std::string& fname) {
+    if (currentBuffer().isReadOnly()) {
+        throw std::runtime_error("'readonly' option is set");
+    }
     currentBuffer().saveToFile(fname);
+    // :w <name> renames the buffer, and every view of the same document
+    for (size_t i = 0; i < buffers.size(); ++i) {
+        if (buffers[i]->sharesDocumentWith(currentBuffer())) {
+            tab_names[i] = buffers[i]->getFilename();
+        }
+    }
     // Optionally, display a save confirmation in the status bar
     refresh_render();
 }
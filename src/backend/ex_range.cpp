@@ -0,0 +1,152 @@
+// src/backend/ex_range.cpp
+
+#include "backend/ex_range.h"
+#include "backend/buffer.h"
+#include <algorithm>
+#include <cctype>
+#include <climits>
+
+static void skipSpaces(const std::string& command, size_t& pos) {
+    while (pos < command.size() && command[pos] == ' ') {
+        ++pos;
+    }
+}
+
+// Saturates rather than overflows; any line that far is past the end
+static long readNumber(const std::string& command, size_t& pos) {
+    long n = 0;
+    while (pos < command.size() &&
+           std::isdigit(static_cast<unsigned char>(command[pos]))) {
+        n = std::min(n * 10 + (command[pos] - '0'), 1L * INT_MAX);
+        ++pos;
+    }
+    return n;
+}
+
+// An address as a line number counted from 1, 0 being above the first
+// line, where . is `base`. `found` is false if there is none at `pos`.
+static bool readAddress(const std::string& command, size_t& pos,
+                        Buffer& buffer, long base, long& line, bool& found,
+                        std::string& error) {
+    skipSpaces(command, pos);
+    found = true;
+    char c = pos < command.size() ? command[pos] : '\0';
+    if (c == '.') {
+        line = base;
+        ++pos;
+    } else if (c == '$') {
+        buffer.indexThrough(INT_MAX);
+        line = buffer.getLineCount();
+        ++pos;
+    } else if (std::isdigit(static_cast<unsigned char>(c))) {
+        line = readNumber(command, pos);
+    } else if (c == '\'') {
+        char name = pos + 1 < command.size() ? command[pos + 1] : '\0';
+        int mark = buffer.getMark(name);
+        if (mark < 0) {
+            error = std::string("Mark not set: ") + name;
+            return false;
+        }
+        line = mark + 1;
+        pos += 2;
+    } else if (c == '+' || c == '-') {
+        line = base;
+    } else {
+        found = false;
+        return true;
+    }
+
+    for (;;) {
+        skipSpaces(command, pos);
+        if (pos >= command.size() ||
+            (command[pos] != '+' && command[pos] != '-')) {
+            break;
+        }
+        long sign = command[pos++] == '+' ? 1 : -1;
+        long n = 1;
+        if (pos < command.size() &&
+            std::isdigit(static_cast<unsigned char>(command[pos]))) {
+            n = readNumber(command, pos);
+        }
+        line += sign * n;
+    }
+
+    // Numbers far into a lazily loaded file need the lines up to them
+    if (line > 0) {
+        buffer.indexThrough(static_cast<int>(std::min(line, 1L * INT_MAX)) - 1);
+    }
+    if (line < 0 || line > buffer.getLineCount()) {
+        error = "Invalid range";
+        return false;
+    }
+    return true;
+}
+
+bool parseRange(const std::string& command, size_t& pos, Buffer& buffer,
+                LineRange& range, std::string& error) {
+    range = LineRange();
+    long base = buffer.getCursorY() + 1;
+    skipSpaces(command, pos);
+    if (pos < command.size() && command[pos] == '%') {
+        ++pos;
+        buffer.indexThrough(INT_MAX);
+        range.first = 0;
+        range.last = buffer.getLineCount() - 1;
+        range.count = 2;
+        return true;
+    }
+
+    long first;
+    bool found;
+    if (!readAddress(command, pos, buffer, base, first, found, error)) {
+        return false;
+    }
+    skipSpaces(command, pos);
+    bool separator = pos < command.size() &&
+                     (command[pos] == ',' || command[pos] == ';');
+    if (!found && !separator) {
+        return true;
+    }
+    if (!found) {
+        first = base; // ",5" is ".,5"
+    }
+    long last = first;
+    range.count = 1;
+    if (separator) {
+        if (command[pos] == ';') {
+            base = first;
+        }
+        ++pos;
+        if (!readAddress(command, pos, buffer, base, last, found, error)) {
+            return false;
+        }
+        if (!found) {
+            last = base;
+        }
+        range.count = 2;
+    }
+
+    if (first > last) {
+        std::swap(first, last);
+    }
+    // Line 0 is the first line, to commands that work on lines
+    range.first = static_cast<int>(std::max(first, 1L)) - 1;
+    range.last = static_cast<int>(std::max(last, 1L)) - 1;
+    return true;
+}
+
+bool parseAddress(const std::string& command, size_t& pos, Buffer& buffer,
+                  int& line, std::string& error) {
+    long address;
+    bool found;
+    if (!readAddress(command, pos, buffer, buffer.getCursorY() + 1, address,
+                     found, error)) {
+        return false;
+    }
+    if (!found) {
+        error = "Invalid address";
+        return false;
+    }
+    line = static_cast<int>(address) - 1;
+    return true;
+}
@@ -0,0 +1,597 @@
+// src/backend/line_layout.cpp
+
+#include "backend/line_layout.h"
+#include <algorithm>
+#include <cstdint>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define VIXX_LAYOUT_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// Most lines shown at once plus some slack; past this the cache starts over
+const size_t kMaxCachedLines = 4096;
+
+struct Range {
+    uint32_t first;
+    uint32_t last;
+};
+
+// Code points that take no column of their own: combining marks, joiners,
+// variation selectors and other format characters
+const Range kZeroWidth[] = {
+    {0x0300, 0x036F},   {0x0483, 0x0489},   {0x0591, 0x05BD},
+    {0x05BF, 0x05BF},   {0x05C1, 0x05C2},   {0x05C4, 0x05C5},
+    {0x05C7, 0x05C7},   {0x0610, 0x061A},   {0x064B, 0x065F},
+    {0x0670, 0x0670},   {0x06D6, 0x06DC},   {0x06DF, 0x06E4},
+    {0x06E7, 0x06E8},   {0x06EA, 0x06ED},   {0x0711, 0x0711},
+    {0x0730, 0x074A},   {0x07A6, 0x07B0},   {0x07EB, 0x07F3},
+    {0x0816, 0x082D},   {0x0859, 0x085B},   {0x08D3, 0x0902},
+    {0x093A, 0x093A},   {0x093C, 0x093C},   {0x0941, 0x0948},
+    {0x094D, 0x094D},   {0x0951, 0x0957},   {0x0962, 0x0963},
+    {0x0981, 0x0981},   {0x09BC, 0x09BC},   {0x09C1, 0x09C4},
+    {0x09CD, 0x09CD},   {0x09E2, 0x09E3},   {0x0A01, 0x0A02},
+    {0x0A3C, 0x0A3C},   {0x0A41, 0x0A51},   {0x0A70, 0x0A71},
+    {0x0A75, 0x0A75},   {0x0A81, 0x0A82},   {0x0ABC, 0x0ABC},
+    {0x0AC1, 0x0AC8},   {0x0ACD, 0x0ACD},   {0x0B01, 0x0B01},
+    {0x0B3C, 0x0B3C},   {0x0B3F, 0x0B3F},   {0x0B41, 0x0B44},
+    {0x0B4D, 0x0B4D},   {0x0BC0, 0x0BC0},   {0x0BCD, 0x0BCD},
+    {0x0C3E, 0x0C40},   {0x0C46, 0x0C56},   {0x0CBC, 0x0CBC},
+    {0x0CCC, 0x0CCD},   {0x0D41, 0x0D44},   {0x0D4D, 0x0D4D},
+    {0x0DCA, 0x0DCA},   {0x0DD2, 0x0DD6},   {0x0E31, 0x0E31},
+    {0x0E34, 0x0E3A},   {0x0E47, 0x0E4E},   {0x0EB1, 0x0EB1},
+    {0x0EB4, 0x0EBC},   {0x0EC8, 0x0ECD},   {0x0F18, 0x0F19},
+    {0x0F35, 0x0F35},   {0x0F37, 0x0F37},   {0x0F39, 0x0F39},
+    {0x0F71, 0x0F7E},   {0x0F80, 0x0F84},   {0x0F86, 0x0F87},
+    {0x0F8D, 0x0FBC},   {0x0FC6, 0x0FC6},   {0x102D, 0x1030},
+    {0x1032, 0x1037},   {0x1039, 0x103A},   {0x103D, 0x103E},
+    {0x1058, 0x1059},   {0x1160, 0x11FF},   {0x135D, 0x135F},
+    {0x1712, 0x1714},   {0x17B4, 0x17B5},   {0x17B7, 0x17BD},
+    {0x17C6, 0x17C6},   {0x17C9, 0x17D3},   {0x180B, 0x180E},
+    {0x18A9, 0x18A9},   {0x1920, 0x1922},   {0x1927, 0x1928},
+    {0x1932, 0x1932},   {0x1939, 0x193B},   {0x1A17, 0x1A18},
+    {0x1AB0, 0x1AFF},   {0x1B00, 0x1B03},   {0x1B34, 0x1B34},
+    {0x1B36, 0x1B3A},   {0x1B3C, 0x1B3C},   {0x1B42, 0x1B42},
+    {0x1B6B, 0x1B73},   {0x1DC0, 0x1DFF},   {0x200B, 0x200F},
+    {0x202A, 0x202E},   {0x2060, 0x2064},   {0x20D0, 0x20F0},
+    {0x2CEF, 0x2CF1},   {0x2DE0, 0x2DFF},   {0x302A, 0x302D},
+    {0x3099, 0x309A},   {0xA66F, 0xA672},   {0xA674, 0xA67D},
+    {0xA69E, 0xA69F},   {0xA6F0, 0xA6F1},   {0xA802, 0xA802},
+    {0xA806, 0xA806},   {0xA80B, 0xA80B},   {0xA825, 0xA826},
+    {0xA8C4, 0xA8C5},   {0xA8E0, 0xA8F1},   {0xA926, 0xA92D},
+    {0xA947, 0xA951},   {0xA980, 0xA982},   {0xA9B3, 0xA9B3},
+    {0xA9B6, 0xA9B9},   {0xA9BC, 0xA9BC},   {0xAA29, 0xAA2E},
+    {0xAA31, 0xAA32},   {0xAA35, 0xAA36},   {0xAA43, 0xAA43},
+    {0xAA4C, 0xAA4C},   {0xAAB0, 0xAAB0},   {0xAAB2, 0xAAB4},
+    {0xAAB7, 0xAAB8},   {0xAABE, 0xAABF},   {0xAAC1, 0xAAC1},
+    {0xABE5, 0xABE5},   {0xABE8, 0xABE8},   {0xABED, 0xABED},
+    {0xD7B0, 0xD7FF},   {0xFB1E, 0xFB1E},   {0xFE00, 0xFE0F},
+    {0xFE20, 0xFE2F},   {0xFEFF, 0xFEFF},   {0xFFF9, 0xFFFB},
+    {0x1D167, 0x1D169}, {0x1D173, 0x1D182}, {0x1D185, 0x1D18B},
+    {0x1D1AA, 0x1D1AD}, {0x1F3FB, 0x1F3FF}, {0xE0001, 0xE0001},
+    {0xE0020, 0xE007F}, {0xE0100, 0xE01EF},
+};
+
+// East Asian wide and full-width characters, and emoji shown as such
+const Range kWide[] = {
+    {0x1100, 0x115F},   {0x231A, 0x231B},   {0x2329, 0x232A},
+    {0x23E9, 0x23EC},   {0x23F0, 0x23F0},   {0x23F3, 0x23F3},
+    {0x25FD, 0x25FE},   {0x2614, 0x2615},   {0x2648, 0x2653},
+    {0x267F, 0x267F},   {0x2693, 0x2693},   {0x26A1, 0x26A1},
+    {0x26AA, 0x26AB},   {0x26BD, 0x26BE},   {0x26C4, 0x26C5},
+    {0x26CE, 0x26CE},   {0x26D4, 0x26D4},   {0x26EA, 0x26EA},
+    {0x26F2, 0x26F3},   {0x26F5, 0x26F5},   {0x26FA, 0x26FA},
+    {0x26FD, 0x26FD},   {0x2705, 0x2705},   {0x270A, 0x270B},
+    {0x2728, 0x2728},   {0x274C, 0x274C},   {0x274E, 0x274E},
+    {0x2753, 0x2755},   {0x2757, 0x2757},   {0x2795, 0x2797},
+    {0x27B0, 0x27B0},   {0x27BF, 0x27BF},   {0x2B1B, 0x2B1C},
+    {0x2B50, 0x2B50},   {0x2B55, 0x2B55},   {0x2E80, 0x303E},
+    {0x3041, 0x33FF},   {0x3400, 0x4DBF},   {0x4E00, 0x9FFF},
+    {0xA000, 0xA4CF},   {0xA960, 0xA97F},   {0xAC00, 0xD7A3},
+    {0xF900, 0xFAFF},   {0xFE10, 0xFE19},   {0xFE30, 0xFE6F},
+    {0xFF00, 0xFF60},   {0xFFE0, 0xFFE6},   {0x16FE0, 0x16FE4},
+    {0x17000, 0x187F7}, {0x18800, 0x18CD5}, {0x1B000, 0x1B2FF},
+    {0x1F004, 0x1F004}, {0x1F0CF, 0x1F0CF}, {0x1F18E, 0x1F18E},
+    {0x1F191, 0x1F19A}, {0x1F200, 0x1F202}, {0x1F210, 0x1F23B},
+    {0x1F240, 0x1F248}, {0x1F250, 0x1F251}, {0x1F260, 0x1F265},
+    {0x1F300, 0x1F320}, {0x1F32D, 0x1F335}, {0x1F337, 0x1F37C},
+    {0x1F37E, 0x1F393}, {0x1F3A0, 0x1F3CA}, {0x1F3CF, 0x1F3D3},
+    {0x1F3E0, 0x1F3F0}, {0x1F3F4, 0x1F3F4}, {0x1F3F8, 0x1F43E},
+    {0x1F440, 0x1F440}, {0x1F442, 0x1F4FC}, {0x1F4FF, 0x1F53D},
+    {0x1F54B, 0x1F54E}, {0x1F550, 0x1F567}, {0x1F57A, 0x1F57A},
+    {0x1F595, 0x1F596}, {0x1F5A4, 0x1F5A4}, {0x1F5FB, 0x1F64F},
+    {0x1F680, 0x1F6C5}, {0x1F6CC, 0x1F6CC}, {0x1F6D0, 0x1F6D2},
+    {0x1F6D5, 0x1F6D7}, {0x1F6EB, 0x1F6EC}, {0x1F6F4, 0x1F6FC},
+    {0x1F7E0, 0x1F7EB}, {0x1F90C, 0x1F93A}, {0x1F93C, 0x1F945},
+    {0x1F947, 0x1F9FF}, {0x1FA70, 0x1FAFF}, {0x20000, 0x2FFFD},
+    {0x30000, 0x3FFFD},
+};
+
+template <size_t N>
+bool inRanges(const Range (&ranges)[N], uint32_t cp) {
+    const Range* it = std::upper_bound(
+        ranges, ranges + N, cp,
+        [](uint32_t value, const Range& range) { return value < range.first; });
+    return it != ranges && cp <= (it - 1)->last;
+}
+
+bool zeroWidth(uint32_t cp) {
+    return cp >= 0x0300 && inRanges(kZeroWidth, cp);
+}
+
+// The code point of the UTF-8 sequence at p, and its length; 0 if the bytes
+// are not a well-formed sequence
+size_t decodeUtf8(const unsigned char* p, size_t n, uint32_t& cp) {
+    size_t length = utf8SequenceLength(p[0]);
+    if (length == 0 || length > n) {
+        return 0;
+    }
+    if (length == 1) {
+        cp = p[0];
+        return 1;
+    }
+    static const uint32_t kMinimum[] = {0, 0, 0x80, 0x800, 0x10000};
+    cp = p[0] & (0x7F >> length);
+    for (size_t i = 1; i < length; ++i) {
+        if ((p[i] & 0xC0) != 0x80) {
+            return 0;
+        }
+        cp = cp << 6 | (p[i] & 0x3F);
+    }
+    if (cp < kMinimum[length] || cp > 0x10FFFF ||
+        (cp >= 0xD800 && cp <= 0xDFFF)) {
+        return 0;
+    }
+    return length;
+}
+
+enum class GlyphKind { TEXT, MARK, TAB, CONTROL, HEX };
+
+// One character as it is shown
+struct Glyph {
+    size_t length;  // Bytes
+    size_t columns;
+    GlyphKind kind;
+};
+
+// The character at p, which starts at `column`. A combining mark with no
+// character before it is shown on a space of its own.
+Glyph glyphAt(const unsigned char* p, size_t n, size_t column) {
+    if (p[0] == '\t') {
+        return Glyph{1, LineLayout::kTabStop - column % LineLayout::kTabStop,
+                     GlyphKind::TAB};
+    }
+    if (p[0] < 0x20 || p[0] == 0x7F) {
+        return Glyph{1, 2, GlyphKind::CONTROL};
+    }
+    uint32_t cp;
+    size_t length = decodeUtf8(p, n, cp);
+    if (length == 0) {
+        return Glyph{1, 4, GlyphKind::HEX};
+    }
+    if (cp >= 0x80 && cp < 0xA0) {
+        return Glyph{length, 4, GlyphKind::HEX};
+    }
+    Glyph glyph{length, 1, GlyphKind::TEXT};
+    if (zeroWidth(cp)) {
+        glyph.kind = GlyphKind::MARK;
+    } else if (cp >= 0x1100 && inRanges(kWide, cp)) {
+        glyph.columns = 2;
+    }
+    // Marks that follow combine with it, and a zero width joiner takes the
+    // code point after it along too
+    bool joined = cp == 0x200D;
+    while (glyph.length < n) {
+        uint32_t next;
+        size_t next_length = decodeUtf8(p + glyph.length, n - glyph.length, next);
+        if (next_length == 0 || next < 0xA0 || !(joined || zeroWidth(next))) {
+            break;
+        }
+        joined = next == 0x200D;
+        glyph.length += next_length;
+    }
+    return glyph;
+}
+
+size_t printablePrefixScalar(const unsigned char* p, size_t n) {
+    size_t i = 0;
+    while (i < n && p[i] >= 0x20 && p[i] < 0x7F) {
+        ++i;
+    }
+    return i;
+}
+
+#ifdef VIXX_LAYOUT_X86
+
+// A signed compare against ' ' catches both control characters and bytes
+// from 0x80 up, which are negative; DEL needs a compare of its own
+size_t printablePrefixSSE2(const unsigned char* p, size_t n) {
+    const __m128i space = _mm_set1_epi8(0x20);
+    const __m128i del = _mm_set1_epi8(0x7F);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        __m128i bad = _mm_or_si128(_mm_cmplt_epi8(v, space), _mm_cmpeq_epi8(v, del));
+        uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(bad));
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + printablePrefixScalar(p + i, n - i);
+}
+
+__attribute__((target("avx2"))) size_t
+printablePrefixAVX2(const unsigned char* p, size_t n) {
+    const __m256i space = _mm256_set1_epi8(0x20);
+    const __m256i del = _mm256_set1_epi8(0x7F);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+        __m256i bad = _mm256_or_si256(_mm256_cmpgt_epi8(space, v),
+                                      _mm256_cmpeq_epi8(v, del));
+        uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(bad));
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + printablePrefixSSE2(p + i, n - i);
+}
+
+#endif // VIXX_LAYOUT_X86
+
+// Bytes of printable ASCII at the start of p
+size_t printablePrefix(const unsigned char* p, size_t n) {
+#ifdef VIXX_LAYOUT_X86
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2 ? printablePrefixAVX2(p, n) : printablePrefixSSE2(p, n);
+#else
+    return printablePrefixScalar(p, n);
+#endif
+}
+
+// The printable ASCII at the start of p that stands alone, leaving out a
+// last byte that a combining mark after it belongs with
+size_t asciiRun(const unsigned char* p, size_t n) {
+    size_t run = printablePrefix(p, n);
+    if (run > 0 && run < n && p[run] >= 0x80) {
+        uint32_t cp;
+        if (decodeUtf8(p + run, n - run, cp) && zeroWidth(cp)) {
+            --run;
+        }
+    }
+    return run;
+}
+
+// Calls piece(byte, column, ascii) for each piece of a line that is not
+// all printable ASCII, then returns its width in columns
+template <typename Piece>
+size_t forEachPiece(const unsigned char* p, size_t length, Piece piece) {
+    size_t at = asciiRun(p, length);
+    size_t column = at;
+    if (at > 0) {
+        piece(0, 0, true);
+    }
+    while (at < length) {
+        Glyph glyph = glyphAt(p + at, length - at, column);
+        piece(at, column, false);
+        at += glyph.length;
+        column += glyph.columns;
+        size_t run = asciiRun(p + at, length - at);
+        if (run > 0) {
+            piece(at, column, true);
+            at += run;
+            column += run;
+        }
+    }
+    return column;
+}
+
+// Breaks a line into rows of `width` columns, a piece at a time. A run of
+// ASCII breaks anywhere; a single character moves to the next row whole
+// unless the row is empty.
+class RowBreaker {
+  public:
+    explicit RowBreaker(size_t width) : width(width), used(0) {}
+
+    // Calls row(byte) for the start of each row after the first
+    template <typename Row>
+    void add(size_t byte, size_t columns, bool ascii, Row row) {
+        if (!ascii) {
+            if (used > 0 && used + columns > width) {
+                row(byte);
+                used = 0;
+            }
+            used += columns;
+            return;
+        }
+        while (columns > 0) {
+            if (used >= width) {
+                row(byte);
+                used = 0;
+            }
+            size_t take = std::min(width - used, columns);
+            byte += take;
+            columns -= take;
+            used += take;
+        }
+    }
+
+  private:
+    size_t width;
+    size_t used;
+};
+
+void appendHex(unsigned value, std::string& out) {
+    static const char kDigits[] = "0123456789abcdef";
+    out += '<';
+    if (value > 0xFF) {
+        out += kDigits[(value >> 12) & 0xF];
+        out += kDigits[(value >> 8) & 0xF];
+    }
+    out += kDigits[(value >> 4) & 0xF];
+    out += kDigits[value & 0xF];
+    out += '>';
+}
+
+} // namespace
+
+size_t utf8SequenceLength(unsigned char lead) {
+    if (lead < 0x80) {
+        return 1;
+    }
+    if (lead < 0xC2) {
+        return 0;
+    }
+    if (lead < 0xE0) {
+        return 2;
+    }
+    if (lead < 0xF0) {
+        return 3;
+    }
+    return lead < 0xF5 ? 4 : 0;
+}
+
+// ===--- LineLayout ---===
+
+LineLayout::LineLayout() : bytes(0), total_columns(0), wrap_width(0) {}
+
+LineLayout::LineLayout(const char* line, size_t length)
+    : bytes(length), total_columns(0), wrap_width(0) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(line);
+    if (asciiRun(p, length) == length) {
+        total_columns = length;
+        return;
+    }
+    total_columns = forEachPiece(p, length, [this](size_t byte, size_t column,
+                                                   bool ascii) {
+        pieces.push_back(Piece{byte, column, ascii});
+    });
+    pieces.push_back(Piece{length, total_columns, false});
+}
+
+// The piece holding `offset`, which is less than length()
+size_t LineLayout::pieceAt(size_t offset) const {
+    auto it = std::upper_bound(
+        pieces.begin(), pieces.end(), offset,
+        [](size_t value, const Piece& piece) { return value < piece.byte; });
+    return static_cast<size_t>(it - pieces.begin()) - 1;
+}
+
+size_t LineLayout::charStart(size_t offset) const {
+    if (offset >= bytes) {
+        return bytes;
+    }
+    if (simple()) {
+        return offset;
+    }
+    const Piece& piece = pieces[pieceAt(offset)];
+    return piece.ascii ? offset : piece.byte;
+}
+
+size_t LineLayout::nextChar(size_t offset) const {
+    if (offset >= bytes) {
+        return bytes;
+    }
+    if (simple()) {
+        return offset + 1;
+    }
+    size_t k = pieceAt(offset);
+    return pieces[k].ascii ? offset + 1 : pieces[k + 1].byte;
+}
+
+size_t LineLayout::prevChar(size_t offset) const {
+    if (offset == 0) {
+        return 0;
+    }
+    return charStart(std::min(offset, bytes) - 1);
+}
+
+size_t LineLayout::columnOf(size_t offset) const {
+    if (offset >= bytes) {
+        return total_columns;
+    }
+    if (simple()) {
+        return offset;
+    }
+    const Piece& piece = pieces[pieceAt(offset)];
+    return piece.ascii ? piece.column + (offset - piece.byte) : piece.column;
+}
+
+size_t LineLayout::offsetAtColumn(size_t column) const {
+    if (column >= total_columns) {
+        return bytes;
+    }
+    if (simple()) {
+        return column;
+    }
+    auto it = std::upper_bound(
+        pieces.begin(), pieces.end(), column,
+        [](size_t value, const Piece& piece) { return value < piece.column; });
+    const Piece& piece = *(it - 1);
+    return piece.ascii ? piece.byte + (column - piece.column) : piece.byte;
+}
+
+// Fills row_starts for `width`
+void LineLayout::wrap(size_t width) const {
+    if (wrap_width == width) {
+        return;
+    }
+    wrap_width = width;
+    row_starts.assign(1, 0);
+    RowBreaker breaker(width);
+    for (size_t k = 0; k + 1 < pieces.size(); ++k) {
+        breaker.add(pieces[k].byte, pieces[k + 1].column - pieces[k].column,
+                    pieces[k].ascii,
+                    [this](size_t byte) { row_starts.push_back(byte); });
+    }
+}
+
+size_t LineLayout::rowCount(size_t width) const {
+    if (simple()) {
+        return bytes > width ? (bytes + width - 1) / width : 1;
+    }
+    wrap(width);
+    return row_starts.size();
+}
+
+size_t LineLayout::rowStart(size_t row, size_t width) const {
+    if (simple()) {
+        return std::min(row * width, bytes);
+    }
+    wrap(width);
+    return row < row_starts.size() ? row_starts[row] : bytes;
+}
+
+void LineLayout::position(size_t offset, size_t width, size_t& row,
+                          size_t& column) const {
+    if (simple()) {
+        offset = std::min(offset, bytes);
+        row = offset / width;
+        column = offset % width;
+        return;
+    }
+    wrap(width);
+    offset = charStart(offset);
+    row = static_cast<size_t>(std::upper_bound(row_starts.begin(),
+                                               row_starts.end(), offset) -
+                              row_starts.begin()) - 1;
+    column = columnOf(offset) - columnOf(row_starts[row]);
+    if (offset == bytes && column >= width) {
+        ++row;
+        column = 0;
+    }
+}
+
+void LineLayout::display(const char* line, size_t begin, size_t end,
+                         std::string& out) const {
+    begin = charStart(begin);
+    end = std::min(end, bytes);
+    if (simple()) {
+        if (begin < end) {
+            out.append(line + begin, end - begin);
+        }
+        return;
+    }
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(line);
+    for (size_t k = pieceAt(begin); begin < end; ++k) {
+        const Piece& piece = pieces[k];
+        size_t piece_end = std::min(pieces[k + 1].byte, end);
+        if (piece.ascii) {
+            out.append(line + begin, piece_end - begin);
+            begin = piece_end;
+            continue;
+        }
+        Glyph glyph = glyphAt(p + piece.byte, bytes - piece.byte, piece.column);
+        switch (glyph.kind) {
+        case GlyphKind::MARK:
+            out += ' ';
+            out.append(line + piece.byte, glyph.length);
+            break;
+        case GlyphKind::TAB:
+            out.append(glyph.columns, ' ');
+            break;
+        case GlyphKind::CONTROL:
+            out += '^';
+            out += static_cast<char>(p[piece.byte] ^ 0x40);
+            break;
+        case GlyphKind::HEX: {
+            uint32_t cp = p[piece.byte];
+            if (glyph.length > 1) {
+                decodeUtf8(p + piece.byte, glyph.length, cp);
+            }
+            appendHex(cp, out);
+            break;
+        }
+        default:
+            out.append(line + piece.byte, glyph.length);
+            break;
+        }
+        begin = pieces[k + 1].byte;
+    }
+}
+
+// No character takes more than kTabStop columns, so a short enough line
+// fits in a row without being looked at. Other lines are walked piece by
+// piece as the constructor and wrap() do, without keeping the pieces.
+size_t LineLayout::countRows(const char* line, size_t length, size_t width) {
+    if (length <= width / kTabStop) {
+        return 1;
+    }
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(line);
+    if (printablePrefix(p, length) == length) {
+        return length > width ? (length + width - 1) / width : 1;
+    }
+    size_t rows = 1;
+    RowBreaker breaker(width);
+    // Each piece is added once the next one says how wide it is
+    size_t last_byte = 0, last_column = 0;
+    bool last_ascii = false, started = false;
+    size_t columns = forEachPiece(p, length, [&](size_t byte, size_t column,
+                                                 bool ascii) {
+        if (started) {
+            breaker.add(last_byte, column - last_column, last_ascii,
+                        [&rows](size_t) { ++rows; });
+        }
+        last_byte = byte;
+        last_column = column;
+        last_ascii = ascii;
+        started = true;
+    });
+    breaker.add(last_byte, columns - last_column, last_ascii,
+                [&rows](size_t) { ++rows; });
+    return rows;
+}
+
+// ===--- LayoutCache ---===
+
+const LineLayout& LayoutCache::get(const PieceTable& text, size_t line) {
+    auto it = layouts.find(line);
+    if (it != layouts.end()) {
+        return it->second;
+    }
+    if (layouts.size() >= kMaxCachedLines) {
+        layouts.clear();
+    }
+    std::string content = text.getLine(line);
+    return layouts.emplace(line, LineLayout(content.data(), content.size()))
+        .first->second;
+}
+
+void LayoutCache::linesChanged(size_t line, size_t removed, size_t inserted) {
+    auto first = layouts.lower_bound(line);
+    auto rest = layouts.lower_bound(line + removed);
+    layouts.erase(first, rest);
+    if (removed == inserted) {
+        return;
+    }
+    // Later lines keep their layouts under their new numbers
+    std::map<size_t, LineLayout> moved;
+    while (rest != layouts.end()) {
+        auto node = layouts.extract(rest++);
+        node.key() = node.key() - removed + inserted;
+        moved.insert(std::move(node));
+    }
+    layouts.merge(moved);
+}
@@ -0,0 +1,160 @@
+// src/backend/line_scanner.cpp
+
+#include "backend/line_scanner.h"
+#include <cstdint>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define VIXX_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+void scanScalar(const char* data, size_t n, size_t base, char prev,
+                std::vector<size_t>& breaks, LineScanStats& stats) {
+    for (size_t i = 0; i < n; ++i) {
+        if (data[i] == '\n') {
+            breaks.push_back(base + i);
+            ++stats.newlines;
+            if ((i > 0 ? data[i - 1] : prev) == '\r')
+                ++stats.crlf;
+        }
+    }
+}
+
+#ifdef VIXX_SCAN_X86
+
+// Shared by both vector widths: records the newlines of one block given its
+// '\n' and '\r' masks. `carry` is 1 when the previous block ended in '\r'.
+template <typename Mask>
+inline void emitBlock(Mask nl, Mask cr, Mask carry, size_t block_base,
+                      std::vector<size_t>& breaks, LineScanStats& stats) {
+    stats.newlines += __builtin_popcountll(nl);
+    stats.crlf += __builtin_popcountll(nl & ((cr << 1) | carry));
+    while (nl) {
+        breaks.push_back(block_base + __builtin_ctzll(nl));
+        nl &= nl - 1;
+    }
+}
+
+void scanSSE2(const char* data, size_t n, size_t base, char prev,
+              std::vector<size_t>& breaks, LineScanStats& stats) {
+    const __m128i lf = _mm_set1_epi8('\n');
+    const __m128i cr = _mm_set1_epi8('\r');
+    uint32_t carry = prev == '\r';
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        uint32_t m_lf = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, lf)));
+        if (m_lf == 0) {
+            carry = data[i + 15] == '\r';
+            continue;
+        }
+        uint32_t m_cr = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, cr)));
+        emitBlock<uint32_t>(m_lf, m_cr, carry, base + i, breaks, stats);
+        carry = (m_cr >> 15) & 1;
+    }
+    scanScalar(data + i, n - i, base + i, i > 0 ? data[i - 1] : prev, breaks,
+               stats);
+}
+
+__attribute__((target("avx2"))) void
+scanAVX2(const char* data, size_t n, size_t base, char prev,
+         std::vector<size_t>& breaks, LineScanStats& stats) {
+    const __m256i lf = _mm256_set1_epi8('\n');
+    const __m256i cr = _mm256_set1_epi8('\r');
+    uint64_t carry = prev == '\r';
+    size_t i = 0;
+    // Two 32-byte blocks per iteration, combined into one 64-bit mask
+    for (; i + 64 <= n; i += 64) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + 32));
+        uint64_t m_lf =
+            static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, lf))) |
+            static_cast<uint64_t>(static_cast<uint32_t>(
+                _mm256_movemask_epi8(_mm256_cmpeq_epi8(b, lf)))) << 32;
+        if (m_lf == 0) {
+            carry = data[i + 63] == '\r';
+            continue;
+        }
+        uint64_t m_cr =
+            static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, cr))) |
+            static_cast<uint64_t>(static_cast<uint32_t>(
+                _mm256_movemask_epi8(_mm256_cmpeq_epi8(b, cr)))) << 32;
+        emitBlock<uint64_t>(m_lf, m_cr, carry, base + i, breaks, stats);
+        carry = m_cr >> 63;
+    }
+    scanSSE2(data + i, n - i, base + i, i > 0 ? data[i - 1] : prev, breaks,
+             stats);
+}
+
+#endif // VIXX_SCAN_X86
+
+} // namespace
+
+bool scanKernelSupported(ScanKernel kernel) {
+    switch (kernel) {
+    case ScanKernel::SCALAR:
+        return true;
+#ifdef VIXX_SCAN_X86
+    case ScanKernel::SSE2:
+        return true; // Part of the x86-64 baseline
+    case ScanKernel::AVX2:
+        return __builtin_cpu_supports("avx2");
+#else
+    default:
+        return false;
+#endif
+    }
+    return false;
+}
+
+ScanKernel bestScanKernel() {
+    static const ScanKernel best =
+        scanKernelSupported(ScanKernel::AVX2)   ? ScanKernel::AVX2
+        : scanKernelSupported(ScanKernel::SSE2) ? ScanKernel::SSE2
+                                                : ScanKernel::SCALAR;
+    return best;
+}
+
+const char* scanKernelName(ScanKernel kernel) {
+    switch (kernel) {
+    case ScanKernel::SCALAR:
+        return "scalar";
+    case ScanKernel::SSE2:
+        return "sse2";
+    case ScanKernel::AVX2:
+        return "avx2";
+    }
+    return "?";
+}
+
+void scanLines(const char* data, size_t n, size_t base, char prev,
+               std::vector<size_t>& breaks, LineScanStats& stats) {
+    scanLines(bestScanKernel(), data, n, base, prev, breaks, stats);
+}
+
+void scanLines(ScanKernel kernel, const char* data, size_t n, size_t base,
+               char prev, std::vector<size_t>& breaks, LineScanStats& stats) {
+    switch (kernel) {
+#ifdef VIXX_SCAN_X86
+    case ScanKernel::AVX2:
+        scanAVX2(data, n, base, prev, breaks, stats);
+        return;
+    case ScanKernel::SSE2:
+        scanSSE2(data, n, base, prev, breaks, stats);
+        return;
+#endif
+    default:
+        scanScalar(data, n, base, prev, breaks, stats);
+        return;
+    }
+}
+
+LineEnding detectLineEnding(const LineScanStats& stats) {
+    if (stats.crlf == 0)
+        return LineEnding::LF;
+    if (stats.crlf == stats.newlines)
+        return LineEnding::CRLF;
+    return LineEnding::MIXED;
+}
@@ -0,0 +1,43 @@
+// src/backend/mapped_file.cpp
+
+#include "backend/mapped_file.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+std::shared_ptr<MappedFile> MappedFile::open(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return nullptr;
+    }
+
+    size_t length = static_cast<size_t>(st.st_size);
+    const char* addr = nullptr;
+    if (length > 0) {
+        void* p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            close(fd);
+            return nullptr;
+        }
+        addr = static_cast<const char*>(p);
+    }
+    close(fd); // The mapping keeps its own reference to the file
+
+    return std::shared_ptr<MappedFile>(new MappedFile(addr, length));
+}
+
+MappedFile::MappedFile(const char* addr, size_t length)
+    : addr(addr), length(length) {}
+
+MappedFile::~MappedFile() {
+    if (addr) {
+        munmap(const_cast<char*>(addr), length);
+    }
+}
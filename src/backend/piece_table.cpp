@@ -0,0 +1,840 @@
+// src/backend/piece_table.cpp
+
+#include "backend/piece_table.h"
+#include "backend/line_scanner.h"
+#include "common/thread_pool.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// Size of a fresh add-buffer chunk; larger insertions get a chunk of their own
+const size_t kChunkCapacity = 1 << 20;
+
+const uint32_t kNoSource = UINT32_MAX;
+
+// Bytes scanned per lock hold by the background indexer
+const size_t kIndexChunk = 1 << 20;
+
+// Extra lines indexed past the ones asked for, so scrolling a few screens
+// does not go back to the scanner every frame
+const size_t kScanAheadLines = 4096;
+
+// Most runs repeat() shares before it copies the text instead
+const size_t kRepeatShareRuns = 4096;
+
+} // namespace
+
+// ===--- TextSource ---===
+
+TextSource::TextSource(std::string text, std::vector<size_t> breaks)
+    : owned(std::move(text)), base(nullptr), length(0), cap(0),
+      breaks(std::move(breaks)), index_complete(true), scanned(0) {
+    base = owned.data();
+    length = cap = scanned = owned.size();
+}
+
+TextSource::TextSource(size_t capacity)
+    : storage(new char[capacity]), base(storage.get()), length(0),
+      cap(capacity), index_complete(true), scanned(0) {}
+
+TextSource::TextSource(std::shared_ptr<MappedFile> file)
+    : mapping(std::move(file)), base(mapping->data()), length(mapping->size()),
+      cap(mapping->size()), index_complete(false), scanned(0) {
+    if (length == 0)
+        index_complete = true;
+}
+
+
+size_t TextSource::append(const char* text, size_t n) {
+    size_t start = length;
+    std::memcpy(storage.get() + start, text, n);
+    LineScanStats stats;
+    scanLines(text, n, start, '\0', breaks, stats);
+    length += n;
+    return start;
+}
+
+size_t TextSource::countBreaks(size_t start, size_t end) const {
+    std::unique_lock<std::mutex> lock(index_mutex, std::defer_lock);
+    if (!indexed())
+        lock.lock();
+    auto first = std::lower_bound(breaks.begin(), breaks.end(), start);
+    auto last = std::lower_bound(first, breaks.end(), end);
+    return static_cast<size_t>(last - first);
+}
+
+size_t TextSource::nthBreak(size_t start, size_t k) const {
+    std::unique_lock<std::mutex> lock(index_mutex, std::defer_lock);
+    if (!indexed())
+        lock.lock();
+    auto first = std::lower_bound(breaks.begin(), breaks.end(), start);
+    return *(first + k);
+}
+
+void TextSource::indexBreaks(size_t count) {
+    if (indexed())
+        return;
+    std::lock_guard<std::mutex> lock(index_mutex);
+    while (breaks.size() < count && scanned < length) {
+        scanChunk(64 * 1024);
+    }
+}
+
+void TextSource::indexTo(size_t offset) {
+    if (indexed())
+        return;
+    std::lock_guard<std::mutex> lock(index_mutex);
+    if (scanned < offset)
+        scanChunk(std::min(offset, length) - scanned);
+}
+
+void TextSource::indexAll() {
+    if (indexed())
+        return;
+    std::lock_guard<std::mutex> lock(index_mutex);
+    scanChunk(length - scanned);
+}
+
+void TextSource::indexInBackground(ThreadPool& pool,
+                                   std::function<void()> done) {
+    std::weak_ptr<TextSource> source = shared_from_this();
+    pool.submit([source, &pool, done] { indexStep(source, pool, done); });
+}
+
+void TextSource::indexStep(std::weak_ptr<TextSource> source, ThreadPool& pool,
+                           std::function<void()> done) {
+    if (std::shared_ptr<TextSource> alive = source.lock()) {
+        if (!alive->indexed()) {
+            std::lock_guard<std::mutex> lock(alive->index_mutex);
+            alive->scanChunk(kIndexChunk);
+        }
+        if (!alive->indexed()) {
+            pool.submit([source, &pool, done] { indexStep(source, pool, done); });
+            return;
+        }
+    }
+    if (done)
+        done();
+}
+
+void TextSource::scanChunk(size_t bytes) {
+    size_t end = std::min(length, scanned + bytes);
+    LineScanStats stats;
+    scanLines(base + scanned, end - scanned, scanned,
+              scanned > 0 ? base[scanned - 1] : '\0', breaks, stats);
+    scanned = end;
+    if (scanned == length)
+        index_complete.store(true, std::memory_order_release);
+}
+
+// ===--- PieceList ---===
+
+void PieceList::push_back(const Piece& piece) {
+    if (count == 0) {
+        single = piece;
+    } else {
+        if (count == 1)
+            many.assign(1, single);
+        many.push_back(piece);
+    }
+    ++count;
+}
+
+void PieceList::push_front(const Piece& piece) {
+    if (count == 0) {
+        single = piece;
+    } else {
+        if (count == 1)
+            many.assign(1, single);
+        many.insert(many.begin(), piece);
+    }
+    ++count;
+}
+
+void PieceList::pop_back() {
+    if (count == 0)
+        return;
+    if (count == 2) {
+        single = many.front();
+        many.clear();
+    } else if (count > 2) {
+        many.pop_back();
+    }
+    --count;
+}
+
+size_t PieceList::length() const {
+    size_t total = 0;
+    for (size_t i = 0; i < count; ++i)
+        total += (*this)[i].length;
+    return total;
+}
+
+size_t PieceList::newlines() const {
+    size_t total = 0;
+    for (size_t i = 0; i < count; ++i)
+        total += (*this)[i].newlines;
+    return total;
+}
+
+// ===--- SharedText ---===
+
+const SharedText& SharedText::newline() {
+    static const SharedText text = [] {
+        SharedText t;
+        t.runs.push_back(Run{std::make_shared<TextSource>(
+                                 std::string("\n"), std::vector<size_t>{0}),
+                             0, 1, 1});
+        return t;
+    }();
+    return text;
+}
+
+size_t SharedText::length() const {
+    size_t total = 0;
+    for (const Run& run : runs)
+        total += run.length;
+    return total;
+}
+
+size_t SharedText::newlines() const {
+    size_t total = 0;
+    for (const Run& run : runs)
+        total += run.newlines;
+    return total;
+}
+
+void SharedText::append(const SharedText& other) {
+    runs.insert(runs.end(), other.runs.begin(), other.runs.end());
+}
+
+SharedText SharedText::repeat(size_t t) const {
+    SharedText out;
+    if (runs.size() * t <= kRepeatShareRuns) {
+        out.runs.reserve(runs.size() * t);
+        for (size_t i = 0; i < t; ++i)
+            out.append(*this);
+        return out;
+    }
+    std::string text = str();
+    size_t total = text.size() * t;
+    text.reserve(total);
+    while (text.size() * 2 <= total)
+        text.append(text.data(), text.size());
+    text.append(text.data(), total - text.size());
+    std::vector<size_t> breaks;
+    LineScanStats stats;
+    scanLines(text.data(), text.size(), 0, '\0', breaks, stats);
+    size_t newlines = breaks.size();
+    out.runs.push_back(Run{std::make_shared<TextSource>(std::move(text),
+                                                        std::move(breaks)),
+                           0, total, newlines});
+    return out;
+}
+
+void SharedText::chopNewline() {
+    if (runs.empty())
+        return;
+    Run& last = runs.back();
+    if (last.source->data()[last.start + last.length - 1] != '\n')
+        return;
+    --last.length;
+    --last.newlines;
+    if (last.length == 0)
+        runs.pop_back();
+}
+
+std::string SharedText::str() const {
+    std::string out;
+    out.reserve(length());
+    for (const Run& run : runs)
+        out.append(run.source->data() + run.start, run.length);
+    return out;
+}
+
+// ===--- PieceTable ---===
+
+PieceTable::PieceTable()
+    : add_source(kNoSource), root(0), rng_state(2463534242u), lazy(false),
+      tail_start(0), tail_end(0) {
+    load("");
+}
+
+void PieceTable::load(std::string text) {
+    std::vector<size_t> breaks;
+    LineScanStats stats;
+    scanLines(text.data(), text.size(), 0, '\0', breaks, stats);
+    load(std::move(text), std::move(breaks));
+}
+
+void PieceTable::load(std::string text, std::vector<size_t> breaks) {
+    sources.clear();
+    nodes.clear();
+    free_nodes.clear();
+    nodes.push_back(Node{Piece{0, 0, 0, 0}, 0, 0, 0, 0, 0}); // nil sentinel
+    add_source = kNoSource;
+    root = 0;
+    lazy = false;
+    tail_start = tail_end = 0;
+
+    sources.push_back(
+        std::make_shared<TextSource>(std::move(text), std::move(breaks)));
+    const TextSource& original = *sources[0];
+    if (original.size() > 0) {
+        root = newNode(Piece{0, 0, original.size(),
+                             original.countBreaks(0, original.size())});
+    }
+}
+
+void PieceTable::loadMapped(std::shared_ptr<MappedFile> file, size_t length) {
+    load("");
+    sources[0] = std::make_shared<TextSource>(std::move(file));
+    if (length > 0) {
+        // The tree stays empty until the first edit
+        tail_end = length;
+        lazy = true;
+    }
+}
+
+bool PieceTable::indexed() const {
+    return !lazy || sources[0]->indexed();
+}
+
+void PieceTable::indexInBackground(ThreadPool& pool,
+                                   std::function<void()> done) const {
+    if (indexed()) {
+        if (done)
+            done();
+        return;
+    }
+    sources[0]->indexInBackground(pool, std::move(done));
+}
+
+// The source counts newlines from its start, the ones before the tail
+// included
+void PieceTable::indexLines(size_t count) const {
+    size_t tree_lines = nodes[root].sub_newlines;
+    if (!lazy || count <= tree_lines)
+        return;
+    size_t before = sources[0]->countBreaks(0, tail_start);
+    size_t rest = count - tree_lines;
+    size_t wanted = rest > SIZE_MAX - kScanAheadLines - before
+                        ? SIZE_MAX
+                        : rest + before + kScanAheadLines;
+    sources[0]->indexBreaks(wanted);
+}
+
+size_t PieceTable::size() const {
+    return nodes[root].sub_length + (lazy ? tail_end - tail_start : 0);
+}
+
+size_t PieceTable::lineCount() const {
+    size_t lines = nodes[root].sub_newlines + 1;
+    if (lazy)
+        lines += sources[0]->countBreaks(tail_start, tail_end);
+    return lines;
+}
+
+size_t PieceTable::lineStart(size_t line) const {
+    if (line == 0)
+        return 0;
+    indexLines(line);
+    if (line >= lineCount())
+        return size();
+    return newlineOffset(line - 1) + 1;
+}
+
+size_t PieceTable::lineEnd(size_t line) const {
+    indexLines(line + 1);
+    if (line + 1 >= lineCount())
+        return size();
+    return newlineOffset(line);
+}
+
+size_t PieceTable::lineLength(size_t line) const {
+    return lineEnd(line) - lineStart(line);
+}
+
+void PieceTable::readLine(size_t line, std::string& out) const {
+    out.clear();
+    if (line >= lineCount())
+        return;
+    size_t start = lineStart(line);
+    size_t end = lineEnd(line);
+    out.reserve(end - start);
+    forEachSpan(start, end - start,
+                [&out](const char* p, size_t n) { out.append(p, n); });
+}
+
+std::string PieceTable::getLine(size_t line) const {
+    std::string out;
+    readLine(line, out);
+    return out;
+}
+
+char PieceTable::at(size_t offset) const {
+    char c = '\0';
+    forEachSpan(offset, 1, [&c](const char* p, size_t) { c = *p; });
+    return c;
+}
+
+std::string PieceTable::read(size_t offset, size_t n) const {
+    std::string out;
+    out.reserve(n);
+    forEachSpan(offset, n,
+                [&out](const char* p, size_t len) { out.append(p, len); });
+    return out;
+}
+
+void PieceTable::forEachSpan(
+    size_t offset, size_t n,
+    const std::function<void(const char*, size_t)>& f) const {
+    size_t end = std::min(size(), offset + n);
+    if (offset < end)
+        visit(root, 0, offset, end, f);
+    size_t tree_length = nodes[root].sub_length;
+    if (lazy && end > tree_length) {
+        size_t from = std::max(offset, tree_length) - tree_length;
+        f(sources[0]->data() + tail_start + from, end - tree_length - from);
+    }
+}
+
+size_t PieceTable::lineAt(size_t offset) const {
+    size_t tree_length = nodes[root].sub_length;
+    if (lazy && offset >= tree_length) {
+        // Only the tail up to the offset is indexed
+        size_t end = tail_start + std::min(offset - tree_length,
+                                           tail_end - tail_start);
+        sources[0]->indexTo(end);
+        return nodes[root].sub_newlines +
+               sources[0]->countBreaks(tail_start, end);
+    }
+    uint32_t t = root;
+    size_t line = 0;
+    while (t) {
+        const Node& n = nodes[t];
+        size_t left_length = nodes[n.left].sub_length;
+        if (offset < left_length) {
+            t = n.left;
+            continue;
+        }
+        offset -= left_length;
+        line += nodes[n.left].sub_newlines;
+        if (offset < n.piece.length) {
+            return line + sources[n.piece.source]->countBreaks(
+                              n.piece.start, n.piece.start + offset);
+        }
+        offset -= n.piece.length;
+        line += n.piece.newlines;
+        t = n.right;
+    }
+    return line;
+}
+
+PieceList PieceTable::collect(size_t offset, size_t n) const {
+    PieceList out;
+    size_t end = std::min(size(), offset + n);
+    if (offset >= end)
+        return out;
+    collectPieces(root, 0, offset, end, out);
+    size_t tree_length = nodes[root].sub_length;
+    if (lazy && end > tree_length) {
+        // Pieces of the tail carry their newline count, so it is indexed
+        // as far as they go
+        size_t from = tail_start + std::max(offset, tree_length) - tree_length;
+        size_t to = tail_start + end - tree_length;
+        sources[0]->indexTo(to);
+        out.push_back(
+            Piece{0, from, to - from, sources[0]->countBreaks(from, to)});
+    }
+    return out;
+}
+
+SharedText PieceTable::share(size_t offset, size_t n) const {
+    PieceList pieces = collect(offset, n);
+    SharedText text;
+    text.runs.reserve(pieces.size());
+    for (size_t i = 0; i < pieces.size(); ++i) {
+        const Piece& piece = pieces[i];
+        text.runs.push_back(SharedText::Run{sources[piece.source], piece.start,
+                                            piece.length, piece.newlines});
+    }
+    return text;
+}
+
+// Text shared from this table finds its sources near the end of the list,
+// where the newest are, so the search starts there
+PieceList PieceTable::adopt(const SharedText& text) {
+    PieceList pieces;
+    for (const SharedText::Run& run : text.runs) {
+        uint32_t id = static_cast<uint32_t>(sources.size());
+        while (id > 0 && sources[id - 1] != run.source) {
+            --id;
+        }
+        id = id > 0 ? id - 1 : addSource(run.source);
+        pieces.push_back(Piece{id, run.start, run.length, run.newlines});
+    }
+    return pieces;
+}
+
+Piece PieceTable::slice(const Piece& piece, size_t from, size_t length) const {
+    if (from == 0 && length == piece.length)
+        return piece;
+    Piece part{piece.source, piece.start + from, length, 0};
+    part.newlines =
+        sources[part.source]->countBreaks(part.start, part.start + length);
+    return part;
+}
+
+Piece PieceTable::insert(size_t offset, const char* text, size_t n) {
+    if (n == 0)
+        return Piece{0, 0, 0, 0};
+    offset = std::min(offset, size());
+    detachTail(offset);
+
+    uint32_t l, r;
+    split(root, offset, l, r);
+    Piece piece = appendText(text, n);
+    // Consecutive typing lands right after the previous insertion, so the
+    // piece before the cursor usually just grows
+    if (!extendLast(l, piece))
+        l = merge(l, newNode(piece));
+    root = merge(l, r);
+    return piece;
+}
+
+void PieceTable::insertPieces(size_t offset, const PieceList& pieces) {
+    if (pieces.empty())
+        return;
+    offset = std::min(offset, size());
+    detachTail(offset);
+
+    uint32_t l, r;
+    split(root, offset, l, r);
+    root = merge(merge(l, buildTree(pieces.data(), pieces.size())), r);
+}
+
+uint32_t PieceTable::addSource(std::shared_ptr<TextSource> source) {
+    sources.push_back(std::move(source));
+    return static_cast<uint32_t>(sources.size() - 1);
+}
+
+void PieceTable::replaceRanges(const std::vector<Splice>& splices) {
+    if (splices.empty())
+        return;
+    detachTail(splices.back().offset + splices.back().length);
+
+    std::vector<Piece> old;
+    old.reserve(nodes.size());
+    flatten(root, old);
+
+    std::vector<Piece> out;
+    out.reserve(old.size() + 2 * splices.size());
+    auto push = [&out](const Piece& piece) {
+        if (piece.length == 0)
+            return;
+        if (!out.empty()) {
+            Piece& last = out.back();
+            if (last.source == piece.source &&
+                last.start + last.length == piece.start) {
+                last.length += piece.length;
+                last.newlines += piece.newlines;
+                return;
+            }
+        }
+        out.push_back(piece);
+    };
+
+    // Walks the old pieces up to `target`, keeping or dropping what it
+    // passes over
+    size_t i = 0, skip = 0, pos = 0;
+    auto advance = [&](size_t target, bool keep) {
+        while (pos < target && i < old.size()) {
+            const Piece& piece = old[i];
+            size_t take = std::min(piece.length - skip, target - pos);
+            if (keep)
+                push(take == piece.length ? piece : slice(piece, skip, take));
+            pos += take;
+            skip += take;
+            if (skip == piece.length) {
+                ++i;
+                skip = 0;
+            }
+        }
+    };
+    for (const Splice& splice : splices) {
+        advance(splice.offset, true);
+        advance(splice.offset + splice.length, false);
+        for (size_t k = 0; k < splice.pieces.size(); ++k)
+            push(splice.pieces[k]);
+    }
+    advance(SIZE_MAX, true);
+
+    freeTree(root);
+    root = buildTree(out.data(), out.size());
+}
+
+void PieceTable::erase(size_t offset, size_t n) {
+    if (n == 0 || offset >= size())
+        return;
+    n = std::min(n, size() - offset);
+    detachTail(offset + n);
+
+    uint32_t a, bc, b, c;
+    split(root, offset, a, bc);
+    split(bc, n, b, c);
+    freeTree(b);
+    root = merge(a, c);
+}
+
+void PieceTable::materialize() {
+    detachTail(SIZE_MAX);
+}
+
+// Editing needs newline counts in the tree, so an edit of a lazily loaded
+// file moves the tail up to document offset `end` into it, indexing only
+// that far; the rest stays with the background index. Once that is done
+// the whole tail goes. The original itself is never copied: the tree only
+// gets a piece that points at it.
+void PieceTable::detachTail(size_t end) {
+    if (!lazy)
+        return;
+    TextSource& original = *sources[0];
+    size_t tree_length = nodes[root].sub_length;
+    size_t to = tail_end;
+    if (!original.indexed() && end < tree_length + (tail_end - tail_start))
+        to = tail_start + (end > tree_length ? end - tree_length : 0);
+    if (to > tail_start) {
+        original.indexTo(to);
+        Piece piece{0, tail_start, to - tail_start,
+                    original.countBreaks(tail_start, to)};
+        if (!extendLast(root, piece))
+            root = merge(root, newNode(piece));
+        tail_start = to;
+    }
+    if (tail_start == tail_end)
+        lazy = false;
+}
+
+// ===--- Treap internals ---===
+
+uint32_t PieceTable::nextPriority() {
+    // xorshift32
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+uint32_t PieceTable::newNode(const Piece& piece) {
+    uint32_t id;
+    if (!free_nodes.empty()) {
+        id = free_nodes.back();
+        free_nodes.pop_back();
+    } else {
+        id = static_cast<uint32_t>(nodes.size());
+        nodes.emplace_back();
+    }
+    nodes[id] = Node{piece, 0, 0, nextPriority(), piece.length, piece.newlines};
+    return id;
+}
+
+void PieceTable::freeTree(uint32_t t) {
+    if (!t)
+        return;
+    freeTree(nodes[t].left);
+    freeTree(nodes[t].right);
+    free_nodes.push_back(t);
+}
+
+void PieceTable::pull(uint32_t t) {
+    Node& n = nodes[t];
+    n.sub_length = nodes[n.left].sub_length + n.piece.length +
+                   nodes[n.right].sub_length;
+    n.sub_newlines = nodes[n.left].sub_newlines + n.piece.newlines +
+                     nodes[n.right].sub_newlines;
+}
+
+uint32_t PieceTable::merge(uint32_t a, uint32_t b) {
+    if (!a)
+        return b;
+    if (!b)
+        return a;
+    if (nodes[a].priority > nodes[b].priority) {
+        nodes[a].right = merge(nodes[a].right, b);
+        pull(a);
+        return a;
+    }
+    nodes[b].left = merge(a, nodes[b].left);
+    pull(b);
+    return b;
+}
+
+// Splits t so that l holds exactly the first `offset` bytes. A piece that
+// straddles the boundary is cut in two.
+void PieceTable::split(uint32_t t, size_t offset, uint32_t& l, uint32_t& r) {
+    if (!t) {
+        l = r = 0;
+        return;
+    }
+    size_t left_length = nodes[nodes[t].left].sub_length;
+    size_t piece_length = nodes[t].piece.length;
+
+    if (offset <= left_length) {
+        uint32_t ll, lr;
+        split(nodes[t].left, offset, ll, lr);
+        nodes[t].left = lr;
+        pull(t);
+        l = ll;
+        r = t;
+    } else if (offset >= left_length + piece_length) {
+        uint32_t rl, rr;
+        split(nodes[t].right, offset - left_length - piece_length, rl, rr);
+        nodes[t].right = rl;
+        pull(t);
+        l = t;
+        r = rr;
+    } else {
+        size_t k = offset - left_length;
+        Piece head = nodes[t].piece;
+        Piece tail = head;
+        tail.start += k;
+        tail.length -= k;
+        tail.newlines = sources[tail.source]->countBreaks(
+            tail.start, tail.start + tail.length);
+        head.length = k;
+        head.newlines -= tail.newlines;
+
+        nodes[t].piece = head;
+        uint32_t right = nodes[t].right;
+        nodes[t].right = 0;
+        pull(t);
+        uint32_t tail_node = newNode(tail);
+        l = t;
+        r = merge(tail_node, right);
+    }
+}
+
+bool PieceTable::extendLast(uint32_t t, const Piece& piece) {
+    if (!t)
+        return false;
+    if (nodes[t].right) {
+        if (!extendLast(nodes[t].right, piece))
+            return false;
+        pull(t);
+        return true;
+    }
+    Piece& last = nodes[t].piece;
+    if (last.source != piece.source || last.start + last.length != piece.start)
+        return false;
+    last.length += piece.length;
+    last.newlines += piece.newlines;
+    pull(t);
+    return true;
+}
+
+// Builds a balanced subtree in O(k). Priorities are raised towards the root
+// so the result is a valid treap.
+uint32_t PieceTable::buildTree(const Piece* pieces, size_t n) {
+    if (n == 0)
+        return 0;
+    size_t mid = n / 2;
+    uint32_t left = buildTree(pieces, mid);
+    uint32_t right = buildTree(pieces + mid + 1, n - mid - 1);
+    uint32_t t = newNode(pieces[mid]);
+    nodes[t].left = left;
+    nodes[t].right = right;
+    uint32_t priority = std::max(nodes[left].priority, nodes[right].priority);
+    nodes[t].priority = std::max(nodes[t].priority, priority == UINT32_MAX
+                                                        ? priority
+                                                        : priority + 1);
+    pull(t);
+    return t;
+}
+
+Piece PieceTable::appendText(const char* text, size_t n) {
+    if (add_source == kNoSource ||
+        sources[add_source]->size() + n > sources[add_source]->capacity()) {
+        sources.push_back(
+            std::make_shared<TextSource>(std::max(kChunkCapacity, n)));
+        add_source = static_cast<uint32_t>(sources.size() - 1);
+    }
+    TextSource& chunk = *sources[add_source];
+    size_t start = chunk.append(text, n);
+    return Piece{add_source, start, n, chunk.countBreaks(start, start + n)};
+}
+
+// Offset of the k-th (0-based) newline in the document
+size_t PieceTable::newlineOffset(size_t k) const {
+    size_t tree_newlines = nodes[root].sub_newlines;
+    if (lazy && k >= tree_newlines) {
+        size_t at = sources[0]->nthBreak(tail_start, k - tree_newlines);
+        return nodes[root].sub_length + at - tail_start;
+    }
+    uint32_t t = root;
+    size_t base = 0;
+    while (t) {
+        const Node& n = nodes[t];
+        size_t left_newlines = nodes[n.left].sub_newlines;
+        if (k < left_newlines) {
+            t = n.left;
+            continue;
+        }
+        k -= left_newlines;
+        base += nodes[n.left].sub_length;
+        if (k < n.piece.newlines) {
+            const TextSource& src = *sources[n.piece.source];
+            return base + src.nthBreak(n.piece.start, k) - n.piece.start;
+        }
+        k -= n.piece.newlines;
+        base += n.piece.length;
+        t = n.right;
+    }
+    return size();
+}
+
+void PieceTable::visit(uint32_t t, size_t base, size_t from, size_t to,
+                       const std::function<void(const char*, size_t)>& f) const {
+    if (!t)
+        return;
+    const Node& n = nodes[t];
+    size_t piece_begin = base + nodes[n.left].sub_length;
+    size_t piece_end = piece_begin + n.piece.length;
+
+    if (from < piece_begin)
+        visit(n.left, base, from, to, f);
+    size_t s = std::max(from, piece_begin);
+    size_t e = std::min(to, piece_end);
+    if (s < e)
+        f(sources[n.piece.source]->data() + n.piece.start + (s - piece_begin),
+          e - s);
+    if (to > piece_end)
+        visit(n.right, piece_end, from, to, f);
+}
+
+void PieceTable::flatten(uint32_t t, std::vector<Piece>& out) const {
+    if (!t)
+        return;
+    flatten(nodes[t].left, out);
+    out.push_back(nodes[t].piece);
+    flatten(nodes[t].right, out);
+}
+
+void PieceTable::collectPieces(uint32_t t, size_t base, size_t from, size_t to,
+                               PieceList& out) const {
+    if (!t)
+        return;
+    const Node& n = nodes[t];
+    size_t piece_begin = base + nodes[n.left].sub_length;
+    size_t piece_end = piece_begin + n.piece.length;
+
+    if (from < piece_begin)
+        collectPieces(n.left, base, from, to, out);
+    size_t s = std::max(from, piece_begin);
+    size_t e = std::min(to, piece_end);
+    if (s < e)
+        out.push_back(slice(n.piece, s - piece_begin, e - s));
+    if (to > piece_end)
+        collectPieces(n.right, piece_end, from, to, out);
+}
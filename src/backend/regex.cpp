@@ -0,0 +1,1398 @@
+// src/backend/regex.cpp
+
+#include "backend/regex.h"
+#include <algorithm>
+#include <bitset>
+#include <cctype>
+#include <cstring>
+#include <unordered_map>
+
+namespace {
+
+using ByteSet = std::bitset<256>;
+
+enum class Op : uint8_t { SET, SPLIT, JMP, SAVE, ASSERT, BACKREF, MATCH };
+enum Assertion : uint32_t { BOL, EOL, WORD_START, WORD_END };
+
+struct Inst {
+    Op op;
+    uint32_t out; // Next instruction; SPLIT's preferred branch
+    uint32_t alt; // SPLIT's other branch
+    uint32_t arg; // SET: set; SAVE: slot; ASSERT: Assertion; BACKREF: group
+};
+
+const uint32_t kNoSlot = UINT32_MAX;
+const size_t kMaxInsts = 1 << 16;
+const int kMaxCount = 1000; // Largest n or m in \{n,m}
+const size_t kMaxStates = 2048; // Per DFA; the cache is flushed past this
+const size_t kBacktrackBudget = 1 << 22; // Steps per backtracking run
+
+// Bytes that make up words for \< and \>; bytes of UTF-8 sequences count
+bool isWordByte(unsigned char c) {
+    return std::isalnum(c) || c == '_' || c >= 0x80;
+}
+
+} // namespace
+
+// ===--- Program ---===
+
+struct RegexCode {
+    std::vector<Inst> insts;
+    uint32_t start = 0;      // Matches at the first position only
+    uint32_t unanchored = 0; // Skips any number of bytes first, as the
+                             // last resort
+};
+
+struct RegexProgram {
+    std::vector<ByteSet> sets;
+    RegexCode exec;    // With captures and backreferences: the backtracker's
+    RegexCode dfa;     // No captures, backreferences widened to their group
+    RegexCode reverse; // dfa read backwards; empty with backreferences
+    size_t groups = 0;
+    bool backrefs = false;
+    bool word_asserts = false;
+    bool ignore_case = false;
+    bool is_literal = false;
+    std::string literal; // The pattern if is_literal, else bytes every match
+                         // has in a row, possibly none
+
+    // Bytes no instruction tells apart share a class, which keeps the DFA
+    // tables small; class `classes` is the end of the text
+    uint8_t byte_class[256];
+    std::vector<unsigned char> class_byte; // One byte of every class
+    size_t classes = 0;
+};
+
+namespace {
+
+// ===--- Parser ---===
+
+struct Node {
+    enum Kind { EMPTY, SET, CONCAT, ALT, REPEAT, GROUP, ASSERT, BACKREF };
+    Kind kind;
+    std::vector<int> kids;
+    int value = 0; // SET: set; GROUP, BACKREF: group; ASSERT: Assertion
+    int min = 0;   // REPEAT; max < 0 for no limit
+    int max = 0;
+    bool greedy = true;
+};
+
+ByteSet classSet(char name) {
+    ByteSet set;
+    for (int c = 0; c < 128; ++c) {
+        bool in = false;
+        switch (std::tolower(name)) {
+        case 's': in = c == ' ' || c == '\t'; break;
+        case 'd': in = std::isdigit(c); break;
+        case 'w': in = std::isalnum(c) || c == '_'; break;
+        case 'a': in = std::isalpha(c); break;
+        case 'l': in = std::islower(c); break;
+        case 'u': in = std::isupper(c); break;
+        case 'x': in = std::isxdigit(c); break;
+        case 'o': in = c >= '0' && c <= '7'; break;
+        case 'h': in = std::isalpha(c) || c == '_'; break;
+        }
+        set[c] = in;
+    }
+    if (std::isupper(static_cast<unsigned char>(name))) {
+        set.flip();
+    }
+    return set;
+}
+
+// [:name:] inside brackets; false for an unknown name
+bool namedClass(const std::string& name, ByteSet& set) {
+    static const struct {
+        const char* name;
+        int (*test)(int);
+    } kClasses[] = {
+        {"alnum", isalnum}, {"alpha", isalpha}, {"blank", isblank},
+        {"cntrl", iscntrl}, {"digit", isdigit}, {"graph", isgraph},
+        {"lower", islower}, {"print", isprint}, {"punct", ispunct},
+        {"space", isspace}, {"upper", isupper}, {"xdigit", isxdigit},
+    };
+    for (const auto& entry : kClasses) {
+        if (name == entry.name) {
+            for (int c = 0; c < 128; ++c) {
+                if (entry.test(c)) {
+                    set[c] = true;
+                }
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+class Parser {
+  public:
+    Parser(const std::string& pattern, RegexProgram& program,
+           std::vector<Node>& nodes)
+        : p(pattern), i(0), program(program), nodes(nodes) {
+        std::fill(group_body, group_body + RegexMatch::kGroups, -1);
+    }
+
+    // Root node, or -1 with `error` set
+    int parse();
+
+    std::string error;
+
+  private:
+    const std::string& p;
+    size_t i;
+    RegexProgram& program;
+    std::vector<Node>& nodes;
+    int group_body[RegexMatch::kGroups]; // -1 until the group is closed
+
+    bool at(const char* s) const {
+        return p.compare(i, std::strlen(s), s) == 0;
+    }
+    bool atMulti() const {
+        return i < p.size() && (p[i] == '*' || at("\\+") || at("\\=") ||
+                                at("\\?") || at("\\{"));
+    }
+    int fail(const std::string& message) {
+        if (error.empty()) {
+            error = message;
+        }
+        return -1;
+    }
+    int add(Node node) {
+        nodes.push_back(std::move(node));
+        return static_cast<int>(nodes.size() - 1);
+    }
+    int addSet(ByteSet set);
+    int addByte(unsigned char c) {
+        ByteSet set;
+        set[c] = true;
+        return addSet(set);
+    }
+    int addAssert(Assertion assertion) {
+        Node node{Node::ASSERT, {}};
+        node.value = assertion;
+        return add(std::move(node));
+    }
+
+    int parseAlt();
+    int parseConcat();
+    int parseAtom();
+    int parseMulti(int atom);
+    int parseBracket(ByteSet& set);
+    unsigned char bracketChar(size_t& k) const;
+    bool parseCount(int& value);
+};
+
+int Parser::parse() {
+    // \c and \C apply to the whole pattern, wherever they are
+    for (size_t k = 0; k + 1 < p.size(); ++k) {
+        if (p[k] == '\\') {
+            if (p[k + 1] == 'c' || p[k + 1] == 'C') {
+                program.ignore_case = p[k + 1] == 'c';
+            }
+            ++k;
+        }
+    }
+    int root = parseAlt();
+    if (root >= 0 && i < p.size()) {
+        return fail("Unmatched \\)");
+    }
+    return root;
+}
+
+int Parser::addSet(ByteSet set) {
+    if (program.ignore_case) {
+        for (int c = 'a'; c <= 'z'; ++c) {
+            bool either = set[c] || set[std::toupper(c)];
+            set[c] = either;
+            set[std::toupper(c)] = either;
+        }
+    }
+    set['\n'] = false; // Lines never contain one
+    program.sets.push_back(set);
+    Node node{Node::SET, {}};
+    node.value = static_cast<int>(program.sets.size() - 1);
+    return add(std::move(node));
+}
+
+int Parser::parseAlt() {
+    Node alt{Node::ALT, {}};
+    for (;;) {
+        int branch = parseConcat();
+        if (branch < 0) {
+            return -1;
+        }
+        alt.kids.push_back(branch);
+        if (!at("\\|")) {
+            break;
+        }
+        i += 2;
+    }
+    return alt.kids.size() == 1 ? alt.kids[0] : add(std::move(alt));
+}
+
+int Parser::parseConcat() {
+    Node concat{Node::CONCAT, {}};
+    // Like in Vim, ^ only anchors at the start of a branch and $ at its end,
+    // and a * with nothing before it is an ordinary character
+    bool star_is_literal = true;
+    while (i < p.size() && !at("\\|") && !at("\\)")) {
+        if (p[i] == '^' && concat.kids.empty()) {
+            concat.kids.push_back(addAssert(BOL));
+            ++i;
+            continue;
+        }
+        if (p[i] == '$' &&
+            (i + 1 == p.size() || p.compare(i + 1, 2, "\\|") == 0 ||
+             p.compare(i + 1, 2, "\\)") == 0)) {
+            concat.kids.push_back(addAssert(EOL));
+            ++i;
+            continue;
+        }
+        int atom;
+        if (p[i] == '*' && star_is_literal) {
+            atom = addByte('*');
+            ++i;
+        } else {
+            atom = parseAtom();
+        }
+        star_is_literal = false;
+        if (atom < 0 || (atom = parseMulti(atom)) < 0) {
+            return -1;
+        }
+        concat.kids.push_back(atom);
+    }
+    if (concat.kids.empty()) {
+        return add(Node{Node::EMPTY, {}});
+    }
+    return concat.kids.size() == 1 ? concat.kids[0] : add(std::move(concat));
+}
+
+int Parser::parseAtom() {
+    char c = p[i];
+    if (c == '.') {
+        ++i;
+        return addSet(ByteSet().set());
+    }
+    if (c == '[') {
+        ByteSet set;
+        int parsed = parseBracket(set);
+        if (parsed < 0) {
+            return -1;
+        }
+        if (parsed > 0) {
+            return addSet(set);
+        }
+        ++i; // No closing ']': the '[' is an ordinary character
+        return addByte('[');
+    }
+    if (c != '\\') {
+        ++i;
+        return addByte(static_cast<unsigned char>(c));
+    }
+
+    if (i + 1 == p.size()) {
+        return fail("Trailing \\");
+    }
+    char e = p[i + 1];
+    i += 2;
+    switch (e) {
+    case '(': {
+        if (program.groups + 1 == RegexMatch::kGroups) {
+            return fail("Too many \\(");
+        }
+        int group = static_cast<int>(++program.groups);
+        int body = parseAlt();
+        if (body < 0) {
+            return -1;
+        }
+        if (!at("\\)")) {
+            return fail("Unmatched \\(");
+        }
+        i += 2;
+        group_body[group] = body;
+        Node node{Node::GROUP, {body}};
+        node.value = group;
+        return add(std::move(node));
+    }
+    case '%': {
+        if (i == p.size() || p[i] != '(') {
+            return fail("Unsupported: \\%");
+        }
+        ++i;
+        int body = parseAlt();
+        if (body < 0) {
+            return -1;
+        }
+        if (!at("\\)")) {
+            return fail("Unmatched \\%(");
+        }
+        i += 2;
+        return body;
+    }
+    case '<':
+    case '>':
+        program.word_asserts = true;
+        return addAssert(e == '<' ? WORD_START : WORD_END);
+    case 'n':
+        return fail("Patterns cannot match across lines");
+    case 't':
+        return addByte('\t');
+    case 'e':
+        return addByte(27);
+    case 'r':
+        return addByte('\r');
+    case 'c':
+    case 'C':
+        return add(Node{Node::EMPTY, {}});
+    case 's': case 'S': case 'd': case 'D': case 'w': case 'W':
+    case 'a': case 'A': case 'l': case 'L': case 'u': case 'U':
+    case 'x': case 'X': case 'o': case 'O': case 'h': case 'H':
+        return addSet(classSet(e));
+    case '+':
+    case '=':
+    case '?':
+    case '{':
+        return fail(std::string("\\") + e + " follows nothing");
+    case 'z': case 'v': case 'V': case 'm': case 'M': case '@': case '&':
+    case '_': case 'i': case 'I': case 'k': case 'K': case 'f': case 'F':
+    case 'p': case 'P':
+        return fail(std::string("Unsupported: \\") + e);
+    default:
+        if (e >= '1' && e <= '9') {
+            size_t group = static_cast<size_t>(e - '0');
+            if (group > program.groups) {
+                return fail("Illegal back reference");
+            }
+            program.backrefs = true;
+            Node node{Node::BACKREF, {}};
+            node.value = static_cast<int>(group);
+            if (group_body[group] >= 0) {
+                node.kids.push_back(group_body[group]); // Closed by now
+            }
+            return add(std::move(node));
+        }
+        return addByte(static_cast<unsigned char>(e)); // \. \* \[ \\ \/ ...
+    }
+}
+
+int Parser::parseMulti(int atom) {
+    Node repeat{Node::REPEAT, {atom}};
+    if (i < p.size() && p[i] == '*') {
+        repeat.max = -1;
+        ++i;
+    } else if (at("\\+")) {
+        repeat.min = 1;
+        repeat.max = -1;
+        i += 2;
+    } else if (at("\\=") || at("\\?")) {
+        repeat.max = 1;
+        i += 2;
+    } else if (at("\\{")) {
+        i += 2;
+        if (i < p.size() && p[i] == '-') {
+            repeat.greedy = false;
+            ++i;
+        }
+        int low = -1, high = -1;
+        if (!parseCount(low)) {
+            return -1;
+        }
+        bool comma = i < p.size() && p[i] == ',';
+        if (comma) {
+            ++i;
+            if (!parseCount(high)) {
+                return -1;
+            }
+        }
+        if (at("\\}")) {
+            ++i;
+        }
+        if (i == p.size() || p[i] != '}') {
+            return fail("Syntax error in \\{...}");
+        }
+        ++i;
+        if (comma) {
+            repeat.min = std::max(low, 0);
+            repeat.max = high;
+        } else {
+            repeat.min = std::max(low, 0);
+            repeat.max = low; // \{} is *, \{n} exactly n
+        }
+        if (repeat.max >= 0 && repeat.min > repeat.max) {
+            std::swap(repeat.min, repeat.max); // As Vim does
+        }
+    } else {
+        return atom;
+    }
+    if (atMulti()) {
+        return fail("Nested multi");
+    }
+    return add(std::move(repeat));
+}
+
+bool Parser::parseCount(int& value) {
+    if (i == p.size() || !std::isdigit(static_cast<unsigned char>(p[i]))) {
+        return true; // Left out
+    }
+    value = 0;
+    while (i < p.size() && std::isdigit(static_cast<unsigned char>(p[i]))) {
+        value = value * 10 + (p[i++] - '0');
+        if (value > kMaxCount) {
+            fail("Count too large in \\{...}");
+            return false;
+        }
+    }
+    return true;
+}
+
+// 1 with the set filled in, 0 if there is no closing ']', -1 on error
+int Parser::parseBracket(ByteSet& set) {
+    size_t k = i + 1;
+    bool negate = k < p.size() && p[k] == '^';
+    if (negate) {
+        ++k;
+    }
+    if (k < p.size() && p[k] == ']') {
+        set[']'] = true;
+        ++k;
+    }
+    while (k < p.size() && p[k] != ']') {
+        if (p.compare(k, 2, "[:") == 0) {
+            size_t close = p.find(":]", k + 2);
+            if (close != std::string::npos &&
+                namedClass(p.substr(k + 2, close - k - 2), set)) {
+                k = close + 2;
+                continue;
+            }
+        }
+        unsigned char low = bracketChar(k);
+        if (k + 1 < p.size() && p[k] == '-' && p[k + 1] != ']') {
+            ++k;
+            unsigned char high = bracketChar(k);
+            if (high < low) {
+                return fail("Reverse range in character class");
+            }
+            for (int c = low; c <= high; ++c) {
+                set[c] = true;
+            }
+        } else {
+            set[low] = true;
+        }
+    }
+    if (k >= p.size()) {
+        return 0;
+    }
+    i = k + 1;
+    if (negate) {
+        set.flip();
+    }
+    return 1;
+}
+
+unsigned char Parser::bracketChar(size_t& k) const {
+    if (p[k] == '\\' && k + 1 < p.size()) {
+        char e = p[k + 1];
+        const char* escapes = "etrbn\\]^-";
+        const char* values = "\x1b\t\r\b\n\\]^-";
+        if (const char* hit = std::strchr(escapes, e)) {
+            k += 2;
+            return static_cast<unsigned char>(values[hit - escapes]);
+        }
+    }
+    return static_cast<unsigned char>(p[k++]); // Includes a lone '\'
+}
+
+// ===--- Compiler ---===
+
+enum class Mode { EXEC, DFA, REVERSE };
+
+// Emits the program back to front: every node is compiled knowing the
+// instruction that follows it
+class Compiler {
+  public:
+    Compiler(const std::vector<Node>& nodes, uint32_t any_set,
+             RegexCode& code, Mode mode)
+        : nodes(nodes), any_set(any_set), code(code),
+          mode(mode), too_large(false) {}
+
+    bool compile(int root) {
+        uint32_t match = add(Inst{Op::MATCH, 0, 0, 0});
+        code.start = emit(root, match);
+        uint32_t loop = add(Inst{Op::SPLIT, code.start, 0, 0});
+        code.insts[loop].alt = add(Inst{Op::SET, loop, 0, any_set});
+        code.unanchored = loop;
+        return !too_large;
+    }
+
+  private:
+    const std::vector<Node>& nodes;
+    uint32_t any_set;
+    RegexCode& code;
+    Mode mode;
+    bool too_large;
+
+    uint32_t add(Inst inst) {
+        if (code.insts.size() >= kMaxInsts) {
+            too_large = true;
+        }
+        code.insts.push_back(inst);
+        return static_cast<uint32_t>(code.insts.size() - 1);
+    }
+    uint32_t split(uint32_t preferred, uint32_t other) {
+        return add(Inst{Op::SPLIT, preferred, other, 0});
+    }
+
+    uint32_t emit(int n, uint32_t next);
+    uint32_t emitRepeat(int kid, int min, int max, bool greedy,
+                        uint32_t next);
+};
+
+uint32_t Compiler::emit(int n, uint32_t next) {
+    if (too_large) {
+        return next;
+    }
+    const Node& node = nodes[n];
+    switch (node.kind) {
+    case Node::EMPTY:
+        return next;
+    case Node::SET:
+        return add(Inst{Op::SET, next, 0, static_cast<uint32_t>(node.value)});
+    case Node::CONCAT:
+        if (mode == Mode::REVERSE) {
+            for (int kid : node.kids) {
+                next = emit(kid, next);
+            }
+        } else {
+            for (auto it = node.kids.rbegin(); it != node.kids.rend(); ++it) {
+                next = emit(*it, next);
+            }
+        }
+        return next;
+    case Node::ALT: {
+        std::vector<uint32_t> starts;
+        for (int kid : node.kids) {
+            starts.push_back(emit(kid, next));
+        }
+        uint32_t first = starts.back();
+        for (size_t k = starts.size() - 1; k-- > 0;) {
+            first = split(starts[k], first);
+        }
+        return first;
+    }
+    case Node::REPEAT:
+        return emitRepeat(node.kids[0], node.min, node.max, node.greedy, next);
+    case Node::GROUP: {
+        if (mode != Mode::EXEC) {
+            return emit(node.kids[0], next);
+        }
+        uint32_t slot = static_cast<uint32_t>(2 * node.value);
+        uint32_t close = add(Inst{Op::SAVE, next, 0, slot + 1});
+        uint32_t body = emit(node.kids[0], close);
+        return add(Inst{Op::SAVE, body, 0, slot});
+    }
+    case Node::ASSERT: {
+        uint32_t assertion = static_cast<uint32_t>(node.value);
+        if (mode == Mode::REVERSE) {
+            static const uint32_t kMirror[] = {EOL, BOL, WORD_END, WORD_START};
+            assertion = kMirror[assertion];
+        }
+        return add(Inst{Op::ASSERT, next, 0, assertion});
+    }
+    case Node::BACKREF: {
+        if (mode == Mode::EXEC) {
+            return add(Inst{Op::BACKREF, next, 0,
+                            static_cast<uint32_t>(node.value)});
+        }
+        // The DFA matches a superset instead: whatever the group could
+        // match, or nothing if it took no part; anything at all from
+        // inside the group itself
+        if (!node.kids.empty()) {
+            return emitRepeat(node.kids[0], 0, 1, true, next);
+        }
+        uint32_t loop = split(0, next);
+        code.insts[loop].out = add(Inst{Op::SET, loop, 0, any_set});
+        return loop;
+    }
+    }
+    return next;
+}
+
+uint32_t Compiler::emitRepeat(int kid, int min, int max, bool greedy,
+                              uint32_t next) {
+    uint32_t cur = next;
+    if (max < 0) {
+        uint32_t loop = split(0, 0);
+        uint32_t body = emit(kid, loop);
+        code.insts[loop].out = greedy ? body : next;
+        code.insts[loop].alt = greedy ? next : body;
+        cur = loop;
+    } else {
+        // x\{0,2} is (x(x)?)?: each optional copy may stop at `next`
+        for (int k = min; k < max && !too_large; ++k) {
+            uint32_t body = emit(kid, cur);
+            cur = greedy ? split(body, next) : split(next, body);
+        }
+    }
+    for (int k = 0; k < min && !too_large; ++k) {
+        cur = emit(kid, cur);
+    }
+    return cur;
+}
+
+// Splits the bytes into classes no set, nor \< and \>, tells apart
+void buildByteClasses(RegexProgram& program) {
+    std::vector<ByteSet> splits = program.sets;
+    ByteSet newline;
+    newline['\n'] = true;
+    splits.push_back(newline);
+    if (program.word_asserts) {
+        ByteSet word;
+        for (int c = 0; c < 256; ++c) {
+            word[c] = isWordByte(static_cast<unsigned char>(c));
+        }
+        splits.push_back(word);
+    }
+
+    uint16_t cls[256] = {};
+    size_t count = 1;
+    for (const ByteSet& set : splits) {
+        std::vector<int> remap(2 * count, -1);
+        size_t next_count = 0;
+        for (int c = 0; c < 256; ++c) {
+            int& id = remap[2 * cls[c] + set[c]];
+            if (id < 0) {
+                id = static_cast<int>(next_count++);
+            }
+            cls[c] = static_cast<uint16_t>(id);
+        }
+        count = next_count;
+    }
+    program.classes = count;
+    program.class_byte.assign(count, 0);
+    for (int c = 255; c >= 0; --c) {
+        program.byte_class[c] = static_cast<uint8_t>(cls[c]);
+        program.class_byte[cls[c]] = static_cast<unsigned char>(c);
+    }
+}
+
+// A pattern of plain characters only, searched for with SubstringSearcher
+bool findLiteral(const std::vector<Node>& nodes, int root,
+                 const RegexProgram& program, std::string& literal) {
+    std::vector<int> single(1, root);
+    const std::vector<int>& kids =
+        nodes[root].kind == Node::CONCAT ? nodes[root].kids : single;
+    literal.clear();
+    for (int kid : kids) {
+        if (nodes[kid].kind != Node::SET) {
+            return false;
+        }
+        const ByteSet& set = program.sets[nodes[kid].value];
+        if (set.count() != 1) {
+            return false;
+        }
+        for (int c = 0; c < 256; ++c) {
+            if (set[c]) {
+                literal += static_cast<char>(c);
+            }
+        }
+    }
+    return !literal.empty();
+}
+
+// Adds the bytes that every match of `node` has in a row to `run`, and
+// keeps the longest run that ended in `best`
+void requiredRun(const std::vector<Node>& nodes, int node,
+                 const RegexProgram& program, std::string& run,
+                 std::string& best) {
+    auto end_run = [&run, &best]() {
+        if (run.size() > best.size()) {
+            best = run;
+        }
+        run.clear();
+    };
+    const Node& n = nodes[node];
+    switch (n.kind) {
+    case Node::EMPTY:
+    case Node::ASSERT:
+        break; // Take no bytes
+    case Node::SET: {
+        const ByteSet& set = program.sets[n.value];
+        if (set.count() != 1) {
+            end_run();
+            break;
+        }
+        for (int c = 0; c < 256; ++c) {
+            if (set[c]) {
+                run += static_cast<char>(c);
+            }
+        }
+        break;
+    }
+    case Node::CONCAT:
+        for (int kid : n.kids) {
+            requiredRun(nodes, kid, program, run, best);
+        }
+        break;
+    case Node::GROUP:
+        requiredRun(nodes, n.kids[0], program, run, best);
+        break;
+    case Node::REPEAT:
+        // The first copy follows on from the run, but not what comes after
+        if (n.min > 0) {
+            requiredRun(nodes, n.kids[0], program, run, best);
+        }
+        end_run();
+        break;
+    default:
+        end_run();
+        break;
+    }
+}
+
+std::string requiredLiteral(const std::vector<Node>& nodes, int root,
+                            const RegexProgram& program) {
+    std::string run;
+    std::string best;
+    requiredRun(nodes, root, program, run, best);
+    return run.size() > best.size() ? run : best;
+}
+
+} // namespace
+
+// ===--- Regex ---===
+
+Regex::Regex(const std::string& pattern) : source(pattern) {
+    auto compiled = std::make_shared<RegexProgram>();
+    std::vector<Node> nodes;
+    Parser parser(pattern, *compiled, nodes);
+    int root = parser.parse();
+    if (root < 0) {
+        error_message = parser.error;
+        return;
+    }
+
+    ByteSet any;
+    any.set();
+    any['\n'] = false;
+    compiled->sets.push_back(any);
+    uint32_t any_set = static_cast<uint32_t>(compiled->sets.size() - 1);
+
+    bool fits =
+        Compiler(nodes, any_set, compiled->exec, Mode::EXEC)
+            .compile(root) &&
+        Compiler(nodes, any_set, compiled->dfa, Mode::DFA)
+            .compile(root) &&
+        (compiled->backrefs ||
+         Compiler(nodes, any_set, compiled->reverse, Mode::REVERSE)
+             .compile(root));
+    if (!fits) {
+        error_message = "Pattern too long";
+        return;
+    }
+    compiled->is_literal = findLiteral(nodes, root, *compiled, compiled->literal);
+    if (!compiled->is_literal) {
+        compiled->literal = requiredLiteral(nodes, root, *compiled);
+    }
+    buildByteClasses(*compiled);
+    program = std::move(compiled);
+}
+
+Regex Regex::literal(const std::string& text) {
+    if (text.find('\n') != std::string::npos) {
+        Regex regex;
+        regex.source = text;
+        regex.error_message = "Patterns cannot match across lines";
+        return regex;
+    }
+    std::string escaped;
+    for (char c : text) {
+        if (std::strchr("\\.[*~^$", c)) {
+            escaped += '\\';
+        }
+        escaped += c;
+    }
+    Regex regex(escaped);
+    regex.source = text;
+    return regex;
+}
+
+size_t Regex::groupCount() const {
+    return program ? program->groups : 0;
+}
+
+bool Regex::hasBackrefs() const {
+    return program && program->backrefs;
+}
+
+// ===--- RegexDFA ---===
+
+// States are ordered lists of NFA threads, highest priority first, plus
+// what is known about the byte before. They are made the first time a
+// transition reaches them; the table then answers every later visit.
+class RegexDFA {
+  public:
+    static const uint8_t kBol = 1;      // At the start of the line
+    static const uint8_t kPrevWord = 2; // The byte before is a word byte
+    static const uint8_t kMatched = 4;  // A match ends before the last byte
+    static const uint8_t kDead = 8;     // No thread left
+
+    // With `longest`, threads carry on past a match, so the last match seen
+    // is the longest; otherwise a match cuts off every thread of lower
+    // priority, as a backtracker would never get to them
+    RegexDFA(const RegexProgram& program, const RegexCode& code,
+             uint32_t entry, bool longest)
+        : program(program), code(code), entry(entry), longest(longest),
+          shift(0), seen(code.insts.size(), 0),
+          queued(code.insts.size(), 0), generation(0), flushes(0) {
+        while ((size_t(1) << shift) < program.classes + 1) {
+            ++shift;
+        }
+        std::fill(starts, starts + 4, -1);
+    }
+
+    // State before the first byte; `before` is kBol and/or kPrevWord
+    int start(uint8_t before) {
+        if (starts[before] < 0) {
+            kernel.assign(1, entry);
+            int state = intern(before, kernel);
+            starts[before] = state;
+        }
+        return starts[before];
+    }
+
+    // State after the byte class `cls`, or after the end of the text for
+    // cls == program.classes. A '\n' starts the next line.
+    int next(int state, size_t cls) {
+        uint32_t target = table[(static_cast<size_t>(state) << shift) + cls];
+        return target != kUnknown ? static_cast<int>(target & ~kStop)
+                                  : compute(state, cls);
+    }
+
+    uint8_t flags(int state) const { return state_flags[state]; }
+
+    // Feeds the bytes [p, end) to `state` and stops after the first that
+    // leads to a matched or dead state; returns the byte after it, or end
+    const char* run(int& state, const char* p, const char* end) {
+        const uint8_t* byte_class = program.byte_class;
+        const uint32_t* entries = table.data();
+        uint32_t current = static_cast<uint32_t>(state);
+        while (p < end) {
+            size_t cls = byte_class[static_cast<unsigned char>(*p++)];
+            uint32_t target = entries[(static_cast<size_t>(current) << shift) + cls];
+            if (target >= kStop) {
+                if (target == kUnknown) {
+                    target = static_cast<uint32_t>(
+                        compute(static_cast<int>(current), cls));
+                    entries = table.data();
+                } else {
+                    target &= ~kStop;
+                }
+                if (state_flags[target] & (kMatched | kDead)) {
+                    state = static_cast<int>(target);
+                    return p;
+                }
+            }
+            current = target;
+        }
+        state = static_cast<int>(current);
+        return p;
+    }
+
+  private:
+    const RegexProgram& program;
+    const RegexCode& code;
+    uint32_t entry;
+    bool longest;
+    unsigned shift; // A state's entries start at state << shift
+
+    // Table entries are the target state, with kStop set if it is matched
+    // or dead, so that run() reads one entry per byte and nothing else
+    static constexpr uint32_t kStop = 1u << 31;
+    static constexpr uint32_t kUnknown = UINT32_MAX; // Not computed yet
+    std::vector<uint32_t> table;
+    std::vector<uint8_t> state_flags;
+    std::vector<std::vector<uint32_t>> kernels;
+    std::unordered_map<std::string, int> index;
+    int starts[4];
+
+    // Scratch space for compute()
+    std::vector<uint32_t> stack;
+    std::vector<uint32_t> kernel;
+    std::vector<uint32_t> seen;   // Instructions visited, by generation
+    std::vector<uint32_t> queued; // Already in `kernel`, by generation
+    uint32_t generation;
+    std::string key;
+    size_t flushes;
+
+    int compute(int state, size_t cls);
+    int intern(uint8_t flags, const std::vector<uint32_t>& threads);
+    void flush();
+};
+
+int RegexDFA::compute(int state, size_t cls) {
+    bool end = cls == program.classes;
+    bool newline = !end && cls == program.byte_class[static_cast<unsigned char>('\n')];
+    unsigned char byte = end ? 0 : program.class_byte[cls];
+    bool next_word = !end && program.word_asserts && isWordByte(byte);
+    uint8_t before = state_flags[state];
+
+    if (++generation == 0) {
+        std::fill(seen.begin(), seen.end(), 0);
+        std::fill(queued.begin(), queued.end(), 0);
+        generation = 1;
+    }
+    const std::vector<uint32_t>& threads = kernels[state];
+    stack.assign(threads.rbegin(), threads.rend());
+    kernel.clear();
+    bool matched = false;
+
+    // Depth first, preferred branch first: threads come out in priority
+    // order
+    while (!stack.empty()) {
+        uint32_t pc = stack.back();
+        stack.pop_back();
+        if (seen[pc] == generation) {
+            continue;
+        }
+        seen[pc] = generation;
+        const Inst& inst = code.insts[pc];
+        switch (inst.op) {
+        case Op::SET:
+            if (!end && program.sets[inst.arg][byte] &&
+                queued[inst.out] != generation) {
+                queued[inst.out] = generation;
+                kernel.push_back(inst.out);
+            }
+            break;
+        case Op::SPLIT:
+            stack.push_back(inst.alt);
+            stack.push_back(inst.out);
+            break;
+        case Op::JMP:
+        case Op::SAVE:
+            stack.push_back(inst.out);
+            break;
+        case Op::ASSERT: {
+            bool holds = false;
+            switch (inst.arg) {
+            case BOL: holds = before & kBol; break;
+            case EOL: holds = end || newline; break;
+            case WORD_START: holds = !(before & kPrevWord) && next_word; break;
+            case WORD_END: holds = (before & kPrevWord) && !next_word; break;
+            }
+            if (holds) {
+                stack.push_back(inst.out);
+            }
+            break;
+        }
+        case Op::BACKREF:
+            break; // Not in DFA programs
+        case Op::MATCH:
+            matched = true;
+            if (!longest) {
+                stack.clear();
+            }
+            break;
+        }
+    }
+
+    uint8_t flags = 0;
+    if (newline) {
+        kernel.assign(1, entry);
+        flags = kBol;
+    } else if (next_word) {
+        flags = kPrevWord;
+    }
+    if (matched) {
+        flags |= kMatched;
+    }
+    size_t flushes_before = flushes;
+    int target = intern(flags, kernel);
+    if (flushes == flushes_before) {
+        table[(static_cast<size_t>(state) << shift) + cls] =
+            static_cast<uint32_t>(target) |
+            (state_flags[target] & (kMatched | kDead) ? kStop : 0);
+    }
+    return target;
+}
+
+int RegexDFA::intern(uint8_t flags, const std::vector<uint32_t>& threads) {
+    key.assign(1, static_cast<char>(flags));
+    key.append(reinterpret_cast<const char*>(threads.data()),
+               threads.size() * sizeof(uint32_t));
+    auto it = index.find(key);
+    if (it != index.end()) {
+        return it->second;
+    }
+    if (kernels.size() >= kMaxStates) {
+        flush();
+    }
+    int state = static_cast<int>(kernels.size());
+    kernels.push_back(threads);
+    state_flags.push_back(flags | (threads.empty() ? kDead : 0));
+    table.resize(table.size() + (size_t(1) << shift), kUnknown);
+    index.emplace(key, state);
+    return state;
+}
+
+void RegexDFA::flush() {
+    table.clear();
+    state_flags.clear();
+    kernels.clear();
+    index.clear();
+    std::fill(starts, starts + 4, -1);
+    ++flushes;
+}
+
+// ===--- RegexMatcher ---===
+
+RegexMatcher::RegexMatcher(const Regex& regex) : program(regex.program) {
+    if (!program) {
+        return; // Did not compile: never matches
+    }
+    if (!program->literal.empty()) {
+        searcher.reset(new SubstringSearcher(program->literal));
+    }
+    if (program->is_literal) {
+        return;
+    }
+    forward.reset(
+        new RegexDFA(*program, program->dfa, program->dfa.unanchored, false));
+    if (!program->backrefs) {
+        reverse.reset(new RegexDFA(*program, program->reverse,
+                                   program->reverse.start, true));
+    }
+}
+
+RegexMatcher::~RegexMatcher() = default;
+
+bool RegexMatcher::find(const char* data, size_t n, size_t from,
+                        RegexMatch& match, bool captures) {
+    if (!program || from > n) {
+        return false;
+    }
+    std::fill(match.begin, match.begin + RegexMatch::kGroups, RegexMatch::npos);
+    std::fill(match.end, match.end + RegexMatch::kGroups, RegexMatch::npos);
+
+    if (searcher) {
+        // Without the literal there is no match; with it, a literal
+        // pattern has its match
+        size_t pos = searcher->find(data, n, from);
+        if (pos == SubstringSearcher::npos) {
+            return false;
+        }
+        if (program->is_literal) {
+            match.begin[0] = pos;
+            match.end[0] = pos + program->literal.size();
+            return true;
+        }
+    }
+
+    size_t end = matchEnd(data, n, from);
+    if (end == RegexMatch::npos) {
+        return false;
+    }
+    bool found = false;
+    if (program->backrefs) {
+        // The DFA only says the line may match: find the match itself
+        for (size_t start = from; start <= n && !found; ++start) {
+            found = backtrack(data, n, start, n, false);
+        }
+        if (!found) {
+            return false;
+        }
+    } else {
+        size_t start = matchStart(data, n, from, end);
+        found = captures && program->groups > 0 &&
+                backtrack(data, n, start, end, true);
+        if (!found) {
+            match.begin[0] = start;
+            match.end[0] = end;
+            return true;
+        }
+    }
+    for (size_t g = 0; g <= program->groups; ++g) {
+        if (slots[2 * g] != RegexMatch::npos &&
+            slots[2 * g + 1] != RegexMatch::npos) {
+            match.begin[g] = slots[2 * g];
+            match.end[g] = slots[2 * g + 1];
+        }
+    }
+    return true;
+}
+
+size_t RegexMatcher::findLine(const char* data, size_t n, size_t from) {
+    if (!program || from > n) {
+        return RegexMatch::npos;
+    }
+    size_t hit = RegexMatch::npos;
+    if (program->is_literal) {
+        hit = searcher->find(data, n, from);
+    } else if (searcher) {
+        // Only lines with the literal in them can match, so the DFA runs on
+        // those alone
+        size_t pos = from;
+        while ((pos = searcher->find(data, n, pos)) != SubstringSearcher::npos) {
+            const void* newline = memrchr(data + from, '\n', pos - from);
+            size_t begin = newline ? static_cast<size_t>(
+                                         static_cast<const char*>(newline) - data) + 1
+                                   : from;
+            newline = std::memchr(data + pos, '\n', n - pos);
+            size_t end = newline ? static_cast<size_t>(
+                                       static_cast<const char*>(newline) - data)
+                                 : n;
+            if (matchEnd(data + begin, end - begin, 0) != RegexMatch::npos) {
+                return begin;
+            }
+            if (end == n) {
+                break;
+            }
+            pos = end + 1;
+        }
+        return RegexMatch::npos;
+    } else {
+        RegexDFA& dfa = *forward;
+        int state = dfa.start(RegexDFA::kBol);
+        const char* p = data + from;
+        const char* end = data + n;
+        while (p < end) {
+            p = dfa.run(state, p, end);
+            if (dfa.flags(state) & RegexDFA::kMatched) {
+                hit = static_cast<size_t>(p - data) - 1;
+                break;
+            }
+        }
+        if (hit == RegexMatch::npos &&
+            (dfa.flags(dfa.next(state, program->classes)) & RegexDFA::kMatched)) {
+            hit = n;
+        }
+    }
+    if (hit == RegexMatch::npos) {
+        return hit;
+    }
+    // A match that ends at a '\n' belongs to the line before it
+    const void* newline = memrchr(data + from, '\n', hit - from);
+    return newline ? static_cast<size_t>(static_cast<const char*>(newline) - data) + 1
+                   : from;
+}
+
+// End of the first match starting at or after `from`, or npos
+size_t RegexMatcher::matchEnd(const char* data, size_t n, size_t from) {
+    RegexDFA& dfa = *forward;
+    uint8_t before = RegexDFA::kBol;
+    if (from > 0) {
+        before = program->word_asserts &&
+                         isWordByte(static_cast<unsigned char>(data[from - 1]))
+                     ? RegexDFA::kPrevWord
+                     : 0;
+    }
+    int state = dfa.start(before);
+    size_t end = RegexMatch::npos;
+    const char* p = data + from;
+    while (p < data + n) {
+        p = dfa.run(state, p, data + n);
+        uint8_t flags = dfa.flags(state);
+        if (flags & RegexDFA::kMatched) {
+            end = static_cast<size_t>(p - data) - 1;
+        }
+        if (flags & RegexDFA::kDead) {
+            return end;
+        }
+    }
+    if (dfa.flags(dfa.next(state, program->classes)) & RegexDFA::kMatched) {
+        end = n;
+    }
+    return end;
+}
+
+// Start of that match: the longest match of the reversed pattern that
+// ends at `end`, read backwards down to `from`
+size_t RegexMatcher::matchStart(const char* data, size_t n, size_t from,
+                                size_t end) {
+    RegexDFA& dfa = *reverse;
+    const uint8_t* byte_class = program->byte_class;
+    uint8_t before = RegexDFA::kBol;
+    if (end < n) {
+        before = program->word_asserts &&
+                         isWordByte(static_cast<unsigned char>(data[end]))
+                     ? RegexDFA::kPrevWord
+                     : 0;
+    }
+    int state = dfa.start(before);
+    size_t start = RegexMatch::npos;
+    for (size_t i = end; i > from; --i) {
+        state = dfa.next(state, byte_class[static_cast<unsigned char>(data[i - 1])]);
+        uint8_t flags = dfa.flags(state);
+        if (flags & RegexDFA::kMatched) {
+            start = i;
+        }
+        if (flags & RegexDFA::kDead) {
+            return start;
+        }
+    }
+    // Only the match flag matters here, which depends on the byte before
+    // `from` but not on reading it
+    size_t cls = from > 0 ? byte_class[static_cast<unsigned char>(data[from - 1])]
+                          : program->classes;
+    if (dfa.flags(dfa.next(state, cls)) & RegexDFA::kMatched) {
+        start = from;
+    }
+    return start;
+}
+
+// Runs the exec program anchored at `start`, consuming no further than
+// `limit`, and leaves the match and its groups in `slots`. With `memoize`
+// no (instruction, position) pair is tried twice, which bounds the work,
+// and the match has to end at `limit`; only backreferences make memoizing
+// unsound, as they depend on the groups.
+bool RegexMatcher::backtrack(const char* data, size_t n, size_t start,
+                             size_t limit, bool memoize) {
+    const RegexCode& code = program->exec;
+    std::fill(slots, slots + 2 * RegexMatch::kGroups, RegexMatch::npos);
+    size_t width = limit - start + 1;
+    if (memoize) {
+        visited.assign((code.insts.size() * width + 63) / 64, 0);
+    }
+    jobs.clear();
+    jobs.push_back(Job{code.start, kNoSlot, start});
+    size_t budget = kBacktrackBudget;
+
+    while (!jobs.empty()) {
+        Job job = jobs.back();
+        jobs.pop_back();
+        if (job.slot != kNoSlot) {
+            slots[job.slot] = job.pos;
+            continue;
+        }
+        uint32_t pc = job.pc;
+        size_t pos = job.pos;
+        for (bool alive = true; alive;) {
+            if (budget-- == 0) {
+                return false;
+            }
+            if (memoize) {
+                size_t bit = pc * width + (pos - start);
+                uint64_t mask = uint64_t(1) << (bit & 63);
+                if (visited[bit >> 6] & mask) {
+                    break;
+                }
+                visited[bit >> 6] |= mask;
+            }
+            const Inst& inst = code.insts[pc];
+            pc = inst.out;
+            switch (inst.op) {
+            case Op::SET:
+                alive = pos < limit &&
+                        program->sets[inst.arg][static_cast<unsigned char>(data[pos])];
+                ++pos;
+                break;
+            case Op::SPLIT:
+                jobs.push_back(Job{inst.alt, kNoSlot, pos});
+                break;
+            case Op::JMP:
+                break;
+            case Op::SAVE:
+                jobs.push_back(Job{0, inst.arg, slots[inst.arg]});
+                slots[inst.arg] = pos;
+                break;
+            case Op::ASSERT: {
+                bool word_before = pos > 0 && isWordByte(static_cast<unsigned char>(data[pos - 1]));
+                bool word_after = pos < n && isWordByte(static_cast<unsigned char>(data[pos]));
+                switch (inst.arg) {
+                case BOL: alive = pos == 0; break;
+                case EOL: alive = pos == n; break;
+                case WORD_START: alive = !word_before && word_after; break;
+                case WORD_END: alive = word_before && !word_after; break;
+                }
+                break;
+            }
+            case Op::BACKREF: {
+                size_t b = slots[2 * inst.arg], e = slots[2 * inst.arg + 1];
+                if (b == RegexMatch::npos || e == RegexMatch::npos) {
+                    break; // A group that took no part matches nothing
+                }
+                size_t length = e - b;
+                alive = length <= limit - pos;
+                for (size_t k = 0; alive && k < length; ++k) {
+                    unsigned char x = static_cast<unsigned char>(data[b + k]);
+                    unsigned char y = static_cast<unsigned char>(data[pos + k]);
+                    alive = x == y || (program->ignore_case &&
+                                       std::tolower(x) == std::tolower(y));
+                }
+                pos += length;
+                break;
+            }
+            case Op::MATCH:
+                // Given a limit, the match must end there, as the DFA said
+                if (memoize && pos != limit) {
+                    alive = false;
+                    break;
+                }
+                slots[0] = start;
+                slots[1] = pos;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// ===--- ReplaceTemplate ---===
+
+ReplaceTemplate::ReplaceTemplate(const std::string& replacement)
+    : groups(false) {
+    for (size_t i = 0; i < replacement.size(); ++i) {
+        char c = replacement[i];
+        if (c == '&') {
+            parts.push_back(Part{0, 0, 0});
+            continue;
+        }
+        if (c != '\\' || i + 1 == replacement.size()) {
+            addText(&c, 1);
+            continue;
+        }
+        char e = replacement[++i];
+        if (e >= '0' && e <= '9') {
+            parts.push_back(Part{e - '0', 0, 0});
+            groups = groups || e != '0';
+            continue;
+        }
+        switch (e) {
+        case 'r': c = '\n'; break;
+        case 'n': c = '\0'; break;
+        case 't': c = '\t'; break;
+        default: c = e; break; // \& \\ and the rest stand for themselves
+        }
+        addText(&c, 1);
+    }
+}
+
+ReplaceTemplate ReplaceTemplate::literal(const std::string& text) {
+    ReplaceTemplate result;
+    result.addText(text.data(), text.size());
+    return result;
+}
+
+void ReplaceTemplate::addText(const char* s, size_t n) {
+    if (n == 0) {
+        return;
+    }
+    if (!parts.empty() && parts.back().group < 0) {
+        parts.back().length += n; // Text parts are contiguous in `text`
+    } else {
+        parts.push_back(Part{-1, text.size(), n});
+    }
+    text.append(s, n);
+}
+
+void ReplaceTemplate::expand(const char* line, const RegexMatch& match,
+                             std::string& out) const {
+    for (const Part& part : parts) {
+        if (part.group < 0) {
+            out.append(text, part.begin, part.length);
+        } else if (match.begin[part.group] != RegexMatch::npos) {
+            out.append(line + match.begin[part.group],
+                       match.end[part.group] - match.begin[part.group]);
+        }
+    }
+}
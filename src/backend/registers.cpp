@@ -0,0 +1,46 @@
+// src/backend/registers.cpp
+
+#include "backend/registers.h"
+#include <cctype>
+
+bool Registers::isValid(char name) {
+    return name == '"' || name == '0' ||
+           std::isalpha(static_cast<unsigned char>(name));
+}
+
+void Registers::store(char name, const Register& reg, bool yank) {
+    if (std::isupper(static_cast<unsigned char>(name))) {
+        // Appending lines to characters, or characters to lines, puts a
+        // line break between them, and the result is lines
+        Register& target = named[name - 'A'];
+        if (reg.linewise && !target.linewise && !target.text.empty()) {
+            target.text.append(SharedText::newline());
+        }
+        target.text.append(reg.text);
+        if (!reg.linewise && target.linewise) {
+            target.text.append(SharedText::newline());
+        }
+        target.linewise = target.linewise || reg.linewise;
+        unnamed = target;
+    } else if (std::islower(static_cast<unsigned char>(name))) {
+        named[name - 'a'] = reg;
+        unnamed = reg;
+    } else {
+        unnamed = reg;
+        if (yank || name == '0') {
+            yanked = reg;
+        }
+    }
+}
+
+const Register* Registers::get(char name) const {
+    const Register* reg = &unnamed;
+    if (name == '0') {
+        reg = &yanked;
+    } else if (std::isupper(static_cast<unsigned char>(name))) {
+        reg = &named[name - 'A'];
+    } else if (std::islower(static_cast<unsigned char>(name))) {
+        reg = &named[name - 'a'];
+    }
+    return reg->text.empty() ? nullptr : reg;
+}
@@ -0,0 +1,287 @@
+// src/backend/row_index.cpp
+
+#include "backend/row_index.h"
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+RowIndex::RowIndex()
+    : width(0), covered(0), nodes(1), root(0), rng_state(2463534242u) {}
+
+void RowIndex::invalidate() {
+    width = 0;
+    covered = 0;
+    nodes.assign(1, Node());
+    free_nodes.clear();
+    root = 0;
+}
+
+void RowIndex::linesChanged(const PieceTable& text, size_t line,
+                            size_t removed, size_t inserted) {
+    if (!width || line >= covered) {
+        return;
+    }
+    uint32_t before, rest, changed, after;
+    split(root, line, before, rest);
+    if (line + removed > covered) {
+        // The edit runs past the lines read so far, which now end at `line`
+        freeTree(rest);
+        root = before;
+        covered = line;
+        return;
+    }
+    // As in SearchIndex: the changed lines are cut out and read again, and
+    // the first line after them moves by inserted - removed, wrapping
+    // around in size_t on a move back
+    size_t before_lines = nodes[before].sub_gap;
+    split(rest, line + removed - before_lines, changed, after);
+    size_t changed_lines = nodes[changed].sub_gap;
+    freeTree(changed);
+
+    std::vector<Entry> entries;
+    size_t last = before_lines;
+    scan(text, line, line + inserted, last, entries);
+    uint32_t fresh = buildTree(entries.data(), entries.size());
+    if (after) {
+        shiftFirst(after, changed_lines + inserted - removed -
+                              nodes[fresh].sub_gap);
+    }
+    root = merge(merge(before, fresh), after);
+    covered += inserted - removed;
+}
+
+size_t RowIndex::rowsBetween(const PieceTable& text, size_t width,
+                             size_t first, size_t last) {
+    if (first >= last) {
+        return 0;
+    }
+    sync(text, width, last);
+    return last - first + extraBefore(last) - extraBefore(first);
+}
+
+// With R(x) = x + extraBefore(x), the rows above line x, the answer is the
+// first x with R(last + 1) - R(x) <= rows. Between two wrapped lines R goes
+// up by one a line, so the search finds the first node whose line ends at
+// or past the target row and solves for x among the lines before it.
+size_t RowIndex::firstLineFitting(const PieceTable& text, size_t width,
+                                  size_t last, size_t rows) {
+    sync(text, width, last + 1);
+    size_t end_row = last + 1 + extraBefore(last + 1);
+    if (end_row <= rows) {
+        return 0;
+    }
+    size_t target = end_row - rows;
+    size_t base = 0;
+    size_t base_extra = 0;
+    size_t first = SIZE_MAX;
+    for (uint32_t t = root; t;) {
+        const Node& n = nodes[t];
+        const Node& left = nodes[n.left];
+        size_t through = base + left.sub_gap + n.gap; // The node's line + 1
+        size_t extra_before = base_extra + left.sub_extra;
+        if (through + extra_before + n.extra >= target) {
+            first = std::min(target - extra_before, through);
+            t = n.left;
+        } else {
+            base = through;
+            base_extra = extra_before + n.extra;
+            t = n.right;
+        }
+    }
+    if (first == SIZE_MAX) {
+        first = target - base_extra;
+    }
+    return std::min(first, last);
+}
+
+// Makes sure lines [0, lines) are read for `width`, as far as the text is
+// indexed. The last line of a text still being indexed may not have ended
+// yet, so it is left for later.
+void RowIndex::sync(const PieceTable& text, size_t width, size_t lines) {
+    if (width != this->width) {
+        invalidate();
+        this->width = width;
+    }
+    if (lines <= covered) {
+        return;
+    }
+    text.indexLines(lines);
+    bool complete = text.indexed();
+    size_t available = text.lineCount() - (complete ? 0 : 1);
+    size_t last = std::min(lines, available);
+    if (last <= covered) {
+        return;
+    }
+    std::vector<Entry> entries;
+    size_t before = nodes[root].sub_gap;
+    scan(text, covered, last, before, entries);
+    root = merge(root, buildTree(entries.data(), entries.size()));
+    covered = last;
+}
+
+// Appends the lines in [first, last) that wrap. `before` is one past the
+// last wrapped line so far, which the first gap counts from. A line split
+// across pieces is put together in `carry` to be laid out.
+void RowIndex::scan(const PieceTable& text, size_t first, size_t last,
+                    size_t& before, std::vector<Entry>& entries) const {
+    if (first >= last) {
+        return;
+    }
+    size_t begin = text.lineStart(first);
+    size_t end = text.lineEnd(last - 1);
+    size_t line = first;
+    std::string carry;
+    auto lineDone = [&](const char* p, size_t n) {
+        size_t rows = LineLayout::countRows(p, n, width);
+        if (rows > 1) {
+            entries.push_back(Entry{line + 1 - before, rows - 1});
+            before = line + 1;
+        }
+        ++line;
+    };
+    text.forEachSpan(begin, end - begin, [&](const char* p, size_t n) {
+        const char* stop = p + n;
+        while (const void* found = std::memchr(p, '\n', stop - p)) {
+            const char* newline = static_cast<const char*>(found);
+            if (carry.empty()) {
+                lineDone(p, newline - p);
+            } else {
+                carry.append(p, newline - p);
+                lineDone(carry.data(), carry.size());
+                carry.clear();
+            }
+            p = newline + 1;
+        }
+        carry.append(p, stop - p);
+    });
+    lineDone(carry.data(), carry.size());
+}
+
+// Rows past the first of the lines before `line`
+size_t RowIndex::extraBefore(size_t line) const {
+    size_t extra = 0;
+    size_t base = 0;
+    for (uint32_t t = root; t;) {
+        const Node& n = nodes[t];
+        const Node& left = nodes[n.left];
+        size_t through = base + left.sub_gap + n.gap;
+        if (through <= line) {
+            extra += left.sub_extra + n.extra;
+            base = through;
+            t = n.right;
+        } else {
+            t = n.left;
+        }
+    }
+    return extra;
+}
+
+// ===--- Treap ---===
+
+uint32_t RowIndex::nextPriority() {
+    // xorshift32
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+uint32_t RowIndex::newNode(size_t gap, size_t extra) {
+    uint32_t id;
+    if (!free_nodes.empty()) {
+        id = free_nodes.back();
+        free_nodes.pop_back();
+    } else {
+        id = static_cast<uint32_t>(nodes.size());
+        nodes.emplace_back();
+    }
+    nodes[id] = Node{0, 0, nextPriority(), gap, gap, extra, extra};
+    return id;
+}
+
+void RowIndex::freeTree(uint32_t t) {
+    if (!t) {
+        return;
+    }
+    freeTree(nodes[t].left);
+    freeTree(nodes[t].right);
+    free_nodes.push_back(t);
+}
+
+void RowIndex::pull(uint32_t t) {
+    Node& n = nodes[t];
+    const Node& l = nodes[n.left];
+    const Node& r = nodes[n.right];
+    n.sub_gap = l.sub_gap + n.gap + r.sub_gap;
+    n.sub_extra = l.sub_extra + n.extra + r.sub_extra;
+}
+
+uint32_t RowIndex::merge(uint32_t a, uint32_t b) {
+    if (!a) {
+        return b;
+    }
+    if (!b) {
+        return a;
+    }
+    if (nodes[a].priority > nodes[b].priority) {
+        nodes[a].right = merge(nodes[a].right, b);
+        pull(a);
+        return a;
+    }
+    nodes[b].left = merge(a, nodes[b].left);
+    pull(b);
+    return b;
+}
+
+// Splits t so that l holds the nodes for lines before `lines`, counted from
+// the start of t
+void RowIndex::split(uint32_t t, size_t lines, uint32_t& l, uint32_t& r) {
+    if (!t) {
+        l = r = 0;
+        return;
+    }
+    size_t through = nodes[nodes[t].left].sub_gap + nodes[t].gap;
+    if (through <= lines) {
+        uint32_t rl, rr;
+        split(nodes[t].right, lines - through, rl, rr);
+        nodes[t].right = rl;
+        pull(t);
+        l = t;
+        r = rr;
+    } else {
+        uint32_t ll, lr;
+        split(nodes[t].left, lines, ll, lr);
+        nodes[t].left = lr;
+        pull(t);
+        l = ll;
+        r = t;
+    }
+}
+
+// Adds `diff` to the gap of the first node in t
+void RowIndex::shiftFirst(uint32_t t, size_t diff) {
+    for (; t; t = nodes[t].left) {
+        nodes[t].sub_gap += diff;
+        if (!nodes[t].left) {
+            nodes[t].gap += diff;
+        }
+    }
+}
+
+uint32_t RowIndex::buildTree(const Entry* entries, size_t n) {
+    if (n == 0) {
+        return 0;
+    }
+    size_t mid = n / 2;
+    uint32_t left = buildTree(entries, mid);
+    uint32_t right = buildTree(entries + mid + 1, n - mid - 1);
+    uint32_t t = newNode(entries[mid].gap, entries[mid].extra);
+    nodes[t].left = left;
+    nodes[t].right = right;
+    uint32_t priority = std::max(nodes[left].priority, nodes[right].priority);
+    nodes[t].priority = std::max(nodes[t].priority, priority == UINT32_MAX
+                                                        ? priority
+                                                        : priority + 1);
+    pull(t);
+    return t;
+}
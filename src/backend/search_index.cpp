@@ -0,0 +1,438 @@
+// src/backend/search_index.cpp
+
+#include "backend/search_index.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// Fewest lines one worker searches when the index is built
+const size_t kBuildChunkLines = 16 << 10;
+
+// Lines find() reads at a time
+const size_t kFindBlockLines = 4 << 10;
+
+// Columns where the matches in a line begin, taken as :s///g takes them:
+// an empty match right where the last one ended does not count
+void lineMatches(RegexMatcher& matcher, const char* line, size_t length,
+                 std::vector<size_t>& starts) {
+    starts.clear();
+    RegexMatch match;
+    size_t last_end = RegexMatch::npos;
+    for (size_t from = 0;
+         from <= length && matcher.find(line, length, from, match);) {
+        size_t begin = match.begin[0], end = match.end[0];
+        if (begin == end && begin == last_end) {
+            from = begin + 1;
+            continue;
+        }
+        starts.push_back(begin);
+        last_end = end;
+        from = end > begin ? end : end + 1;
+    }
+}
+
+// Calls found(line, starts) for every line in [first, last) with a match,
+// in order, until it returns false
+template <typename Found>
+void scanLines(RegexMatcher& matcher, const PieceTable& text, size_t first,
+               size_t last, Found found) {
+    if (first >= last) {
+        return;
+    }
+    size_t begin = text.lineStart(first);
+    std::string block = text.read(begin, text.lineEnd(last - 1) - begin);
+    const char* data = block.data();
+    std::vector<size_t> starts;
+    size_t line = first;
+    size_t line_begin = 0;
+    for (size_t at = matcher.findLine(data, block.size(), 0);
+         at != RegexMatch::npos;) {
+        line += static_cast<size_t>(std::count(data + line_begin, data + at, '\n'));
+        line_begin = at;
+        const void* newline = std::memchr(data + at, '\n', block.size() - at);
+        size_t length = newline ? static_cast<const char*>(newline) - (data + at)
+                                : block.size() - at;
+        lineMatches(matcher, data + at, length, starts);
+        if (!starts.empty() && !found(line, starts)) {
+            return;
+        }
+        if (!newline) {
+            break;
+        }
+        at = matcher.findLine(data, block.size(), at + length + 1);
+    }
+}
+
+} // namespace
+
+SearchIndex::SearchIndex() : nodes(1), root(0), rng_state(2463534242u) {}
+
+void SearchIndex::build(const Regex& regex, const PieceTable& text,
+                        ThreadPool& pool) {
+    pattern = std::make_shared<const Regex>(regex);
+    rebuild(text, pool);
+}
+
+// Workers search runs of lines, as :s does, and the lines they found are
+// put in the tree in one O(m) pass
+void SearchIndex::rebuild(const PieceTable& text, ThreadPool& pool) {
+    nodes.assign(1, Node());
+    free_nodes.clear();
+    root = 0;
+    if (!pattern || !pattern->ok()) {
+        return;
+    }
+    // Workers only read the table, so it must not be indexed under them
+    text.indexLines(SIZE_MAX);
+
+    size_t line_count = text.lineCount();
+    size_t chunk_count = std::max<size_t>(
+        1, std::min(pool.concurrency() * 4, line_count / kBuildChunkLines));
+    std::vector<std::vector<Entry>> found(chunk_count);
+    pool.parallelFor(chunk_count, [&](size_t c) {
+        RegexMatcher matcher(*pattern);
+        std::vector<Entry>& entries = found[c];
+        scanLines(matcher, text, line_count * c / chunk_count,
+                  line_count * (c + 1) / chunk_count,
+                  [&entries](size_t line, std::vector<size_t>& starts) {
+                      entries.push_back(Entry{line, 0, std::move(starts)});
+                      return true;
+                  });
+    });
+
+    std::vector<Entry> entries;
+    size_t before = 0;
+    for (std::vector<Entry>& chunk : found) {
+        for (Entry& entry : chunk) {
+            entry.gap = entry.line + 1 - before;
+            before = entry.line + 1;
+            entries.push_back(std::move(entry));
+        }
+    }
+    root = buildTree(entries.data(), entries.size());
+}
+
+void SearchIndex::clear() {
+    pattern.reset();
+    nodes.assign(1, Node());
+    free_nodes.clear();
+    root = 0;
+}
+
+const std::string& SearchIndex::source() const {
+    static const std::string none;
+    return pattern ? pattern->pattern() : none;
+}
+
+void SearchIndex::linesChanged(const PieceTable& text, size_t line,
+                               size_t removed, size_t inserted) {
+    if (!pattern || !pattern->ok()) {
+        return;
+    }
+    // before: lines < line; changed: the removed lines; after: the rest.
+    // A tree's gaps sum to one past its last line, counted from the end
+    // of the tree before it.
+    uint32_t before, rest, changed, after;
+    split(root, line, before, rest);
+    size_t before_lines = nodes[before].sub_gap;
+    split(rest, line + removed - before_lines, changed, after);
+    size_t changed_lines = nodes[changed].sub_gap;
+    freeTree(changed);
+
+    std::vector<Entry> entries;
+    RegexMatcher matcher(*pattern);
+    size_t last = before_lines;
+    scanLines(matcher, text, line, line + inserted,
+              [&entries, &last](size_t found, std::vector<size_t>& starts) {
+                  entries.push_back(Entry{found, found + 1 - last, std::move(starts)});
+                  last = found + 1;
+                  return true;
+              });
+    uint32_t fresh = buildTree(entries.data(), entries.size());
+
+    // The first line after the edit moves by inserted - removed and now
+    // counts from the new lines. A move back wraps around in size_t, which
+    // the sums undo.
+    if (after) {
+        shiftFirst(after, changed_lines + inserted - removed -
+                              nodes[fresh].sub_gap);
+    }
+    root = merge(merge(before, fresh), after);
+}
+
+bool SearchIndex::next(size_t line, size_t column, bool forward,
+                       SearchHit& hit) const {
+    size_t count = nodes[root].sub_nodes;
+    if (count == 0) {
+        return false;
+    }
+    size_t k, matches_before;
+    size_t at = 0; // Set by nodeAt() on every path that reads it
+    countBefore(line, k, matches_before);
+    hit.wrapped = false;
+
+    if (forward) {
+        if (k < count) {
+            const Node& n = nodes[nodeAt(k, at)];
+            auto it = at == line ? std::upper_bound(n.starts.begin(),
+                                                    n.starts.end(), column)
+                                 : n.starts.begin();
+            if (it != n.starts.end()) {
+                hit.line = at;
+                hit.column = *it;
+                hit.ordinal = matches_before + (it - n.starts.begin()) + 1;
+                return true;
+            }
+            ++k;
+            matches_before += n.starts.size();
+        }
+        if (k == count) {
+            k = 0;
+            matches_before = 0;
+            hit.wrapped = true;
+        }
+        hit.column = nodes[nodeAt(k, hit.line)].starts.front();
+        hit.ordinal = matches_before + 1;
+        return true;
+    }
+
+    if (k < count) {
+        const Node& n = nodes[nodeAt(k, at)];
+        if (at == line) {
+            auto it = std::lower_bound(n.starts.begin(), n.starts.end(), column);
+            if (it != n.starts.begin()) {
+                hit.line = at;
+                hit.column = *(it - 1);
+                hit.ordinal = matches_before + (it - n.starts.begin());
+                return true;
+            }
+        }
+    }
+    if (k == 0) {
+        k = count;
+        matches_before = matchCount();
+        hit.wrapped = true;
+    }
+    hit.column = nodes[nodeAt(k - 1, hit.line)].starts.back();
+    hit.ordinal = matches_before;
+    return true;
+}
+
+// The cursor line first, then the other lines a block at a time, round to
+// the cursor line again
+bool SearchIndex::find(const Regex& pattern, const PieceTable& text,
+                       size_t line, size_t column, bool forward,
+                       SearchHit& hit) {
+    if (!pattern.ok()) {
+        return false;
+    }
+    RegexMatcher matcher(pattern);
+    std::vector<size_t> starts;
+    std::string current = text.getLine(line);
+    lineMatches(matcher, current.data(), current.size(), starts);
+    hit = SearchHit();
+    if (forward) {
+        auto it = std::upper_bound(starts.begin(), starts.end(), column);
+        if (it != starts.end()) {
+            hit.line = line;
+            hit.column = *it;
+            return true;
+        }
+    } else {
+        auto it = std::lower_bound(starts.begin(), starts.end(), column);
+        if (it != starts.begin()) {
+            hit.line = line;
+            hit.column = *(it - 1);
+            return true;
+        }
+    }
+
+    struct Range {
+        size_t first, last;
+        bool wrapped;
+    };
+    size_t line_count = text.lineCount();
+    Range ranges[2] = {{line + 1, line_count, false}, {0, line + 1, true}};
+    if (!forward) {
+        ranges[0] = Range{0, line, false};
+        ranges[1] = Range{line, line_count, true};
+    }
+    bool found = false;
+    for (const Range& range : ranges) {
+        size_t count = range.last - range.first;
+        for (size_t done = 0; done < count && !found; done += kFindBlockLines) {
+            size_t n = std::min(kFindBlockLines, count - done);
+            size_t first = forward ? range.first + done : range.last - done - n;
+            // Forwards the first line found will do; backwards the block is
+            // read to its end for the last one
+            scanLines(matcher, text, first, first + n,
+                      [&](size_t at, std::vector<size_t>& line_starts) {
+                          hit.line = at;
+                          hit.column = forward ? line_starts.front()
+                                               : line_starts.back();
+                          found = true;
+                          return !forward;
+                      });
+        }
+        if (found) {
+            hit.wrapped = range.wrapped;
+            return true;
+        }
+    }
+    return false;
+}
+
+// ===--- Treap ---===
+
+uint32_t SearchIndex::nextPriority() {
+    // xorshift32
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+uint32_t SearchIndex::newNode(size_t gap, std::vector<size_t> starts) {
+    uint32_t id;
+    if (!free_nodes.empty()) {
+        id = free_nodes.back();
+        free_nodes.pop_back();
+    } else {
+        id = static_cast<uint32_t>(nodes.size());
+        nodes.emplace_back();
+    }
+    size_t matches = starts.size();
+    nodes[id] = Node{0, 0, nextPriority(), gap, gap, 1, matches, std::move(starts)};
+    return id;
+}
+
+void SearchIndex::freeTree(uint32_t t) {
+    if (!t) {
+        return;
+    }
+    freeTree(nodes[t].left);
+    freeTree(nodes[t].right);
+    std::vector<size_t>().swap(nodes[t].starts);
+    free_nodes.push_back(t);
+}
+
+void SearchIndex::pull(uint32_t t) {
+    Node& n = nodes[t];
+    const Node& l = nodes[n.left];
+    const Node& r = nodes[n.right];
+    n.sub_gap = l.sub_gap + n.gap + r.sub_gap;
+    n.sub_nodes = l.sub_nodes + 1 + r.sub_nodes;
+    n.sub_matches = l.sub_matches + n.starts.size() + r.sub_matches;
+}
+
+uint32_t SearchIndex::merge(uint32_t a, uint32_t b) {
+    if (!a) {
+        return b;
+    }
+    if (!b) {
+        return a;
+    }
+    if (nodes[a].priority > nodes[b].priority) {
+        nodes[a].right = merge(nodes[a].right, b);
+        pull(a);
+        return a;
+    }
+    nodes[b].left = merge(a, nodes[b].left);
+    pull(b);
+    return b;
+}
+
+// Splits t so that l holds the nodes for lines before `lines`, counted from
+// the start of t
+void SearchIndex::split(uint32_t t, size_t lines, uint32_t& l, uint32_t& r) {
+    if (!t) {
+        l = r = 0;
+        return;
+    }
+    size_t through = nodes[nodes[t].left].sub_gap + nodes[t].gap;
+    if (through <= lines) {
+        uint32_t rl, rr;
+        split(nodes[t].right, lines - through, rl, rr);
+        nodes[t].right = rl;
+        pull(t);
+        l = t;
+        r = rr;
+    } else {
+        uint32_t ll, lr;
+        split(nodes[t].left, lines, ll, lr);
+        nodes[t].left = lr;
+        pull(t);
+        l = ll;
+        r = t;
+    }
+}
+
+// Adds `diff` to the gap of the first node in t
+void SearchIndex::shiftFirst(uint32_t t, size_t diff) {
+    for (; t; t = nodes[t].left) {
+        nodes[t].sub_gap += diff;
+        if (!nodes[t].left) {
+            nodes[t].gap += diff;
+        }
+    }
+}
+
+uint32_t SearchIndex::buildTree(Entry* entries, size_t n) {
+    if (n == 0) {
+        return 0;
+    }
+    size_t mid = n / 2;
+    uint32_t left = buildTree(entries, mid);
+    uint32_t right = buildTree(entries + mid + 1, n - mid - 1);
+    uint32_t t = newNode(entries[mid].gap, std::move(entries[mid].starts));
+    nodes[t].left = left;
+    nodes[t].right = right;
+    uint32_t priority = std::max(nodes[left].priority, nodes[right].priority);
+    nodes[t].priority = std::max(nodes[t].priority, priority == UINT32_MAX
+                                                        ? priority
+                                                        : priority + 1);
+    pull(t);
+    return t;
+}
+
+// Nodes, and matches, on lines before `line`
+void SearchIndex::countBefore(size_t line, size_t& nodes_before,
+                              size_t& matches_before) const {
+    nodes_before = 0;
+    matches_before = 0;
+    size_t base = 0;
+    for (uint32_t t = root; t;) {
+        const Node& n = nodes[t];
+        const Node& left = nodes[n.left];
+        size_t through = base + left.sub_gap + n.gap;
+        if (through <= line) {
+            nodes_before += left.sub_nodes + 1;
+            matches_before += left.sub_matches + n.starts.size();
+            base = through;
+            t = n.right;
+        } else {
+            t = n.left;
+        }
+    }
+}
+
+// The k-th node in line order, and its line
+uint32_t SearchIndex::nodeAt(size_t k, size_t& line) const {
+    size_t base = 0;
+    for (uint32_t t = root; t;) {
+        const Node& n = nodes[t];
+        const Node& left = nodes[n.left];
+        if (k < left.sub_nodes) {
+            t = n.left;
+        } else if (k == left.sub_nodes) {
+            line = base + left.sub_gap + n.gap - 1;
+            return t;
+        } else {
+            k -= left.sub_nodes + 1;
+            base += left.sub_gap + n.gap;
+            t = n.right;
+        }
+    }
+    return 0;
+}
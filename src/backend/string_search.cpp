@@ -0,0 +1,212 @@
+// src/backend/string_search.cpp
+
+#include "backend/string_search.h"
+#include <cstring>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define VIXX_SEARCH_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+#ifdef VIXX_SEARCH_X86
+
+// Both vector kernels: compare the first byte of the needle at positions
+// [i, i + width) and its last byte at [i + k - 1, i + k - 1 + width), and
+// memcmp the middle of the candidates where both match.
+template <typename Mask>
+inline size_t checkCandidates(Mask candidates, const char* data, size_t i,
+                              const char* needle, size_t k) {
+    while (candidates) {
+        size_t pos = i + __builtin_ctzll(candidates);
+        if (k <= 2 || std::memcmp(data + pos + 1, needle + 1, k - 2) == 0)
+            return pos;
+        candidates &= candidates - 1;
+    }
+    return SubstringSearcher::npos;
+}
+
+size_t findTail(const char* data, size_t n, size_t i, const char* needle,
+                size_t k) {
+    for (; i + k <= n; ++i) {
+        if (data[i] == needle[0] && data[i + k - 1] == needle[k - 1] &&
+            std::memcmp(data + i, needle, k) == 0)
+            return i;
+    }
+    return SubstringSearcher::npos;
+}
+
+size_t findSSE2(const char* data, size_t n, const char* needle, size_t k) {
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[k - 1]);
+    size_t i = 0;
+    for (; i + k - 1 + 16 <= n; i += 16) {
+        __m128i block_first =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i block_last =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + k - 1));
+        uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_and_si128(
+            _mm_cmpeq_epi8(first, block_first), _mm_cmpeq_epi8(last, block_last))));
+        if (mask) {
+            size_t pos = checkCandidates<uint32_t>(mask, data, i, needle, k);
+            if (pos != SubstringSearcher::npos)
+                return pos;
+        }
+    }
+    return findTail(data, n, i, needle, k);
+}
+
+__attribute__((target("avx2"))) size_t
+findAVX2(const char* data, size_t n, const char* needle, size_t k) {
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[k - 1]);
+    size_t i = 0;
+    for (; i + k - 1 + 32 <= n; i += 32) {
+        __m256i block_first =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        __m256i block_last = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(data + i + k - 1));
+        uint32_t mask = static_cast<uint32_t>(
+            _mm256_movemask_epi8(_mm256_and_si256(
+                _mm256_cmpeq_epi8(first, block_first),
+                _mm256_cmpeq_epi8(last, block_last))));
+        if (mask) {
+            size_t pos = checkCandidates<uint32_t>(mask, data, i, needle, k);
+            if (pos != SubstringSearcher::npos)
+                return pos;
+        }
+    }
+    return findTail(data, n, i, needle, k);
+}
+
+#endif // VIXX_SEARCH_X86
+
+} // namespace
+
+bool searchKernelSupported(SearchKernel kernel) {
+    switch (kernel) {
+    case SearchKernel::SCALAR:
+    case SearchKernel::HORSPOOL:
+        return true;
+#ifdef VIXX_SEARCH_X86
+    case SearchKernel::SSE2:
+        return true; // Part of the x86-64 baseline
+    case SearchKernel::AVX2:
+        return __builtin_cpu_supports("avx2");
+#else
+    default:
+        return false;
+#endif
+    }
+    return false;
+}
+
+// Horspool is never chosen: on prose its skips stay short, and bench_search
+// has it behind even the scalar kernel at every needle length up to 120 bytes
+SearchKernel bestSearchKernel() {
+    static const SearchKernel best =
+        searchKernelSupported(SearchKernel::AVX2)   ? SearchKernel::AVX2
+        : searchKernelSupported(SearchKernel::SSE2) ? SearchKernel::SSE2
+                                                    : SearchKernel::SCALAR;
+    return best;
+}
+
+const char* searchKernelName(SearchKernel kernel) {
+    switch (kernel) {
+    case SearchKernel::SCALAR:
+        return "scalar";
+    case SearchKernel::SSE2:
+        return "sse2";
+    case SearchKernel::AVX2:
+        return "avx2";
+    case SearchKernel::HORSPOOL:
+        return "horspool";
+    }
+    return "?";
+}
+
+// ===--- SubstringSearcher ---===
+
+SubstringSearcher::SubstringSearcher(const std::string& needle)
+    : SubstringSearcher(needle, bestSearchKernel()) {}
+
+SubstringSearcher::SubstringSearcher(const std::string& needle,
+                                     SearchKernel kernel)
+    : needle(needle), method(kernel) {
+    if (!searchKernelSupported(method))
+        method = SearchKernel::SCALAR;
+    size_t k = needle.size();
+    for (size_t c = 0; c < 256; ++c)
+        skip[c] = k;
+    for (size_t i = 0; i + 1 < k; ++i)
+        skip[static_cast<unsigned char>(needle[i])] = k - 1 - i;
+}
+
+size_t SubstringSearcher::find(const char* data, size_t n, size_t from) const {
+    size_t k = needle.size();
+    if (from > n)
+        return npos;
+    if (k == 0)
+        return from;
+    if (n - from < k)
+        return npos;
+
+    const char* base = data + from;
+    size_t length = n - from;
+    size_t pos;
+    if (k == 1) {
+        // memchr is already vectorized
+        const void* hit = std::memchr(base, needle[0], length);
+        pos = hit ? static_cast<size_t>(static_cast<const char*>(hit) - base)
+                  : npos;
+    } else {
+        switch (method) {
+#ifdef VIXX_SEARCH_X86
+        case SearchKernel::AVX2:
+            pos = findAVX2(base, length, needle.data(), k);
+            break;
+        case SearchKernel::SSE2:
+            pos = findSSE2(base, length, needle.data(), k);
+            break;
+#endif
+        case SearchKernel::HORSPOOL:
+            pos = findHorspool(base, length);
+            break;
+        default:
+            pos = findScalar(base, length);
+            break;
+        }
+    }
+    return pos == npos ? npos : pos + from;
+}
+
+// memchr to the next first byte, then check the last byte and the rest
+size_t SubstringSearcher::findScalar(const char* data, size_t n) const {
+    size_t k = needle.size();
+    const char* p = data;
+    const char* end = data + n - k + 1; // Past the last possible start
+    while (p < end) {
+        p = static_cast<const char*>(
+            std::memchr(p, needle[0], static_cast<size_t>(end - p)));
+        if (!p)
+            return npos;
+        if (p[k - 1] == needle[k - 1] &&
+            std::memcmp(p + 1, needle.data() + 1, k - 2) == 0)
+            return static_cast<size_t>(p - data);
+        ++p;
+    }
+    return npos;
+}
+
+size_t SubstringSearcher::findHorspool(const char* data, size_t n) const {
+    size_t k = needle.size();
+    char last = needle[k - 1];
+    for (size_t i = 0; i + k <= n;) {
+        char c = data[i + k - 1];
+        if (c == last && std::memcmp(data + i, needle.data(), k - 1) == 0)
+            return i;
+        i += skip[static_cast<unsigned char>(c)];
+    }
+    return npos;
+}
@@ -0,0 +1,554 @@
+// src/backend/syntax.cpp
+
+#include "backend/syntax.h"
+#include <algorithm>
+#include <string_view>
+
+namespace {
+
+// Lexer states, in the low byte; a raw string keeps a hash of its
+// delimiter above it
+enum LexMode : uint32_t {
+    kNormal = 0,
+    kBlockComment = 1,
+    kString = 2,      // A string a backslash carried on
+    kLineComment = 3, // A // comment a backslash carried on
+    kRawString = 4
+};
+
+// Longest raw string delimiter the standard allows
+const size_t kMaxDelimiter = 16;
+
+// Lines lexed between looks at the clock while idle
+const size_t kIdleBatch = 256;
+
+// Most known states skipped at once after lexing agrees with one
+const size_t kMaxSkip = 4096;
+
+const char* const kKeywords[] = {
+    "alignas", "alignof", "and", "asm", "auto", "break", "case", "catch",
+    "class", "co_await", "co_return", "co_yield", "const", "const_cast",
+    "consteval", "constexpr", "constinit", "continue", "decltype", "default",
+    "delete", "do", "dynamic_cast", "else", "enum", "explicit", "export",
+    "extern", "false", "final", "for", "friend", "goto", "if", "inline",
+    "mutable", "namespace", "new", "noexcept", "not", "nullptr", "operator",
+    "or", "override", "private", "protected", "public", "register",
+    "reinterpret_cast", "requires", "return", "sizeof", "static",
+    "static_assert", "static_cast", "struct", "switch", "template", "this",
+    "thread_local", "throw", "true", "try", "typedef", "typeid", "typename",
+    "union", "using", "virtual", "volatile", "while",
+};
+
+const char* const kTypes[] = {
+    "bool", "char", "char16_t", "char32_t", "char8_t", "double", "float",
+    "int", "int16_t", "int32_t", "int64_t", "int8_t", "intptr_t", "long",
+    "ptrdiff_t", "short", "signed", "size_t", "ssize_t", "uint16_t",
+    "uint32_t", "uint64_t", "uint8_t", "uintptr_t", "unsigned", "void",
+    "wchar_t",
+};
+
+// The keywords and type names, grouped by first byte so a lookup compares
+// an identifier with the handful of words that start like it
+class WordTable {
+  public:
+    WordTable() {
+        for (const char* word : kKeywords) {
+            words.push_back(Word{word, SyntaxKind::KEYWORD});
+        }
+        for (const char* word : kTypes) {
+            words.push_back(Word{word, SyntaxKind::TYPE});
+        }
+        std::sort(words.begin(), words.end(),
+                  [](const Word& a, const Word& b) { return a.text < b.text; });
+        size_t i = 0;
+        for (size_t c = 0; c <= 256; ++c) {
+            while (i < words.size() &&
+                   static_cast<unsigned char>(words[i].text[0]) < c) {
+                ++i;
+            }
+            first[c] = static_cast<uint8_t>(i);
+        }
+    }
+
+    SyntaxKind find(std::string_view word) const {
+        unsigned char c = static_cast<unsigned char>(word[0]);
+        for (size_t i = first[c]; i < first[c + 1]; ++i) {
+            if (words[i].text == word) {
+                return words[i].kind;
+            }
+        }
+        return SyntaxKind::NORMAL;
+    }
+
+  private:
+    struct Word {
+        std::string_view text;
+        SyntaxKind kind;
+    };
+
+    std::vector<Word> words;
+    uint8_t first[257]; // Words starting with byte c are [first[c], first[c + 1])
+};
+
+bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\v';
+}
+
+bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+// Bytes past 0x7f are taken as letters, so UTF-8 identifiers stay whole
+bool isIdentStart(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' ||
+           static_cast<unsigned char>(c) >= 0x80;
+}
+
+bool isIdent(char c) {
+    return isIdentStart(c) || isDigit(c);
+}
+
+// Prefixes a string literal can carry; the ones ending in R make it raw
+bool isStringPrefix(std::string_view word) {
+    return word == "L" || word == "u" || word == "U" || word == "u8" ||
+           word == "R" || word == "LR" || word == "uR" || word == "UR" ||
+           word == "u8R";
+}
+
+uint32_t delimiterHash(const char* p, size_t n) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < n; ++i) {
+        h = (h ^ static_cast<unsigned char>(p[i])) * 16777619u;
+    }
+    return h & 0xffffff;
+}
+
+class TokenSink {
+  public:
+    explicit TokenSink(std::vector<SyntaxToken>* tokens) : tokens(tokens) {}
+
+    void add(size_t begin, size_t end, SyntaxKind kind) {
+        if (tokens && end > begin) {
+            tokens->push_back(SyntaxToken{begin, end, kind});
+        }
+    }
+
+  private:
+    std::vector<SyntaxToken>* tokens;
+};
+
+// Past the "*/" at or after `i`, or `n` with `closed` false
+size_t skipBlockComment(const char* s, size_t n, size_t i, bool& closed) {
+    for (; i + 1 < n; ++i) {
+        if (s[i] == '*' && s[i + 1] == '/') {
+            closed = true;
+            return i + 2;
+        }
+    }
+    closed = false;
+    return n;
+}
+
+// Past the `quote` closing a literal whose body starts at `i`, or `n` with
+// `closed` false. A backslash escapes the byte after it.
+size_t skipQuoted(const char* s, size_t n, size_t i, char quote,
+                  bool& closed) {
+    while (i < n) {
+        if (s[i] == '\\') {
+            i += 2;
+        } else if (s[i] == quote) {
+            closed = true;
+            return i + 1;
+        } else {
+            ++i;
+        }
+    }
+    closed = false;
+    return n;
+}
+
+// Past the )delimiter" closing a raw string whose delimiter hashes to
+// `hash`, or `n` with `closed` false
+size_t skipRaw(const char* s, size_t n, size_t i, uint32_t hash,
+               bool& closed) {
+    for (; i < n; ++i) {
+        if (s[i] != ')') {
+            continue;
+        }
+        size_t end = i + 1;
+        while (end < n && end - i - 1 <= kMaxDelimiter && s[end] != '"') {
+            ++end;
+        }
+        if (end < n && s[end] == '"' &&
+            delimiterHash(s + i + 1, end - i - 1) == hash) {
+            closed = true;
+            return end + 1;
+        }
+    }
+    closed = false;
+    return n;
+}
+
+// Whether a line ends in a backslash that carries it on
+bool continues(const char* s, size_t n) {
+    return n > 0 && s[n - 1] == '\\';
+}
+
+// Past a number starting at `i`: digits, letters for the base and suffix,
+// digit separators, and a sign after an exponent
+size_t skipNumber(const char* s, size_t n, size_t i) {
+    ++i;
+    while (i < n) {
+        char c = s[i];
+        char prev = s[i - 1];
+        bool exponent = prev == 'e' || prev == 'E' || prev == 'p' ||
+                        prev == 'P';
+        if (isIdent(c) || c == '.' || (c == '\'' && i + 1 < n &&
+                                       isIdent(s[i + 1])) ||
+            ((c == '+' || c == '-') && exponent)) {
+            ++i;
+        } else {
+            break;
+        }
+    }
+    return i;
+}
+
+} // namespace
+
+SyntaxLanguage detectSyntaxLanguage(const std::string& filename) {
+    static const std::string_view kCppExtensions[] = {
+        ".C", ".H", ".c", ".c++", ".cc", ".cpp", ".cxx",
+        ".h", ".h++", ".hh", ".hpp", ".hxx", ".inl", ".ipp", ".tcc",
+    };
+    size_t dot = filename.rfind('.');
+    if (dot == std::string::npos || filename.find('/', dot) != std::string::npos) {
+        return SyntaxLanguage::NONE;
+    }
+    std::string_view extension(filename.data() + dot, filename.size() - dot);
+    for (std::string_view cpp : kCppExtensions) {
+        if (extension == cpp) {
+            return SyntaxLanguage::CPP;
+        }
+    }
+    return SyntaxLanguage::NONE;
+}
+
+uint32_t lexCppLine(const char* s, size_t n, uint32_t state,
+                    std::vector<SyntaxToken>* tokens) {
+    TokenSink out(tokens);
+    size_t i = 0;
+    bool closed = true;
+
+    // Finish what the line before left open
+    switch (state & 0xff) {
+    case kBlockComment:
+        i = skipBlockComment(s, n, 0, closed);
+        out.add(0, i, SyntaxKind::COMMENT);
+        if (!closed) {
+            return kBlockComment;
+        }
+        break;
+    case kString:
+        i = skipQuoted(s, n, 0, '"', closed);
+        out.add(0, i, SyntaxKind::STRING);
+        if (!closed) {
+            return continues(s, n) ? kString : kNormal;
+        }
+        break;
+    case kLineComment:
+        out.add(0, n, SyntaxKind::COMMENT);
+        return continues(s, n) ? kLineComment : kNormal;
+    case kRawString:
+        i = skipRaw(s, n, 0, state >> 8, closed);
+        out.add(0, i, SyntaxKind::STRING);
+        if (!closed) {
+            return state;
+        }
+        break;
+    default:
+        break;
+    }
+
+    bool line_start = i == 0;
+    while (i < n) {
+        char c = s[i];
+        if (isSpace(c)) {
+            ++i;
+            continue;
+        }
+        bool first = line_start;
+        line_start = false;
+        char next = i + 1 < n ? s[i + 1] : '\0';
+
+        if (c == '/' && next == '/') {
+            out.add(i, n, SyntaxKind::COMMENT);
+            return continues(s, n) ? kLineComment : kNormal;
+        }
+        if (c == '/' && next == '*') {
+            size_t end = skipBlockComment(s, n, i + 2, closed);
+            out.add(i, end, SyntaxKind::COMMENT);
+            if (!closed) {
+                return kBlockComment;
+            }
+            i = end;
+            continue;
+        }
+        if (c == '#' && first) {
+            // The directive, and the header an #include names
+            size_t word = i + 1;
+            while (word < n && isSpace(s[word])) {
+                ++word;
+            }
+            size_t end = word;
+            while (end < n && isIdent(s[end])) {
+                ++end;
+            }
+            out.add(i, end, SyntaxKind::PREPROC);
+            i = end;
+            if (std::string_view(s + word, end - word) == "include") {
+                while (i < n && isSpace(s[i])) {
+                    ++i;
+                }
+                if (i < n && s[i] == '<') {
+                    size_t close = i + 1;
+                    while (close < n && s[close] != '>') {
+                        ++close;
+                    }
+                    close = std::min(close + 1, n);
+                    out.add(i, close, SyntaxKind::STRING);
+                    i = close;
+                }
+            }
+            continue;
+        }
+        if (c == '"' || c == '\'') {
+            size_t end = skipQuoted(s, n, i + 1, c, closed);
+            out.add(i, end, SyntaxKind::STRING);
+            if (!closed && c == '"' && continues(s, n)) {
+                return kString;
+            }
+            i = end;
+            continue;
+        }
+        if (isDigit(c) || (c == '.' && isDigit(next))) {
+            size_t end = skipNumber(s, n, i);
+            out.add(i, end, SyntaxKind::NUMBER);
+            i = end;
+            continue;
+        }
+        if (isIdentStart(c)) {
+            size_t end = i + 1;
+            while (end < n && isIdent(s[end])) {
+                ++end;
+            }
+            std::string_view word(s + i, end - i);
+            if (end < n && (s[end] == '"' || s[end] == '\'') &&
+                isStringPrefix(word)) {
+                char quote = s[end];
+                size_t open = end + 1;
+                if (word.back() == 'R' && quote == '"') {
+                    size_t paren = open;
+                    while (paren < n && paren - open <= kMaxDelimiter &&
+                           s[paren] != '(') {
+                        ++paren;
+                    }
+                    if (paren < n && s[paren] == '(') {
+                        uint32_t hash = delimiterHash(s + open, paren - open);
+                        size_t close = skipRaw(s, n, paren + 1, hash, closed);
+                        out.add(i, close, SyntaxKind::STRING);
+                        if (!closed) {
+                            return kRawString | (hash << 8);
+                        }
+                        i = close;
+                        continue;
+                    }
+                }
+                size_t close = skipQuoted(s, n, open, quote, closed);
+                out.add(i, close, SyntaxKind::STRING);
+                if (!closed && quote == '"' && continues(s, n)) {
+                    return kString;
+                }
+                i = close;
+                continue;
+            }
+            static const WordTable table;
+            SyntaxKind kind = table.find(word);
+            if (kind != SyntaxKind::NORMAL) {
+                out.add(i, end, kind);
+            }
+            i = end;
+            continue;
+        }
+        ++i;
+    }
+    return kNormal;
+}
+
+// ===--- SyntaxHighlighter ---===
+
+SyntaxHighlighter::SyntaxHighlighter()
+    : language(SyntaxLanguage::NONE), valid(0) {}
+
+void SyntaxHighlighter::setLanguage(SyntaxLanguage language) {
+    if (language != this->language) {
+        this->language = language;
+        clear();
+    }
+}
+
+void SyntaxHighlighter::clear() {
+    states.clear();
+    valid = 0;
+}
+
+// The edited lines, and the line after them when lines went away, hold
+// kUnknown, so lexing on from before them cannot stop there
+void SyntaxHighlighter::linesChanged(size_t line, size_t removed,
+                                     size_t inserted) {
+    if (line >= states.size()) {
+        return;
+    }
+    // Only a change in line count moves the states after the edit
+    removed = std::min(removed, states.size() - line);
+    if (removed > inserted) {
+        states.erase(states.begin() + line + inserted,
+                     states.begin() + line + removed);
+    } else if (removed < inserted) {
+        states.insert(states.begin() + line + removed, inserted - removed,
+                      kUnknown);
+    }
+    std::fill(states.begin() + line,
+              states.begin() + std::min(line + std::max<size_t>(inserted, 1),
+                                        states.size()),
+              kUnknown);
+    valid = std::min(valid, line);
+}
+
+// The last line of a text still being indexed may not have ended yet
+size_t SyntaxHighlighter::available(const PieceTable& text) {
+    return text.lineCount() - (text.indexed() ? 0 : 1);
+}
+
+uint32_t SyntaxHighlighter::startState(size_t line) const {
+    if (line == 0 || line > states.size() || states[line - 1] == kUnknown) {
+        return 0;
+    }
+    return states[line - 1];
+}
+
+uint32_t SyntaxHighlighter::lexLine(const char* line, size_t length,
+                                    uint32_t state,
+                                    std::vector<SyntaxToken>* tokens) const {
+    switch (language) {
+    case SyntaxLanguage::CPP:
+        return lexCppLine(line, length, state, tokens);
+    default:
+        return 0;
+    }
+}
+
+// Lexes a line from the state before it and stores its end state. Returns
+// whether that was the state already stored.
+bool SyntaxHighlighter::store(const PieceTable& text, size_t line,
+                              size_t& changed_first, size_t& changed_last) {
+    text.readLine(line, scratch);
+    uint32_t end = lexLine(scratch.data(), scratch.size(), startState(line),
+                           nullptr);
+    if (line >= states.size()) {
+        states.resize(line + 1, kUnknown);
+    }
+    if (states[line] == end) {
+        return true;
+    }
+    states[line] = end;
+    // The line after starts differently now
+    changed_first = std::min(changed_first, line + 1);
+    changed_last = std::max(changed_last, line + 1);
+    return false;
+}
+
+// Moves `valid` to at least `limit`, stopping at lines the text has not
+// indexed yet
+void SyntaxHighlighter::advance(const PieceTable& text, size_t limit,
+                                size_t& changed_first, size_t& changed_last) {
+    text.indexLines(limit);
+    limit = std::min(limit, available(text));
+    while (valid < limit) {
+        bool same = store(text, valid, changed_first, changed_last);
+        ++valid;
+        if (same) {
+            // The states after this one were lexed from it. The skip is
+            // bounded so a keystroke does not scan the whole file; when it
+            // falls short, the next line lexes the same and skips on.
+            size_t stop = std::min(states.size(), valid + kMaxSkip);
+            valid = std::find(states.begin() + valid, states.begin() + stop,
+                              kUnknown) -
+                    states.begin();
+        } else if (valid == limit && valid < states.size()) {
+            // The next one was lexed from what this one was
+            states[valid] = kUnknown;
+        }
+    }
+}
+
+void SyntaxHighlighter::prepare(const PieceTable& text, size_t first,
+                                size_t last, size_t& changed_first,
+                                size_t& changed_last) {
+    if (!enabled()) {
+        return;
+    }
+    last = std::min(last, available(text));
+    if (first >= last) {
+        return;
+    }
+    if (first <= valid + kSyncLines) {
+        advance(text, last, changed_first, changed_last);
+        return;
+    }
+
+    // Far past the known states: guess from a little way up, unless a
+    // guess already runs through the window
+    if (states.size() < last) {
+        states.resize(last, kUnknown);
+    }
+    if (std::find(states.begin() + first - 1, states.begin() + last,
+                  kUnknown) == states.begin() + last) {
+        return;
+    }
+    // The lines around the guess were not lexed from it
+    size_t start = first - kSyncLines;
+    states[start - 1] = kUnknown;
+    for (size_t line = start; line < last; ++line) {
+        store(text, line, changed_first, changed_last);
+    }
+    if (last < states.size()) {
+        states[last] = kUnknown;
+    }
+}
+
+// A text still being indexed has more lines to come
+bool SyntaxHighlighter::pending(const PieceTable& text) const {
+    return enabled() && (valid < text.lineCount() || !text.indexed());
+}
+
+void SyntaxHighlighter::idle(const PieceTable& text,
+                             std::chrono::steady_clock::time_point deadline,
+                             size_t& changed_first, size_t& changed_last) {
+    while (pending(text)) {
+        size_t before = valid;
+        advance(text, valid + kIdleBatch, changed_first, changed_last);
+        if (valid == before ||
+            std::chrono::steady_clock::now() >= deadline) {
+            return;
+        }
+    }
+}
+
+void SyntaxHighlighter::tokens(size_t line, const std::string& content,
+                               std::vector<SyntaxToken>& out) const {
+    out.clear();
+    if (enabled()) {
+        lexLine(content.data(), content.size(), startState(line), &out);
+    }
+}
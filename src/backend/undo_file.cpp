@@ -0,0 +1,373 @@
+// src/backend/undo_file.cpp
+
+#include "backend/undo_file.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sys/stat.h>
+#include <utility>
+
+namespace {
+
+const char kMagic[8] = {'V', 'I', 'X', 'X', 'U', 'N', 'D', 'O'};
+const unsigned char kVersion = 1;
+const char kNodeRecord = 'N';
+const char kCheckpointRecord = 'C';
+
+// ===--- Encoding ---===
+// Integers are LEB128 varints; hashes are 8 little-endian bytes. A record
+// is a tag byte and a varint payload length, so a record cut short by a
+// crash mid-append is recognized and skipped.
+
+void putVarint(std::string& out, uint64_t v) {
+    while (v >= 0x80) {
+        out += static_cast<char>((v & 0x7f) | 0x80);
+        v >>= 7;
+    }
+    out += static_cast<char>(v);
+}
+
+void putFixed64(std::string& out, uint64_t v) {
+    for (int i = 0; i < 8; ++i) {
+        out += static_cast<char>((v >> (8 * i)) & 0xff);
+    }
+}
+
+bool getVarint(const char*& p, const char* end, uint64_t& v) {
+    v = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        unsigned char byte = static_cast<unsigned char>(*p++);
+        v |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool getFixed64(const char*& p, const char* end, uint64_t& v) {
+    if (end - p < 8) {
+        return false;
+    }
+    v = 0;
+    for (int i = 0; i < 8; ++i) {
+        v |= static_cast<uint64_t>(static_cast<unsigned char>(p[i])) << (8 * i);
+    }
+    p += 8;
+    return true;
+}
+
+void putPieces(std::string& out, const PieceList& pieces,
+               const PieceTable& text) {
+    putVarint(out, pieces.length());
+    for (size_t i = 0; i < pieces.size(); ++i) {
+        out.append(text.pieceData(pieces[i]), pieces[i].length);
+    }
+}
+
+// Copies the bytes into the add buffer and returns them as one piece
+bool getPieces(const char*& p, const char* end, PieceTable& text,
+               PieceList& pieces) {
+    uint64_t length;
+    if (!getVarint(p, end, length) ||
+        length > static_cast<uint64_t>(end - p)) {
+        return false;
+    }
+    if (length > 0) {
+        pieces.push_back(text.store(p, length));
+    }
+    p += length;
+    return true;
+}
+
+void putRecord(std::string& out, char tag, const std::string& payload) {
+    out += tag;
+    putVarint(out, payload.size());
+    out += payload;
+}
+
+void putNode(std::string& out, const UndoNode& node, const PieceTable& text) {
+    std::string payload;
+    putVarint(payload, node.seq);
+    putVarint(payload, node.parent);
+    putVarint(payload, static_cast<uint64_t>(node.time));
+    putVarint(payload, static_cast<uint64_t>(node.group.cursor_y));
+    putVarint(payload, static_cast<uint64_t>(node.group.cursor_x));
+    putVarint(payload, node.group.actions.size());
+    for (const Action& action : node.group.actions) {
+        putVarint(payload, action.offset);
+        putPieces(payload, action.removed, text);
+        putPieces(payload, action.inserted, text);
+    }
+    putRecord(out, kNodeRecord, payload);
+}
+
+void putCheckpoint(std::string& out, const UndoTree& tree, uint64_t hash,
+                   size_t size) {
+    std::string payload;
+    putVarint(payload, tree.currentSeq());
+    putFixed64(payload, hash);
+    putVarint(payload, size);
+    putRecord(out, kCheckpointRecord, payload);
+}
+
+bool getNode(const char* p, const char* end, PieceTable& text,
+             UndoTree& tree) {
+    uint64_t seq, parent, time, cursor_y, cursor_x, count;
+    if (!getVarint(p, end, seq) || !getVarint(p, end, parent) ||
+        !getVarint(p, end, time) || !getVarint(p, end, cursor_y) ||
+        !getVarint(p, end, cursor_x) || !getVarint(p, end, count)) {
+        return false;
+    }
+    UndoGroup group{{}, static_cast<int>(cursor_y), static_cast<int>(cursor_x), 0};
+    for (uint64_t i = 0; i < count; ++i) {
+        Action action;
+        uint64_t offset;
+        if (!getVarint(p, end, offset) ||
+            !getPieces(p, end, text, action.removed) ||
+            !getPieces(p, end, text, action.inserted)) {
+            return false;
+        }
+        action.offset = offset;
+        group.actions.push_back(std::move(action));
+    }
+    return tree.restoreNode(seq, parent, static_cast<int64_t>(time),
+                            std::move(group));
+}
+
+size_t fileSize(const std::string& path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        return SIZE_MAX;
+    }
+    return static_cast<size_t>(st.st_size);
+}
+
+inline uint64_t rotl(uint64_t v, int r) {
+    return (v << r) | (v >> (64 - r));
+}
+
+} // namespace
+
+// ===--- ContentHash ---===
+
+ContentHash::ContentHash()
+    : state(0x243f6a8885a308d3ULL), tail(0), tail_bytes(0), total(0) {}
+
+void ContentHash::update(const char* data, size_t n) {
+    total += n;
+    // Words are taken at fixed offsets of the whole text, however it is
+    // split into calls: first complete the word left over from the last one
+    while (n > 0 && tail_bytes > 0) {
+        tail |= static_cast<uint64_t>(static_cast<unsigned char>(*data++))
+                << (8 * tail_bytes);
+        --n;
+        if (++tail_bytes == 8) {
+            mix(tail);
+            tail = 0;
+            tail_bytes = 0;
+        }
+    }
+    for (; n >= 8; data += 8, n -= 8) {
+        uint64_t word;
+        std::memcpy(&word, data, 8);
+        mix(word);
+    }
+    // Fewer than 8 bytes left: they start the next word
+    while (n > 0) {
+        tail |= static_cast<uint64_t>(static_cast<unsigned char>(*data++))
+                << (8 * tail_bytes);
+        ++tail_bytes;
+        --n;
+    }
+}
+
+void ContentHash::mix(uint64_t word) {
+    state = rotl(state ^ (word * 0x9e3779b97f4a7c15ULL), 31) *
+            0xbf58476d1ce4e5b9ULL;
+}
+
+uint64_t ContentHash::digest() const {
+    ContentHash last = *this;
+    last.mix(tail);
+    uint64_t h = last.state ^ total;
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    return h;
+}
+
+uint64_t hashText(const PieceTable& text) {
+    ContentHash hash;
+    text.forEachSpan(0, text.size(), [&hash](const char* p, size_t n) {
+        hash.update(p, n);
+    });
+    return hash.digest();
+}
+
+// ===--- UndoFile ---===
+
+UndoFile::UndoFile() {
+    reset();
+}
+
+std::string UndoFile::pathFor(const std::string& filename) {
+    size_t slash = filename.rfind('/');
+    size_t base = slash == std::string::npos ? 0 : slash + 1;
+    return filename.substr(0, base) + "." + filename.substr(base) + ".un~";
+}
+
+void UndoFile::reset() {
+    path.clear();
+    written_seq = 0;
+    written_bytes = 0;
+    rebases = 0;
+}
+
+bool UndoFile::load(const std::string& filename, PieceTable& text,
+                    UndoTree& tree) {
+    reset();
+    tree.clear();
+
+    std::string target = pathFor(filename);
+    std::ifstream file(target, std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+    std::string data((std::istreambuf_iterator<char>(file)),
+                     std::istreambuf_iterator<char>());
+    const char* p = data.data();
+    const char* end = p + data.size();
+
+    uint64_t root_time;
+    if (data.size() < sizeof(kMagic) + 1 ||
+        std::memcmp(p, kMagic, sizeof(kMagic)) != 0 ||
+        static_cast<unsigned char>(p[sizeof(kMagic)]) != kVersion) {
+        return false;
+    }
+    p += sizeof(kMagic) + 1;
+    if (!getVarint(p, end, root_time)) {
+        return false;
+    }
+    const char* records = p;
+
+    // First find the last checkpoint, and give up before copying any text
+    // if the file does not match it
+    bool have_checkpoint = false;
+    uint64_t current = 0, hash = 0, size = 0;
+    const char* valid_end = p;
+    while (p < end) {
+        char tag = *p++;
+        uint64_t length;
+        if (!getVarint(p, end, length) ||
+            length > static_cast<uint64_t>(end - p)) {
+            break; // Cut short by a crash while appending
+        }
+        const char* record_end = p + length;
+        if (tag == kCheckpointRecord) {
+            const char* q = p;
+            have_checkpoint = getVarint(q, record_end, current) &&
+                              getFixed64(q, record_end, hash) &&
+                              getVarint(q, record_end, size);
+        }
+        p = record_end;
+        valid_end = p;
+    }
+    if (!have_checkpoint || size != text.size() || hash != hashText(text)) {
+        return false;
+    }
+
+    tree.restoreRoot(static_cast<int64_t>(root_time));
+    for (p = records; p < valid_end;) {
+        char tag = *p++;
+        uint64_t length;
+        getVarint(p, valid_end, length);
+        if (tag == kNodeRecord) {
+            getNode(p, p + length, text, tree);
+        }
+        p += length;
+    }
+    if (!tree.restoreCurrent(current)) {
+        tree.clear();
+        return false;
+    }
+    path = target;
+    written_seq = tree.lastSeq();
+    written_bytes = static_cast<size_t>(valid_end - data.data());
+    rebases = tree.rebaseCount();
+    return true;
+}
+
+bool UndoFile::save(const std::string& filename, uint64_t hash,
+                    const PieceTable& text, const UndoTree& tree) {
+    std::string target = pathFor(filename);
+    if (target != path || tree.rebaseCount() != rebases ||
+        fileSize(target) != written_bytes) {
+        return rewrite(filename, hash, text, tree);
+    }
+
+    // Nodes are immutable once their group is closed, which a save does, so
+    // everything up to written_seq is already on disk as it is now
+    std::string out;
+    for (size_t seq = written_seq + 1; seq <= tree.lastSeq(); ++seq) {
+        if (const UndoNode* node = tree.node(seq)) {
+            putNode(out, *node, text);
+        }
+    }
+    putCheckpoint(out, tree, hash, text.size());
+
+    std::ofstream file(target, std::ios::binary | std::ios::app);
+    file.write(out.data(), static_cast<std::streamsize>(out.size()));
+    file.close();
+    if (!file) {
+        reset();
+        return false;
+    }
+    written_seq = tree.lastSeq();
+    written_bytes += out.size();
+    return true;
+}
+
+bool UndoFile::rewrite(const std::string& filename, uint64_t hash,
+                       const PieceTable& text, const UndoTree& tree) {
+    std::string target = pathFor(filename);
+    std::string out(kMagic, sizeof(kMagic));
+    out += static_cast<char>(kVersion);
+    putVarint(out, static_cast<uint64_t>(tree.rootTime()));
+    for (size_t seq = 1; seq <= tree.lastSeq(); ++seq) {
+        if (const UndoNode* node = tree.node(seq)) {
+            putNode(out, *node, text);
+        }
+    }
+    putCheckpoint(out, tree, hash, text.size());
+
+    std::string tmp_name = target + ".vixx-tmp";
+    std::ofstream file(tmp_name, std::ios::binary);
+    file.write(out.data(), static_cast<std::streamsize>(out.size()));
+    file.close();
+    if (!file) {
+        std::remove(tmp_name.c_str());
+        reset();
+        return false;
+    }
+
+    // The history holds the file's text: no more readable than the file
+    struct stat st;
+    if (stat(filename.c_str(), &st) == 0) {
+        chmod(tmp_name.c_str(), st.st_mode & 0666);
+    }
+    if (std::rename(tmp_name.c_str(), target.c_str()) != 0) {
+        std::remove(tmp_name.c_str());
+        reset();
+        return false;
+    }
+    path = target;
+    written_seq = tree.lastSeq();
+    written_bytes = out.size();
+    rebases = tree.rebaseCount();
+    return true;
+}
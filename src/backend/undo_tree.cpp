@@ -0,0 +1,407 @@
+// src/backend/undo_tree.cpp
+
+#include "backend/undo_tree.h"
+#include <algorithm>
+#include <ctime>
+#include <utility>
+
+namespace {
+
+// Appends `piece`, growing the last piece when it continues it in the same
+// source, as consecutive typing does
+void appendPiece(PieceList& list, const Piece& piece) {
+    if (!list.empty()) {
+        Piece& last = list.back();
+        if (last.source == piece.source &&
+            last.start + last.length == piece.start) {
+            last.length += piece.length;
+            last.newlines += piece.newlines;
+            return;
+        }
+    }
+    list.push_back(piece);
+}
+
+void prependPiece(PieceList& list, const Piece& piece) {
+    if (!list.empty()) {
+        Piece& first = list.front();
+        if (first.source == piece.source &&
+            piece.start + piece.length == first.start) {
+            first.start = piece.start;
+            first.length += piece.length;
+            first.newlines += piece.newlines;
+            return;
+        }
+    }
+    list.push_front(piece);
+}
+
+int64_t now() {
+    return static_cast<int64_t>(std::time(nullptr));
+}
+
+} // namespace
+
+UndoTree::UndoTree() : limit(kDefaultLimit), rebases(0) {
+    clear();
+}
+
+void UndoTree::record(size_t offset, const PieceList& removed,
+                      const PieceList& inserted, int cursor_y, int cursor_x,
+                      const PieceTable& table) {
+    if (removed.empty() && inserted.empty()) {
+        return;
+    }
+    if (!group_open) {
+        newChild(cursor_y, cursor_x);
+        group_open = true;
+    }
+    UndoNode& node = *find(current);
+    UndoGroup& group = node.group;
+    node.time = now();
+
+    if (!group.actions.empty()) {
+        Action& last = group.actions.back();
+        size_t before = costOf(last);
+        if (coalesce(last, offset, removed, inserted, table)) {
+            size_t after = costOf(last);
+            group.cost = group.cost - before + after;
+            total_bytes = total_bytes - before + after;
+            if (last.removed.empty() && last.inserted.empty()) {
+                // Backspaced over everything typed: nothing left to undo
+                group.actions.pop_back();
+                group.cost -= after;
+                total_bytes -= after;
+                if (group.actions.empty()) {
+                    dropNewest();
+                }
+            }
+            enforceLimit();
+            return;
+        }
+    }
+
+    group.actions.push_back(Action{offset, removed, inserted});
+    size_t cost = costOf(group.actions.back());
+    group.cost += cost;
+    total_bytes += cost;
+    enforceLimit();
+}
+
+// Folds a change into `last` when it picks up where `last` left off
+bool UndoTree::coalesce(Action& last, size_t offset, const PieceList& removed,
+                        const PieceList& inserted, const PieceTable& table) {
+    size_t end = last.offset + last.inserted.length();
+
+    if (removed.empty()) {
+        // Typing on at the end of the previous insert
+        if (offset != end) {
+            return false;
+        }
+        for (size_t i = 0; i < inserted.size(); ++i) {
+            appendPiece(last.inserted, inserted[i]);
+        }
+        return true;
+    }
+    if (!inserted.empty()) {
+        return false;
+    }
+
+    size_t n = removed.length();
+    if (offset + n == end && n <= last.inserted.length()) {
+        // Backspace over text typed in this run: it was never there
+        while (n > 0) {
+            Piece& tail = last.inserted.back();
+            if (tail.length <= n) {
+                n -= tail.length;
+                last.inserted.pop_back();
+            } else {
+                tail = table.slice(tail, 0, tail.length - n);
+                n = 0;
+            }
+        }
+        return true;
+    }
+    if (offset + n == last.offset && last.inserted.empty()) {
+        // Backspace further into the text before the change
+        for (size_t i = removed.size(); i-- > 0;) {
+            prependPiece(last.removed, removed[i]);
+        }
+        last.offset = offset;
+        return true;
+    }
+    if (offset == end) {
+        // Delete forward from the end of the change
+        for (size_t i = 0; i < removed.size(); ++i) {
+            appendPiece(last.removed, removed[i]);
+        }
+        return true;
+    }
+    return false;
+}
+
+const UndoGroup* UndoTree::undo() {
+    group_open = false;
+    if (current == 0) {
+        return nullptr;
+    }
+    UndoNode& node = *find(current);
+    find(node.parent)->redo_child = current;
+    current = node.parent;
+    return &node.group;
+}
+
+const UndoGroup* UndoTree::redo() {
+    group_open = false;
+    UndoNode& node = *find(current);
+    if (node.redo_child == 0) {
+        return nullptr;
+    }
+    current = node.redo_child;
+    return &find(current)->group;
+}
+
+// Undoes up to the common ancestor of the two states, then redoes down
+std::vector<UndoStep> UndoTree::travelTo(size_t seq) {
+    group_open = false;
+    std::vector<UndoStep> steps;
+    if (!find(seq)) {
+        return steps;
+    }
+
+    std::vector<size_t> down;
+    size_t from = current;
+    size_t to = seq;
+    while (from != to) {
+        if (from > to) {
+            UndoNode& node = *find(from);
+            steps.push_back(UndoStep{&node.group, false});
+            from = node.parent;
+        } else {
+            down.push_back(to);
+            to = find(to)->parent;
+        }
+    }
+    for (auto it = down.rbegin(); it != down.rend(); ++it) {
+        UndoNode& node = *find(*it);
+        find(node.parent)->redo_child = node.seq;
+        steps.push_back(UndoStep{&node.group, true});
+    }
+    current = seq;
+    return steps;
+}
+
+size_t UndoTree::seqByCount(long count) const {
+    long target = static_cast<long>(current) + count;
+    target = std::max(0L, std::min(target, static_cast<long>(lastSeq())));
+    size_t seq = static_cast<size_t>(target);
+    if (count < 0) {
+        while (seq > 0 && !node(seq)) {
+            --seq;
+        }
+        return seq;
+    }
+    // Forward: the first state at or after the target, else the newest
+    for (size_t s = seq; s <= lastSeq(); ++s) {
+        if (node(s)) {
+            return s;
+        }
+    }
+    for (size_t s = lastSeq(); s > current; --s) {
+        if (node(s)) {
+            return s;
+        }
+    }
+    return current;
+}
+
+size_t UndoTree::seqByTime(int64_t seconds) const {
+    int64_t target = node(current)->time + seconds;
+    size_t seq = 0;
+    for (size_t s = lastSeq(); s >= first_seq && s > 0; --s) {
+        const UndoNode* n = node(s);
+        if (n && n->time <= target) {
+            seq = s;
+            break;
+        }
+    }
+    return seconds < 0 ? std::min(seq, current) : std::max(seq, current);
+}
+
+void UndoTree::clear() {
+    root = UndoNode{0, 0, 0, {}, now(), true, UndoGroup{{}, 0, 0, 0}};
+    nodes.clear();
+    first_seq = 1;
+    next_seq = 1;
+    current = 0;
+    group_open = false;
+    total_bytes = 0;
+}
+
+void UndoTree::setLimit(size_t bytes) {
+    limit = bytes;
+    enforceLimit();
+}
+
+size_t UndoTree::undoSteps() const {
+    size_t steps = 0;
+    for (size_t s = current; s != 0; s = node(s)->parent) {
+        ++steps;
+    }
+    return steps;
+}
+
+const UndoNode* UndoTree::node(size_t seq) const {
+    return const_cast<UndoTree*>(this)->find(seq);
+}
+
+UndoNode* UndoTree::find(size_t seq) {
+    if (seq == 0) {
+        return &root;
+    }
+    if (seq < first_seq || seq >= next_seq) {
+        return nullptr;
+    }
+    UndoNode& node = nodes[seq - first_seq];
+    return node.alive ? &node : nullptr;
+}
+
+UndoNode& UndoTree::newChild(int cursor_y, int cursor_x) {
+    UndoNode& parent = *find(current);
+    size_t seq = next_seq++;
+    nodes.push_back(UndoNode{seq, current, 0, {}, now(), true,
+                             UndoGroup{{}, cursor_y, cursor_x, sizeof(UndoNode)}});
+    parent.children.push_back(seq);
+    parent.redo_child = seq;
+    total_bytes += sizeof(UndoNode);
+    current = seq;
+    return nodes.back();
+}
+
+// Removes the node being recorded when all of its changes cancelled out
+void UndoTree::dropNewest() {
+    UndoNode& node = nodes.back();
+    UndoNode& parent = *find(node.parent);
+    parent.children.pop_back();
+    parent.redo_child = parent.children.empty() ? 0 : parent.children.back();
+    total_bytes -= node.group.cost;
+    current = node.parent;
+    nodes.pop_back();
+    --next_seq;
+    group_open = false;
+}
+
+void UndoTree::dropSubtree(size_t seq) {
+    std::vector<size_t> pending(1, seq);
+    while (!pending.empty()) {
+        UndoNode& node = *find(pending.back());
+        pending.pop_back();
+        pending.insert(pending.end(), node.children.begin(),
+                       node.children.end());
+        total_bytes -= node.group.cost;
+        node.alive = false;
+        node.children = std::vector<size_t>();
+        node.group = UndoGroup{{}, 0, 0, 0};
+    }
+}
+
+bool UndoTree::onCurrentPath(size_t seq) const {
+    size_t s = current;
+    while (s > seq) {
+        s = node(s)->parent;
+    }
+    return s == seq;
+}
+
+// Drops the oldest node until the tree fits. The oldest node is always a
+// child of the root. If the current state descends from it, it becomes the
+// new root and the other branches of the old root go; otherwise it goes
+// with everything below it.
+void UndoTree::enforceLimit() {
+    while (true) {
+        while (!nodes.empty() && !nodes.front().alive) {
+            nodes.pop_front();
+            ++first_seq;
+        }
+        if (total_bytes <= limit || nodes.empty() ||
+            nodes.front().seq == current) {
+            return;
+        }
+
+        UndoNode& oldest = nodes.front();
+        std::vector<size_t>& siblings = root.children;
+        siblings.erase(std::find(siblings.begin(), siblings.end(), oldest.seq));
+        if (onCurrentPath(oldest.seq)) {
+            for (size_t sibling : siblings) {
+                dropSubtree(sibling);
+            }
+            siblings = oldest.children;
+            for (size_t child : siblings) {
+                find(child)->parent = 0;
+            }
+            root.redo_child = oldest.redo_child;
+            root.time = oldest.time;
+            oldest.children.clear();
+            dropSubtree(oldest.seq);
+            ++rebases;
+        } else {
+            if (root.redo_child == oldest.seq) {
+                root.redo_child = siblings.empty() ? 0 : siblings.back();
+            }
+            dropSubtree(oldest.seq);
+        }
+    }
+}
+
+void UndoTree::restoreRoot(int64_t time) {
+    clear();
+    root.time = time;
+}
+
+bool UndoTree::restoreNode(size_t seq, size_t parent, int64_t time,
+                           UndoGroup group) {
+    if (seq < next_seq || !find(parent)) {
+        return false;
+    }
+    // Sequence numbers missing from the file were dropped before it was
+    // written; keep their slots so indexing by seq still works
+    while (next_seq < seq) {
+        nodes.push_back(UndoNode{next_seq++, 0, 0, {}, 0, false,
+                                 UndoGroup{{}, 0, 0, 0}});
+    }
+
+    group.cost = sizeof(UndoNode);
+    for (const Action& action : group.actions) {
+        group.cost += costOf(action);
+    }
+    total_bytes += group.cost;
+    nodes.push_back(UndoNode{seq, parent, 0, {}, time, true, std::move(group)});
+    ++next_seq;
+
+    UndoNode& up = *find(parent);
+    up.children.push_back(seq);
+    up.redo_child = seq;
+    return true;
+}
+
+bool UndoTree::restoreCurrent(size_t seq) {
+    if (!find(seq)) {
+        return false;
+    }
+    current = seq;
+    for (size_t s = seq; s != 0;) {
+        UndoNode& node = *find(s);
+        find(node.parent)->redo_child = s;
+        s = node.parent;
+    }
+    enforceLimit();
+    return true;
+}
+
+// The record itself and any pieces beyond the inline one: what dropping it
+// frees. The text its pieces point at stays in the table's sources, which
+// are append-only and never freed, so it is not counted.
+size_t UndoTree::costOf(const Action& action) {
+    return sizeof(Action) + action.removed.heapBytes() +
+           action.inserted.heapBytes();
+}
@@ -0,0 +1,19 @@
+#include "common/completion_queue.h"
+
+void CompletionQueue::post(std::function<void()> completion) {
+    std::lock_guard<std::mutex> lock(mutex);
+    posted.push_back(std::move(completion));
+}
+
+size_t CompletionQueue::drain() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running.swap(posted);
+    }
+    size_t count = running.size();
+    for (std::function<void()>& completion : running) {
+        completion();
+    }
+    running.clear();
+    return count;
+}
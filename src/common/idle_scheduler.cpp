@@ -0,0 +1,16 @@
+#include "common/idle_scheduler.h"
+
+void IdleScheduler::post(Task task) {
+    tasks.push_back(std::move(task));
+}
+
+void IdleScheduler::run(Clock::time_point deadline) {
+    while (!tasks.empty() && Clock::now() < deadline) {
+        // Off the queue while it runs, so it may post more tasks
+        Task task = std::move(tasks.front());
+        tasks.pop_front();
+        if (task(deadline)) {
+            tasks.push_back(std::move(task));
+        }
+    }
+}
@@ -0,0 +1,240 @@
+#include "common/profiler.h"
+#include <algorithm>
+#include <cstdio>
+
+namespace {
+
+const char* const kPhaseNames[] = {
+    "key",   "edit",      "substitute", "undo",   "search", "scroll",
+    "frame", "index",     "highlight",  "render", "idle",   "completions",
+};
+
+const char* const kCounterNames[] = {
+    "rows_painted",
+    "bytes_written",
+};
+
+const double kPercentiles[] = {50, 90, 99, 99.9};
+
+// A duration in the unit that keeps it short: 850ns, 12us, 3.4ms
+std::string formatNanoseconds(uint64_t ns) {
+    char buf[32];
+    if (ns < 1000) {
+        std::snprintf(buf, sizeof(buf), "%lluns",
+                      static_cast<unsigned long long>(ns));
+    } else if (ns < 1000000) {
+        std::snprintf(buf, sizeof(buf), "%.3gus", ns / 1e3);
+    } else if (ns < 1000000000) {
+        std::snprintf(buf, sizeof(buf), "%.3gms", ns / 1e6);
+    } else {
+        std::snprintf(buf, sizeof(buf), "%.3gs", ns / 1e9);
+    }
+    return buf;
+}
+
+} // namespace
+
+// ===--- Histogram ---===
+
+Histogram::Histogram() : counts(kBucketCount, 0) {
+    reset();
+}
+
+void Histogram::reset() {
+    std::fill(counts.begin(), counts.end(), 0);
+    total_count = 0;
+    total_sum = 0;
+    min_value = UINT64_MAX;
+    max_value = 0;
+}
+
+// Below 2^kSubBucketBits a value is its own index. Above, the top
+// kSubBucketBits bits of the value pick one of 32 buckets for its power of
+// two.
+size_t Histogram::indexOf(uint64_t value) {
+    const uint64_t sub_buckets = uint64_t(1) << kSubBucketBits;
+    if (value < sub_buckets) {
+        return static_cast<size_t>(value);
+    }
+    int top_bit = 63 - __builtin_clzll(value);
+    int shift = top_bit - (kSubBucketBits - 1);
+    uint64_t sub = value >> shift; // In [32, 64)
+    return static_cast<size_t>(sub_buckets +
+                               (shift - 1) * (sub_buckets / 2) +
+                               (sub - sub_buckets / 2));
+}
+
+Histogram::Bucket Histogram::bucketAt(size_t index) {
+    const uint64_t sub_buckets = uint64_t(1) << kSubBucketBits;
+    if (index < sub_buckets) {
+        return Bucket{index, index, 0};
+    }
+    size_t k = index - sub_buckets;
+    int shift = static_cast<int>(k / (sub_buckets / 2)) + 1;
+    uint64_t sub = k % (sub_buckets / 2) + sub_buckets / 2;
+    uint64_t low = sub << shift;
+    return Bucket{low, low + ((uint64_t(1) << shift) - 1), 0};
+}
+
+void Histogram::record(uint64_t value) {
+    ++counts[indexOf(value)];
+    ++total_count;
+    total_sum += value;
+    min_value = std::min(min_value, value);
+    max_value = std::max(max_value, value);
+}
+
+double Histogram::mean() const {
+    return total_count > 0 ? static_cast<double>(total_sum) / total_count : 0;
+}
+
+uint64_t Histogram::percentile(double p) const {
+    if (total_count == 0) {
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(p / 100.0 * total_count + 0.5);
+    rank = std::max<uint64_t>(1, std::min(rank, total_count));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < counts.size(); ++i) {
+        seen += counts[i];
+        if (seen >= rank) {
+            return std::min(bucketAt(i).high, max_value);
+        }
+    }
+    return max_value;
+}
+
+std::vector<Histogram::Bucket> Histogram::buckets() const {
+    std::vector<Bucket> result;
+    for (size_t i = 0; i < counts.size(); ++i) {
+        if (counts[i] > 0) {
+            Bucket bucket = bucketAt(i);
+            bucket.count = counts[i];
+            result.push_back(bucket);
+        }
+    }
+    return result;
+}
+
+// ===--- Profiler ---===
+
+Profiler::Profiler() : is_running(false) {}
+
+Profiler& Profiler::instance() {
+    static Profiler profiler;
+    return profiler;
+}
+
+void Profiler::start() {
+    for (Histogram& histogram : phases) {
+        histogram.reset();
+    }
+    for (Histogram& histogram : counters) {
+        histogram.reset();
+    }
+    started = std::chrono::steady_clock::now();
+    is_running = true;
+}
+
+void Profiler::stop() {
+    if (is_running) {
+        stopped = std::chrono::steady_clock::now();
+        is_running = false;
+    }
+}
+
+void Profiler::record(ProfilePhase phase, uint64_t nanoseconds) {
+    phases[static_cast<size_t>(phase)].record(nanoseconds);
+}
+
+void Profiler::count(ProfileCounter counter, uint64_t value) {
+    counters[static_cast<size_t>(counter)].record(value);
+}
+
+std::string Profiler::summary(size_t top) const {
+    std::vector<size_t> order;
+    for (size_t i = 0; i < static_cast<size_t>(ProfilePhase::COUNT); ++i) {
+        if (phases[i].count() > 0) {
+            order.push_back(i);
+        }
+    }
+    if (order.empty()) {
+        return "Nothing profiled";
+    }
+    std::sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+        return phases[a].sum() > phases[b].sum();
+    });
+    std::string out;
+    for (size_t i = 0; i < order.size() && i < top; ++i) {
+        const Histogram& histogram = phases[order[i]];
+        if (!out.empty()) {
+            out += ", ";
+        }
+        out += std::string(kPhaseNames[order[i]]) + " " +
+               formatNanoseconds(histogram.sum()) + " p50 " +
+               formatNanoseconds(histogram.percentile(50)) + " p99 " +
+               formatNanoseconds(histogram.percentile(99));
+    }
+    return out;
+}
+
+bool Profiler::dump(const std::string& path) const {
+    std::FILE* out = std::fopen(path.c_str(), "w");
+    if (!out) {
+        return false;
+    }
+    std::chrono::steady_clock::time_point end =
+        is_running ? std::chrono::steady_clock::now() : stopped;
+    std::fprintf(out, "# vixx profile over %.3f s\n",
+                 std::chrono::duration<double>(end - started).count());
+
+    auto printRow = [&](const char* name, const Histogram& histogram) {
+        std::fprintf(out, "%-14s %10llu %14llu %12.0f %10llu", name,
+                     static_cast<unsigned long long>(histogram.count()),
+                     static_cast<unsigned long long>(histogram.sum()),
+                     histogram.mean(),
+                     static_cast<unsigned long long>(histogram.min()));
+        for (double p : kPercentiles) {
+            std::fprintf(out, " %10llu", static_cast<unsigned long long>(
+                                             histogram.percentile(p)));
+        }
+        std::fprintf(out, " %12llu\n",
+                     static_cast<unsigned long long>(histogram.max()));
+    };
+    auto printHeader = [&](const char* title) {
+        std::fprintf(out, "\n%-14s %10s %14s %12s %10s %10s %10s %10s %10s %12s\n",
+                     title, "count", "total", "mean", "min", "p50", "p90",
+                     "p99", "p99.9", "max");
+    };
+
+    printHeader("phase (ns)");
+    for (size_t i = 0; i < static_cast<size_t>(ProfilePhase::COUNT); ++i) {
+        printRow(kPhaseNames[i], phases[i]);
+    }
+    printHeader("per frame");
+    for (size_t i = 0; i < static_cast<size_t>(ProfileCounter::COUNT); ++i) {
+        printRow(kCounterNames[i], counters[i]);
+    }
+
+    // The histograms themselves: the range of each non-empty bucket and
+    // how many values fell in it
+    auto printBuckets = [&](const char* name, const Histogram& histogram) {
+        if (histogram.count() == 0) {
+            return;
+        }
+        std::fprintf(out, "\nbuckets %s\n", name);
+        for (const Histogram::Bucket& bucket : histogram.buckets()) {
+            std::fprintf(out, "%llu %llu %llu\n",
+                         static_cast<unsigned long long>(bucket.low),
+                         static_cast<unsigned long long>(bucket.high),
+                         static_cast<unsigned long long>(bucket.count));
+        }
+    };
+    for (size_t i = 0; i < static_cast<size_t>(ProfilePhase::COUNT); ++i) {
+        printBuckets(kPhaseNames[i], phases[i]);
+    }
+    for (size_t i = 0; i < static_cast<size_t>(ProfileCounter::COUNT); ++i) {
+        printBuckets(kCounterNames[i], counters[i]);
+    }
+    return std::fclose(out) == 0;
+}
@@ -0,0 +1,144 @@
+#include "common/thread_pool.h"
+#include <algorithm>
+
+namespace {
+
+// The pool and worker the current thread belongs to, if any
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local size_t current_worker = 0;
+
+} // namespace
+
+ThreadPool::ThreadPool(size_t threads)
+    : queued(0), next_queue(0), stopping(false) {
+    for (size_t i = 0; i < threads; ++i) {
+        workers.push_back(std::make_unique<Worker>());
+    }
+    // Started once every queue exists, since any worker may steal from any
+    for (size_t i = 0; i < threads; ++i) {
+        workers[i]->thread = std::thread([this, i] { workerLoop(i); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (const std::unique_ptr<Worker>& worker : workers) {
+        worker->thread.join();
+    }
+}
+
+ThreadPool& ThreadPool::shared() {
+    static ThreadPool pool(
+        std::max(2u, std::thread::hardware_concurrency()) - 1);
+    return pool;
+}
+
+void ThreadPool::submit(Task task) {
+    if (workers.empty()) {
+        task();
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        if (stopping) {
+            return;
+        }
+    }
+    size_t queue = current_pool == this
+                       ? current_worker
+                       : next_queue.fetch_add(1) % workers.size();
+    push(queue, std::move(task));
+}
+
+void ThreadPool::push(size_t queue, Task task) {
+    {
+        std::lock_guard<std::mutex> lock(workers[queue]->mutex);
+        workers[queue]->tasks.push_back(std::move(task));
+        ++queued;
+    }
+    // Taking sleep_mutex orders this with a worker about to wait
+    { std::lock_guard<std::mutex> lock(sleep_mutex); }
+    wake.notify_one();
+}
+
+// The oldest task of the worker's own queue, or else the newest of another
+bool ThreadPool::take(size_t self, Task& task) {
+    for (size_t k = 0; k < workers.size(); ++k) {
+        Worker& worker = *workers[(self + k) % workers.size()];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if (worker.tasks.empty()) {
+            continue;
+        }
+        if (k == 0) {
+            task = std::move(worker.tasks.front());
+            worker.tasks.pop_front();
+        } else {
+            task = std::move(worker.tasks.back());
+            worker.tasks.pop_back();
+        }
+        --queued;
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::workerLoop(size_t self) {
+    current_pool = this;
+    current_worker = self;
+    Task task;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(sleep_mutex);
+            wake.wait(lock, [this] { return stopping || queued > 0; });
+            if (stopping) {
+                return;
+            }
+        }
+        // Another worker may have taken it meanwhile
+        if (take(self, task)) {
+            task();
+            task = nullptr;
+        }
+    }
+}
+
+void ThreadPool::Loop::run() {
+    size_t i;
+    while ((i = next.fetch_add(1)) < count) {
+        (*body)(i);
+        if (finished.fetch_add(1) + 1 == count) {
+            std::lock_guard<std::mutex> lock(mutex);
+            done.notify_all();
+        }
+    }
+}
+
+void ThreadPool::parallelFor(size_t n, const std::function<void(size_t)>& fn) {
+    if (n == 0) {
+        return;
+    }
+    if (workers.empty() || n == 1) {
+        for (size_t i = 0; i < n; ++i) {
+            fn(i);
+        }
+        return;
+    }
+
+    // Helpers that start after the loop is done find nothing to claim; the
+    // body is only reached through an index claimed before that
+    std::shared_ptr<Loop> loop = std::make_shared<Loop>();
+    loop->body = &fn;
+    loop->count = n;
+    size_t helpers = std::min(n - 1, workers.size());
+    for (size_t i = 0; i < helpers; ++i) {
+        submit([loop] { loop->run(); });
+    }
+
+    loop->run();
+    std::unique_lock<std::mutex> lock(loop->mutex);
+    loop->done.wait(lock, [&] { return loop->finished == n; });
+}
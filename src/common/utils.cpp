@@ -8,7 +8,7 @@ std::vector<std::string> split(const std::string& str, size_t limit) {
     std::string word;
 
     // Split up to 'limit' parts
-    while (stream >> word && result.size() < limit) {
+    while (result.size() < limit && stream >> word) {
         result.push_back(word);
     }
 
@@ -0,0 +1,140 @@
+// src/frontend/event_loop.cpp
+
+#include "frontend/event_loop.h"
+#include "backend/editor.h"
+#include "frontend/input_handler.h"
+#include <chrono>
+#include <cstring>
+#include <ncurses.h>
+#include <poll.h>
+#include <unistd.h>
+
+namespace {
+
+// Longest a batch runs before an intermediate frame is drawn
+const std::chrono::milliseconds kFrameBudget(16);
+
+// Longest a slice of idle work runs before looking for input again
+const std::chrono::milliseconds kIdleSlice(8);
+
+// Milliseconds between looks at the completion queue while background work
+// is running and no key comes
+const int kPollInterval = 20;
+
+// Milliseconds a paste may pause before it is taken to have ended without
+// its end marker
+const int kPasteTimeout = 1000;
+
+const char kPasteEnd[] = "\033[201~";
+
+// Longest escape sequence looked up among the terminal's keys
+const size_t kMaxKeySequence = 16;
+
+} // namespace
+
+EventLoop::EventLoop(Editor& editor, InputHandler& input_handler)
+    : editor_ref(editor), input_ref(input_handler) {}
+
+void EventLoop::run() {
+    bool running = true;
+    while (running) {
+        editor_ref.drainCompletions();
+        editor_ref.flushRender();
+
+        // Poll while idle work is queued, wake up now and then while
+        // background work may finish, and otherwise sleep until a key comes
+        bool idle = editor_ref.hasIdleWork();
+        timeout(idle ? 0 : editor_ref.hasBackgroundWork() ? kPollInterval : -1);
+        int ch = nextKey();
+        if (ch == ERR) {
+            if (idle) {
+                editor_ref.runIdleWork(std::chrono::steady_clock::now() +
+                                       kIdleSlice);
+            }
+            continue;
+        }
+        dispatch(ch);
+        drainInput();
+    }
+}
+
+void EventLoop::drainInput() {
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point deadline = Clock::now() + kFrameBudget;
+
+    timeout(0);
+    int ch;
+    while ((ch = nextKey()) != ERR) {
+        dispatch(ch);
+        if (Clock::now() >= deadline) {
+            editor_ref.flushRender();
+            deadline = Clock::now() + kFrameBudget;
+        }
+    }
+}
+
+void EventLoop::dispatch(int ch) {
+    if (ch == KEY_PASTE_BEGIN) {
+        input_ref.handlePaste(readPaste());
+    } else if (ch != KEY_PASTE_END) {
+        input_ref.handleInput(ch);
+    }
+}
+
+// The bytes left over by a paste go first. They are read as ncurses reads
+// keys: an escape sequence among them is looked up, so an arrow key typed
+// right after a paste is still one key, and a carriage return is a newline.
+int EventLoop::nextKey() {
+    if (pending.empty()) {
+        return getch();
+    }
+    if (pending.front() == '\033') {
+        std::string sequence(1, '\033');
+        for (size_t i = 1; i < pending.size() && i < kMaxKeySequence; ++i) {
+            sequence += pending[i];
+            int code = key_defined(sequence.c_str());
+            if (code > 0) {
+                pending.erase(pending.begin(), pending.begin() + i + 1);
+                return code;
+            }
+            if (code == 0) {
+                break; // Not a key, nor the start of one
+            }
+        }
+    }
+    int ch = static_cast<unsigned char>(pending.front());
+    pending.pop_front();
+    return ch == '\r' ? '\n' : ch; // As ncurses reads it
+}
+
+// ncurses reads its input a byte per read(), which is far too slow for a
+// large paste, so the paste is read from the terminal directly. Keys that
+// came after its end marker in the same block are kept in `pending`; it
+// holds the start of this paste if an earlier one left it there.
+std::string EventLoop::readPaste() {
+    const size_t end_length = std::strlen(kPasteEnd);
+    std::string text(pending.begin(), pending.end());
+    pending.clear();
+    size_t end = text.find(kPasteEnd);
+    char block[1 << 16];
+    while (end == std::string::npos) {
+        struct pollfd pfd = {STDIN_FILENO, POLLIN, 0};
+        if (poll(&pfd, 1, kPasteTimeout) <= 0) {
+            break;
+        }
+        ssize_t n = read(STDIN_FILENO, block, sizeof(block));
+        if (n <= 0) {
+            break;
+        }
+        // The marker may straddle two blocks
+        size_t from = text.size() >= end_length ? text.size() - end_length + 1
+                                                : 0;
+        text.append(block, static_cast<size_t>(n));
+        end = text.find(kPasteEnd, from);
+    }
+    if (end != std::string::npos) {
+        pending.assign(text.begin() + end + end_length, text.end());
+        text.resize(end);
+    }
+    return text;
+}
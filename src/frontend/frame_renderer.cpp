@@ -0,0 +1,226 @@
+// src/frontend/frame_renderer.cpp
+
+#include "frontend/frame_renderer.h"
+#include <algorithm>
+#include <cstdio>
+#include <string>
+
+FrameRenderer::FrameRenderer()
+    : last_tab(-1), last_buffer(nullptr), last_lines(0), last_cols(0),
+      frame_valid(false) {}
+
+int FrameRenderer::getTextWidth() const {
+    return std::max(1, getScreenColumns() - 6);
+}
+
+void FrameRenderer::render(const Buffer& current_buffer,
+                           const std::vector<std::string>& tab_names,
+                           int current_tab, int cursor_x, int cursor_y,
+                           int top_line, Mode mode, const std::string& message,
+                           const std::string& number_buffer,
+                           const std::string& command_line,
+                           const Regex* highlight) {
+    FrameStats stats;
+    setHighlight(highlight);
+    int lines = getScreenHeight();
+    int cols = getScreenColumns();
+
+    // Anything that moves every row invalidates the whole frame model
+    if (!frame_valid || lines != last_lines || cols != last_cols ||
+        &current_buffer != last_buffer) {
+        clearScreen(frame_valid);
+        row_origins.assign(lines, RowOrigin{-1, -1});
+        last_tab = -1;
+        last_status.clear();
+        last_buffer = &current_buffer;
+        last_lines = lines;
+        last_cols = cols;
+        frame_valid = true;
+    }
+
+    // Render Tab Bar if multiple buffers are open
+    if (current_tab != last_tab || tab_names != last_tab_names) {
+        clearRow(0);
+        int x = 0;
+        for (int i = 0; i < static_cast<int>(tab_names.size()); ++i) {
+            std::string tab_name =
+                "[" + std::to_string(i + 1) + "] " +
+                (tab_names[i].empty() ? "[No Name]" : tab_names[i]) + " ";
+            putString(0, x, tab_name, i == current_tab ? 6 : 0);
+            x += tab_name.size() + 1; // +1 for space
+        }
+        last_tab_names = tab_names;
+        last_tab = current_tab;
+        ++stats.rows_painted;
+    }
+
+    // Display line numbers and buffer lines. Only rows that show a different
+    // segment than last frame, or a damaged line, are fetched and repainted.
+    const Damage& damage = current_buffer.getDamage();
+    int line_count = current_buffer.getLineCount();
+    int screen_lines = lines - 1;     // Reserve space for tab bar and status bar
+    int screen_y = 1;                 // Start from line 1 to leave space for tab bar
+    int text_width = getTextWidth();
+    std::string logical_line;
+
+    for (int line = top_line; line < line_count && screen_y < screen_lines; ++line) {
+        const LineLayout& layout = current_buffer.getLayout(line);
+        size_t rows = layout.rowCount(text_width);
+        bool fetched = false;
+        for (size_t row = 0; row < rows && screen_y < screen_lines; ++row, ++screen_y) {
+            size_t start = layout.rowStart(row, text_width);
+            RowOrigin origin{line, static_cast<int>(start)};
+            if (damage.touches(line) || row_origins[screen_y] != origin) {
+                if (!fetched) {
+                    logical_line = current_buffer.getLine(line);
+                    current_buffer.highlightLine(line, logical_line, tokens);
+                    fetched = true;
+                }
+                paintTextRow(screen_y, logical_line, layout, line + 1, start,
+                             layout.rowStart(row + 1, text_width));
+                row_origins[screen_y] = origin;
+                ++stats.rows_painted;
+            }
+        }
+    }
+    // Rows below the end of the buffer
+    for (; screen_y < screen_lines; ++screen_y) {
+        if (row_origins[screen_y] != RowOrigin{-1, -1}) {
+            clearRow(screen_y);
+            row_origins[screen_y] = RowOrigin{-1, -1};
+            ++stats.rows_painted;
+        }
+    }
+
+    // Display status bar
+    // A trailing '+' means the file is still being indexed in the background
+    std::string line_count_info = std::to_string(line_count) + (current_buffer.isFullyIndexed() ? "L" : "+L");
+    std::string fileInfos = current_buffer.getFilename().empty() ? "[No Name]" : "\"" + current_buffer.getFilename() + "\", " + line_count_info;
+    if (current_buffer.isReadOnly()) {
+        fileInfos += " [RO]";
+    }
+    // As in Vim, the byte column and then the screen column if they differ
+    const LineLayout& cursor_layout = current_buffer.getLayout(cursor_y);
+    size_t cursor_column = cursor_layout.columnOf(cursor_x);
+    std::string coor = "(" + std::to_string(cursor_y + 1) + ", " + std::to_string(cursor_x + 1) +
+                       (cursor_column != static_cast<size_t>(cursor_x)
+                            ? "-" + std::to_string(cursor_column + 1)
+                            : "") +
+                       ")";
+    std::string mode_str = (mode == Mode::NORMAL) ? "-- NORMAL --" :
+                           (mode == Mode::INSERT) ? ">> INSERT <<" : ":: COMMAND ::";
+    // In command and search mode the bottom row is what is being typed
+    bool prompt = mode == Mode::COMMAND || mode == Mode::SEARCH;
+    std::string prompt_line = mode == Mode::COMMAND ? ":" + command_line : command_line;
+    std::string status = prompt
+        ? prompt_line
+        : mode_str + "|" + fileInfos + "|" + message + "|" + number_buffer + "|" + coor;
+    if (status != last_status) {
+        int y = lines - 1;
+        clearRow(y);
+        if (prompt) {
+            putString(y, 0, prompt_line, 3);
+        } else {
+            if (message.empty()) {
+                putString(y, 0, mode_str, 1);
+                putString(y, 16, coor, 1);
+            } else {
+                putString(y, 0, "(" + message + ")", 4);
+            }
+            // The file information ends a column short of the right edge
+            int info_x = cols - static_cast<int>(fileInfos.size()) - 1;
+            int number_x = info_x - static_cast<int>(number_buffer.size()) - 15;
+            putString(y, std::max(0, number_x), number_buffer, 3);
+            putString(y, std::max(0, info_x), fileInfos, 5);
+        }
+        last_status = status;
+        ++stats.rows_painted;
+    }
+
+    // Move cursor to the correct position (limited in display area). The
+    // rows above the cursor line come from the buffer's row index.
+    int cursor_row = cursor_y >= top_line
+        ? 1 + current_buffer.getRowsBetween(top_line, cursor_y, text_width)
+        : -1;
+    size_t cys, cxs;
+    cursor_layout.position(cursor_x, text_width, cys, cxs);
+    int cursor_screen_x = static_cast<int>(cxs) + 6;
+    int cursor_screen_y = cursor_row + static_cast<int>(cys);
+    if (prompt) {
+        placeCursor(lines - 1, static_cast<int>(prompt_line.size()));
+    } else if (cursor_row >= 0 && cursor_screen_y < screen_lines) {
+        placeCursor(cursor_screen_y, cursor_screen_x); // 6 spaces for line numbers
+    }
+
+    flush(stats);
+    last_frame_stats = stats;
+}
+
+// Paints bytes [start, end) of a line, which the layout puts in one row
+void FrameRenderer::paintTextRow(int screen_y, const std::string& line,
+                                 const LineLayout& layout, int line_number,
+                                 size_t start, size_t end) {
+    clearRow(screen_y);
+    if (start == 0) {
+        // Render the line number of the logical line, 1-based
+        char number[16];
+        int n = std::snprintf(number, sizeof(number), "%4d", line_number);
+        putText(screen_y, 0, number, static_cast<size_t>(n), 2);
+    }
+    if (start >= end) {
+        return;
+    }
+    // Printable ASCII goes out straight from the line, without a copy
+    if (layout.simple()) {
+        putText(screen_y, 6, line.data() + start, end - start, 0);
+    } else {
+        shown.clear();
+        layout.display(line.data(), start, end, shown);
+        putString(screen_y, 6, shown, 0);
+    }
+    // Colors bytes [begin, stop) of the line where they meet this row
+    size_t start_column = layout.columnOf(start);
+    auto paint = [&](size_t begin, size_t stop, int pair) {
+        begin = std::max(begin, start);
+        stop = std::min(stop, end);
+        if (begin < stop) {
+            int x = 6 + static_cast<int>(layout.columnOf(begin) - start_column);
+            int n = static_cast<int>(layout.columnOf(stop) - layout.columnOf(begin));
+            colorCells(screen_y, x, n, pair);
+        }
+    };
+    for (const SyntaxToken& token : tokens) {
+        if (token.begin >= end) {
+            break;
+        }
+        if (token.kind != SyntaxKind::NORMAL) {
+            paint(token.begin, token.end, 7 + static_cast<int>(token.kind));
+        }
+    }
+    if (!highlight_matcher) {
+        return;
+    }
+    // Matches overlapping this segment; empty ones have nothing to show
+    RegexMatch match;
+    for (size_t from = 0;
+         from < end &&
+         highlight_matcher->find(line.data(), line.size(), from, match);) {
+        paint(match.begin[0], match.end[0], 7);
+        from = match.end[0] > match.begin[0] ? match.end[0] : match.end[0] + 1;
+    }
+}
+
+// Text rows are repainted when what they highlight changes
+void FrameRenderer::setHighlight(const Regex* highlight) {
+    if (highlight && !highlight->ok()) {
+        highlight = nullptr;
+    }
+    std::string source = highlight ? highlight->pattern() : "";
+    if (source == highlight_source &&
+        (highlight_matcher != nullptr) == (highlight != nullptr)) {
+        return;
+    }
+    highlight_matcher.reset(highlight ? new RegexMatcher(*highlight) : nullptr);
+    highlight_source = source;
+    row_origins.assign(row_origins.size(), RowOrigin{-1, -1});
+}
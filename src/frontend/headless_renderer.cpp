@@ -0,0 +1,56 @@
+// src/frontend/headless_renderer.cpp
+
+#include "frontend/headless_renderer.h"
+#include <algorithm>
+#include <string>
+
+HeadlessRenderer::HeadlessRenderer(int lines, int cols)
+    : lines(std::max(3, lines)), cols(std::max(7, cols)), cursor_row(0),
+      cursor_column(0), bytes_written(0) {}
+
+void HeadlessRenderer::initialize() {
+    clearScreen(false);
+    invalidate();
+}
+
+void HeadlessRenderer::clearScreen(bool) {
+    rows.assign(lines, "");
+    colors.assign(lines, std::string(cols, '\0'));
+}
+
+void HeadlessRenderer::clearRow(int y) {
+    rows[y].clear();
+    colors[y].assign(cols, '\0');
+}
+
+// A row's columns are taken to be its bytes; text with wider characters
+// is kept whole, and only its first columns can be colored
+void HeadlessRenderer::putText(int y, int x, const char* text, size_t n,
+                               int pair) {
+    std::string& row = rows[y];
+    size_t at = static_cast<size_t>(x);
+    if (row.size() < at + n) {
+        row.resize(at + n, ' ');
+    }
+    row.replace(at, n, text, n);
+    colorCells(y, x, static_cast<int>(n), pair);
+    bytes_written += n;
+}
+
+void HeadlessRenderer::colorCells(int y, int x, int n, int pair) {
+    std::string& color = colors[y];
+    size_t to = std::min(color.size(), static_cast<size_t>(x + n));
+    for (size_t i = static_cast<size_t>(x); i < to; ++i) {
+        color[i] = static_cast<char>(pair);
+    }
+}
+
+void HeadlessRenderer::placeCursor(int y, int x) {
+    cursor_row = y;
+    cursor_column = x;
+}
+
+void HeadlessRenderer::flush(FrameStats& stats) {
+    stats.bytes_written += bytes_written;
+    bytes_written = 0;
+}
@@ -2,12 +2,18 @@
 
 #include "frontend/input_handler.h"
 #include "backend/editor.h"
+#include "backend/line_layout.h"
+#include "common/profiler.h"
 #include "common/types.h"
-#include "frontend/renderer.h"
+#include <algorithm>
 #include <cctype>
+#include <climits>
 
 // Constructor
-InputHandler::InputHandler(Editor& editor) : editor_ref(editor), command_buffer("") {
+InputHandler::InputHandler(Editor& editor)
+    : editor_ref(editor), command_buffer(""), pending_operator(0),
+      operator_count(1), operator_has_count(false), pending_g(false),
+      pending_register(false), register_name(0), pending_mark(false) {
     editor_ref.refresh_render();
 }
 
@@ -16,6 +22,13 @@ InputHandler::~InputHandler() {}
 
 // Handle input based on current mode
 void InputHandler::handleInput(int ch) {
+    PROFILE_SCOPE(KEY);
+    if (ch == KEY_RESIZE) {
+        // The renderer notices the new size and repaints everything
+        editor_ref.adjustScrolling();
+        editor_ref.refresh_render();
+        return;
+    }
     editor_ref.clear_message();
     Mode current_mode = editor_ref.getMode();
     switch (current_mode) {
@@ -28,35 +41,67 @@ void InputHandler::handleInput(int ch) {
         case Mode::COMMAND:
             handleCommandMode(ch);
             break;
+        case Mode::SEARCH:
+            handleSearchMode(ch);
+            break;
+    }
+}
+
+// A paste goes into the text at the cursor in normal and insert mode, and
+// into a prompt up to its first line break, as if typed
+void InputHandler::handlePaste(const std::string& text) {
+    PROFILE_SCOPE(KEY);
+    editor_ref.clear_message();
+    switch (editor_ref.getMode()) {
+        case Mode::NORMAL:
+        case Mode::INSERT:
+            editor_ref.pasteText(text);
+            break;
+        case Mode::COMMAND:
+        case Mode::SEARCH:
+            for (char c : text) {
+                if (c == '\r' || c == '\n') {
+                    break;
+                }
+                if (editor_ref.getMode() == Mode::COMMAND) {
+                    handleCommandMode(static_cast<unsigned char>(c));
+                } else {
+                    handleSearchMode(static_cast<unsigned char>(c));
+                }
+            }
+            break;
     }
 }
 
 // Handle inputs in Normal mode
 void InputHandler::handleNormalMode(int ch) {
-    static int last_char = 0;         // To track multi-character commands
-
-    if (last_char != 0) {
-        switch (last_char) {
-            case 'g':
-                if (ch == 'g') editor_ref.goToFirstLine();
-                break;
-            case 'd':
-                if (ch == 'd') editor_ref.deleteCurrentLine();
-                break;
-            case 'y':
-                if (ch == 'y') editor_ref.copyCurrentLine();
-                break;
-            default: break;
+    if (pending_register) {
+        // The key after " names the register, digits included
+        pending_register = false;
+        register_name = Registers::isValid(static_cast<char>(ch))
+                            ? static_cast<char>(ch)
+                            : 0;
+        editor_ref.refresh_render();
+        return;
+    }
+    if (pending_mark) {
+        pending_mark = false;
+        if (ch >= 'a' && ch <= 'z') {
+            editor_ref.setMark(static_cast<char>(ch));
         }
-        last_char = 0;
+        editor_ref.clearNumberBuffer();
+        editor_ref.refresh_render();
         return;
     }
-
     if (isdigit(ch) && (!editor_ref.getNumberBuffer().empty() || ch != '0')) {   // The number_buffer cannot start with 0
         editor_ref.appendNumberBuffer(static_cast<char>(ch));
         editor_ref.refresh_render();
         return;
     }
+    if (pending_operator != 0 || pending_g) {
+        handleOperatorPending(ch);
+        return;
+    }
 
     switch (ch) {
         case 27: // ESC key
@@ -69,6 +114,16 @@ void InputHandler::handleNormalMode(int ch) {
             editor_ref.switchMode(Mode::COMMAND);
             command_buffer.clear();
             break;
+        case '/': case '?':
+            editor_ref.beginSearch(ch == '/');
+            command_buffer.clear();
+            break;
+        case 'n':
+            editor_ref.searchNext(getNumberBufferOrDefaultOne(), false);
+            break;
+        case 'N':
+            editor_ref.searchNext(getNumberBufferOrDefaultOne(), true);
+            break;
         case 'h': case 260:
             editor_ref.moveCursorLeft(getNumberBufferOrDefaultOne());
             break;
@@ -95,21 +150,132 @@ void InputHandler::handleNormalMode(int ch) {
             break;
         case 'G':
             if (!editor_ref.getNumberBuffer().empty()) // [number] + G
-                editor_ref.jumpToLine(std::stoi(editor_ref.getNumberBuffer()) - 1); // Line numbers start from 1
+                editor_ref.jumpToLine(getNumberBufferOrDefaultOne() - 1); // Line numbers start from 1
             else
                 editor_ref.goToLastLine();
             break;
-        case 'p':
-            editor_ref.pasteContent(getNumberBufferOrDefaultOne());
+        case 'p': case 'P':
+            editor_ref.pasteContent(register_name,
+                                    getNumberBufferOrDefaultOne(), ch == 'P');
+            break;
+        case 'x': case 'X': // dl and dh
+            editor_ref.applyOperator(register_name, 'd',
+                                     ch == 'x' ? Motion::RIGHT : Motion::LEFT,
+                                     getNumberBufferOrDefaultOne(), false);
             break;
+        case 'm':
+            pending_mark = true;
+            editor_ref.refresh_render();
+            return;
+        case '"':
+            pending_register = true;
+            editor_ref.refresh_render();
+            return;
+        case '}': case '{':
+            editor_ref.moveParagraph(getNumberBufferOrDefaultOne(), ch == '}');
+            break;
+        case 'd': case 'y':
+            // Waits for a motion, whose count multiplies this one
+            pending_operator = static_cast<char>(ch);
+            operator_count = getNumberBufferOrDefaultOne();
+            operator_has_count = !editor_ref.getNumberBuffer().empty();
+            editor_ref.clearNumberBuffer();
+            editor_ref.refresh_render();
+            return;
+        case 'g':
+            // Waits for the second g, keeping the count for it
+            pending_g = true;
+            editor_ref.refresh_render();
+            return;
         default:
-            last_char = ch;
             break;
     }
+    register_name = 0;
     editor_ref.clearNumberBuffer();
     editor_ref.refresh_render();
 }
 
+// The key after d, y or g: a motion, or the operator again for whole lines.
+// Anything else, Esc included, drops the operator.
+void InputHandler::handleOperatorPending(int ch) {
+    bool has_count =
+        operator_has_count || !editor_ref.getNumberBuffer().empty();
+    // Saturated rather than overflowing; no count goes past the last line
+    int count = static_cast<int>(
+        std::min(1LL * operator_count * getNumberBufferOrDefaultOne(),
+                 1LL * INT_MAX));
+    char op = pending_operator;
+    bool after_g = pending_g;
+    char reg_name = register_name;
+    editor_ref.clearNumberBuffer();
+    register_name = 0;
+    pending_operator = 0;
+    operator_count = 1;
+    operator_has_count = false;
+    pending_g = false;
+
+    Motion motion;
+    if (after_g) {
+        if (ch != 'g') {
+            editor_ref.refresh_render();
+            return;
+        }
+        if (op == 0) { // [count]gg
+            if (has_count)
+                editor_ref.jumpToLine(count - 1);
+            else
+                editor_ref.goToFirstLine();
+            editor_ref.refresh_render();
+            return;
+        }
+        motion = Motion::FIRST_LINE;
+    } else if (ch == op) {
+        motion = Motion::LINES;
+    } else {
+        switch (ch) {
+            case 'j': case 258:
+                motion = Motion::DOWN;
+                break;
+            case 'k': case 259:
+                motion = Motion::UP;
+                break;
+            case 'G':
+                motion = Motion::LAST_LINE;
+                break;
+            case '}':
+                motion = Motion::PARAGRAPH_FORWARD;
+                break;
+            case '{':
+                motion = Motion::PARAGRAPH_BACKWARD;
+                break;
+            case 'l': case 261:
+                motion = Motion::RIGHT;
+                break;
+            case 'h': case 260:
+                motion = Motion::LEFT;
+                break;
+            case '0':
+                motion = Motion::LINE_START;
+                break;
+            case '$':
+                motion = Motion::LINE_END;
+                break;
+            case 'g': // dgg and ygg
+                pending_operator = op;
+                register_name = reg_name;
+                operator_count = count;
+                operator_has_count = has_count;
+                pending_g = true;
+                editor_ref.refresh_render();
+                return;
+            default:
+                editor_ref.refresh_render();
+                return;
+        }
+    }
+    editor_ref.applyOperator(reg_name, op, motion, count, has_count);
+}
+
 // Handle inputs in Insert mode
 void InputHandler::handleInsertMode(int ch) {
     switch (ch) {
@@ -136,8 +302,25 @@ void InputHandler::handleInsertMode(int ch) {
             editor_ref.moveCursorRight(getNumberBufferOrDefaultOne());
             break;
         default:
-            if (isprint(ch)) {
-                editor_ref.insertCharacter(static_cast<char>(ch));
+            if (ch == '\t' || isprint(ch)) {
+                pending_char.clear();
+                editor_ref.insertCharacter(std::string(1, static_cast<char>(ch)));
+            } else if (ch >= 0x80 && ch <= 0xFF) {
+                // Anything past ASCII arrives a byte at a time
+                unsigned char byte = static_cast<unsigned char>(ch);
+                if (utf8SequenceLength(byte) > 1) {
+                    pending_char.assign(1, static_cast<char>(byte));
+                } else if ((byte & 0xC0) == 0x80 && !pending_char.empty()) {
+                    pending_char += static_cast<char>(byte);
+                } else {
+                    pending_char.clear();
+                    break;
+                }
+                if (pending_char.size() ==
+                    utf8SequenceLength(static_cast<unsigned char>(pending_char[0]))) {
+                    editor_ref.insertCharacter(pending_char);
+                    pending_char.clear();
+                }
             }
             break;
     }
@@ -145,7 +328,6 @@ void InputHandler::handleInsertMode(int ch) {
 
 // Handle inputs in Command mode
 void InputHandler::handleCommandMode(int ch) {
-    Renderer& renderer = editor_ref.getRenderer();
     if (ch == '\n') {
         editor_ref.executeCommand(command_buffer);
         editor_ref.switchMode(Mode::NORMAL);
@@ -156,18 +338,52 @@ void InputHandler::handleCommandMode(int ch) {
     else if (ch == KEY_BACKSPACE || ch == 127) {
         if (!command_buffer.empty()) {
             command_buffer.pop_back();
-            renderer.displayCommandLine(command_buffer);
+            editor_ref.setCommandLine(command_buffer);
+        }
+    }
+    else {
+        if (isprint(ch)) {
+            command_buffer += static_cast<char>(ch);
+            editor_ref.setCommandLine(command_buffer);
+        }
+    }
+}
+
+// Handle inputs in Search mode: the pattern after / or ?, previewed as it
+// is typed
+void InputHandler::handleSearchMode(int ch) {
+    if (ch == '\n') {
+        editor_ref.executeSearch(command_buffer);
+        editor_ref.switchMode(Mode::NORMAL);
+    }
+    else if (ch == 27) { // ESC key
+        editor_ref.cancelSearch();
+        editor_ref.switchMode(Mode::NORMAL);
+    }
+    else if (ch == KEY_BACKSPACE || ch == 127) {
+        if (command_buffer.empty()) { // Backspace over the / leaves
+            editor_ref.cancelSearch();
+            editor_ref.switchMode(Mode::NORMAL);
+        } else {
+            command_buffer.pop_back();
+            editor_ref.updateSearch(command_buffer);
         }
     }
     else {
         if (isprint(ch)) {
             command_buffer += static_cast<char>(ch);
-            renderer.displayCommandLine(command_buffer);
+            editor_ref.updateSearch(command_buffer);
         }
     }
 }
 
+// Saturates rather than overflows; no count goes past INT_MAX
 int InputHandler::getNumberBufferOrDefaultOne() {
-    if (editor_ref.getNumberBuffer().empty()) return 1;
-    else return std::stoi(editor_ref.getNumberBuffer());
+    const std::string& digits = editor_ref.getNumberBuffer();
+    if (digits.empty()) return 1;
+    long n = 0;
+    for (char c : digits) {
+        n = std::min(n * 10 + (c - '0'), 1L * INT_MAX);
+    }
+    return static_cast<int>(n);
 }
\ No newline at end of file
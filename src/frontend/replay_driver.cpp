@@ -0,0 +1,90 @@
+// src/frontend/replay_driver.cpp
+
+#include "frontend/replay_driver.h"
+#include "backend/editor.h"
+#include "frontend/input_handler.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+namespace {
+
+// Idle work run between two keys, as a slice of the event loop's
+const std::chrono::milliseconds kIdleSlice(8);
+
+const char kPasteBegin[] = "\033[200~";
+const char kPasteEnd[] = "\033[201~";
+
+// The nearest-rank percentile `p` of sorted samples
+double percentile(const std::vector<double>& sorted, double p) {
+    size_t rank = static_cast<size_t>(p / 100.0 * sorted.size() + 0.5);
+    return sorted[std::min(sorted.size() - 1, rank > 0 ? rank - 1 : 0)];
+}
+
+} // namespace
+
+ReplayDriver::ReplayDriver(Editor& editor, InputHandler& input_handler)
+    : editor_ref(editor), input_ref(input_handler) {}
+
+bool ReplayDriver::load(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+    std::stringstream ss;
+    ss << file.rdbuf();
+    keys = ss.str();
+    latencies.reserve(keys.size());
+    return true;
+}
+
+void ReplayDriver::run() {
+    using Clock = std::chrono::steady_clock;
+    editor_ref.flushRender();
+    for (size_t i = 0; i < keys.size(); ++i) {
+        editor_ref.drainCompletions();
+        if (editor_ref.hasIdleWork()) {
+            editor_ref.runIdleWork(Clock::now() + kIdleSlice);
+        }
+
+        Clock::time_point start = Clock::now();
+        if (keys.compare(i, std::strlen(kPasteBegin), kPasteBegin) == 0) {
+            size_t begin = i + std::strlen(kPasteBegin);
+            size_t end = keys.find(kPasteEnd, begin);
+            end = end == std::string::npos ? keys.size() : end;
+            input_ref.handlePaste(keys.substr(begin, end - begin));
+            i = std::min(keys.size(), end + std::strlen(kPasteEnd)) - 1;
+        } else {
+            // ncurses reads a carriage return as a newline
+            unsigned char byte = static_cast<unsigned char>(keys[i]);
+            input_ref.handleInput(byte == '\r' ? '\n' : byte);
+        }
+        editor_ref.flushRender();
+        latencies.push_back(
+            std::chrono::duration<double>(Clock::now() - start).count());
+    }
+}
+
+void ReplayDriver::printReport(std::FILE* out) const {
+    if (latencies.empty()) {
+        std::fprintf(out, "keys: 0\n");
+        return;
+    }
+    std::vector<double> sorted = latencies;
+    std::sort(sorted.begin(), sorted.end());
+    double total = 0;
+    for (double latency : sorted) {
+        total += latency;
+    }
+    std::fprintf(out,
+                 "keys: %zu\n"
+                 "latency p50: %.1f us\n"
+                 "latency p99: %.1f us\n"
+                 "latency max: %.1f us\n"
+                 "total: %.3f s (%.0f keys/s)\n",
+                 sorted.size(), percentile(sorted, 50) * 1e6,
+                 percentile(sorted, 99) * 1e6, sorted.back() * 1e6, total,
+                 total > 0 ? sorted.size() / total : 0.0);
+}
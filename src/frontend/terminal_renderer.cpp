@@ -0,0 +1,124 @@
+// src/frontend/terminal_renderer.cpp
+
+#include "frontend/terminal_renderer.h"
+#include <clocale>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <ncurses.h>
+#include <string>
+#include <unistd.h>
+
+static_assert(KEY_PASTE_BEGIN > KEY_MAX && KEY_PASTE_END > KEY_MAX,
+              "paste keys must not clash with ncurses' own");
+
+TerminalRenderer::TerminalRenderer()
+    : colors_initialized(false), io_stats_fd(-1) {}
+
+TerminalRenderer::~TerminalRenderer() {}
+
+void TerminalRenderer::initialize() {
+    setlocale(LC_ALL, "");  // UTF-8 text goes to the terminal as it is
+    initscr();              // Initialize the window
+    cbreak();               // Disable line buffering
+    noecho();               // Don't echo pressed keys
+    keypad(stdscr, TRUE);   // Enable function keys and arrow keys
+    curs_set(1);            // Show the cursor
+    set_escdelay(50);       // Set ESC latency (milliseconds)
+    io_stats_fd = open("/proc/thread-self/io", O_RDONLY | O_CLOEXEC);
+
+    // Pastes come wrapped in markers, so they are not taken for typing
+    define_key("\033[200~", KEY_PASTE_BEGIN);
+    define_key("\033[201~", KEY_PASTE_END);
+    putp("\033[?2004h");
+
+    if (has_colors()) {
+        start_color();
+        init_pair(1, COLOR_GREEN, COLOR_BLACK);   // Status bar
+        init_pair(2, COLOR_YELLOW, COLOR_BLACK);  // Line number
+        init_pair(3, COLOR_CYAN, COLOR_BLACK);    // Command
+        init_pair(4, COLOR_WHITE, COLOR_RED);     // Message
+        init_pair(5, COLOR_BLUE, COLOR_BLACK);    // File information
+        init_pair(6, COLOR_BLACK, COLOR_WHITE);   // Active Tab
+        init_pair(7, COLOR_BLACK, COLOR_YELLOW);  // Search match
+        init_pair(8, COLOR_MAGENTA, COLOR_BLACK); // Keyword
+        init_pair(9, COLOR_GREEN, COLOR_BLACK);   // Type
+        init_pair(10, COLOR_RED, COLOR_BLACK);    // String
+        init_pair(11, COLOR_RED, COLOR_BLACK);    // Number
+        init_pair(12, COLOR_CYAN, COLOR_BLACK);   // Comment
+        init_pair(13, COLOR_BLUE, COLOR_BLACK);   // Preprocessor
+        colors_initialized = true;
+    }
+}
+
+void TerminalRenderer::shutdown() {
+    putp("\033[?2004l");
+    endwin();
+    if (io_stats_fd >= 0) {
+        close(io_stats_fd);
+        io_stats_fd = -1;
+    }
+}
+
+// Bytes written by the calling thread so far, or 0 where /proc has no
+// per-thread I/O accounting
+size_t TerminalRenderer::bytesWrittenByThread() const {
+    if (io_stats_fd < 0)
+        return 0;
+    char buf[512];
+    ssize_t n = pread(io_stats_fd, buf, sizeof(buf) - 1, 0);
+    if (n <= 0)
+        return 0;
+    buf[n] = '\0';
+    const char* wchar = std::strstr(buf, "wchar:");
+    return wchar ? std::strtoull(wchar + 6, nullptr, 10) : 0;
+}
+
+int TerminalRenderer::getScreenHeight() const {
+    return LINES; // Number of screen lines
+}
+
+int TerminalRenderer::getScreenColumns() const {
+    return COLS;
+}
+
+void TerminalRenderer::clearScreen(bool resized) {
+    if (resized) {
+        clearok(stdscr, TRUE); // The terminal was resized or switched
+    }
+    erase();
+}
+
+void TerminalRenderer::clearRow(int y) {
+    move(y, 0);
+    clrtoeol();
+}
+
+void TerminalRenderer::putText(int y, int x, const char* text, size_t n,
+                               int pair) {
+    color_on(pair);
+    mvaddnstr(y, x, text, static_cast<int>(n));
+    color_off(pair);
+}
+
+// Without colors only search matches show, in reverse video
+void TerminalRenderer::colorCells(int y, int x, int n, int pair) {
+    if (colors_initialized) {
+        mvchgat(y, x, n, A_NORMAL, static_cast<short>(pair), nullptr);
+    } else if (pair == 7) {
+        mvchgat(y, x, n, A_REVERSE, 0, nullptr);
+    }
+}
+
+void TerminalRenderer::placeCursor(int y, int x) {
+    move(y, x);
+}
+
+void TerminalRenderer::flush(FrameStats& stats) {
+    size_t bytes_before = bytesWrittenByThread();
+    refresh();
+    stats.bytes_written += bytesWrittenByThread() - bytes_before;
+}
+
+void TerminalRenderer::color_on(int order) {if (colors_initialized && order) attron(COLOR_PAIR(order));}
+void TerminalRenderer::color_off(int order) {if (colors_initialized && order) attroff(COLOR_PAIR(order));}
@@ -1,24 +1,61 @@
 // src/main.cpp
 
 #include "backend/editor.h"
+#include "frontend/event_loop.h"
+#include "frontend/headless_renderer.h"
 #include "frontend/input_handler.h"
+#include "frontend/replay_driver.h"
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
 
+// vixx [--replay <keys.log> [--headless]] [file]
 int main(int argc, char* argv[]) {
-    Editor editor;
+    std::string fname;
+    std::string replay_path;
+    bool headless = false;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--headless") == 0) {
+            headless = true;
+        } else if (std::strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replay_path = argv[++i];
+        } else {
+            fname = argv[i];
+        }
+    }
+    if (headless && replay_path.empty()) {
+        std::fprintf(stderr, "vixx: --headless needs --replay <keys.log>\n");
+        return 1;
+    }
 
-    // if (argc > 1) {
-    //     editor.openFile(argv[1]);
-    // }
-    editor.openFile(argc > 1 ? argv[1] : "");
+    std::unique_ptr<Renderer> renderer;
+    if (headless) {
+        renderer.reset(new HeadlessRenderer());
+    }
+    Editor editor(std::move(renderer));
+    editor.openFile(fname);
 
     InputHandler input_handler(editor);
 
-    bool running = true;
-    while (running) {
-        int ch = getch();
-        input_handler.handleInput(ch);
+    if (!replay_path.empty()) {
+        ReplayDriver replay(editor, input_handler);
+        if (!replay.load(replay_path)) {
+            editor.shutdown();
+            std::fprintf(stderr, "vixx: cannot read %s\n", replay_path.c_str());
+            return 1;
+        }
+        // The report goes out after the screen is given back, whether the
+        // keys quit the editor or run out
+        editor.setQuitHandler([&replay]() { replay.printReport(stdout); });
+        replay.run();
+        editor.shutdown();
+        replay.printReport(stdout);
+        return 0;
     }
 
+    EventLoop loop(editor, input_handler);
+    loop.run();
+
     return 0;
 }
-